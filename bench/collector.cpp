@@ -0,0 +1,582 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Minimal OTLP receiver used as a stand-in for a real collector while
+// benchmarking the exporters.
+//
+// Accepts OTLP/HTTP (protobuf and json) and OTLP/gRPC for traces, metrics and
+// logs, counts and decodes what it receives and can optionally delay or drop
+// payloads to emulate a slow or failing collector. Spans of exporter_bench
+// carry the time they were sent, their end to end latency is reported as
+// percentiles.
+//
+//   ./collector --http 4318 --http 8555 --grpc 4317 [--delay-ms 5]
+//               [--drop-rate 0.1] [--no-decode] [--report-ms 1000]
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <google/protobuf/util/json_util.h>
+#include <grpcpp/grpcpp.h>
+
+#include "opentelemetry/exporters/otlp/protobuf_include_prefix.h"
+#include "opentelemetry/proto/collector/logs/v1/logs_service.grpc.pb.h"
+#include "opentelemetry/proto/collector/metrics/v1/metrics_service.grpc.pb.h"
+#include "opentelemetry/proto/collector/trace/v1/trace_service.grpc.pb.h"
+#include "opentelemetry/exporters/otlp/protobuf_include_suffix.h"
+
+using namespace boost;
+
+namespace otlp_trace = opentelemetry::proto::collector::trace::v1;
+namespace otlp_metrics = opentelemetry::proto::collector::metrics::v1;
+namespace otlp_logs = opentelemetry::proto::collector::logs::v1;
+namespace otlp_data = opentelemetry::proto::metrics::v1;
+
+namespace {
+
+struct Options {
+  std::vector<unsigned short> http_ports;
+  std::vector<unsigned short> grpc_ports;
+  unsigned int delay_ms = 0;
+  double drop_rate = 0.0;
+  bool decode = true;
+  unsigned int report_ms = 1000;
+};
+
+// Log-linear histogram of latencies in us, 16 buckets per power of two, so a
+// percentile is off by less than 1/16 of its value. Lock-free, it is fed by
+// the receiving threads.
+class LatencyHistogram {
+ public:
+  void Add(uint64_t latency_ns) {
+    m_buckets[Bucket(latency_ns / 1000)].fetch_add(1,
+                                                   std::memory_order_relaxed);
+  }
+
+  /// Upper bound of the bucket holding the q quantile, 0 if empty
+  double PercentileMs(double q) const {
+    std::array<uint64_t, BUCKETS> counts;
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+      total += counts[i];
+    }
+    if (total == 0) {
+      return 0.0;
+    }
+    const auto rank = std::max<uint64_t>(
+        1, static_cast<uint64_t>(q * static_cast<double>(total) + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return static_cast<double>(UpperBound(i)) / 1e3;
+      }
+    }
+    return static_cast<double>(UpperBound(BUCKETS - 1)) / 1e3;
+  }
+
+ private:
+  static constexpr unsigned SUB_BITS = 4;
+  static constexpr size_t SUB = size_t{1} << SUB_BITS;
+  static constexpr size_t BUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+  // Values below SUB have a bucket each, above the top SUB_BITS + 1 bits
+  // select it
+  static size_t Bucket(uint64_t us) {
+    if (us < SUB) {
+      return us;
+    }
+    const unsigned exponent = std::bit_width(us) - 1;
+    const size_t sub = (us >> (exponent - SUB_BITS)) & (SUB - 1);
+    return (exponent - SUB_BITS + 1) * SUB + sub;
+  }
+
+  static uint64_t UpperBound(size_t bucket) {
+    if (bucket < SUB) {
+      return bucket + 1;
+    }
+    const size_t exponent = bucket / SUB + SUB_BITS - 1;
+    return (SUB + bucket % SUB + 1) << (exponent - SUB_BITS);
+  }
+
+  std::array<std::atomic<uint64_t>, BUCKETS> m_buckets{};
+};
+
+// Everything the receiver has seen. Latency is measured from the end time of
+// a span (or the time stamp of a data point) to the moment it was decoded
+// here, so it includes batching, export and transport time. Spans with the
+// bench.sent_ns attribute of exporter_bench are measured from that instead
+// and also go into span_latency.
+struct Stats {
+  std::atomic<uint64_t> requests{};
+  std::atomic<uint64_t> dropped{};
+  std::atomic<uint64_t> bytes{};
+  std::atomic<uint64_t> spans{};
+  std::atomic<uint64_t> events{};
+  std::atomic<uint64_t> data_points{};
+  std::atomic<uint64_t> log_records{};
+  std::atomic<uint64_t> decode_errors{};
+  std::atomic<uint64_t> latency_count{};
+  std::atomic<uint64_t> latency_sum_ns{};
+  std::atomic<uint64_t> latency_max_ns{};
+  LatencyHistogram span_latency;
+
+  /// Returns the latency, 0 without a valid time stamp
+  uint64_t AddLatency(uint64_t now_ns, uint64_t then_ns) {
+    if (then_ns == 0 || then_ns > now_ns) {
+      return 0;
+    }
+    uint64_t latency = now_ns - then_ns;
+    latency_count.fetch_add(1, std::memory_order_relaxed);
+    latency_sum_ns.fetch_add(latency, std::memory_order_relaxed);
+    uint64_t max = latency_max_ns.load(std::memory_order_relaxed);
+    while (latency > max && !latency_max_ns.compare_exchange_weak(
+                                max, latency, std::memory_order_relaxed)) {
+    }
+    return latency;
+  }
+};
+
+Options g_options;
+Stats g_stats;
+std::atomic<bool> g_stop{false};
+
+uint64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// Applies the configured delay and returns false if the payload should be
+// rejected.
+bool Admit() {
+  g_stats.requests.fetch_add(1, std::memory_order_relaxed);
+
+  if (g_options.delay_ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(g_options.delay_ms));
+  }
+
+  if (g_options.drop_rate > 0.0) {
+    thread_local std::mt19937_64 rng{std::random_device{}()};
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    if (dist(rng) < g_options.drop_rate) {
+      g_stats.dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+  return true;
+}
+
+void Account(const otlp_trace::ExportTraceServiceRequest& req) {
+  uint64_t now = NowNs();
+  for (const auto& rs : req.resource_spans()) {
+    for (const auto& ss : rs.scope_spans()) {
+      g_stats.spans.fetch_add(ss.spans_size(), std::memory_order_relaxed);
+      for (const auto& span : ss.spans()) {
+        g_stats.events.fetch_add(span.events_size(),
+                                 std::memory_order_relaxed);
+        uint64_t sent = 0;
+        for (const auto& attribute : span.attributes()) {
+          if (attribute.key() == "bench.sent_ns") {
+            sent = static_cast<uint64_t>(attribute.value().int_value());
+            break;
+          }
+        }
+        if (sent == 0) {
+          g_stats.AddLatency(now, span.end_time_unix_nano());
+        } else if (auto latency = g_stats.AddLatency(now, sent)) {
+          g_stats.span_latency.Add(latency);
+        }
+      }
+    }
+  }
+}
+
+template <typename Points>
+void AccountPoints(uint64_t now, const Points& points) {
+  g_stats.data_points.fetch_add(points.size(), std::memory_order_relaxed);
+  for (const auto& p : points) {
+    g_stats.AddLatency(now, p.time_unix_nano());
+  }
+}
+
+void Account(const otlp_metrics::ExportMetricsServiceRequest& req) {
+  uint64_t now = NowNs();
+  for (const auto& rm : req.resource_metrics()) {
+    for (const auto& sm : rm.scope_metrics()) {
+      for (const auto& m : sm.metrics()) {
+        switch (m.data_case()) {
+          case otlp_data::Metric::kGauge:
+            AccountPoints(now, m.gauge().data_points());
+            break;
+          case otlp_data::Metric::kSum:
+            AccountPoints(now, m.sum().data_points());
+            break;
+          case otlp_data::Metric::kHistogram:
+            AccountPoints(now, m.histogram().data_points());
+            break;
+          case otlp_data::Metric::kSummary:
+            AccountPoints(now, m.summary().data_points());
+            break;
+          default:
+            break;
+        }
+      }
+    }
+  }
+}
+
+void Account(const otlp_logs::ExportLogsServiceRequest& req) {
+  uint64_t now = NowNs();
+  for (const auto& rl : req.resource_logs()) {
+    for (const auto& sl : rl.scope_logs()) {
+      g_stats.log_records.fetch_add(sl.log_records_size(),
+                                    std::memory_order_relaxed);
+      for (const auto& log : sl.log_records()) {
+        g_stats.AddLatency(now, log.time_unix_nano());
+      }
+    }
+  }
+}
+
+template <typename Request>
+void Decode(const std::string& body, bool json) {
+  if (!g_options.decode) {
+    return;
+  }
+
+  Request req;
+  bool ok = false;
+  if (json) {
+    google::protobuf::util::JsonParseOptions opts;
+    opts.ignore_unknown_fields = true;
+    ok = google::protobuf::util::JsonStringToMessage(body, &req, opts).ok();
+  } else {
+    ok = req.ParseFromString(body);
+  }
+
+  if (!ok) {
+    g_stats.decode_errors.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  Account(req);
+}
+
+// OTLP/HTTP, just enough of HTTP/1.1 to talk to the otlp_http exporters.
+class HttpSession : public std::enable_shared_from_this<HttpSession> {
+ public:
+  explicit HttpSession(asio::ip::tcp::socket sock) : m_sock(std::move(sock)) {}
+
+  void Start() { ReadHeader(); }
+
+ private:
+  void ReadHeader() {
+    auto self = shared_from_this();
+    asio::async_read_until(
+        m_sock, m_buf, "\r\n\r\n",
+        [self](const boost::system::error_code& ec, std::size_t header_size) {
+          if (ec) {
+            return;
+          }
+          self->OnHeader(header_size);
+        });
+  }
+
+  void OnHeader(std::size_t header_size) {
+    std::string header(asio::buffers_begin(m_buf.data()),
+                       asio::buffers_begin(m_buf.data()) + header_size);
+    m_buf.consume(header_size);
+
+    m_path = header.substr(0, header.find("\r\n"));
+    m_json = Find(header, "content-type").find("json") != std::string::npos;
+    size_t length = std::strtoull(Find(header, "content-length").c_str(),
+                                  nullptr, 10);
+
+    g_stats.bytes.fetch_add(header_size + length, std::memory_order_relaxed);
+
+    size_t buffered = std::min(length, m_buf.size());
+    m_body.assign(asio::buffers_begin(m_buf.data()),
+                  asio::buffers_begin(m_buf.data()) + buffered);
+    m_buf.consume(buffered);
+
+    if (buffered == length) {
+      OnBody();
+      return;
+    }
+
+    m_body.resize(length);
+    auto self = shared_from_this();
+    asio::async_read(
+        m_sock, asio::buffer(m_body.data() + buffered, length - buffered),
+        [self](const boost::system::error_code& ec, std::size_t) {
+          if (ec) {
+            return;
+          }
+          self->OnBody();
+        });
+  }
+
+  void OnBody() {
+    if (!Admit()) {
+      Reply("503 Service Unavailable");
+      return;
+    }
+
+    if (m_path.find("/v1/traces") != std::string::npos) {
+      Decode<otlp_trace::ExportTraceServiceRequest>(m_body, m_json);
+    } else if (m_path.find("/v1/metrics") != std::string::npos) {
+      Decode<otlp_metrics::ExportMetricsServiceRequest>(m_body, m_json);
+    } else if (m_path.find("/v1/logs") != std::string::npos) {
+      Decode<otlp_logs::ExportLogsServiceRequest>(m_body, m_json);
+    } else {
+      Reply("404 Not Found");
+      return;
+    }
+    Reply("200 OK");
+  }
+
+  void Reply(const char* status) {
+    // An empty Export*ServiceResponse is an empty message in both encodings
+    std::string body = m_json ? "{}" : "";
+    m_response = "HTTP/1.1 ";
+    m_response += status;
+    m_response += "\r\nContent-Type: ";
+    m_response += m_json ? "application/json" : "application/x-protobuf";
+    m_response += "\r\nContent-Length: " + std::to_string(body.size());
+    m_response += "\r\n\r\n" + body;
+
+    auto self = shared_from_this();
+    asio::async_write(
+        m_sock, asio::buffer(m_response),
+        [self](const boost::system::error_code& ec, std::size_t) {
+          if (!ec) {
+            self->ReadHeader();
+          }
+        });
+  }
+
+  static std::string Find(const std::string& header, const std::string& key) {
+    std::string lower(header);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    auto pos = lower.find(key + ":");
+    if (pos == std::string::npos) {
+      return {};
+    }
+    pos += key.size() + 1;
+    auto end = lower.find("\r\n", pos);
+    auto value = lower.substr(pos, end - pos);
+    value.erase(0, value.find_first_not_of(' '));
+    return value;
+  }
+
+  asio::ip::tcp::socket m_sock;
+  asio::streambuf m_buf;
+  std::string m_path;
+  std::string m_body;
+  std::string m_response;
+  bool m_json = false;
+};
+
+class HttpReceiver {
+ public:
+  HttpReceiver(asio::io_service& ios, unsigned short port)
+      : m_acceptor(ios, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port)) {
+    Accept();
+  }
+
+ private:
+  void Accept() {
+    m_acceptor.async_accept([this](const boost::system::error_code& ec,
+                                   asio::ip::tcp::socket sock) {
+      if (!ec) {
+        std::make_shared<HttpSession>(std::move(sock))->Start();
+      }
+      Accept();
+    });
+  }
+
+  asio::ip::tcp::acceptor m_acceptor;
+};
+
+// OTLP/gRPC
+template <typename Request>
+grpc::Status Receive(const Request& req) {
+  g_stats.bytes.fetch_add(req.ByteSizeLong(), std::memory_order_relaxed);
+  if (!Admit()) {
+    return grpc::Status(grpc::StatusCode::UNAVAILABLE, "dropped");
+  }
+  if (g_options.decode) {
+    Account(req);
+  }
+  return grpc::Status::OK;
+}
+
+class TraceService final : public otlp_trace::TraceService::Service {
+  grpc::Status Export(grpc::ServerContext*,
+                      const otlp_trace::ExportTraceServiceRequest* req,
+                      otlp_trace::ExportTraceServiceResponse*) override {
+    return Receive(*req);
+  }
+};
+
+class MetricsService final : public otlp_metrics::MetricsService::Service {
+  grpc::Status Export(grpc::ServerContext*,
+                      const otlp_metrics::ExportMetricsServiceRequest* req,
+                      otlp_metrics::ExportMetricsServiceResponse*) override {
+    return Receive(*req);
+  }
+};
+
+class LogsService final : public otlp_logs::LogsService::Service {
+  grpc::Status Export(grpc::ServerContext*,
+                      const otlp_logs::ExportLogsServiceRequest* req,
+                      otlp_logs::ExportLogsServiceResponse*) override {
+    return Receive(*req);
+  }
+};
+
+void Report(double elapsed_sec) {
+  uint64_t count = g_stats.latency_count.load();
+  double avg_ms =
+      count ? g_stats.latency_sum_ns.load() / 1e6 / static_cast<double>(count)
+            : 0.0;
+  std::cout << "t=" << elapsed_sec << "s"
+            << " requests=" << g_stats.requests.load()
+            << " dropped=" << g_stats.dropped.load()
+            << " bytes=" << g_stats.bytes.load()
+            << " spans=" << g_stats.spans.load()
+            << " events=" << g_stats.events.load()
+            << " points=" << g_stats.data_points.load()
+            << " logs=" << g_stats.log_records.load()
+            << " decode_errors=" << g_stats.decode_errors.load()
+            << " e2e_avg_ms=" << avg_ms
+            << " e2e_max_ms=" << g_stats.latency_max_ns.load() / 1e6
+            << " span_p50_ms=" << g_stats.span_latency.PercentileMs(0.5)
+            << " span_p90_ms=" << g_stats.span_latency.PercentileMs(0.9)
+            << " span_p99_ms=" << g_stats.span_latency.PercentileMs(0.99)
+            << " span_p999_ms=" << g_stats.span_latency.PercentileMs(0.999)
+            << std::endl;
+}
+
+void Usage(const char* prog) {
+  std::cout << "Usage: " << prog
+            << " [--http PORT]... [--grpc PORT]... [--delay-ms N]"
+               " [--drop-rate R] [--no-decode] [--report-ms N]"
+            << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        Usage(argv[0]);
+        exit(1);
+      }
+      return argv[++i];
+    };
+
+    if (arg == "--http") {
+      g_options.http_ports.push_back(std::stoi(next()));
+    } else if (arg == "--grpc") {
+      g_options.grpc_ports.push_back(std::stoi(next()));
+    } else if (arg == "--delay-ms") {
+      g_options.delay_ms = std::stoul(next());
+    } else if (arg == "--drop-rate") {
+      g_options.drop_rate = std::stod(next());
+    } else if (arg == "--no-decode") {
+      g_options.decode = false;
+    } else if (arg == "--report-ms") {
+      g_options.report_ms = std::stoul(next());
+    } else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (g_options.http_ports.empty() && g_options.grpc_ports.empty()) {
+    g_options.http_ports.push_back(4318);
+    g_options.grpc_ports.push_back(4317);
+  }
+
+  std::signal(SIGINT, [](int) { g_stop = true; });
+  std::signal(SIGTERM, [](int) { g_stop = true; });
+
+  asio::io_service ios;
+  std::unique_ptr<asio::io_service::work> work(new asio::io_service::work(ios));
+  std::vector<std::unique_ptr<HttpReceiver>> receivers;
+  for (auto port : g_options.http_ports) {
+    receivers.emplace_back(new HttpReceiver(ios, port));
+    std::cout << "OTLP/HTTP listening on " << port << std::endl;
+  }
+
+  TraceService trace_service;
+  MetricsService metrics_service;
+  LogsService logs_service;
+  std::unique_ptr<grpc::Server> grpc_server;
+  if (!g_options.grpc_ports.empty()) {
+    grpc::ServerBuilder builder;
+    for (auto port : g_options.grpc_ports) {
+      builder.AddListeningPort("0.0.0.0:" + std::to_string(port),
+                               grpc::InsecureServerCredentials());
+      std::cout << "OTLP/gRPC listening on " << port << std::endl;
+    }
+    builder.RegisterService(&trace_service);
+    builder.RegisterService(&metrics_service);
+    builder.RegisterService(&logs_service);
+    grpc_server = builder.BuildAndStart();
+  }
+
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i < std::max(2u, std::thread::hardware_concurrency());
+       ++i) {
+    threads.emplace_back([&ios]() { ios.run(); });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  while (!g_stop) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(g_options.report_ms));
+    Report(std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+               .count());
+  }
+
+  if (grpc_server) {
+    grpc_server->Shutdown();
+  }
+  work.reset();
+  ios.stop();
+  for (auto& t : threads) {
+    t.join();
+  }
+  return 0;
+}
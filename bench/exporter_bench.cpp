@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Pushes a configurable volume of spans and metric updates through one
+// provider and reports throughput, CPU and memory. Every span carries the
+// wall clock time it was ended at as bench.sent_ns, run it against
+// ./collector to get the end to end latency percentiles of the spans.
+//
+//   ./exporter_bench --provider OTLPHTTP --spans 100000 --metrics 1000000
+//
+// Use --provider NOOP for the baseline, the difference between the two runs
+// is the exporter overhead.
+
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libMetrics/Api.h"
+#include "libMetrics/Tracing2.h"
+
+using zil::trace2::Tracing;
+
+namespace {
+
+struct Options {
+  std::string provider = "STDOUT";
+  uint64_t spans = 10000;
+  uint64_t events_per_span = 1;
+  uint64_t metrics = 100000;
+  unsigned int threads = 1;
+  unsigned int settle_ms = 2000;
+};
+
+double ThreadCpuSeconds() {
+  timespec ts{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double ProcessCpuSeconds() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+long MaxRssKb() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+long RssKb() {
+  long pages = 0, resident = 0;
+  std::ifstream statm("/proc/self/statm");
+  statm >> pages >> resident;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Same clock as the span time stamps and the collector
+int64_t WallNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+double Seconds(std::chrono::steady_clock::duration d) {
+  return std::chrono::duration<double>(d).count();
+}
+
+void Usage(const char* prog) {
+  std::cout << "Usage: " << prog
+            << " [--provider STDOUT|OTLPHTTP|OTLPGRPC|PROMETHEUS|FILE_PERFETTO|"
+               "FILE_SPANLOG|FLIGHT_RECORDER|NOOP]"
+               " [--spans N] [--events N] [--metrics N] [--threads N]"
+               " [--settle-ms N]"
+            << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        Usage(argv[0]);
+        exit(1);
+      }
+      return argv[++i];
+    };
+
+    if (arg == "--provider") {
+      opts.provider = next();
+    } else if (arg == "--spans") {
+      opts.spans = std::stoull(next());
+    } else if (arg == "--events") {
+      opts.events_per_span = std::stoull(next());
+    } else if (arg == "--metrics") {
+      opts.metrics = std::stoull(next());
+    } else if (arg == "--threads") {
+      opts.threads = std::max(1, std::stoi(next()));
+    } else if (arg == "--settle-ms") {
+      opts.settle_ms = std::stoul(next());
+    } else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+
+  long rss_before = RssKb();
+  auto init_start = std::chrono::steady_clock::now();
+
+  Metrics::GetInstance(
+      [&opts]() { return std::make_shared<Metrics>(opts.provider); });
+  bool tracing = Tracing::Initialize("exporter_bench", "ALL", opts.provider);
+
+  auto init_time = std::chrono::steady_clock::now() - init_start;
+
+  Z_I64METRIC counter(Z_FL::API_SERVER, "bench_counter",
+                      "Benchmark counter", "calls");
+  Z_DBLHIST histogram(Z_FL::API_SERVER, "bench_histogram",
+                      {1.0, 10.0, 100.0, 1000.0}, "Benchmark histogram", "us");
+
+  std::vector<double> producer_cpu(opts.threads);
+  std::vector<std::thread> producers;
+
+  double cpu_before = ProcessCpuSeconds();
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned int t = 0; t < opts.threads; ++t) {
+    producers.emplace_back([&, t]() {
+      double cpu_start = ThreadCpuSeconds();
+
+      uint64_t spans = opts.spans / opts.threads;
+      for (uint64_t i = 0; i < spans; ++i) {
+        auto span =
+            Tracing::CreateSpan(zil::trace2::FilterClass::NODE, "bench_span");
+        for (uint64_t e = 0; e < opts.events_per_span; ++e) {
+          span.AddEvent("bench_event", {{"index", static_cast<int64_t>(e)}});
+        }
+        span.SetAttribute("bench.sent_ns", WallNs());
+        span.End(zil::trace2::StatusCode::OK);
+      }
+
+      uint64_t metrics = opts.metrics / opts.threads;
+      for (uint64_t i = 0; i < metrics; ++i) {
+        counter++;
+        histogram.Record(static_cast<double>(i % 1000));
+      }
+
+      producer_cpu[t] = ThreadCpuSeconds() - cpu_start;
+    });
+  }
+
+  for (auto& t : producers) {
+    t.join();
+  }
+
+  auto produce_time = std::chrono::steady_clock::now() - start;
+
+  // Give periodic readers at least one more export cycle, then flush.
+  std::this_thread::sleep_for(std::chrono::milliseconds(opts.settle_ms));
+  auto flush_start = std::chrono::steady_clock::now();
+  Metrics::GetInstance().Shutdown();
+  auto flush_time = std::chrono::steady_clock::now() - flush_start;
+
+  double process_cpu = ProcessCpuSeconds() - cpu_before;
+  double producers_cpu = 0;
+  for (auto c : producer_cpu) {
+    producers_cpu += c;
+  }
+
+  uint64_t spans = tracing ? opts.spans / opts.threads * opts.threads : 0;
+  uint64_t metric_ops = opts.metrics / opts.threads * opts.threads * 2;
+  double produce_sec = Seconds(produce_time);
+
+  std::cout << "provider=" << opts.provider
+            << " tracing=" << (tracing ? "on" : "off")
+            << " threads=" << opts.threads << std::endl
+            << "  init_ms=" << Seconds(init_time) * 1e3
+            << " produce_ms=" << produce_sec * 1e3
+            << " flush_ms=" << Seconds(flush_time) * 1e3 << std::endl
+            << "  spans=" << spans
+            << " spans_per_sec=" << (produce_sec > 0 ? spans / produce_sec : 0)
+            << " metric_ops=" << metric_ops << " metric_ops_per_sec="
+            << (produce_sec > 0 ? metric_ops / produce_sec : 0) << std::endl
+            << "  process_cpu_ms=" << process_cpu * 1e3
+            << " producer_cpu_ms=" << producers_cpu * 1e3
+            << " background_cpu_ms=" << (process_cpu - producers_cpu) * 1e3
+            << " cpu_per_span_us="
+            << (spans ? producers_cpu * 1e6 / spans : 0) << std::endl
+            << "  rss_kb=" << RssKb() << " rss_delta_kb="
+            << RssKb() - rss_before << " max_rss_kb=" << MaxRssKb()
+            << std::endl;
+
+  return 0;
+}
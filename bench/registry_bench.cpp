@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Startup cost of declaring many instruments: one SDK instrument per
+// declaration as before the registry, wrappers going through the
+// InstrumentRegistry with unique and with duplicate names, and bulk
+// registration followed by the wrappers.
+//
+//   ./registry_bench --provider OTLPGRPC --instruments 10000
+//
+// Nothing needs to listen on the exporter port, the run is over before
+// the first export.
+
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "libMetrics/Api.h"
+
+using zil::metrics::InstrumentKind;
+using zil::metrics::InstrumentRegistry;
+using zil::metrics::InstrumentSpec;
+
+namespace {
+
+struct Options {
+  std::string provider = "OTLPGRPC";
+  size_t instruments = 10000;
+};
+
+long RssKb() {
+  long pages = 0, resident = 0;
+  std::ifstream statm("/proc/self/statm");
+  statm >> pages >> resident;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+std::string Name(const char* phase, size_t i) {
+  return std::string("bench_") + phase + "_" + std::to_string(i);
+}
+
+template <typename F>
+void Measure(const char* phase, size_t count, F&& f) {
+  long rss_before = RssKb();
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto elapsed = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  std::cout << phase << ": instruments=" << count
+            << " ms=" << elapsed * 1e3
+            << " us_per_instrument=" << (count ? elapsed * 1e6 / count : 0)
+            << " rss_delta_kb=" << RssKb() - rss_before
+            << " registry_size=" << InstrumentRegistry::GetInstance().Size()
+            << std::endl;
+}
+
+void Usage(const char* prog) {
+  std::cout << "Usage: " << prog
+            << " [--provider STDOUT|OTLPHTTP|OTLPGRPC|PROMETHEUS|NOOP]"
+               " [--instruments N]"
+            << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--provider" && i + 1 < argc) {
+      opts.provider = argv[++i];
+    } else if (arg == "--instruments" && i + 1 < argc) {
+      opts.instruments = std::stoull(argv[++i]);
+    } else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+
+  Metrics::GetInstance(
+      [&opts]() { return std::make_shared<Metrics>(opts.provider); });
+
+  const size_t n = opts.instruments;
+
+  // What every declaration did before the registry
+  std::vector<zil::metrics::uint64CounterHandle_t> direct;
+  direct.reserve(n);
+  Measure("direct", n, [&]() {
+    for (size_t i = 0; i < n; ++i) {
+      direct.emplace_back(Metrics::GetMeter()->CreateUInt64Counter(
+          zil::metrics::GetFullName(zil::metrics::METRIC_FAMILY,
+                                    Name("direct", i)),
+          "Benchmark counter", "calls"));
+    }
+  });
+
+  std::vector<std::unique_ptr<Z_I64METRIC>> unique;
+  unique.reserve(n);
+  Measure("registry_unique", n, [&]() {
+    for (size_t i = 0; i < n; ++i) {
+      unique.emplace_back(std::make_unique<Z_I64METRIC>(
+          Z_FL::API_SERVER, Name("unique", i), "Benchmark counter", "calls"));
+    }
+  });
+
+  // Same names again, e.g. a metric declared in a class with many instances
+  std::vector<std::unique_ptr<Z_I64METRIC>> duplicates;
+  duplicates.reserve(n);
+  Measure("registry_duplicate", n, [&]() {
+    for (size_t i = 0; i < n; ++i) {
+      duplicates.emplace_back(std::make_unique<Z_I64METRIC>(
+          Z_FL::API_SERVER, Name("unique", i), "Benchmark counter", "calls"));
+    }
+  });
+
+  std::vector<InstrumentSpec> specs;
+  specs.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    specs.push_back({InstrumentKind::U64_COUNTER, Z_FL::API_SERVER,
+                     Name("bulk", i), "Benchmark counter", "calls", {}});
+  }
+
+  std::vector<std::unique_ptr<Z_I64METRIC>> bulk;
+  bulk.reserve(n);
+  Measure("registry_bulk", n, [&]() {
+    InstrumentRegistry::GetInstance().Register(specs);
+    for (size_t i = 0; i < n; ++i) {
+      bulk.emplace_back(std::make_unique<Z_I64METRIC>(
+          Z_FL::API_SERVER, specs[i].name, "Benchmark counter", "calls"));
+    }
+  });
+
+  return 0;
+}
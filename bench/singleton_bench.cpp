@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Throughput of Filter::GetInstance().Enabled(...) through the previous
+// Singleton (std::function default argument and an unsynchronised static
+// shared_ptr, copied below) and through the current one.
+//
+//   ./singleton_bench --checks 100000000 --threads 4
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libMetrics/Metrics.h"
+
+using zil::metrics::FilterClass;
+using zil::metrics::MetricsFilterMask;
+
+namespace {
+
+// Singleton<T> as it was
+template <typename T>
+class LegacySingleton {
+ public:
+  static T& GetInstance(
+      const std::function<std::shared_ptr<T>()>& _allocator =
+          []() { return std::make_shared<T>(); },
+      const bool reset = false) {
+    static std::shared_ptr<T> instance;
+    if (!instance || reset) {
+      if (_allocator) {
+        instance = _allocator();
+      }
+    }
+    return *instance.get();
+  }
+};
+
+class LegacyFilter : public LegacySingleton<LegacyFilter> {
+ public:
+  LegacyFilter() {
+    m_mask.Store(MetricsFilterMask::Parse(
+        "ALL", zil::metrics::METRICS_FILTER_CLASS_NAMES));
+  }
+
+  bool Enabled(FilterClass to_test) {
+    return m_mask.Test(static_cast<size_t>(to_test));
+  }
+
+ private:
+  MetricsFilterMask m_mask;
+};
+
+template <typename F>
+double Run(const char* name, uint64_t checks, unsigned int threads, F&& f) {
+  std::vector<std::thread> workers;
+  std::vector<uint64_t> enabled(threads);
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      uint64_t count = 0;
+      for (uint64_t i = 0; i < checks / threads; ++i) {
+        count += f(static_cast<FilterClass>(
+            i % static_cast<size_t>(FilterClass::FILTER_CLASS_END)));
+      }
+      enabled[t] = count;
+    });
+  }
+  for (auto& w : workers) {
+    w.join();
+  }
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  uint64_t total = 0;
+  for (auto e : enabled) {
+    total += e;
+  }
+  std::cout << name << ": checks=" << checks << " threads=" << threads
+            << " ms=" << seconds * 1e3
+            << " checks_per_sec=" << (seconds > 0 ? checks / seconds : 0)
+            << " ns_per_check=" << seconds * 1e9 / checks
+            << " enabled=" << total << std::endl;
+  return seconds;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint64_t checks = 100000000;
+  unsigned int threads = 1;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--checks" && i + 1 < argc) {
+      checks = std::stoull(argv[++i]);
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = std::max(1, std::stoi(argv[++i]));
+    } else {
+      std::cout << "Usage: " << argv[0] << " [--checks N] [--threads N]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  // Construct both before timing, the legacy one is not safe on first use
+  // from several threads
+  LegacyFilter::GetInstance();
+  zil::metrics::Filter::GetInstance().Reload("ALL");
+
+  double before = Run("legacy", checks, threads, [](FilterClass fc) {
+    return LegacyFilter::GetInstance().Enabled(fc);
+  });
+  double after = Run("current", checks, threads, [](FilterClass fc) {
+    return zil::metrics::Filter::GetInstance().Enabled(fc);
+  });
+
+  std::cout << "speedup=" << (after > 0 ? before / after : 0) << std::endl;
+  return 0;
+}
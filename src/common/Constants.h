@@ -35,11 +35,21 @@ const uint64_t METRIC_ZILLIQA_READER_TIMEOUT_MS{500};
 std::string TRACE_ZILLIQA_PROVIDER{"OTLPHTTP"};
 const std::string TRACE_ZILLIQA_HOSTNAME{"0.0.0.0"};
 const std::string TRACE_ZILLIQA_PORT{"4318"};
+const std::string TRACE_ZILLIQA_GRPC_PORT{"4317"};
 const double METRICS_VERSION{8.6};
 const std::string WARNING{"WARNING"};
 const std::string INFO{"INFO"};
 const std::string FATAL{"FATAL"};
 std::string TRACE_ZILLIQA_MASK{"ALL"};
+std::string TRACE_ZILLIQA_PERFETTO_FILE{"zilliqa-trace.json"};
+std::string TRACE_ZILLIQA_SPANLOG_DIR{"spanlog"};
+const uint64_t TRACE_ZILLIQA_SPANLOG_SEGMENT_MB{64};
+const uint64_t TRACE_ZILLIQA_SPANLOG_SEGMENTS{16};
+const bool TRACE_ZILLIQA_SPANLOG_ZSTD{false};
+std::string TRACE_ZILLIQA_FLIGHT_DIR{"."};
+const uint64_t TRACE_ZILLIQA_FLIGHT_RECORDS{4096};
+std::string LOGGING_ZILLIQA_PROVIDER{"STDOUT"};
+std::string LOGGING_ZILLIQA_FILE{"zilliqa.log"};
 const std::string ZILLIQA_METRIC_FAMILY{"zilliqa_cpp"};
 };
 
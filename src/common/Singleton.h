@@ -18,10 +18,19 @@
 #ifndef ZILLIQA_SRC_COMMON_SINGLETON_H_
 #define ZILLIQA_SRC_COMMON_SINGLETON_H_
 
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <type_traits>
+#include <vector>
 
+// The instance pointer is constinit, so GetInstance() on a constructed
+// singleton is one acquire load (a plain load on x86) and a branch. The
+// first use constructs under a mutex and publishes with a release store,
+// concurrent first uses are race free.
+//
+// T's constructor must not call its own GetInstance.
 template <typename T>
 class Singleton {
  protected:
@@ -37,22 +46,59 @@ class Singleton {
                                    // non-virtual destructor [-Weffc++]
 
  public:
-  static T& GetInstance(
-      const std::function<std::shared_ptr<T>()>& _allocator =
-          []() { return std::make_shared<T>(); },
-      const bool reset =
-          false) noexcept(std::is_nothrow_constructible<T>::value) {
-    // Guaranteed to be destroyed.
-    // Instantiated on first use.
-    // Thread safe in C++11
-    static std::shared_ptr<T> instance;
-    if (!instance || reset) {
-      if (_allocator) {
-        instance = _allocator();
+  using Allocator = std::function<std::shared_ptr<T>()>;
+
+  static T& GetInstance() {
+    if (T* instance = m_instance.load(std::memory_order_acquire)) [[likely]] {
+      return *instance;
+    }
+    return CreateDefault();
+  }
+
+  /// Constructs with the allocator if there is no instance yet, e.g. to
+  /// pick a provider. reset is kept for older callers, see ResetForTesting.
+  static T& GetInstance(const Allocator& allocator, const bool reset = false) {
+    if (!reset) {
+      if (T* instance = m_instance.load(std::memory_order_acquire)) {
+        return *instance;
       }
     }
-    return *instance.get();
+    return Create(allocator, reset);
+  }
+
+  /// Replaces the instance, the next GetInstance() constructs a default one
+  /// if allocator is empty. Previous instances live until exit so
+  /// references taken before stay valid. For tests only.
+  static void ResetForTesting(const Allocator& allocator = {}) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_owner) {
+      m_retired.push_back(std::move(m_owner));
+    }
+    m_owner = allocator ? allocator() : nullptr;
+    m_instance.store(m_owner.get(), std::memory_order_release);
   }
+
+ private:
+  // Out of line so the fast path stays a load and a branch
+  [[gnu::noinline]] static T& CreateDefault() { return Create({}, false); }
+
+  static T& Create(const Allocator& allocator, bool reset) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_owner && !reset) {
+      return *m_owner;
+    }
+    if (m_owner) {
+      m_retired.push_back(std::move(m_owner));
+    }
+    m_owner = allocator ? allocator() : std::make_shared<T>();
+    m_instance.store(m_owner.get(), std::memory_order_release);
+    return *m_owner;
+  }
+
+  static constinit inline std::atomic<T*> m_instance{nullptr};
+  static inline std::mutex m_mutex;
+  static inline std::shared_ptr<T> m_owner;
+  static inline std::vector<std::shared_ptr<T>> m_retired;
 };
 
 #endif  // ZILLIQA_SRC_COMMON_SINGLETON_H_
@@ -17,10 +17,16 @@
 #ifndef ZILLIQA_SRC_LIBMETRICS_API_H_
 #define ZILLIQA_SRC_LIBMETRICS_API_H_
 
+#include "FilterReload.h"
+#include "Logging.h"
+#include "MetricCatalog.h"
 #include "Metrics.h"
+#include "Profiler.h"
 #include "Tracing.h"
 #include "Helper.h"
 #include "libMetrics/internal/mixins.h"
+#include "libMetrics/internal/mutex.h"
+#include "libMetrics/internal/queue.h"
 #include "libMetrics/internal/scope.h"
 
 // These definitions will probably be changed as people will not like the Z_
@@ -38,6 +44,29 @@ using Z_I64GAUGE = zil::metrics::InstrumentWrapper<zil::metrics::I64Gauge>;
 using Z_I64UPDOWN = zil::metrics::InstrumentWrapper<zil::metrics::I64UpDown>;
 using Z_DBLUPDOWN = zil::metrics::InstrumentWrapper<zil::metrics::DoubleUpDown>;
 
+// Synchronous, one relaxed atomic operation per update
+
+using Z_I64SYNCGAUGE = zil::metrics::I64SyncGauge;
+using Z_DBLSYNCGAUGE = zil::metrics::DoubleSyncGauge;
+using Z_I64SYNCUPDOWN = zil::metrics::I64SyncUpDown;
+using Z_DBLSYNCUPDOWN = zil::metrics::DoubleSyncUpDown;
+
+using Z_LATENCY = zil::metrics::LatencyHistograms;
+using Z_ASYNCLATENCY = zil::metrics::LatencyBinding;
+using Z_LATENCYTOKEN = zil::metrics::LatencyToken;
+using Z_LATENCYSTATUS = zil::metrics::LatencyStatus;
+
+using Z_LOCKSTATS = zil::metrics::LockHistograms;
+using Z_MUTEX = zil::metrics::InstrumentedMutex;
+using Z_SHAREDMUTEX = zil::metrics::InstrumentedSharedMutex;
+
+using Z_QUEUESTATS = zil::metrics::QueueStats;
+template <typename T>
+using Z_QUEUE = zil::metrics::InstrumentedQueue<T>;
+
+using Z_CATALOG = zil::metrics::MetricCatalog;
+using Z_MID = zil::metrics::MetricId;
+
 // Lazy
 
 using Z_FL = zil::metrics::FilterClass;
@@ -60,6 +89,14 @@ using Z_FL = zil::metrics::FilterClass;
     }                                                                  \
   }
 
+// Times the rest of the enclosing scope into a Z_LATENCY, wall and thread CPU
+// time are recorded with the calling function as the "method" attribute.
+
+#define LATENCY_SCOPE(HISTOGRAMS)                                           \
+  static const zil::metrics::ScopeSite zil_scope_site_(__FILE__,            \
+                                                       __FUNCTION__);       \
+  zil::metrics::ScopeTimer zil_scope_timer_(HISTOGRAMS, zil_scope_site_)
+
 #define METRICS_ENABLED(FILTER_CLASS)          \
   zil::metrics::Filter::GetInstance().Enabled( \
       zil::metrics::FilterClass::FILTER_CLASS)
@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "Asio.h"
+
+#include <algorithm>
+
+#include "libUtils/Logger.h"
+
+namespace zil {
+namespace metrics {
+
+namespace {
+
+// Pool thread slot of the calling thread, one executor per thread
+struct ThreadBinding {
+  const void *owner = nullptr;
+  std::atomic<uint64_t> *busyNs = nullptr;
+  // handlers dispatched from handlers must not count twice
+  unsigned depth = 0;
+};
+
+thread_local ThreadBinding t_binding;
+
+}  // namespace
+
+HandlerTag::HandlerTag(const char *name) noexcept
+    : m_pairs{Attribute{"handler", name}}, m_attributes(m_pairs) {}
+
+ExecutorStats::ExecutorStats(FilterClass fc, const std::string &name,
+                             const std::string &description,
+                             const std::vector<double> &boundaries)
+    : m_fc(fc),
+      m_slots(new ThreadSlot[MAX_THREADS]),
+      m_lag(fc, name + "_lag", boundaries,
+            description + " (post to handler start)", "us"),
+      m_run(fc, name + "_run", boundaries, description + " (handler run time)",
+            "us"),
+      m_pendingGauge(Metrics::GetInstance().CreateInt64Gauge(
+          name + "_pending", description + " (pending handlers)", "handlers")),
+      m_busy(Metrics::GetInstance().CreateDoubleObservableCounter(
+          name + "_busy", description + " (busy time per thread)", "s")) {
+  m_pendingGauge.SetCallback(
+      FilteredCallback(m_fc, [this](Observable::Result &&result) {
+        result.Set(Pending(), AttributeSetHandle{});
+      }));
+  m_busy.SetCallback(FilteredCallback(m_fc, [this](Observable::Result &&result) {
+    const uint32_t threads =
+        std::min(m_threads.load(std::memory_order_relaxed), MAX_THREADS);
+    for (uint32_t i = 0; i < threads; ++i) {
+      const ThreadSlot &slot = m_slots[i];
+      if (slot.ready.load(std::memory_order_acquire)) {
+        result.Set(slot.busyNs.load(std::memory_order_relaxed) / 1e9,
+                   slot.attributes);
+      }
+    }
+  }));
+}
+
+void ExecutorStats::RegisterThread() {
+  const uint32_t index = m_threads.fetch_add(1, std::memory_order_relaxed);
+  if (index >= MAX_THREADS) {
+    LOG_GENERAL(WARNING, "Executor thread " << index << " is not counted, "
+                                            << MAX_THREADS << " at most");
+    return;
+  }
+  ThreadSlot &slot = m_slots[index];
+  slot.attributes =
+      AttributeSetHandle{{"thread", static_cast<int64_t>(index)}};
+  slot.ready.store(true, std::memory_order_release);
+  t_binding = ThreadBinding{this, &slot.busyNs, 0};
+}
+
+void ExecutorStats::UnregisterThread() noexcept {
+  if (t_binding.owner == this) {
+    t_binding = ThreadBinding{};
+  }
+}
+
+uint64_t ExecutorStats::Posted() noexcept {
+  if (!Enabled()) {
+    return 0;
+  }
+  m_pending.fetch_add(1, std::memory_order_relaxed);
+  return MonotonicNs();
+}
+
+void ExecutorStats::Started(const HandlerTag &tag, uint64_t postNs,
+                            uint64_t startNs) noexcept {
+  ++t_binding.depth;
+  if (postNs == 0) {
+    return;
+  }
+  m_pending.fetch_sub(1, std::memory_order_relaxed);
+  try {
+    m_lag.RecordWithAttributes((startNs - postNs) / 1e3, tag.Attributes());
+  } catch (...) {
+    LOG_GENERAL(WARNING, "Handler lag not recorded");
+  }
+}
+
+void ExecutorStats::Finished(const HandlerTag &tag,
+                             uint64_t startNs) noexcept {
+  const uint64_t runNs = MonotonicNs() - startNs;
+  if (--t_binding.depth == 0 && t_binding.owner == this) {
+    // only this thread writes its slot
+    t_binding.busyNs->store(
+        t_binding.busyNs->load(std::memory_order_relaxed) + runNs,
+        std::memory_order_relaxed);
+  }
+  try {
+    m_run.RecordWithAttributes(runNs / 1e3, tag.Attributes());
+  } catch (...) {
+    LOG_GENERAL(WARNING, "Handler run time not recorded");
+  }
+}
+
+void InstrumentedExecutor::Run() {
+  struct Registration {
+    ExecutorStats &stats;
+
+    explicit Registration(ExecutorStats &s) : stats(s) {
+      stats.RegisterThread();
+    }
+
+    ~Registration() { stats.UnregisterThread(); }
+  } registration(m_stats);
+  m_context.run();
+}
+
+SocketStats::Peer::Peer(const std::string &label)
+    : label(label),
+      attributes{{"peer", label}},
+      out{{"peer", label}, {"direction", "out"}},
+      in{{"peer", label}, {"direction", "in"}} {}
+
+SocketStats::SocketStats(FilterClass fc, const std::string &name,
+                         const std::string &description,
+                         const std::vector<double> &boundaries)
+    : m_fc(fc),
+      m_other(&m_peers.emplace_back("other")),
+      m_connect(fc, name + "_connect", boundaries,
+                description + " (connect latency)", "us"),
+      m_write(fc, name + "_write", boundaries,
+              description + " (write latency)", "us"),
+      m_read(fc, name + "_read", boundaries,
+             description + " (read latency)", "us"),
+      m_bytes(Metrics::GetInstance().CreateInt64ObservableCounter(
+          name + "_bytes", description + " (bytes)", "bytes")),
+      m_ops(Metrics::GetInstance().CreateInt64ObservableCounter(
+          name + "_ops", description + " (operations)", "operations")) {
+  m_bytes.SetCallback(FilteredCallback(m_fc, [this](Observable::Result &&result) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const Peer &peer : m_peers) {
+      result.Set(peer.bytesOut.load(std::memory_order_relaxed), peer.out);
+      result.Set(peer.bytesIn.load(std::memory_order_relaxed), peer.in);
+    }
+  }));
+  m_ops.SetCallback(FilteredCallback(m_fc, [this](Observable::Result &&result) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const Peer &peer : m_peers) {
+      result.Set(peer.opsOut.load(std::memory_order_relaxed), peer.out);
+      result.Set(peer.opsIn.load(std::memory_order_relaxed), peer.in);
+    }
+  }));
+}
+
+SocketStats::Peer &SocketStats::GetPeer(const std::string &label) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (auto it = m_labels.find(label); it != m_labels.end()) {
+    return *it->second;
+  }
+  if (m_labels.size() >= MAX_PEERS) {
+    return *m_other;
+  }
+  Peer &peer = m_peers.emplace_back(label);
+  m_labels.emplace(label, &peer);
+  return peer;
+}
+
+void SocketStats::Record(Op op, const Peer &peer, uint64_t ns) noexcept {
+  try {
+    switch (op) {
+      case Op::CONNECT:
+        m_connect.RecordWithAttributes(ns / 1e3, peer.attributes);
+        break;
+      case Op::WRITE:
+        m_write.RecordWithAttributes(ns / 1e3, peer.attributes);
+        break;
+      case Op::READ:
+        m_read.RecordWithAttributes(ns / 1e3, peer.attributes);
+        break;
+    }
+  } catch (...) {
+    LOG_GENERAL(WARNING, "Socket latency of " << peer.label << " not recorded");
+  }
+}
+
+void InstrumentedSocket::SetPeer(const std::string &label) {
+  if (!label.empty()) {
+    m_peer = &m_stats.GetPeer(label);
+    return;
+  }
+  boost::system::error_code ec;
+  const auto endpoint = m_socket.remote_endpoint(ec);
+  m_peer = &m_stats.GetPeer(ec ? "unknown" : endpoint.address().to_string());
+}
+
+void InstrumentedSocket::Flush() noexcept {
+  if (m_peer == nullptr) {
+    return;
+  }
+  if (m_out.ops != 0) {
+    m_peer->bytesOut.fetch_add(m_out.bytes, std::memory_order_relaxed);
+    m_peer->opsOut.fetch_add(m_out.ops, std::memory_order_relaxed);
+    m_out = Direction{};
+  }
+  if (m_in.ops != 0) {
+    m_peer->bytesIn.fetch_add(m_in.bytes, std::memory_order_relaxed);
+    m_peer->opsIn.fetch_add(m_in.ops, std::memory_order_relaxed);
+    m_in = Direction{};
+  }
+}
+
+uint64_t InstrumentedSocket::Completed(SocketStats::Op op, uint64_t startNs,
+                                       const boost::system::error_code &ec,
+                                       std::size_t bytes) noexcept {
+  const uint64_t ns = startNs != 0 ? MonotonicNs() - startNs : 0;
+  if (op != SocketStats::Op::CONNECT) {
+    const bool out = op == SocketStats::Op::WRITE;
+    Direction &direction = out ? m_out : m_in;
+    direction.bytes += bytes;
+    if (++direction.ops >= FLUSH_OPS) {
+      auto &peerBytes = out ? m_peer->bytesOut : m_peer->bytesIn;
+      auto &peerOps = out ? m_peer->opsOut : m_peer->opsIn;
+      peerBytes.fetch_add(direction.bytes, std::memory_order_relaxed);
+      peerOps.fetch_add(direction.ops, std::memory_order_relaxed);
+      direction = Direction{};
+    }
+  }
+  if (ns != 0 && !ec) {
+    m_stats.Record(op, *m_peer, ns);
+  }
+  return ns;
+}
+
+}  // namespace metrics
+}  // namespace zil
@@ -0,0 +1,546 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_ASIO_H_
+#define ZILLIQA_SRC_LIBMETRICS_ASIO_H_
+
+// Instrumentation of boost::asio, kept out of Api.h so that only users of
+// asio pull it in
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <opentelemetry/common/key_value_iterable_view.h>
+
+#include "libMetrics/Tracing2.h"
+#include "libMetrics/internal/clock.h"
+#include "libMetrics/internal/mixins.h"
+
+namespace zil {
+namespace metrics {
+
+// Name of a kind of handler as a pre-built {"handler", name} attribute,
+// declare one per call site, e.g. static
+class HandlerTag final {
+ public:
+  /// \param name Must outlive the tag, e.g. a literal
+  explicit HandlerTag(const char *name) noexcept;
+
+  const opentelemetry::common::KeyValueIterable &Attributes() const noexcept {
+    return m_attributes;
+  }
+
+ private:
+  using Attribute = std::pair<opentelemetry::nostd::string_view,
+                              opentelemetry::common::AttributeValue>;
+
+  std::array<Attribute, 1> m_pairs;
+  // Refers to m_pairs, hence no copy or move
+  opentelemetry::common::KeyValueIterableView<std::array<Attribute, 1>>
+      m_attributes;
+
+  HandlerTag(const HandlerTag &) = delete;
+
+  HandlerTag &operator=(const HandlerTag &) = delete;
+};
+
+// Instruments of one io_context thread pool:
+//   <name>_lag      us from post to the start of the handler, per handler
+//   <name>_run      us a handler ran, per handler
+//   <name>_pending  handlers posted and not started yet
+//   <name>_busy     seconds each pool thread spent in handlers, the rate of
+//                   it is the utilisation of the thread
+// Must outlive the io_context, which destroys the handlers it still holds.
+class ExecutorStats final {
+ public:
+  static constexpr uint32_t MAX_THREADS = 256;
+
+  ExecutorStats(FilterClass fc, const std::string &name,
+                const std::string &description,
+                const std::vector<double> &boundaries = {
+                    10.0, 100.0, 1000.0, 10000.0, 100000.0, 1000000.0});
+
+  bool Enabled() { return Filter::GetInstance().Enabled(m_fc); }
+
+  /// Counts the calling thread into <name>_busy until UnregisterThread, one
+  /// io_context pool thread each. Threads beyond MAX_THREADS are not counted.
+  void RegisterThread();
+
+  void UnregisterThread() noexcept;
+
+  int64_t Pending() const noexcept {
+    return m_pending.load(std::memory_order_relaxed);
+  }
+
+  // Used by TrackedHandler
+
+  /// \return Post time, 0 if the filter class is disabled
+  uint64_t Posted() noexcept;
+
+  /// A posted handler was destroyed without running
+  void Dropped() noexcept { m_pending.fetch_sub(1, std::memory_order_relaxed); }
+
+  /// \param postNs Return of Posted, 0 for handlers of async operations
+  void Started(const HandlerTag &tag, uint64_t postNs,
+               uint64_t startNs) noexcept;
+
+  void Finished(const HandlerTag &tag, uint64_t startNs) noexcept;
+
+ private:
+  struct alignas(64) ThreadSlot {
+    // written by the owning thread only
+    std::atomic<uint64_t> busyNs{};
+    std::atomic<bool> ready{};
+    AttributeSetHandle attributes;
+  };
+
+  FilterClass m_fc;
+  alignas(64) std::atomic<int64_t> m_pending{};
+  std::atomic<uint32_t> m_threads{};
+  std::unique_ptr<ThreadSlot[]> m_slots;
+  InstrumentWrapper<DoubleHistogram> m_lag;
+  InstrumentWrapper<DoubleHistogram> m_run;
+  // Last, so the callbacks are removed before anything they read goes away
+  Observable m_pendingGauge;
+  Observable m_busy;
+
+  ExecutorStats(const ExecutorStats &) = delete;
+
+  ExecutorStats &operator=(const ExecutorStats &) = delete;
+};
+
+// Completion handler hook, times the handler it wraps into ExecutorStats.
+// Handlers of Post and Dispatch count as pending and record their lag from
+// the post, handlers of async operations only their run time, the lag of
+// those is the I/O latency. Move only, so a posted handler is counted once;
+// associated executor and allocator are the ones of the wrapped handler.
+template <typename Handler>
+class TrackedHandler {
+ public:
+  TrackedHandler(ExecutorStats &stats, const HandlerTag &tag, Handler handler,
+                 bool posted)
+      : m_handler(std::move(handler)),
+        m_stats(&stats),
+        m_tag(&tag),
+        m_postNs(posted ? stats.Posted() : 0) {}
+
+  TrackedHandler(TrackedHandler &&other) noexcept(
+      std::is_nothrow_move_constructible_v<Handler>)
+      : m_handler(std::move(other.m_handler)),
+        m_stats(other.m_stats),
+        m_tag(other.m_tag),
+        m_postNs(std::exchange(other.m_postNs, 0)) {}
+
+  ~TrackedHandler() {
+    if (m_postNs != 0) {
+      m_stats->Dropped();
+    }
+  }
+
+  template <typename... Args>
+  void operator()(Args &&...args) {
+    const uint64_t postNs = std::exchange(m_postNs, 0);
+    if (postNs == 0 && !m_stats->Enabled()) {
+      m_handler(std::forward<Args>(args)...);
+      return;
+    }
+    // records in the dtor, also if the handler throws
+    struct Scope {
+      ExecutorStats &stats;
+      const HandlerTag &tag;
+      const uint64_t startNs = MonotonicNs();
+
+      ~Scope() { stats.Finished(tag, startNs); }
+    } scope{*m_stats, *m_tag};
+    m_stats->Started(*m_tag, postNs, scope.startNs);
+    m_handler(std::forward<Args>(args)...);
+  }
+
+  const Handler &Inner() const noexcept { return m_handler; }
+
+ private:
+  Handler m_handler;
+  ExecutorStats *m_stats;
+  const HandlerTag *m_tag;
+  uint64_t m_postNs;
+
+  TrackedHandler(const TrackedHandler &) = delete;
+
+  TrackedHandler &operator=(const TrackedHandler &) = delete;
+};
+
+// An io_context with its ExecutorStats. Pool threads call Run instead of
+// io_context::run, work goes through Post and Dispatch, and completion
+// handlers of async operations through Wrap:
+//
+//   static const Z_HANDLERTAG readTag("read");
+//   asio::async_read_until(sock, buf, '\n', executor.Wrap(readTag, ...));
+class InstrumentedExecutor final {
+ public:
+  InstrumentedExecutor(boost::asio::io_context &context,
+                       ExecutorStats &stats) noexcept
+      : m_context(context), m_stats(stats) {}
+
+  boost::asio::io_context &Context() noexcept { return m_context; }
+
+  ExecutorStats &Stats() noexcept { return m_stats; }
+
+  template <typename Handler>
+  TrackedHandler<std::decay_t<Handler>> Wrap(const HandlerTag &tag,
+                                             Handler &&handler) {
+    return {m_stats, tag, std::forward<Handler>(handler), false};
+  }
+
+  template <typename Handler>
+  void Post(const HandlerTag &tag, Handler &&handler) {
+    boost::asio::post(m_context,
+                      TrackedHandler<std::decay_t<Handler>>(
+                          m_stats, tag, std::forward<Handler>(handler), true));
+  }
+
+  /// Runs the handler inline if called from a pool thread
+  template <typename Handler>
+  void Dispatch(const HandlerTag &tag, Handler &&handler) {
+    boost::asio::dispatch(
+        m_context, TrackedHandler<std::decay_t<Handler>>(
+                       m_stats, tag, std::forward<Handler>(handler), true));
+  }
+
+  /// io_context::run on the calling thread as a counted pool thread
+  void Run();
+
+ private:
+  boost::asio::io_context &m_context;
+  ExecutorStats &m_stats;
+
+  InstrumentedExecutor(const InstrumentedExecutor &) = delete;
+
+  InstrumentedExecutor &operator=(const InstrumentedExecutor &) = delete;
+};
+
+
+// Network accounting of the InstrumentedSockets of one kind, per peer
+// label: <name>_bytes and <name>_ops counters with "peer" and "direction"
+// in or out, and <name>_connect, <name>_write and <name>_read histograms
+// (us, successful operations) with "peer". Labels are bounded, peers beyond
+// MAX_PEERS distinct labels are reported as "other".
+class SocketStats final {
+ public:
+  static constexpr size_t MAX_PEERS = 64;
+
+  enum class Op { CONNECT, WRITE, READ };
+
+  // Totals and pre-built attributes of one peer label
+  struct Peer {
+    explicit Peer(const std::string &label);
+
+    const std::string label;
+    const AttributeSetHandle attributes;
+    const AttributeSetHandle out;
+    const AttributeSetHandle in;
+    std::atomic<uint64_t> bytesOut{};
+    std::atomic<uint64_t> opsOut{};
+    std::atomic<uint64_t> bytesIn{};
+    std::atomic<uint64_t> opsIn{};
+  };
+
+  SocketStats(FilterClass fc, const std::string &name,
+              const std::string &description,
+              const std::vector<double> &boundaries = {
+                  10.0, 100.0, 1000.0, 10000.0, 100000.0, 1000000.0});
+
+  bool Enabled() { return Filter::GetInstance().Enabled(m_fc); }
+
+  /// Takes a lock, look peers up once per socket
+  Peer &GetPeer(const std::string &label);
+
+  void Record(Op op, const Peer &peer, uint64_t ns) noexcept;
+
+ private:
+  FilterClass m_fc;
+  // guards the peers, which stay where they are once created
+  std::mutex m_mutex;
+  std::deque<Peer> m_peers;
+  std::map<std::string, Peer *, std::less<>> m_labels;
+  Peer *m_other;
+  InstrumentWrapper<DoubleHistogram> m_connect;
+  InstrumentWrapper<DoubleHistogram> m_write;
+  InstrumentWrapper<DoubleHistogram> m_read;
+  // Last, so the callbacks are removed before anything they read goes away
+  Observable m_bytes;
+  Observable m_ops;
+
+  SocketStats(const SocketStats &) = delete;
+
+  SocketStats &operator=(const SocketStats &) = delete;
+};
+
+template <typename Handler>
+class SocketHandler;
+
+// tcp::socket with network accounting into SocketStats. Bytes and
+// operations are counted in the socket and added to the peer totals every
+// FLUSH_OPS operations per direction and on destruction, so an operation
+// costs two clock reads and a histogram record. At most one read and one
+// write may be outstanding, as for asio's composed operations anyway.
+//
+// With a trace filter class every completed operation records a Tracing2
+// span, a child of the span active when it was started, with peer, bytes
+// and latency_us attributes. Spans are bound to a thread, so the span cannot
+// cover the I/O itself, it ends before the completion handler runs.
+// Operations the handler starts outside spans of its own get the same
+// parent, so connect, write and read of one request are siblings.
+class InstrumentedSocket final {
+ public:
+  static constexpr uint32_t FLUSH_OPS = 64;
+
+  using Endpoint = boost::asio::ip::tcp::endpoint;
+
+  InstrumentedSocket(boost::asio::io_context &context, SocketStats &stats,
+                     std::optional<trace2::FilterClass> trace = std::nullopt)
+      : m_socket(context), m_stats(stats), m_trace(trace) {}
+
+  ~InstrumentedSocket() { Flush(); }
+
+  /// For everything else, e.g. accept, shutdown and cancel
+  boost::asio::ip::tcp::socket &Raw() noexcept { return m_socket; }
+
+  /// Sets the peer label, the remote address if empty. AsyncConnect takes
+  /// the address connected to, accepted sockets the remote one on first use
+  void SetPeer(const std::string &label = {});
+
+  const std::string &PeerLabel() {
+    EnsurePeer();
+    return m_peer->label;
+  }
+
+  template <typename Handler>
+  void AsyncConnect(const Endpoint &endpoint, Handler &&handler) {
+    if (m_peer == nullptr) {
+      m_peer = &m_stats.GetPeer(endpoint.address().to_string());
+    }
+    m_socket.async_connect(
+        endpoint, MakeHandler(SocketStats::Op::CONNECT,
+                              std::forward<Handler>(handler)));
+  }
+
+  template <typename ConstBuffers, typename Handler>
+  void AsyncWrite(const ConstBuffers &buffers, Handler &&handler) {
+    EnsurePeer();
+    boost::asio::async_write(
+        m_socket, buffers,
+        MakeHandler(SocketStats::Op::WRITE, std::forward<Handler>(handler)));
+  }
+
+  template <typename Buffer, typename Handler>
+  void AsyncReadUntil(Buffer &buffer, char delimiter, Handler &&handler) {
+    EnsurePeer();
+    boost::asio::async_read_until(
+        m_socket, buffer, delimiter,
+        MakeHandler(SocketStats::Op::READ, std::forward<Handler>(handler)));
+  }
+
+  /// Adds the counts of the socket to the peer totals
+  void Flush() noexcept;
+
+ private:
+  template <typename Handler>
+  friend class SocketHandler;
+
+  struct Direction {
+    uint64_t bytes = 0;
+    uint64_t ops = 0;
+  };
+
+  template <typename Handler>
+  SocketHandler<std::decay_t<Handler>> MakeHandler(SocketStats::Op op,
+                                                   Handler &&handler) {
+    std::optional<trace2::TraceContext> context;
+    if (m_trace && trace2::Tracing::IsEnabled(*m_trace)) {
+      context = trace2::Tracing::GetActiveContext();
+      if (!context->IsValid()) {
+        context = t_handlerContext;
+      }
+    }
+    return {*this, op, std::forward<Handler>(handler),
+            m_stats.Enabled() ? MonotonicNs() : 0, context};
+  }
+
+  void EnsurePeer() {
+    if (m_peer == nullptr) {
+      SetPeer();
+    }
+  }
+
+  /// \return Latency of the operation in ns, 0 if not timed
+  uint64_t Completed(SocketStats::Op op, uint64_t startNs,
+                     const boost::system::error_code &ec,
+                     std::size_t bytes) noexcept;
+
+  // Parent of the operation whose completion handler runs on this thread
+  static inline thread_local trace2::TraceContext t_handlerContext{};
+
+  boost::asio::ip::tcp::socket m_socket;
+  SocketStats &m_stats;
+  std::optional<trace2::FilterClass> m_trace;
+  SocketStats::Peer *m_peer = nullptr;
+  // each only touched by the one outstanding operation of its direction
+  Direction m_out;
+  Direction m_in;
+
+  InstrumentedSocket(const InstrumentedSocket &) = delete;
+
+  InstrumentedSocket &operator=(const InstrumentedSocket &) = delete;
+};
+
+// Completion handler of InstrumentedSocket operations, accounts before the
+// wrapped handler runs as that may destroy the socket
+template <typename Handler>
+class SocketHandler {
+ public:
+  SocketHandler(InstrumentedSocket &socket, SocketStats::Op op,
+                Handler handler, uint64_t startNs,
+                std::optional<trace2::TraceContext> context)
+      : m_handler(std::move(handler)),
+        m_socket(&socket),
+        m_op(op),
+        m_startNs(startNs),
+        m_context(context) {}
+
+  SocketHandler(SocketHandler &&) = default;
+
+  void operator()(const boost::system::error_code &ec) {
+    Complete(ec, 0, [&] { m_handler(ec); });
+  }
+
+  void operator()(const boost::system::error_code &ec, std::size_t bytes) {
+    Complete(ec, bytes, [&] { m_handler(ec, bytes); });
+  }
+
+  const Handler &Inner() const noexcept { return m_handler; }
+
+ private:
+  template <typename Call>
+  void Complete(const boost::system::error_code &ec, std::size_t bytes,
+                Call &&call) {
+    const uint64_t ns = m_socket->Completed(m_op, m_startNs, ec, bytes);
+    if (!m_context) {
+      call();
+      return;
+    }
+    static constexpr const char *NAMES[] = {"socket.connect", "socket.write",
+                                            "socket.read"};
+    {
+      auto span = trace2::Tracing::CreateChildSpan(
+          *m_socket->m_trace, NAMES[static_cast<int>(m_op)], *m_context);
+      span.SetAttribute("peer", std::string_view(m_socket->PeerLabel()));
+      span.SetAttribute("bytes", static_cast<uint64_t>(bytes));
+      span.SetAttribute("latency_us", static_cast<int64_t>(ns / 1000));
+      if (ec) {
+        span.SetAttribute("error", std::string_view(ec.message()));
+      }
+    }
+
+    // the socket may be gone once the handler returns
+    struct ContextScope {
+      trace2::TraceContext previous;
+      ~ContextScope() { InstrumentedSocket::t_handlerContext = previous; }
+    } scope{std::exchange(InstrumentedSocket::t_handlerContext, *m_context)};
+    call();
+  }
+
+  Handler m_handler;
+  InstrumentedSocket *m_socket;
+  SocketStats::Op m_op;
+  uint64_t m_startNs;
+  std::optional<trace2::TraceContext> m_context;
+
+  SocketHandler(const SocketHandler &) = delete;
+
+  SocketHandler &operator=(const SocketHandler &) = delete;
+};
+
+}  // namespace metrics
+}  // namespace zil
+
+namespace boost {
+namespace asio {
+
+template <typename Handler, typename Executor>
+struct associated_executor<zil::metrics::TrackedHandler<Handler>, Executor> {
+  using type = typename associated_executor<Handler, Executor>::type;
+
+  static type get(const zil::metrics::TrackedHandler<Handler> &handler,
+                  const Executor &executor = Executor()) noexcept {
+    return associated_executor<Handler, Executor>::get(handler.Inner(),
+                                                       executor);
+  }
+};
+
+template <typename Handler, typename Allocator>
+struct associated_allocator<zil::metrics::TrackedHandler<Handler>, Allocator> {
+  using type = typename associated_allocator<Handler, Allocator>::type;
+
+  static type get(const zil::metrics::TrackedHandler<Handler> &handler,
+                  const Allocator &allocator = Allocator()) noexcept {
+    return associated_allocator<Handler, Allocator>::get(handler.Inner(),
+                                                         allocator);
+  }
+};
+
+template <typename Handler, typename Executor>
+struct associated_executor<zil::metrics::SocketHandler<Handler>, Executor> {
+  using type = typename associated_executor<Handler, Executor>::type;
+
+  static type get(const zil::metrics::SocketHandler<Handler> &handler,
+                  const Executor &executor = Executor()) noexcept {
+    return associated_executor<Handler, Executor>::get(handler.Inner(),
+                                                       executor);
+  }
+};
+
+template <typename Handler, typename Allocator>
+struct associated_allocator<zil::metrics::SocketHandler<Handler>, Allocator> {
+  using type = typename associated_allocator<Handler, Allocator>::type;
+
+  static type get(const zil::metrics::SocketHandler<Handler> &handler,
+                  const Allocator &allocator = Allocator()) noexcept {
+    return associated_allocator<Handler, Allocator>::get(handler.Inner(),
+                                                         allocator);
+  }
+};
+
+}  // namespace asio
+}  // namespace boost
+
+using Z_EXECUTORSTATS = zil::metrics::ExecutorStats;
+using Z_EXECUTOR = zil::metrics::InstrumentedExecutor;
+using Z_HANDLERTAG = zil::metrics::HandlerTag;
+using Z_SOCKETSTATS = zil::metrics::SocketStats;
+using Z_SOCKET = zil::metrics::InstrumentedSocket;
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_ASIO_H_
@@ -24,6 +24,10 @@ namespace zil {
 namespace metrics {
 
 const std::string METRIC_FAMILY{"zilliqa"};
+// Reserved for the instruments libMetrics publishes about itself
+const std::string SELF_METRIC_FAMILY{"zilliqa_otel"};
+// Built-in process collector, see FilterClass::PROCESS
+const std::string PROCESS_METRIC_FAMILY{"zilliqa_process"};
 const std::string METRIC_SCHEMA_VERSION{"1.2.0"};
 const std::string METRIC_SCHEMA{"https://opentelemetry.io/schemas/1.2.0"};
 
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZILLIQA_SRC_LIBMETRICS_FILTERMASK_H_
+#define ZILLIQA_SRC_LIBMETRICS_FILTERMASK_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace zil {
+namespace metrics {
+
+/// Enum name and hierarchical path of a filter class, e.g.
+/// {"EVM_CLIENT_LOW_LEVEL", "EVM.CLIENT.LOW_LEVEL"}
+struct FilterClassName {
+  std::string_view name;
+  std::string_view path;
+};
+
+// Bitset of N filter classes in 64 bit atomic words. Testing a class is one
+// relaxed load of the word at a constant index and a test of a constant bit
+// when the class is known at compile time.
+//
+// Masks are comma separated entries applied in order:
+//
+//   ALL                   every class
+//   EVM_CLIENT            one class by enum name
+//   EVM.CLIENT            a class by path and all the classes below it
+//   ACCOUNTSTORE.*        '*' matches any characters inside one segment
+//   -EVM.CLIENT.LOW_LEVEL clears what the entry matches
+//
+// NONE or an empty mask selects nothing.
+template <size_t N>
+class FilterMask {
+ public:
+  static constexpr size_t WORDS = (N + 63) / 64;
+
+  using Words = std::array<uint64_t, WORDS>;
+  using Classes = std::array<FilterClassName, N>;
+
+  static constexpr size_t Word(size_t index) { return index / 64; }
+
+  static constexpr uint64_t Bit(size_t index) {
+    return uint64_t{1} << (index % 64);
+  }
+
+  bool Test(size_t index) const noexcept {
+    return m_words[Word(index)].load(std::memory_order_relaxed) & Bit(index);
+  }
+
+  Words Load() const noexcept {
+    Words words{};
+    for (size_t i = 0; i < WORDS; ++i) {
+      words[i] = m_words[i].load(std::memory_order_relaxed);
+    }
+    return words;
+  }
+
+  /// Word by word, a concurrent Test sees each word either old or new.
+  /// Returns false if nothing changed.
+  bool Store(const Words &words) noexcept {
+    bool changed = false;
+    for (size_t i = 0; i < WORDS; ++i) {
+      changed |= m_words[i].exchange(words[i], std::memory_order_relaxed) !=
+                 words[i];
+    }
+    return changed;
+  }
+
+  /// Entries matching no class are appended to unmatched if given
+  static Words Parse(std::string_view mask, const Classes &classes,
+                     std::vector<std::string> *unmatched = nullptr) {
+    Words words{};
+    if (mask == "NONE") {
+      return words;
+    }
+
+    while (!mask.empty()) {
+      auto comma = mask.find(',');
+      auto entry = Trim(mask.substr(0, comma));
+      mask = comma == std::string_view::npos ? std::string_view{}
+                                             : mask.substr(comma + 1);
+      if (entry.empty()) {
+        continue;
+      }
+
+      bool clear = entry.front() == '-';
+      if (clear) {
+        entry.remove_prefix(1);
+      }
+
+      bool matched = false;
+      for (size_t i = 0; i < N; ++i) {
+        if (entry == "ALL" || entry == classes[i].name ||
+            MatchPath(entry, classes[i].path)) {
+          matched = true;
+          if (clear) {
+            words[Word(i)] &= ~Bit(i);
+          } else {
+            words[Word(i)] |= Bit(i);
+          }
+        }
+      }
+
+      if (!matched && unmatched) {
+        unmatched->emplace_back(entry);
+      }
+    }
+    return words;
+  }
+
+ private:
+  static std::string_view Trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+      text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) {
+      text.remove_suffix(1);
+    }
+    return text;
+  }
+
+  /// '*' matches any run of characters in text
+  static bool MatchSegment(std::string_view pattern, std::string_view text) {
+    size_t p = 0, t = 0;
+    size_t star = std::string_view::npos, resume = 0;
+    while (t < text.size()) {
+      if (p < pattern.size() && pattern[p] == '*') {
+        star = p++;
+        resume = t;
+      } else if (p < pattern.size() && pattern[p] == text[t]) {
+        ++p;
+        ++t;
+      } else if (star != std::string_view::npos) {
+        p = star + 1;
+        t = ++resume;
+      } else {
+        return false;
+      }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+      ++p;
+    }
+    return p == pattern.size();
+  }
+
+  /// The pattern matches the path or one of its ancestors, segment by
+  /// segment
+  static bool MatchPath(std::string_view pattern, std::string_view path) {
+    while (!pattern.empty()) {
+      if (path.empty()) {
+        return false;
+      }
+      auto p_end = pattern.find('.');
+      auto c_end = path.find('.');
+      if (!MatchSegment(pattern.substr(0, p_end), path.substr(0, c_end))) {
+        return false;
+      }
+      pattern = p_end == std::string_view::npos ? std::string_view{}
+                                                : pattern.substr(p_end + 1);
+      path = c_end == std::string_view::npos ? std::string_view{}
+                                             : path.substr(c_end + 1);
+    }
+    return true;
+  }
+
+  std::array<std::atomic<uint64_t>, WORDS> m_words{};
+};
+
+}  // namespace metrics
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_FILTERMASK_H_
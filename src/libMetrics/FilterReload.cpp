@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "FilterReload.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include "MetricCatalog.h"
+#include "Metrics.h"
+#include "Tracing.h"
+#include "Tracing2.h"
+#include "libUtils/Logger.h"
+
+namespace zil {
+namespace metrics {
+
+namespace {
+
+constexpr char WAKE = 'w';
+constexpr char QUIT = 'q';
+
+// Write end of the watcher pipe, read by the signal handler
+std::atomic<int> g_wakeFd{-1};
+
+void OnSignal(int) {
+  int saved = errno;
+  int fd = g_wakeFd.load(std::memory_order_relaxed);
+  if (fd >= 0) {
+    [[maybe_unused]] auto n = ::write(fd, &WAKE, 1);
+  }
+  errno = saved;
+}
+
+std::string Trim(std::string_view text) {
+  std::string result;
+  std::copy_if(text.begin(), text.end(), std::back_inserter(result),
+               [](unsigned char c) { return !std::isspace(c); });
+  return result;
+}
+
+bool ModificationTime(const std::string &path, timespec &mtime) {
+  struct stat st {};
+  if (::stat(path.c_str(), &st) != 0) {
+    return false;
+  }
+  mtime = st.st_mtim;
+  return true;
+}
+
+class Watcher {
+ public:
+  ~Watcher() { Stop(); }
+
+  bool Start(const std::string &path, std::chrono::milliseconds interval) {
+    Stop();
+
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+      LOG_GENERAL(WARNING, "Cannot watch " << path << ": "
+                                           << std::strerror(errno));
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_read = fds[0];
+    m_write = fds[1];
+    g_wakeFd.store(m_write, std::memory_order_relaxed);
+    m_thread = std::thread([this, path, interval] { Run(path, interval); });
+    MetricCatalog::Set<MetricId::FILTER_FILE_WATCHED>(1);
+    return true;
+  }
+
+  void Stop() {
+    std::thread thread;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_thread.joinable()) {
+        return;
+      }
+      g_wakeFd.store(-1, std::memory_order_relaxed);
+      [[maybe_unused]] auto n = ::write(m_write, &QUIT, 1);
+      thread.swap(m_thread);
+    }
+    thread.join();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ::close(m_read);
+    ::close(m_write);
+    m_read = m_write = -1;
+    MetricCatalog::Set<MetricId::FILTER_FILE_WATCHED>(0);
+  }
+
+ private:
+  void Run(const std::string &path, std::chrono::milliseconds interval) {
+    timespec last{};
+    bool known = ModificationTime(path, last);
+    if (known) {
+      FilterReload::ApplyFile(path);
+    }
+
+    for (;;) {
+      pollfd pfd{m_read, POLLIN, 0};
+      bool forced = false;
+      if (::poll(&pfd, 1, static_cast<int>(interval.count())) > 0) {
+        char buffer[64];
+        ssize_t n = ::read(m_read, buffer, sizeof(buffer));
+        if (n > 0 && std::memchr(buffer, QUIT, n) != nullptr) {
+          return;
+        }
+        forced = n > 0;
+      }
+
+      timespec mtime{};
+      if (!ModificationTime(path, mtime)) {
+        known = false;
+        continue;
+      }
+      if (forced || !known || mtime.tv_sec != last.tv_sec ||
+          mtime.tv_nsec != last.tv_nsec) {
+        last = mtime;
+        known = true;
+        FilterReload::ApplyFile(path);
+      }
+    }
+  }
+
+  std::mutex m_mutex;
+  std::thread m_thread;
+  int m_read = -1;
+  int m_write = -1;
+};
+
+Watcher &GetWatcher() {
+  static Watcher watcher;
+  return watcher;
+}
+
+}  // namespace
+
+bool FilterReload::Apply(std::optional<std::string_view> metrics_mask,
+                         std::optional<std::string_view> trace_mask) {
+  bool changed = false;
+
+  if (metrics_mask && Filter::GetInstance().Reload(*metrics_mask)) {
+    LOG_GENERAL(INFO, "Metrics filter mask set to '" << *metrics_mask << "'");
+    MetricCatalog::Add<MetricId::FILTER_MASK_CHANGES>(1, 0);
+    changed = true;
+  }
+
+  if (trace_mask) {
+    bool trace_changed = zil::trace::Filter::GetInstance().Reload(*trace_mask);
+    trace_changed = zil::trace2::Tracing::SetFilters(*trace_mask) ||
+                    trace_changed;
+    if (trace_changed) {
+      LOG_GENERAL(INFO, "Trace filter mask set to '" << *trace_mask << "'");
+      MetricCatalog::Add<MetricId::FILTER_MASK_CHANGES>(1, 1);
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+bool FilterReload::ApplyFile(const std::string &path) {
+  std::ifstream file(path);
+  if (!file) {
+    LOG_GENERAL(WARNING, "Cannot read filter file " << path);
+    return false;
+  }
+
+  std::optional<std::string> metrics_mask;
+  std::optional<std::string> trace_mask;
+
+  std::string line;
+  while (std::getline(file, line)) {
+    line = Trim(line.substr(0, line.find('#')));
+    if (line.empty()) {
+      continue;
+    }
+
+    auto eq = line.find('=');
+    auto key = line.substr(0, eq);
+    auto value = eq == std::string::npos ? std::string{} : line.substr(eq + 1);
+    if (key == "METRIC_ZILLIQA_MASK") {
+      metrics_mask = std::move(value);
+    } else if (key == "TRACE_ZILLIQA_MASK") {
+      trace_mask = std::move(value);
+    } else {
+      LOG_GENERAL(WARNING, "Unknown key " << key << " in " << path);
+    }
+  }
+
+  Apply(metrics_mask, trace_mask);
+  return true;
+}
+
+bool FilterReload::Watch(const std::string &path,
+                         std::chrono::milliseconds interval) {
+  return GetWatcher().Start(path, interval);
+}
+
+bool FilterReload::HandleSignal(int signal) {
+  struct sigaction action {};
+  action.sa_handler = OnSignal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  return ::sigaction(signal, &action, nullptr) == 0;
+}
+
+void FilterReload::Stop() { GetWatcher().Stop(); }
+
+}  // namespace metrics
+}  // namespace zil
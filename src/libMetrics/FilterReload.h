@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZILLIQA_SRC_LIBMETRICS_FILTERRELOAD_H_
+#define ZILLIQA_SRC_LIBMETRICS_FILTERRELOAD_H_
+
+#include <csignal>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace zil {
+namespace metrics {
+
+// Changes the metrics and trace filter masks of a running node, e.g. to turn
+// on EVM_CLIENT_LOW_LEVEL tracing during an incident without a restart.
+//
+// The filter file has one KEY=VALUE per line, '#' starts a comment:
+//
+//   METRIC_ZILLIQA_MASK=EVM_CLIENT,API_SERVER
+//   TRACE_ZILLIQA_MASK=EVM_CLIENT,EVM_CLIENT_LOW_LEVEL
+//
+// A key that is not in the file leaves its mask as it is, an empty value
+// disables all classes.
+class FilterReload {
+ public:
+  /// Admin call, std::nullopt leaves that mask as it is. Returns true if a
+  /// mask changed.
+  static bool Apply(std::optional<std::string_view> metrics_mask,
+                    std::optional<std::string_view> trace_mask);
+
+  /// Applies a filter file once, false if it cannot be read
+  static bool ApplyFile(const std::string &path);
+
+  /// Applies the file now and whenever its modification time changes,
+  /// checked every interval by a background thread. Replaces a previous
+  /// Watch.
+  static bool Watch(const std::string &path,
+                    std::chrono::milliseconds interval =
+                        std::chrono::milliseconds(1000));
+
+  /// Makes the signal re-apply the watched file immediately, has no effect
+  /// while nothing is watched
+  static bool HandleSignal(int signal = SIGHUP);
+
+  /// Stops the watcher thread, also done at exit
+  static void Stop();
+};
+
+}  // namespace metrics
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_FILTERRELOAD_H_
@@ -0,0 +1,444 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Logging.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef ENABLE_LOGS_PREVIEW
+#include "opentelemetry/exporters/otlp/otlp_grpc_log_record_exporter_factory.h"
+#include "opentelemetry/exporters/otlp/otlp_http_log_record_exporter_factory.h"
+#include "opentelemetry/exporters/otlp/otlp_http_log_record_exporter_options.h"
+#include "opentelemetry/sdk/logs/batch_log_record_processor_factory.h"
+#include "opentelemetry/sdk/logs/batch_log_record_processor_options.h"
+#include "opentelemetry/sdk/logs/logger_provider.h"
+#include "opentelemetry/sdk/resource/resource.h"
+#include "opentelemetry/sdk/version/version.h"
+#endif
+
+#include "Tracing2.h"
+#include "common/Constants.h"
+#include "internal/clock.h"
+#include "internal/logring.h"
+
+namespace zil::logging {
+
+namespace {
+
+constexpr auto POLL_INTERVAL = std::chrono::milliseconds(5);
+
+std::atomic<uint64_t> g_dropped{0};
+
+// Rings of all threads which logged, never destroyed since threads may log
+// during static destruction
+struct Rings {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<LogRing>> rings;
+};
+
+Rings &GetRings() {
+  static auto *rings = new Rings;
+  return *rings;
+}
+
+struct ThreadRing {
+  std::shared_ptr<LogRing> ring = std::make_shared<LogRing>();
+
+  ThreadRing() {
+    auto &rings = GetRings();
+    std::lock_guard<std::mutex> lock(rings.mutex);
+    rings.rings.push_back(ring);
+  }
+
+  ~ThreadRing() { ring->m_closed.store(true, std::memory_order_release); }
+};
+
+LogRing &GetThreadRing() {
+  thread_local ThreadRing threadRing;
+  return *threadRing.ring;
+}
+
+class Sink {
+ public:
+  virtual ~Sink() = default;
+
+  virtual void Write(const Record &record) = 0;
+
+  /// End of a batch
+  virtual void Flush() {}
+
+  /// Returns false if the sink cannot be written any more
+  virtual bool Shutdown() { return true; }
+};
+
+class StreamSink final : public Sink {
+ public:
+  explicit StreamSink(FILE *stream, bool owned = false)
+      : m_stream(stream), m_owned(owned) {}
+
+  ~StreamSink() override {
+    if (m_owned) {
+      std::fclose(m_stream);
+    }
+  }
+
+  void Write(const Record &record) override { FormatRecord(m_line, record); }
+
+  void Flush() override {
+    std::fwrite(m_line.data(), 1, m_line.size(), m_stream);
+    std::fflush(m_stream);
+    m_line.clear();
+  }
+
+ private:
+  FILE *m_stream;
+  bool m_owned;
+  std::string m_line;
+};
+
+#ifdef ENABLE_LOGS_PREVIEW
+
+namespace logs_api = opentelemetry::logs;
+namespace logs_sdk = opentelemetry::sdk::logs;
+namespace otlp = opentelemetry::exporter::otlp;
+
+class OtlpSink final : public Sink {
+ public:
+  explicit OtlpSink(std::unique_ptr<logs_sdk::LogRecordExporter> exporter) {
+    logs_sdk::BatchLogRecordProcessorOptions options;
+    options.max_queue_size = 8192;
+    options.max_export_batch_size = 512;
+    options.schedule_delay_millis = std::chrono::milliseconds(1000);
+
+    auto resource = opentelemetry::sdk::resource::Resource::Create(
+        {{"service.name", "zilliqa-cpp"}});
+    m_provider = std::make_shared<logs_sdk::LoggerProvider>(
+        logs_sdk::BatchLogRecordProcessorFactory::Create(std::move(exporter),
+                                                         options),
+        resource);
+    m_logger = m_provider->GetLogger("zilliqa-cpp", "zilliqa-cpp",
+                                     OPENTELEMETRY_SDK_VERSION);
+  }
+
+  void Write(const Record &record) override {
+    auto log = m_logger->CreateLogRecord();
+    if (!log) {
+      return;
+    }
+    const auto &header = record.header;
+    log->SetTimestamp(std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::nanoseconds(header.timestamp_ns))));
+    log->SetSeverity(ToOtel(header.severity));
+    log->SetBody(opentelemetry::nostd::string_view(record.message));
+    log->SetAttribute("code.filepath", header.file);
+    log->SetAttribute("code.lineno", static_cast<int64_t>(header.line));
+    log->SetAttribute("code.function", header.function);
+    log->SetAttribute("thread.id", static_cast<int64_t>(header.thread));
+    if (HasTraceIds(header)) {
+      log->SetTraceId(opentelemetry::trace::TraceId(
+          opentelemetry::nostd::span<const uint8_t, 16>(header.trace_id, 16)));
+      log->SetSpanId(opentelemetry::trace::SpanId(
+          opentelemetry::nostd::span<const uint8_t, 8>(header.span_id, 8)));
+      log->SetTraceFlags(opentelemetry::trace::TraceFlags(
+          opentelemetry::trace::TraceFlags::kIsSampled));
+    }
+    m_logger->EmitLogRecord(std::move(log));
+  }
+
+  bool Shutdown() override {
+    m_provider->ForceFlush();
+    m_provider->Shutdown();
+    return false;
+  }
+
+ private:
+  static logs_api::Severity ToOtel(Severity severity) {
+    switch (severity) {
+      case Severity::INFO:
+        return logs_api::Severity::kInfo;
+      case Severity::WARNING:
+        return logs_api::Severity::kWarn;
+      case Severity::FATAL:
+        return logs_api::Severity::kFatal;
+    }
+    return logs_api::Severity::kInvalid;
+  }
+
+  std::shared_ptr<logs_sdk::LoggerProvider> m_provider;
+  opentelemetry::nostd::shared_ptr<logs_api::Logger> m_logger;
+};
+
+#endif  // ENABLE_LOGS_PREVIEW
+
+std::unique_ptr<Sink> CreateSink(std::string_view name,
+                                 std::string_view file) {
+  std::string cmp(name.empty() ? LOGGING_ZILLIQA_PROVIDER : name);
+
+  if (cmp == "FILE") {
+    const std::string path(file.empty() ? LOGGING_ZILLIQA_FILE : file);
+    if (FILE *stream = std::fopen(path.c_str(), "a")) {
+      return std::make_unique<StreamSink>(stream, true);
+    }
+    std::fprintf(stderr, "Cannot open log file %s, logging to stdout\n",
+                 path.c_str());
+  }
+#ifdef ENABLE_LOGS_PREVIEW
+  try {
+    if (cmp == "OTLPHTTP") {
+      otlp::OtlpHttpLogRecordExporterOptions options;
+      options.url = "http://" + TRACE_ZILLIQA_HOSTNAME + ":" +
+                    TRACE_ZILLIQA_PORT + "/v1/logs";
+      return std::make_unique<OtlpSink>(
+          otlp::OtlpHttpLogRecordExporterFactory::Create(options));
+    }
+    if (cmp == "OTLPGRPC") {
+      otlp::OtlpGrpcExporterOptions options;
+      options.endpoint = TRACE_ZILLIQA_HOSTNAME + ":" + TRACE_ZILLIQA_GRPC_PORT;
+      return std::make_unique<OtlpSink>(
+          otlp::OtlpGrpcLogRecordExporterFactory::Create(options));
+    }
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "Cannot create %s log exporter, logging to stdout: %s\n",
+                 cmp.c_str(), e.what());
+  }
+#endif
+  return std::make_unique<StreamSink>(stdout);
+}
+
+// The consumer. Leaked on purpose, like Rings, so that logging from static
+// destructors still works; the atexit handler flushes and stops it.
+class Pipeline {
+ public:
+  static Pipeline &GetInstance() {
+    static auto *pipeline = new Pipeline;
+    return *pipeline;
+  }
+
+  void Start(std::string_view sink, std::string_view file, bool replace) {
+    std::lock_guard<std::mutex> lock(m_startMutex);
+    if (m_started.load(std::memory_order_relaxed) && !replace) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> drain(m_drainMutex);
+      DrainLocked();
+      if (m_sink) {
+        m_sink->Shutdown();
+      }
+      m_sink = CreateSink(sink, file);
+    }
+    if (!m_thread.joinable()) {
+      m_stop = false;
+      m_running.store(true, std::memory_order_release);
+      m_thread = std::thread([this] { Run(); });
+    }
+    if (!m_started.exchange(true)) {
+      std::atexit([] { Pipeline::GetInstance().Shutdown(); });
+    }
+  }
+
+  void EnsureStarted() {
+    if (!m_started.load(std::memory_order_acquire)) [[unlikely]] {
+      Start({}, {}, false);
+    }
+  }
+
+  /// False once Shutdown stopped the consumer thread
+  bool Running() const noexcept {
+    return m_running.load(std::memory_order_acquire);
+  }
+
+  void Flush() {
+    std::lock_guard<std::mutex> lock(m_drainMutex);
+    DrainLocked();
+  }
+
+  /// Drains before the next poll, for rings filling up in a burst
+  void Wake() {
+    if (!m_wake.exchange(true, std::memory_order_relaxed)) {
+      m_cv.notify_one();
+    }
+  }
+
+  void Shutdown() {
+    std::lock_guard<std::mutex> lock(m_startMutex);
+    {
+      std::lock_guard<std::mutex> stop(m_mutex);
+      m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) {
+      m_thread.join();
+    }
+    m_running.store(false, std::memory_order_release);
+
+    std::lock_guard<std::mutex> drain(m_drainMutex);
+    DrainLocked();
+    if (m_sink && !m_sink->Shutdown()) {
+      m_sink = std::make_unique<StreamSink>(stdout);
+    }
+  }
+
+ private:
+  Pipeline() = default;
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop) {
+      m_cv.wait_for(lock, POLL_INTERVAL, [this] {
+        return m_stop || m_wake.load(std::memory_order_relaxed);
+      });
+      m_wake.store(false, std::memory_order_relaxed);
+      lock.unlock();
+      Flush();
+      lock.lock();
+    }
+  }
+
+  void DrainLocked() {
+    std::vector<std::shared_ptr<LogRing>> rings;
+    {
+      auto &all = GetRings();
+      std::lock_guard<std::mutex> lock(all.mutex);
+      rings = all.rings;
+    }
+
+    for (auto &ring : rings) {
+      ring->Drain([this](const char *data, uint32_t size) {
+        m_batch.push_back(DecodeRecord(data, size));
+      });
+    }
+
+    if (auto dropped = g_dropped.load(std::memory_order_relaxed);
+        dropped != m_reportedDropped) {
+      Record record{};
+      record.header.timestamp_ns = metrics::RealtimeNs();
+      record.header.file = __FILE__;
+      record.header.function = __FUNCTION__;
+      record.header.line = __LINE__;
+      record.header.thread = LogThreadId();
+      record.header.severity = Severity::WARNING;
+      record.message = std::to_string(dropped - m_reportedDropped) +
+                       " log records dropped, rings full";
+      m_batch.push_back(std::move(record));
+      m_reportedDropped = dropped;
+    }
+
+    if (!m_batch.empty() && m_sink) {
+      std::stable_sort(m_batch.begin(), m_batch.end(),
+                       [](const Record &a, const Record &b) {
+                         return a.header.timestamp_ns < b.header.timestamp_ns;
+                       });
+      for (const auto &record : m_batch) {
+        m_sink->Write(record);
+      }
+      m_sink->Flush();
+    }
+    m_batch.clear();
+
+    // rings of exited threads go once drained
+    auto &all = GetRings();
+    std::lock_guard<std::mutex> lock(all.mutex);
+    std::erase_if(all.rings, [](const std::shared_ptr<LogRing> &ring) {
+      return ring->m_closed.load(std::memory_order_acquire) && ring->Empty();
+    });
+  }
+
+  std::mutex m_startMutex;
+  std::atomic<bool> m_started{false};
+  std::atomic<bool> m_running{false};
+
+  // one consumer at a time: the thread, Flush or a FATAL record
+  std::mutex m_drainMutex;
+  std::unique_ptr<Sink> m_sink;
+  std::vector<Record> m_batch;
+  uint64_t m_reportedDropped = 0;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_stop = false;
+  std::atomic<bool> m_wake{false};
+  std::thread m_thread;
+};
+
+// Pushes records to the ring of the calling thread
+class PipelineBackend final : public LogBackend {
+ public:
+  void ActiveIds(uint8_t (&trace_id)[16],
+                 uint8_t (&span_id)[8]) noexcept override {
+    auto span = trace2::Tracing::GetActiveSpan();
+    if (span.IsRecording()) {
+      std::memcpy(trace_id, span.GetTraceId().Id().data(), sizeof(trace_id));
+      std::memcpy(span_id, span.GetSpanId().Id().data(), sizeof(span_id));
+    }
+  }
+
+  void Write(const char *record, uint32_t size) noexcept override {
+    auto &pipeline = Pipeline::GetInstance();
+    pipeline.EnsureStarted();
+
+    auto &ring = GetThreadRing();
+    if (!ring.Push(record, size)) {
+      g_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (ring.Used() > LogRing::CAPACITY / 2) {
+      pipeline.Wake();
+    }
+
+    // FATAL usually precedes abort(), and after Shutdown nobody else drains
+    RecordWriter::Header header;
+    std::memcpy(&header, record, sizeof(header));
+    if (header.severity == Severity::FATAL || !pipeline.Running()) {
+      pipeline.Flush();
+    }
+  }
+};
+
+}  // namespace
+
+void Logging::Init(std::string_view sink, std::string_view file) {
+  Pipeline::GetInstance().Start(sink, file, true);
+}
+
+void Logging::Flush() { Pipeline::GetInstance().Flush(); }
+
+void Logging::Shutdown() { Pipeline::GetInstance().Shutdown(); }
+
+uint64_t Logging::Dropped() noexcept {
+  return g_dropped.load(std::memory_order_relaxed);
+}
+
+bool Logging::Install() noexcept {
+  // leaked like the pipeline, records may be written during static
+  // destruction
+  static auto *backend = new PipelineBackend;
+  LogControl::SetBackend(backend);
+  return true;
+}
+
+}  // namespace zil::logging
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZILLIQA_SRC_LIBMETRICS_LOGGING_H_
+#define ZILLIQA_SRC_LIBMETRICS_LOGGING_H_
+
+#include <cstdint>
+#include <string_view>
+
+#include "libUtils/LogRecord.h"
+
+namespace zil {
+namespace logging {
+
+// Asynchronous log pipeline behind LOG_GENERAL, the LogBackend of
+// libUtils/LogRecord.h. A log call encodes its arguments in binary into a
+// record and pushes it to a ring owned by the calling thread, nothing is
+// formatted or written on that thread. A consumer thread drains the rings
+// every few ms, formats the records in timestamp order and hands them to
+// the sink: STDOUT, FILE or OTLPHTTP / OTLPGRPC through a batching log
+// record processor.
+//
+// Records carry the trace and span id of the active Tracing2 span of the
+// calling thread. When a ring is full the record is dropped and counted.
+// FATAL records are flushed before the call returns.
+class Logging {
+ public:
+  /// Selects the sink and starts the consumer, the first log call does so
+  /// with the config value if this is not called before.
+  /// \param sink One of STDOUT, FILE, OTLPHTTP or OTLPGRPC. If empty then
+  /// config value is used
+  /// \param file Path of the FILE sink, the config value if empty
+  static void Init(std::string_view sink = {}, std::string_view file = {});
+
+  /// Writes out every record pushed so far
+  static void Flush();
+
+  /// Flushes and stops the consumer, later records are written by the
+  /// thread logging them. Also done at exit.
+  static void Shutdown();
+
+  static void SetLevel(Severity level) noexcept { LogControl::SetLevel(level); }
+
+  static bool Enabled(Severity level) noexcept {
+    return LogControl::Enabled(level);
+  }
+
+  /// Records lost to full rings since start
+  static uint64_t Dropped() noexcept;
+
+  /// Makes the pipeline the LOG_GENERAL backend, see below
+  static bool Install() noexcept;
+};
+
+// Every program including this header links the pipeline and has it
+// installed during static initialization
+inline const bool g_loggingInstalled = Logging::Install();
+
+}  // namespace logging
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_LOGGING_H_
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "MetricCatalog.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <opentelemetry/metrics/provider.h>
+
+#include "Metrics.h"
+
+namespace zil {
+namespace metrics {
+
+namespace {
+
+// Instruments of the catalog entries, replaced on every Publish
+struct Published {
+  std::vector<std::unique_ptr<Observable>> instruments;
+  std::unique_ptr<BatchObservable> batch;
+};
+
+std::mutex g_mutex;
+Published g_published;
+
+// Per cell, {dim_key, index} or empty, built once
+const std::vector<AttributeSetHandle> &CellAttributes() {
+  static const std::vector<AttributeSetHandle> attributes = [] {
+    std::vector<AttributeSetHandle> result(MetricCatalog::CELL_COUNT);
+    for (size_t id = 0; id < MetricCatalog::METRIC_COUNT; ++id) {
+      const auto &d = MetricCatalog::DESCRIPTORS[id];
+      if (d.dim_size <= 1) {
+        continue;
+      }
+      for (size_t dim = 0; dim < d.dim_size; ++dim) {
+        result[MetricCatalog::OFFSETS[id] + dim] = {
+            {d.dim_key, static_cast<int64_t>(dim)}};
+      }
+    }
+    return result;
+  }();
+  return attributes;
+}
+
+}  // namespace
+
+void MetricCatalog::Publish() {
+  auto meter = opentelemetry::metrics::Provider::GetMeterProvider()->GetMeter(
+      METRIC_FAMILY, METRIC_SCHEMA_VERSION, METRIC_SCHEMA);
+
+  Published published;
+  // (id, member) pairs, in catalog order
+  std::vector<std::pair<MetricId, Observable *>> entries;
+
+  // All entries get an instrument, the callback skips the ones of disabled
+  // filter classes so Filter::Reload can switch them on and off
+  for (size_t i = 0; i < METRIC_COUNT; ++i) {
+    const auto &d = DESCRIPTORS[i];
+
+    Observable::observable_t instrument;
+    switch (d.kind) {
+      case MetricKind::I64_COUNTER:
+        instrument =
+            meter->CreateInt64ObservableCounter(d.name, d.description, d.unit);
+        break;
+      case MetricKind::I64_UPDOWN:
+        instrument = meter->CreateInt64ObservableUpDownCounter(
+            d.name, d.description, d.unit);
+        break;
+      case MetricKind::I64_GAUGE:
+        instrument =
+            meter->CreateInt64ObservableGauge(d.name, d.description, d.unit);
+        break;
+      case MetricKind::DOUBLE_GAUGE:
+        instrument =
+            meter->CreateDoubleObservableGauge(d.name, d.description, d.unit);
+        break;
+    }
+
+    published.instruments.emplace_back(
+        new Observable(std::move(instrument), d.name));
+    entries.emplace_back(static_cast<MetricId>(i),
+                         published.instruments.back().get());
+  }
+
+  if (!entries.empty()) {
+    std::vector<Observable *> members;
+    for (const auto &entry : entries) {
+      members.push_back(entry.second);
+    }
+
+    // The whole table in one pass
+    published.batch = std::make_unique<BatchObservable>(std::move(members));
+    published.batch->SetCallback(
+        [entries](BatchObservable::BatchResult &&result) {
+          const auto &attributes = CellAttributes();
+          auto &filter = Filter::GetInstance();
+          for (const auto &[id, member] : entries) {
+            const auto &d = Describe(id);
+            if (!filter.Enabled(d.filter)) {
+              continue;
+            }
+            for (size_t dim = 0; dim < d.dim_size; ++dim) {
+              const auto &cell_attributes = attributes[Index(id, dim)];
+              if (d.kind == MetricKind::DOUBLE_GAUGE) {
+                result.Set(*member, GetDouble(id, dim), cell_attributes);
+              } else {
+                result.Set(*member, Get(id, dim), cell_attributes);
+              }
+            }
+          }
+        });
+  }
+
+  // old callbacks are removed in dtors, outside the lock. The old batch
+  // goes first, see member order.
+  Published old;
+  {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    std::swap(old, g_published);
+    g_published = std::move(published);
+  }
+}
+
+}  // namespace metrics
+}  // namespace zil
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZILLIQA_SRC_LIBMETRICS_METRICCATALOG_H_
+#define ZILLIQA_SRC_LIBMETRICS_METRICCATALOG_H_
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+
+#include "MetricFilters.h"
+
+// Metrics declared once, at compile time. Each entry becomes one atomic cell
+// per dimension value in a static table addressed by a constexpr index, and
+// the whole table is exported by one callback per collection cycle.
+//
+// M(ID, KIND, NAME, UNIT, FILTER, DIM_KEY, DIM_SIZE, DESCRIPTION)
+//
+// KIND is one of I64_COUNTER, I64_UPDOWN, I64_GAUGE, DOUBLE_GAUGE. NAME is
+// prefixed with METRIC_CATALOG_PREFIX. With DIM_SIZE > 1 the cells are
+// reported with the attribute {DIM_KEY, index}, DIM_SIZE 1 has no attribute.
+//
+// To extend the catalog add items together with the code that updates them,
+// names must stay unique.
+#define METRIC_CATALOG_PREFIX "zilliqa_"
+
+#define METRICS_CATALOG(M)                                                  \
+  M(FILTER_MASK_CHANGES, I64_COUNTER, "filter_mask_changes", "changes",     \
+    TELEMETRY_FILTER, "signal", 2,                                          \
+    "Filter masks changed by FilterReload, signal 0 metrics and 1 traces")  \
+  M(FILTER_FILE_WATCHED, I64_GAUGE, "filter_file_watched", "files",         \
+    TELEMETRY_FILTER, "", 1, "1 while FilterReload watches a filter file")
+
+namespace zil {
+namespace metrics {
+
+enum class MetricId : size_t {
+#define ENUM_METRIC_ID(ID, ...) ID,
+  METRICS_CATALOG(ENUM_METRIC_ID)
+#undef ENUM_METRIC_ID
+      METRIC_ID_END
+};
+
+enum class MetricKind { I64_COUNTER, I64_UPDOWN, I64_GAUGE, DOUBLE_GAUGE };
+
+struct MetricDescriptor {
+  MetricKind kind;
+  const char *name;
+  const char *unit;
+  FilterClass filter;
+  const char *dim_key;
+  size_t dim_size;
+  const char *description;
+};
+
+// One cache line per cell, doubles are stored bit cast
+struct alignas(64) MetricCell {
+  std::atomic<int64_t> value{};
+};
+
+class MetricCatalog {
+ public:
+  static constexpr size_t METRIC_COUNT =
+      static_cast<size_t>(MetricId::METRIC_ID_END);
+
+  static constexpr std::array<MetricDescriptor, METRIC_COUNT> DESCRIPTORS{{
+#define DESCRIBE_METRIC(ID, KIND, NAME, UNIT, FILTER, DIM_KEY, DIM_SIZE, \
+                        DESCRIPTION)                                     \
+  {MetricKind::KIND,   METRIC_CATALOG_PREFIX NAME,                       \
+   UNIT,               FilterClass::FILTER,                              \
+   DIM_KEY,            DIM_SIZE,                                         \
+   DESCRIPTION},
+      METRICS_CATALOG(DESCRIBE_METRIC)
+#undef DESCRIBE_METRIC
+  }};
+
+  static constexpr auto OFFSETS = [] {
+    std::array<size_t, METRIC_COUNT + 1> offsets{};
+    for (size_t i = 0; i < METRIC_COUNT; ++i) {
+      offsets[i + 1] = offsets[i] + DESCRIPTORS[i].dim_size;
+    }
+    return offsets;
+  }();
+
+  static constexpr size_t CELL_COUNT = OFFSETS[METRIC_COUNT];
+
+  static constexpr const MetricDescriptor &Describe(MetricId id) {
+    return DESCRIPTORS[static_cast<size_t>(id)];
+  }
+
+  /// Position of (id, dim) in the cell table
+  static constexpr size_t Index(MetricId id, size_t dim = 0) {
+    return OFFSETS[static_cast<size_t>(id)] + dim;
+  }
+
+  template <MetricId ID>
+  static void Add(int64_t value = 1, size_t dim = 0) noexcept {
+    static_assert(Describe(ID).kind != MetricKind::DOUBLE_GAUGE);
+    Cell<ID>(dim).fetch_add(value, std::memory_order_relaxed);
+  }
+
+  template <MetricId ID>
+  static void Sub(int64_t value = 1, size_t dim = 0) noexcept {
+    static_assert(Describe(ID).kind == MetricKind::I64_UPDOWN ||
+                  Describe(ID).kind == MetricKind::I64_GAUGE);
+    Cell<ID>(dim).fetch_sub(value, std::memory_order_relaxed);
+  }
+
+  template <MetricId ID, typename T>
+  static void Set(T value, size_t dim = 0) noexcept {
+    if constexpr (Describe(ID).kind == MetricKind::DOUBLE_GAUGE) {
+      Cell<ID>(dim).store(std::bit_cast<int64_t>(static_cast<double>(value)),
+                          std::memory_order_relaxed);
+    } else {
+      static_assert(Describe(ID).kind != MetricKind::I64_COUNTER);
+      Cell<ID>(dim).store(static_cast<int64_t>(value),
+                          std::memory_order_relaxed);
+    }
+  }
+
+  static int64_t Get(MetricId id, size_t dim = 0) noexcept {
+    return m_cells[Index(id, dim)].value.load(std::memory_order_relaxed);
+  }
+
+  static double GetDouble(MetricId id, size_t dim = 0) noexcept {
+    return std::bit_cast<double>(Get(id, dim));
+  }
+
+  /// (Re)creates the instruments on the current meter provider, entries of
+  /// disabled filter classes report nothing. Called by Metrics::Init
+  static void Publish();
+
+ private:
+  template <MetricId ID>
+  static std::atomic<int64_t> &Cell(size_t dim) noexcept {
+    assert(dim < Describe(ID).dim_size);
+    return m_cells[Index(ID, dim)].value;
+  }
+
+  static inline std::array<MetricCell, CELL_COUNT> m_cells{};
+};
+
+}  // namespace metrics
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_METRICCATALOG_H_
@@ -18,37 +18,52 @@
 #ifndef ZILLIQA_SRC_LIBMETRICS_METRICFILTERS_H_
 #define ZILLIQA_SRC_LIBMETRICS_METRICFILTERS_H_
 
-// Currently maxes out at 64 filters, in order to increase developer should
-// change the type of the mask from uint64_t to uint128_t or uint256_t if
-// the number of filters ever increases beyond 64.
+#include <array>
+
+#include "FilterMask.h"
+
+// Each class has an enum name and a hierarchical path, masks select classes
+// by either, see FilterMask. The number of classes is not limited, the mask
+// grows by one 64 bit word per 64 classes.
 //
 // Do not override the default numbering of these items, the algorithms rely
 // upon these definitions being consecutive, so no assigning new numbers.
 
-// To extend filter classes, you may add items, the total number is limited to
-// 64 (bit mask)
-#define METRICS_FILTER_CLASSES(M) \
-  M(EVM_CLIENT)                   \
-  M(EVM_CLIENT_LOW_LEVEL)         \
-  M(SCILLA_IPC)                   \
-  M(EVM_RPC)                      \
-  M(LOOKUP_SERVER)                \
-  M(MSG_DISPATCH)                 \
-  M(ACCOUNTSTORE_EVM)             \
-  M(ACCOUNTSTORE_SCILLA)          \
-  M(ACCOUNTSTORE_HISTOGRAMS)      \
-  M(TRANSACTION_VERIFY)           \
-  M(CPS)                          \
-  M(API_SERVER)
+// To extend filter classes, you may add items, paths must stay unique
+#define METRICS_FILTER_CLASSES(M)                          \
+  M(EVM_CLIENT, "EVM.CLIENT")                              \
+  M(EVM_CLIENT_LOW_LEVEL, "EVM.CLIENT.LOW_LEVEL")          \
+  M(SCILLA_IPC, "SCILLA.IPC")                              \
+  M(EVM_RPC, "EVM.RPC")                                    \
+  M(LOOKUP_SERVER, "LOOKUP.SERVER")                        \
+  M(MSG_DISPATCH, "NODE.MSG_DISPATCH")                     \
+  M(ACCOUNTSTORE_EVM, "ACCOUNTSTORE.EVM")                  \
+  M(ACCOUNTSTORE_SCILLA, "ACCOUNTSTORE.SCILLA")            \
+  M(ACCOUNTSTORE_HISTOGRAMS, "ACCOUNTSTORE.HISTOGRAMS")    \
+  M(TRANSACTION_VERIFY, "NODE.TRANSACTION_VERIFY")         \
+  M(CPS, "CPS")                                            \
+  M(API_SERVER, "API.SERVER")                              \
+  M(PROCESS, "PROCESS")                                    \
+  M(QUEUE, "QUEUE")                                        \
+  M(TELEMETRY_FILTER, "TELEMETRY.FILTER")
 
 namespace zil {
 namespace metrics {
 enum class FilterClass {
-#define ENUM_FILTER_CLASS(C) C,
+#define ENUM_FILTER_CLASS(C, PATH) C,
   METRICS_FILTER_CLASSES(ENUM_FILTER_CLASS)
 #undef ENUM_FILTER_CLASS
       FILTER_CLASS_END
 };
+
+using MetricsFilterMask =
+    FilterMask<static_cast<size_t>(FilterClass::FILTER_CLASS_END)>;
+
+inline constexpr MetricsFilterMask::Classes METRICS_FILTER_CLASS_NAMES{{
+#define NAME_FILTER_CLASS(C, PATH) {#C, PATH},
+    METRICS_FILTER_CLASSES(NAME_FILTER_CLASS)
+#undef NAME_FILTER_CLASS
+}};
 }  // namespace metrics
 }  // namespace zil
 
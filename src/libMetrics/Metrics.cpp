@@ -17,6 +17,9 @@
 
 #include "Metrics.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <set>
 #include <vector>
 
 #include <boost/algorithm/string.hpp>
@@ -39,7 +42,12 @@
 #include "opentelemetry/sdk/resource/resource.h"
 
 
+#include "MetricCatalog.h"
 #include "common/Constants.h"
+#include "internal/process.h"
+#include "internal/registry.h"
+#include "internal/selftelemetry.h"
+#include "internal/start.h"
 #include "libUtils/Logger.h"
 
 namespace metrics_sdk = opentelemetry::sdk::metrics;
@@ -49,13 +57,84 @@ namespace otlp_exporter = opentelemetry::exporter::otlp;
 
 // The OpenTelemetry Metrics Interface.
 
-Metrics::Metrics() { Init(); }
+namespace {
+
+enum class StartState { NONE, ASYNC, READY };
+
+std::atomic<StartState> g_startState{StartState::NONE};
+std::mutex g_startMutex;
+std::condition_variable g_startCv;
+
+// Observables created while StartAsync runs, rebound by ProviderReady
+std::mutex g_pendingMutex;
+std::set<zil::metrics::Observable *> g_pending;
+
+zil::metrics::StartThread &GetStartThread() {
+  static zil::metrics::StartThread startThread;
+  return startThread;
+}
+
+}  // namespace
+
+Metrics::Metrics(std::string_view provider) { Init(provider); }
+
+void Metrics::StartAsync(std::string_view provider) {
+  bool created = false;
+  GetInstance([&created] {
+    created = true;
+    g_startState.store(StartState::ASYNC, std::memory_order_release);
+    return std::make_shared<Metrics>(Deferred{});
+  });
+  if (!created) {
+    return;
+  }
+
+  GetStartThread().Start([provider = std::string(provider)] {
+    GetInstance().Init(provider);
+  });
+}
+
+bool Metrics::Ready() {
+  auto state = g_startState.load(std::memory_order_acquire);
+  if (state == StartState::NONE) {
+    GetInstance();
+    state = g_startState.load(std::memory_order_acquire);
+  }
+  return state == StartState::READY;
+}
+
+bool Metrics::WaitReady(std::chrono::milliseconds timeout) {
+  if (Ready()) {
+    return true;
+  }
+  std::unique_lock<std::mutex> lock(g_startMutex);
+  return g_startCv.wait_for(lock, timeout, [] {
+    return g_startState.load(std::memory_order_acquire) == StartState::READY;
+  });
+}
+
+void Metrics::ProviderReady() {
+  {
+    std::lock_guard<std::mutex> lock(g_pendingMutex);
+    g_startState.store(StartState::READY, std::memory_order_release);
+    for (auto *observable : g_pending) {
+      observable->Rebind();
+    }
+    g_pending.clear();
+  }
+
+  // counters and histograms replay their pre-buffers on next use
+  zil::metrics::Filter::Invalidate();
+
+  { std::lock_guard<std::mutex> lock(g_startMutex); }
+  g_startCv.notify_all();
+}
 
 
-void Metrics::Init() {
+void Metrics::Init(std::string_view provider) {
   zil::metrics::Filter::GetInstance().init();
 
-  std::string cmp(METRIC_ZILLIQA_PROVIDER);
+  std::string cmp(provider.empty() ? METRIC_ZILLIQA_PROVIDER : provider);
 
   if (cmp == "PROMETHEUS") {
     std::cout << "initialising prometheus" << std::endl;
@@ -72,6 +151,15 @@ void Metrics::Init() {
     LOG_GENERAL(WARNING,"Telemetry provider has defaulted to NOOP provider due to no configuration");
     InitNoop();
   }
+
+  // instruments created from here on belong to the new provider
+  zil::metrics::InstrumentRegistry::GetInstance().Reset();
+
+  zil::metrics::SelfTelemetry::GetInstance().Publish(cmp);
+  zil::metrics::ProcessMetrics::GetInstance().Publish();
+  zil::metrics::MetricCatalog::Publish();
+
+  ProviderReady();
 }
 
 void Metrics::InitNoop() {
@@ -83,8 +171,10 @@ void Metrics::InitNoop() {
 }
 
 void Metrics::InitStdOut() {
-  std::unique_ptr<metrics_sdk::PushMetricExporter> exporter{
-      new metrics_exporter::OStreamMetricExporter};
+  std::unique_ptr<metrics_sdk::PushMetricExporter> exporter =
+      zil::metrics::SelfTelemetry::Wrap(
+          std::unique_ptr<metrics_sdk::PushMetricExporter>{
+              new metrics_exporter::OStreamMetricExporter});
   // Initialize and set the global MeterProvider
   metrics_sdk::PeriodicExportingMetricReaderOptions options;
   options.export_interval_millis =
@@ -125,7 +215,8 @@ void Metrics::InitOTHTTP() {
         opentelemetry::sdk::metrics::AggregationTemporality::kCumulative;
   }
   std::unique_ptr<metrics_sdk::PushMetricExporter> exporter =
-      otlp_exporter::OtlpHttpMetricExporterFactory::Create(options);
+      zil::metrics::SelfTelemetry::Wrap(
+          otlp_exporter::OtlpHttpMetricExporterFactory::Create(options));
 
   opentelemetry::sdk::resource::ResourceAttributes attributes = {
       {"service.name", "zilliqa-daemon"}, {"version", (double)::METRICS_VERSION}};
@@ -169,7 +260,8 @@ void Metrics::InitOtlpGrpc() {
   options.aggregation_temporality =
       opentelemetry::sdk::metrics::AggregationTemporality::kCumulative;
 
-  auto exporter = otlp_exporter::OtlpGrpcMetricExporterFactory::Create(options);
+  auto exporter = zil::metrics::SelfTelemetry::Wrap(
+      otlp_exporter::OtlpGrpcMetricExporterFactory::Create(options));
   std::unique_ptr<metrics_sdk::MetricReader> reader{
       new metrics_sdk::PeriodicExportingMetricReader(std::move(exporter),
                                                      opts)};
@@ -190,8 +282,10 @@ void Metrics::InitPrometheus(
   if (!addr.empty()) {
     opts.url = addr;
   }
-  std::unique_ptr<metrics_sdk::PushMetricExporter> exporter{
-      new metrics_exporter::PrometheusExporter(opts)};
+  std::unique_ptr<metrics_sdk::PushMetricExporter> exporter =
+      zil::metrics::SelfTelemetry::Wrap(
+          std::unique_ptr<metrics_sdk::PushMetricExporter>{
+              new metrics_exporter::PrometheusExporter(opts)});
 
   metrics_sdk::PeriodicExportingMetricReaderOptions options;
 
@@ -220,9 +314,15 @@ void Metrics::InitPrometheus(
 }
 
 void Metrics::Shutdown() {
-  auto p = std::static_pointer_cast<metrics_sdk::MeterProvider>(
+  // a provider still being built by StartAsync is shut down as well
+  GetStartThread().Join();
+
+  // The NOOP provider is not an SDK provider, nothing to flush
+  auto p = std::dynamic_pointer_cast<metrics_sdk::MeterProvider>(
       metrics_api::Provider::GetMeterProvider());
-  p->Shutdown();
+  if (p) {
+    p->Shutdown();
+  }
 }
 
 
@@ -261,48 +361,74 @@ zil::metrics::doubleHistogram_t Metrics::CreateDoubleHistogram(
 
 zil::metrics::Observable Metrics::CreateInt64UpDownMetric(
     const std::string &name, const std::string &desc, std::string unit) {
+  auto full_name = GetFullName(ZILLIQA_METRIC_FAMILY, name);
   return zil::metrics::Observable(
-      GetMeter()->CreateInt64ObservableUpDownCounter(
-          GetFullName(ZILLIQA_METRIC_FAMILY, name), desc, unit));
+      [full_name, desc, unit] {
+        return GetMeter()->CreateInt64ObservableUpDownCounter(full_name, desc, unit);
+      },
+      full_name);
 }
 
 zil::metrics::Observable Metrics::CreateDoubleUpDownMetric(
     const std::string &name, const std::string &desc, std::string unit) {
+  auto full_name = GetFullName(ZILLIQA_METRIC_FAMILY, name);
   return zil::metrics::Observable(
-      GetMeter()->CreateDoubleObservableUpDownCounter(
-          GetFullName(ZILLIQA_METRIC_FAMILY, name), desc, unit));
+      [full_name, desc, unit] {
+        return GetMeter()->CreateDoubleObservableUpDownCounter(full_name, desc, unit);
+      },
+      full_name);
 }
 
 zil::metrics::Observable Metrics::CreateInt64Gauge(const std::string &name,
                                                    const std::string &desc,
                                                    std::string unit) {
-  return zil::metrics::Observable(GetMeter()->CreateInt64ObservableGauge(
-      GetFullName(ZILLIQA_METRIC_FAMILY, name), desc, unit));
+  auto full_name = GetFullName(ZILLIQA_METRIC_FAMILY, name);
+  return zil::metrics::Observable(
+      [full_name, desc, unit] {
+        return GetMeter()->CreateInt64ObservableGauge(full_name, desc, unit);
+      },
+      full_name);
 }
 
 zil::metrics::Observable Metrics::CreateDoubleGauge(const std::string &name,
                                                     const std::string &desc,
                                                     std::string unit) {
-  return zil::metrics::Observable(GetMeter()->CreateDoubleObservableGauge(
-      GetFullName(ZILLIQA_METRIC_FAMILY, name), desc, unit));
+  auto full_name = GetFullName(ZILLIQA_METRIC_FAMILY, name);
+  return zil::metrics::Observable(
+      [full_name, desc, unit] {
+        return GetMeter()->CreateDoubleObservableGauge(full_name, desc, unit);
+      },
+      full_name);
 }
 
 zil::metrics::Observable Metrics::CreateInt64ObservableCounter(
     const std::string &name, const std::string &desc, std::string unit) {
-  return zil::metrics::Observable(GetMeter()->CreateInt64ObservableCounter(
-      GetFullName(ZILLIQA_METRIC_FAMILY, name), desc, unit));
+  auto full_name = GetFullName(ZILLIQA_METRIC_FAMILY, name);
+  return zil::metrics::Observable(
+      [full_name, desc, unit] {
+        return GetMeter()->CreateInt64ObservableCounter(full_name, desc, unit);
+      },
+      full_name);
 }
 
 zil::metrics::Observable Metrics::CreateDoubleObservableCounter(
     const std::string &name, const std::string &desc, std::string unit) {
-  return zil::metrics::Observable(GetMeter()->CreateDoubleObservableCounter(
-      GetFullName(ZILLIQA_METRIC_FAMILY, name), desc, unit));
+  auto full_name = GetFullName(ZILLIQA_METRIC_FAMILY, name);
+  return zil::metrics::Observable(
+      [full_name, desc, unit] {
+        return GetMeter()->CreateDoubleObservableCounter(full_name, desc, unit);
+      },
+      full_name);
 }
 
 void Metrics::AddCounterSumView(const std::string &name,
                                 const std::string &description) {
-  auto p = std::static_pointer_cast<metrics_sdk::MeterProvider>(
+  // Views only exist on an SDK provider, not on NOOP
+  auto p = std::dynamic_pointer_cast<metrics_sdk::MeterProvider>(
       metrics_api::Provider::GetMeterProvider());
+  if (!p) {
+    return;
+  }
   std::shared_ptr<opentelemetry::metrics::Meter> meter =
       p->GetMeter("zilliqa", "1.2.0", METRIC_ZILLIQA_SCHEMA);
   // counter view
@@ -322,6 +448,13 @@ void Metrics::AddCounterSumView(const std::string &name,
 void Metrics::AddCounterHistogramView(const std::string name,
                                       std::vector<double> list,
                                       const std::string &description) {
+  // Views only exist on an SDK provider, not on NOOP
+  auto p = std::dynamic_pointer_cast<metrics_sdk::MeterProvider>(
+      metrics_api::Provider::GetMeterProvider());
+  if (!p) {
+    return;
+  }
+
   // counter view
 
   std::unique_ptr<metrics_sdk::InstrumentSelector>
@@ -348,8 +481,6 @@ void Metrics::AddCounterHistogramView(const std::string name,
       aggregation_config,
   }};
 
-  auto p = std::static_pointer_cast<metrics_sdk::MeterProvider>(
-      metrics_api::Provider::GetMeterProvider());
   p->AddView(std::move(histogram_instrument_selector),
              std::move(histogram_meter_selector), std::move(histogram_view));
 }
@@ -409,16 +540,70 @@ void Observable::Result::SetImpl(double value,
   SetT<double>(m_result, value, attributes);
 }
 
+Observable::Observable(Factory factory, std::string name)
+    : m_name(std::move(name)),
+      m_nameAttribute{
+          {"observable", opentelemetry::nostd::string_view(m_name)}} {
+  // may construct Metrics, so not under g_pendingMutex
+  if (!Metrics::Ready()) {
+    std::lock_guard<std::mutex> lock(g_pendingMutex);
+    if (g_startState.load(std::memory_order_acquire) != StartState::READY) {
+      m_observable = factory();
+      m_factory = std::move(factory);
+      m_deferred = true;
+      g_pending.insert(this);
+    }
+  }
+  if (!m_observable) {
+    m_observable = factory();
+  }
+  assert(m_observable);
+}
+
+void Observable::Rebind() {
+  auto observable = m_factory();
+  m_factory = nullptr;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_callback) {
+    m_observable->RemoveCallback(&Observable::RawCallback, this);
+    observable->AddCallback(&Observable::RawCallback, this);
+  }
+  // the placeholder is released after the lock
+  m_observable.swap(observable);
+}
+
 void Observable::SetCallback(Callback cb) {
   assert(cb);
-  m_callback = std::move(cb);
-  m_observable->AddCallback(&Observable::RawCallback, this);
+  // otherwise RawCallback would be registered twice
+  ResetCallback();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_callback = std::move(cb);
+    m_observable->AddCallback(&Observable::RawCallback, this);
+  }
+  SelfTelemetry::GetInstance().Register(this);
 }
 
-Observable::~Observable() {
-  if (m_callback) {
+void Observable::ResetCallback() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_callback) {
+      return;
+    }
     m_observable->RemoveCallback(&Observable::RawCallback, this);
+    m_callback = nullptr;
+  }
+  SelfTelemetry::GetInstance().Unregister(this);
+}
+
+Observable::~Observable() {
+  if (m_deferred) {
+    // waits for a Rebind in progress
+    std::lock_guard<std::mutex> lock(g_pendingMutex);
+    g_pending.erase(this);
   }
+  ResetCallback();
 }
 
 void Observable::RawCallback(
@@ -427,45 +612,209 @@ void Observable::RawCallback(
   auto *self = static_cast<Observable *>(state);
 
   assert(self->m_callback);
+  auto &telemetry = SelfTelemetry::GetInstance();
+  telemetry.CollectionStarted();
+  auto start = MonotonicNs();
   self->m_callback(Result(observer_result));
+  telemetry.ObservableCalled(*self, MonotonicNs() - start);
 }
 
 namespace {
 
-constexpr uint64_t ALL = std::numeric_limits<uint64_t>::max();
+// Array attributes are not kept
+template <typename Owned>
+bool ToOwned(const common::AttributeValue &value, Owned &owned) {
+  return opentelemetry::nostd::visit(
+      [&owned](const auto &v) {
+        using V = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<V, bool> || std::is_same_v<V, double> ||
+                      std::is_same_v<V, uint64_t>) {
+          owned = v;
+          return true;
+        } else if constexpr (std::is_same_v<V, int32_t> ||
+                             std::is_same_v<V, int64_t>) {
+          owned = static_cast<int64_t>(v);
+          return true;
+        } else if constexpr (std::is_same_v<V, uint32_t>) {
+          owned = static_cast<uint64_t>(v);
+          return true;
+        } else if constexpr (std::is_same_v<V, const char *>) {
+          owned = std::string(v);
+          return true;
+        } else if constexpr (std::is_same_v<V,
+                                            opentelemetry::nostd::string_view>) {
+          owned = std::string(v.data(), v.size());
+          return true;
+        } else {
+          return false;
+        }
+      },
+      value);
+}
 
-void UpdateMetricsMask(uint64_t &mask, const std::string &filter) {
-  if (filter.empty()) {
-    return;
+}  // namespace
+
+AttributeSetHandle::AttributeSetHandle(
+    std::initializer_list<std::pair<std::string_view, common::AttributeValue>>
+        attributes) {
+  size_t count = 0;
+  for (const auto &[key, value] : attributes) {
+    Store(count, {key.data(), key.size()}, value, count);
   }
+  m_attributes.resize(count);
+}
+
+void AttributeSetHandle::Assign(const common::KeyValueIterable &attributes) {
+  size_t count = 0;
+  attributes.ForEachKeyValue(
+      [this, &count](opentelemetry::nostd::string_view key,
+                     common::AttributeValue value) noexcept {
+        Store(count, key, value, count);
+        return true;
+      });
+  m_attributes.resize(count);
+}
 
-  if (filter == "ALL") {
-    mask = ALL;
+void AttributeSetHandle::Store(size_t index,
+                               opentelemetry::nostd::string_view key,
+                               const common::AttributeValue &value,
+                               size_t &count) {
+  if (index == m_attributes.size()) {
+    m_attributes.emplace_back();
+  }
+  auto &attribute = m_attributes[index];
+  if (ToOwned(value, attribute.second)) {
+    attribute.first.assign(key.data(), key.size());
+    ++count;
+  }
+}
+
+bool AttributeSetHandle::ForEachKeyValue(
+    opentelemetry::nostd::function_ref<
+        bool(opentelemetry::nostd::string_view, common::AttributeValue)>
+        callback) const noexcept {
+  for (const auto &[key, value] : m_attributes) {
+    auto attribute = std::visit(
+        [](const auto &v) -> common::AttributeValue {
+          if constexpr (std::is_same_v<std::decay_t<decltype(v)>,
+                                       std::string>) {
+            return opentelemetry::nostd::string_view(v.data(), v.size());
+          } else {
+            return v;
+          }
+        },
+        value);
+    if (!callback(opentelemetry::nostd::string_view(key.data(), key.size()),
+                  attribute)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+BatchObservable::BatchObservable(std::vector<Observable *> members)
+    : m_members(std::move(members)),
+      m_entries(m_members.size()),
+      m_sizes(m_members.size()),
+      m_served(m_members.size(), true) {
+  assert(std::none_of(m_members.begin(), m_members.end(),
+                      [](const Observable *m) { return m == nullptr; }));
+}
+
+BatchObservable::~BatchObservable() {
+  for (auto *member : m_members) {
+    member->ResetCallback();
+  }
+}
+
+void BatchObservable::SetCallback(Callback cb) {
+  assert(cb);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_callback = std::move(cb);
+    std::fill(m_served.begin(), m_served.end(), true);
+  }
+
+  // member callbacks take the SDK lock, so not under m_mutex
+  for (size_t i = 0; i < m_members.size(); ++i) {
+    m_members[i]->SetCallback([this, i](Observable::Result &&result) {
+      Observe(i, std::move(result));
+    });
+  }
+}
+
+void BatchObservable::Observe(size_t member, Observable::Result &&result) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // Every member is called once per collection, whatever the reader, so a
+  // member already served from the snapshot means the next cycle began
+  if (m_served[member]) {
+    std::fill(m_sizes.begin(), m_sizes.end(), 0);
+    std::fill(m_served.begin(), m_served.end(), false);
+    m_callback(BatchResult(*this));
+  }
+  m_served[member] = true;
+
+  const auto &entries = m_entries[member];
+  for (size_t i = 0; i < m_sizes[member]; ++i) {
+    const auto &entry = entries[i];
+    std::visit(
+        [&result, &entry](auto value) {
+          result.Set(value, static_cast<const common::KeyValueIterable &>(
+                                entry.attributes));
+        },
+        entry.value);
+  }
+}
+
+void BatchObservable::BatchResult::SetImpl(
+    const Observable &instrument, std::variant<int64_t, double> value,
+    const common::KeyValueIterable &attributes) {
+  auto &members = m_batch.m_members;
+  auto it = std::find(members.begin(), members.end(), &instrument);
+  if (it == members.end()) {
+    LOG_GENERAL(WARNING, "Instrument is not a member of the batch");
     return;
   }
 
-#define CHECK_FILTER(FILTER)                              \
-  if (filter == #FILTER) {                                \
-    mask |= (1 << static_cast<int>(FilterClass::FILTER)); \
-    return;                                               \
+  size_t member = it - members.begin();
+  auto &entries = m_batch.m_entries[member];
+  auto &size = m_batch.m_sizes[member];
+  if (size == entries.size()) {
+    entries.emplace_back();
   }
 
-  METRICS_FILTER_CLASSES(CHECK_FILTER)
+  // Reuses the strings of the previous cycles
+  auto &entry = entries[size++];
+  entry.value = value;
+  entry.attributes.Assign(attributes);
+}
+
+namespace {
 
-#undef CHECK_FILTER
+MetricsFilterMask::Words ParseMetricsMask(std::string_view mask) {
+  std::vector<std::string> unmatched;
+  auto words =
+      MetricsFilterMask::Parse(mask, METRICS_FILTER_CLASS_NAMES, &unmatched);
+  for (const auto &entry : unmatched) {
+    LOG_GENERAL(WARNING, "Unknown metrics filter class " << entry);
+  }
+  return words;
 }
 
 }  // namespace
 
 void Filter::init() {
-  std::vector<std::string> flags;
-  boost::split(flags, METRIC_ZILLIQA_MASK, boost::is_any_of(","));
-  for (const auto &f : flags) {
-    UpdateMetricsMask(m_mask, f);
-    if (m_mask == ALL) {
-      break;
-    }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_set) {
+    StoreLocked(ParseMetricsMask(METRIC_ZILLIQA_MASK));
   }
 }
 
+bool Filter::Reload(std::string_view mask) {
+  auto words = ParseMetricsMask(mask);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return StoreLocked(words);
+}
+
 }  // namespace zil::metrics
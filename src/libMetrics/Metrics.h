@@ -18,9 +18,16 @@
 #ifndef ZILLIQA_SRC_LIBMETRICS_METRICS_H_
 #define ZILLIQA_SRC_LIBMETRICS_METRICS_H_
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <functional>
 #include <list>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
 
 #include <opentelemetry/metrics/provider.h>
 
@@ -35,6 +42,11 @@ class Metrics;
 namespace zil {
 namespace metrics {
 
+class SelfTelemetry;
+class ProcessMetrics;
+class MetricCatalog;
+class BatchObservable;
+
 namespace common = opentelemetry::common;
 namespace metrics_api = opentelemetry::metrics;
 
@@ -44,6 +56,12 @@ using doubleCounter_t = std::unique_ptr<metrics_api::Counter<double>>;
 using uint64Historgram_t = std::unique_ptr<metrics_api::Histogram<uint64_t>>;
 using doubleHistogram_t = std::unique_ptr<metrics_api::Histogram<double>>;
 
+// Shared by the wrappers of the same name, see InstrumentRegistry
+using uint64CounterHandle_t = std::shared_ptr<metrics_api::Counter<uint64_t>>;
+using doubleCounterHandle_t = std::shared_ptr<metrics_api::Counter<double>>;
+using doubleHistogramHandle_t =
+    std::shared_ptr<metrics_api::Histogram<double>>;
+
 inline auto GetMeter(
     std::shared_ptr<opentelemetry::metrics::MeterProvider> &provider,
     const std::string &family) {
@@ -62,14 +80,89 @@ inline std::string GetFullName(const std::string &family,
 
 class Filter : public Singleton<Filter> {
  public:
+  /// Seeds the mask from METRIC_ZILLIQA_MASK, unless it was set before by
+  /// init, Reload or Store: a mask applied at runtime is kept
   void init();
 
+  /// Replaces the mask with a METRIC_ZILLIQA_MASK style list, may be called
+  /// at any time. Returns false if the mask is unchanged.
+  bool Reload(std::string_view mask);
+
   bool Enabled(FilterClass to_test) {
-    return m_mask & (1 << static_cast<int>(to_test));
+    return m_mask.Test(static_cast<size_t>(to_test));
+  }
+
+  /// Current mask, to be put back later with Store
+  MetricsFilterMask::Words Mask() const noexcept { return m_mask.Load(); }
+
+  /// Replaces the mask, returns false if it is unchanged
+  bool Store(const MetricsFilterMask::Words &words) noexcept {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return StoreLocked(words);
+  }
+
+  /// Bumped on every change of the mask, lets instruments notice that their
+  /// class was switched on or off
+  static uint64_t Generation() noexcept {
+    return m_generation.load(std::memory_order_acquire);
+  }
+
+  /// Bumps the generation without a mask change, so that instruments
+  /// resolve again, e.g. once Metrics::StartAsync is done
+  static void Invalidate() noexcept {
+    m_generation.fetch_add(1, std::memory_order_release);
   }
 
  private:
-  uint64_t m_mask{};
+  bool StoreLocked(const MetricsFilterMask::Words &words) noexcept {
+    m_set = true;
+    if (!m_mask.Store(words)) {
+      return false;
+    }
+    m_generation.fetch_add(1, std::memory_order_release);
+    return true;
+  }
+
+  MetricsFilterMask m_mask;
+  // orders the seeding of init against runtime changes
+  std::mutex m_mutex;
+  bool m_set = false;
+  static inline std::atomic<uint64_t> m_generation{};
+};
+
+// Attributes built once, typically when a callback is registered, and then
+// passed to Observable::Result::Set(value, handle) on every collection. Keys
+// and string values are owned by the set, so reporting a series allocates
+// nothing on our side, unlike the initializer_list overload of Set.
+class AttributeSetHandle final : public common::KeyValueIterable {
+ public:
+  AttributeSetHandle() = default;
+
+  AttributeSetHandle(
+      std::initializer_list<std::pair<std::string_view, common::AttributeValue>>
+          attributes);
+
+  explicit AttributeSetHandle(const common::KeyValueIterable &attributes) {
+    Assign(attributes);
+  }
+
+  /// Replaces the content reusing the storage, array values are dropped
+  void Assign(const common::KeyValueIterable &attributes);
+
+  bool ForEachKeyValue(
+      opentelemetry::nostd::function_ref<
+          bool(opentelemetry::nostd::string_view, common::AttributeValue)>
+          callback) const noexcept override;
+
+  size_t size() const noexcept override { return m_attributes.size(); }
+
+ private:
+  using OwnedValue = std::variant<bool, int64_t, uint64_t, double, std::string>;
+
+  void Store(size_t index, opentelemetry::nostd::string_view key,
+             const common::AttributeValue &value, size_t &count);
+
+  std::vector<std::pair<std::string, OwnedValue>> m_attributes;
 };
 
 class Observable {
@@ -124,6 +217,10 @@ class Observable {
 
   void SetCallback(Callback cb);
 
+  /// Removes the callback if any, the instrument reports nothing until the
+  /// next SetCallback
+  void ResetCallback();
+
   /// Dtor resets callback in compliance to opentelemetry API
   ~Observable();
 
@@ -141,16 +238,125 @@ class Observable {
 
   // for ctor.
   friend Metrics;
+  friend SelfTelemetry;
+  friend ProcessMetrics;
+  friend MetricCatalog;
+
+  using Factory = std::function<observable_t()>;
 
-  Observable(observable_t ob) : m_observable(std::move(ob)) {
+  Observable(observable_t ob, std::string name)
+      : m_observable(std::move(ob)),
+        m_name(std::move(name)),
+        m_nameAttribute{
+            {"observable", opentelemetry::nostd::string_view(m_name)}} {
     assert(m_observable);
   }
 
+  /// While Metrics::StartAsync runs the instrument is created on the
+  /// placeholder provider and kept pending, factory makes the real one
+  Observable(Factory factory, std::string name);
+
+  /// Moves the instrument and callback to the provider built by StartAsync
+  void Rebind();
+
   static void RawCallback(
       opentelemetry::metrics::ObserverResult observer_result, void *state);
 
+  // guards m_observable and m_callback against Rebind
+  std::mutex m_mutex;
   observable_t m_observable;
   Callback m_callback;
+  Factory m_factory;
+  bool m_deferred = false;
+  std::string m_name;
+  // {"observable", m_name}, see SelfTelemetry
+  AttributeSetHandle m_nameAttribute;
+
+  // callback statistics, see SelfTelemetry
+  mutable std::atomic<uint64_t> m_callbackCount{};
+  mutable std::atomic<uint64_t> m_callbackNs{};
+};
+
+// One callback for a group of Observables which are all computed from the
+// same expensive snapshot. The callback runs once per collection cycle, on
+// the first member the SDK collects, and the values it sets are handed out
+// to the other members as the SDK gets to them.
+//
+// Members must outlive the batch, declare it after them.
+class BatchObservable {
+ public:
+  class BatchResult {
+   public:
+    template <class T>
+    void Set(const Observable &instrument, T value,
+             const common::KeyValueIterable &attributes) {
+      if constexpr (std::is_integral_v<T>) {
+        SetImpl(instrument, static_cast<int64_t>(value), attributes);
+      } else {
+        SetImpl(instrument, static_cast<double>(value), attributes);
+      }
+    }
+
+    template <class T, class U,
+              std::enable_if_t<common::detail::is_key_value_iterable<U>::value>
+                  * = nullptr>
+    void Set(const Observable &instrument, T value, const U &attributes) {
+      Set(instrument, value, common::KeyValueIterableView<U>{attributes});
+    }
+
+    template <class T>
+    void Set(
+        const Observable &instrument, T value,
+        std::initializer_list<std::pair<std::string, common::AttributeValue>>
+            attributes) {
+      Set(instrument, value,
+          opentelemetry::nostd::span<
+              const std::pair<std::string, common::AttributeValue>>{
+              attributes.begin(), attributes.end()});
+    }
+
+   private:
+    friend BatchObservable;  // for ctor
+
+    explicit BatchResult(BatchObservable &batch) : m_batch(batch) {}
+
+    void SetImpl(const Observable &instrument, std::variant<int64_t, double> value,
+                 const common::KeyValueIterable &attributes);
+
+    BatchObservable &m_batch;
+  };
+
+  using Callback = std::function<void(BatchResult &&result)>;
+
+  explicit BatchObservable(std::vector<Observable *> members);
+
+  /// Replaces the callbacks of all members
+  void SetCallback(Callback cb);
+
+  /// Resets the callbacks of all members
+  ~BatchObservable();
+
+  BatchObservable(const BatchObservable &) = delete;
+
+  BatchObservable &operator=(const BatchObservable &) = delete;
+
+ private:
+  struct Entry {
+    std::variant<int64_t, double> value;
+    AttributeSetHandle attributes;
+  };
+
+  void Observe(size_t member, Observable::Result &&result);
+
+  std::vector<Observable *> m_members;
+  Callback m_callback;
+
+  std::mutex m_mutex;
+  // Per member, cleared each cycle but the capacity is kept
+  std::vector<std::vector<Entry>> m_entries;
+  std::vector<size_t> m_sizes;
+  // Per member, handed its values of the current snapshot
+  std::vector<bool> m_served;
 };
 
 }  // namespace metrics
@@ -163,7 +369,28 @@ class Observable {
 
 class Metrics : public Singleton<Metrics> {
  public:
-  Metrics();
+  struct Deferred {};
+
+  /// \param provider If empty then config value is used
+  explicit Metrics(std::string_view provider = {});
+
+  /// Constructs without a provider, see StartAsync
+  explicit Metrics(Deferred) {}
+
+  /// Builds the provider on a background thread, so neither startup nor the
+  /// first instrument waits for exporter setup. Until it is ready counters
+  /// and histograms record into bounded pre-buffers which are replayed into
+  /// the real instruments, observables are moved over with their callbacks.
+  /// Does nothing if Metrics is already constructed.
+  /// \param provider If empty then config value is used
+  static void StartAsync(std::string_view provider = {});
+
+  /// True once the provider is built. Constructs Metrics synchronously, as
+  /// any first use did before, unless StartAsync was called.
+  static bool Ready();
+
+  /// Waits for StartAsync, returns false on timeout
+  static bool WaitReady(std::chrono::milliseconds timeout);
 
   std::string Version() { return "Initial"; }
 
@@ -202,10 +429,15 @@ class Metrics : public Singleton<Metrics> {
   zil::metrics::Observable CreateDoubleObservableCounter(
       const std::string &name, const std::string &desc, std::string unit = "");
 
+  /// Builds the meter provider.
+  /// \param provider One of PROMETHEUS, OTLPHTTP, OTLPGRPC, STDOUT or NOOP.
+  /// If empty then config value is used
+  void Init(std::string_view provider = {});
+
   /// Called on main() exit explicitly
-  void Init();
   void Shutdown();
 
+  /// Views are only added to an SDK provider, nothing is done under NOOP
   void AddCounterSumView(const std::string &name,
                          const std::string &description);
 
@@ -218,6 +450,10 @@ class Metrics : public Singleton<Metrics> {
 
   friend class api_test;
 
+  /// Called at the end of Init, rebinds the pending observables and makes
+  /// the buffered instruments switch to the real provider
+  static void ProviderReady();
+
   void InitPrometheus(const std::string &addr);
 
   void InitOTHTTP();
@@ -0,0 +1,478 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "Profiler.h"
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "libUtils/Logger.h"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace zil::trace {
+
+namespace {
+
+constexpr uint32_t MAX_FRAMES = 58;
+
+constexpr uint32_t SPAN_DEPTH = 32;
+constexpr uint64_t RING_SIZE = 256;
+
+struct Sample {
+  uint32_t frames;
+  uint8_t name_size;
+  char name[43];
+  void *pcs[MAX_FRAMES];
+};
+static_assert(sizeof(Sample) == 512);
+
+// Written by the thread itself and read by its signal handler, so plain
+// fields ordered by signal fences
+struct SpanEntry {
+  char name[47];
+  uint8_t size;
+  uint32_t samples;
+};
+
+struct SpanStack {
+  uint32_t depth;
+  SpanEntry entries[SPAN_DEPTH];
+};
+
+// Samples of one thread, the handler produces and the aggregator consumes
+struct ThreadProfile {
+  pid_t tid = 0;
+  pthread_t thread{};
+  // bounds of the thread's stack, the frame pointer walk stays within
+  uintptr_t stackLow = 0;
+  uintptr_t stackHigh = 0;
+  timer_t timer{};
+  bool armed = false;
+  std::atomic<uint64_t> head{0};
+  std::atomic<uint64_t> tail{0};
+  std::unique_ptr<Sample[]> samples;
+};
+
+// Trivially constructed, so the handler can read them
+thread_local SpanStack t_spans;
+thread_local ThreadProfile *t_profile = nullptr;
+
+std::atomic<bool> g_running{false};
+std::atomic<unsigned> g_hz{0};
+std::atomic<uint64_t> g_dropped{0};
+
+void *InterruptedPc(void *context) noexcept {
+  [[maybe_unused]] auto *uc = static_cast<ucontext_t *>(context);
+#if defined(__x86_64__)
+  return reinterpret_cast<void *>(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__aarch64__)
+  return reinterpret_cast<void *>(uc->uc_mcontext.pc);
+#else
+  return nullptr;
+#endif
+}
+
+uintptr_t InterruptedFp(void *context) noexcept {
+  [[maybe_unused]] auto *uc = static_cast<ucontext_t *>(context);
+#if defined(__x86_64__)
+  return static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_RBP]);
+#elif defined(__aarch64__)
+  return static_cast<uintptr_t>(uc->uc_mcontext.regs[29]);
+#else
+  return 0;
+#endif
+}
+
+// Walks the frame pointer chain of the interrupted code: a frame starts with
+// the caller's frame pointer followed by the return address. Only reads
+// memory of the thread's stack, so it is async signal safe, unlike
+// backtrace(). Frames of code built without frame pointers are skipped
+// along with their callers up to the next frame that has one.
+uint32_t Unwind(const ThreadProfile &profile, void *context,
+                void *(&pcs)[MAX_FRAMES]) noexcept {
+  uint32_t frames = 0;
+  pcs[frames++] = InterruptedPc(context);
+
+  uintptr_t fp = InterruptedFp(context);
+  while (frames < MAX_FRAMES && fp % sizeof(uintptr_t) == 0 &&
+         fp >= profile.stackLow &&
+         fp + 2 * sizeof(uintptr_t) <= profile.stackHigh) {
+    const auto *frame = reinterpret_cast<const uintptr_t *>(fp);
+    if (frame[1] == 0) {
+      break;
+    }
+    pcs[frames++] = reinterpret_cast<void *>(frame[1]);
+    // callers are further up the stack
+    if (frame[0] <= fp) {
+      break;
+    }
+    fp = frame[0];
+  }
+  return frames;
+}
+
+void OnSample(int, siginfo_t *, void *context) {
+  const int saved = errno;
+  ThreadProfile *profile = t_profile;
+  if (profile != nullptr && profile->samples) {
+    const uint64_t head = profile->head.load(std::memory_order_relaxed);
+    if (head - profile->tail.load(std::memory_order_acquire) < RING_SIZE) {
+      Sample &sample = profile->samples[head % RING_SIZE];
+      sample.frames = Unwind(*profile, context, sample.pcs);
+
+      const uint32_t depth = t_spans.depth;
+      std::atomic_signal_fence(std::memory_order_acquire);
+      if (depth == 0) {
+        sample.name_size = 0;
+      } else {
+        SpanEntry &span = t_spans.entries[std::min(depth, SPAN_DEPTH) - 1];
+        sample.name_size = std::min<uint8_t>(span.size, sizeof(sample.name));
+        std::memcpy(sample.name, span.name, sample.name_size);
+        if (depth <= SPAN_DEPTH) {
+          ++span.samples;
+        }
+      }
+      profile->head.store(head + 1, std::memory_order_release);
+    } else {
+      g_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  errno = saved;
+}
+
+class Profiles {
+ public:
+  // Never destroyed, threads may unregister after static destruction
+  static Profiles &GetInstance() {
+    static Profiles *profiles = new Profiles;
+    return *profiles;
+  }
+
+  void Register(ThreadProfile *profile) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_threads.push_back(profile);
+    if (g_running.load(std::memory_order_relaxed)) {
+      Arm(*profile);
+    }
+  }
+
+  void Unregister(ThreadProfile *profile) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Disarm(*profile);
+    Drain(*profile);
+    m_threads.erase(std::find(m_threads.begin(), m_threads.end(), profile));
+  }
+
+  bool Start(unsigned hz) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (g_running.load(std::memory_order_relaxed) || hz == 0) {
+      return false;
+    }
+
+    struct sigaction action {};
+    action.sa_sigaction = OnSample;
+    action.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &m_previous) != 0) {
+      return false;
+    }
+
+    g_hz.store(hz, std::memory_order_relaxed);
+    g_running.store(true, std::memory_order_relaxed);
+    for (ThreadProfile *profile : m_threads) {
+      Arm(*profile);
+    }
+    m_stop = false;
+    m_aggregator = std::thread([this] { Aggregate(); });
+    return true;
+  }
+
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!g_running.load(std::memory_order_relaxed)) {
+        return;
+      }
+      g_running.store(false, std::memory_order_relaxed);
+      for (ThreadProfile *profile : m_threads) {
+        Disarm(*profile);
+      }
+      // deleting the timers discarded their pending signals
+      sigaction(SIGPROF, &m_previous, nullptr);
+      m_stop = true;
+    }
+    m_wake.notify_all();
+    m_aggregator.join();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    DrainAll();
+    const uint64_t dropped = g_dropped.exchange(0);
+    if (dropped > 0) {
+      LOG_GENERAL(WARNING, "Profiler dropped " << dropped << " samples");
+    }
+  }
+
+  void Reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    DrainAll();
+    m_stacks.clear();
+  }
+
+  bool WriteFolded(const std::string &path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    DrainAll();
+
+    // pcs within the same functions fold into one line
+    std::map<std::string, uint64_t> folded;
+    for (const auto &[stack, count] : m_stacks) {
+      const auto &[name, pcs] = stack;
+      std::string line = name.empty() ? "-" : name;
+      // outermost frame first, return addresses point after the call
+      for (size_t i = pcs.size(); i-- > 0;) {
+        line += ';';
+        line += Symbol(i == 0 ? pcs[i] : static_cast<char *>(pcs[i]) - 1);
+      }
+      folded[line] += count;
+    }
+
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+      return false;
+    }
+    for (const auto &[line, count] : folded) {
+      out << line << ' ' << count << '\n';
+    }
+    out.flush();
+    return static_cast<bool>(out);
+  }
+
+ private:
+  Profiles() = default;
+
+  void Arm(ThreadProfile &profile) {
+    if (!profile.samples) {
+      profile.samples = std::make_unique<Sample[]>(RING_SIZE);
+    }
+
+    clockid_t clock;
+    if (pthread_getcpuclockid(profile.thread, &clock) != 0) {
+      return;
+    }
+    sigevent event{};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = profile.tid;
+    if (timer_create(clock, &event, &profile.timer) != 0) {
+      LOG_GENERAL(WARNING, "Cannot create profiler timer of thread "
+                               << profile.tid << ": " << std::strerror(errno));
+      return;
+    }
+    profile.armed = true;
+
+    const long interval = 1000000000L / g_hz.load(std::memory_order_relaxed);
+    itimerspec spec{};
+    spec.it_interval.tv_sec = interval / 1000000000L;
+    spec.it_interval.tv_nsec = interval % 1000000000L;
+    spec.it_value = spec.it_interval;
+    timer_settime(profile.timer, 0, &spec, nullptr);
+  }
+
+  void Disarm(ThreadProfile &profile) {
+    if (profile.armed) {
+      timer_delete(profile.timer);
+      profile.armed = false;
+    }
+  }
+
+  void Drain(ThreadProfile &profile) {
+    if (!profile.samples) {
+      return;
+    }
+    uint64_t tail = profile.tail.load(std::memory_order_relaxed);
+    const uint64_t head = profile.head.load(std::memory_order_acquire);
+    for (; tail != head; ++tail) {
+      const Sample &sample = profile.samples[tail % RING_SIZE];
+      ++m_stacks[{std::string(sample.name, sample.name_size),
+                  std::vector<void *>(sample.pcs,
+                                      sample.pcs + sample.frames)}];
+    }
+    profile.tail.store(tail, std::memory_order_release);
+  }
+
+  void DrainAll() {
+    for (ThreadProfile *profile : m_threads) {
+      Drain(*profile);
+    }
+  }
+
+  void Aggregate() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop) {
+      m_wake.wait_for(lock, std::chrono::milliseconds(100));
+      DrainAll();
+    }
+  }
+
+  const std::string &Symbol(void *pc) {
+    auto it = m_symbols.find(pc);
+    if (it != m_symbols.end()) {
+      return it->second;
+    }
+
+    std::string symbol;
+    Dl_info info{};
+    if (dladdr(pc, &info) != 0 && info.dli_sname != nullptr) {
+      int status = 0;
+      char *demangled =
+          abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+      symbol = status == 0 ? demangled : info.dli_sname;
+      std::free(demangled);
+    } else {
+      char buffer[32];
+      const auto offset = reinterpret_cast<uintptr_t>(pc) -
+                          reinterpret_cast<uintptr_t>(info.dli_fbase);
+      std::snprintf(buffer, sizeof(buffer), "+0x%zx", offset);
+      const char *module = info.dli_fname != nullptr
+                               ? std::strrchr(info.dli_fname, '/')
+                               : nullptr;
+      symbol = std::string(module != nullptr ? module + 1 : "?") + buffer;
+    }
+    // ';' separates the frames of folded stacks
+    std::replace(symbol.begin(), symbol.end(), ';', ':');
+    return m_symbols.emplace(pc, std::move(symbol)).first->second;
+  }
+
+  std::mutex m_mutex;
+  std::vector<ThreadProfile *> m_threads;
+  // (span name, innermost frame first) -> samples
+  std::map<std::pair<std::string, std::vector<void *>>, uint64_t> m_stacks;
+  std::unordered_map<void *, std::string> m_symbols;
+  std::thread m_aggregator;
+  std::condition_variable m_wake;
+  bool m_stop = false;
+  // SIGPROF disposition before Start, restored by Stop
+  struct sigaction m_previous {};
+};
+
+// Registration of the thread, undone at its exit
+class Registration {
+ public:
+  Registration() {
+    m_profile.tid = static_cast<pid_t>(::syscall(SYS_gettid));
+    m_profile.thread = pthread_self();
+    pthread_attr_t attr;
+    if (pthread_getattr_np(m_profile.thread, &attr) == 0) {
+      void *address = nullptr;
+      size_t size = 0;
+      if (pthread_attr_getstack(&attr, &address, &size) == 0) {
+        m_profile.stackLow = reinterpret_cast<uintptr_t>(address);
+        m_profile.stackHigh = m_profile.stackLow + size;
+      }
+      pthread_attr_destroy(&attr);
+    }
+    Profiles::GetInstance().Register(&m_profile);
+    t_profile = &m_profile;
+  }
+
+  ~Registration() {
+    t_profile = nullptr;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    Profiles::GetInstance().Unregister(&m_profile);
+  }
+
+ private:
+  ThreadProfile m_profile;
+};
+
+}  // namespace
+
+bool Profiler::Start(unsigned hz) {
+  if (!Profiles::GetInstance().Start(hz)) {
+    return false;
+  }
+  LOG_GENERAL(INFO, "Profiler started at " << hz << " Hz");
+  return true;
+}
+
+void Profiler::Stop() { Profiles::GetInstance().Stop(); }
+
+bool Profiler::Running() noexcept {
+  return g_running.load(std::memory_order_relaxed);
+}
+
+void Profiler::Reset() { Profiles::GetInstance().Reset(); }
+
+bool Profiler::WriteFolded(const std::string &path) {
+  return Profiles::GetInstance().WriteFolded(path);
+}
+
+void Profiler::RegisterThread() {
+  static thread_local Registration registration;
+}
+
+void Profiler::PushSpan(std::string_view name) noexcept {
+  const uint32_t depth = t_spans.depth;
+  if (depth < SPAN_DEPTH) {
+    SpanEntry &span = t_spans.entries[depth];
+    span.size = static_cast<uint8_t>(std::min(name.size(), sizeof(span.name)));
+    std::memcpy(span.name, name.data(), span.size);
+    span.samples = 0;
+  }
+  std::atomic_signal_fence(std::memory_order_release);
+  t_spans.depth = depth + 1;
+}
+
+double Profiler::InnermostSpanCpuMs() noexcept {
+  const uint32_t depth = t_spans.depth;
+  const unsigned hz = g_hz.load(std::memory_order_relaxed);
+  if (depth == 0 || depth > SPAN_DEPTH || !Running()) {
+    return 0;
+  }
+  return t_spans.entries[depth - 1].samples * 1000.0 / hz;
+}
+
+void Profiler::PopSpan() noexcept {
+  if (t_spans.depth > 0) {
+    --t_spans.depth;
+  }
+  std::atomic_signal_fence(std::memory_order_release);
+}
+
+}  // namespace zil::trace
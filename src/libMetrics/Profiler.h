@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_PROFILER_H_
+#define ZILLIQA_SRC_LIBMETRICS_PROFILER_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace zil {
+namespace trace {
+
+// Sampling CPU profiler that knows about Tracing2 spans. Every registered
+// thread gets a SIGPROF timer on its own CPU clock; the handler walks the
+// frame pointer chain and takes the name of the innermost Tracing2 span of
+// the thread, which the span stack keeps in a signal safe copy. A background thread folds the
+// samples per span name, WriteFolded writes them for flamegraph.pl or
+// speedscope with the span name as the root frame ("-" outside spans).
+// Spans ending while the profiler runs get a profile.cpu_ms attribute with
+// the CPU time sampled while they were innermost.
+//
+// Threads starting a Tracing2 span while the profiler runs register
+// themselves, others can call RegisterThread. Build with
+// -fno-omit-frame-pointer for complete stacks. Function names come from the
+// dynamic symbol table, so link executables with -rdynamic to see more than
+// addresses.
+class Profiler {
+ public:
+  /// Starts sampling at hz per CPU second of every registered thread
+  /// \return false if already running or the timers cannot be created
+  static bool Start(unsigned hz = 99);
+
+  /// Stops sampling and restores the SIGPROF disposition from before Start,
+  /// the samples are kept until Reset
+  static void Stop();
+
+  static bool Running() noexcept;
+
+  /// Drops the samples taken so far
+  static void Reset();
+
+  /// Writes "<span name>;<outermost frame>;...;<innermost frame> <count>"
+  /// lines, false if the file cannot be written
+  static bool WriteFolded(const std::string &path);
+
+  /// Makes the calling thread a sampled one, it unregisters at exit
+  static void RegisterThread();
+
+  // Span stack of the thread as the signal handler sees it, used by Tracing2
+
+  static void PushSpan(std::string_view name) noexcept;
+
+  /// \return CPU ms sampled while the span was innermost, 0 if not running
+  static double InnermostSpanCpuMs() noexcept;
+
+  static void PopSpan() noexcept;
+};
+
+}  // namespace trace
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_PROFILER_H_
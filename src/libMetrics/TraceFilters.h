@@ -18,34 +18,47 @@
 #ifndef ZILLIQA_SRC_LIBMETRICS_TRACEFILTERS_H_
 #define ZILLIQA_SRC_LIBMETRICS_TRACEFILTERS_H_
 
-// Currently maxes out at 64 filters, in order to increase developer should
-// change the type of the mask from uint64_t to uint128_t or uint256_t if
-// the number of filters ever increases beyond 64.
+#include <array>
+
+#include "FilterMask.h"
+
+// Shared by zil::trace and zil::trace2. Each class has an enum name and a
+// hierarchical path, masks select classes by either, see FilterMask. The
+// number of classes is not limited.
 //
 // Do not override the default numbering of these items, the algorithms rely
 // upon these definitions being consecutive, so no assigning new numbers.
 
-// To extend filter classes, you may add items, the total number is limited to
-// 64 (bit mask)
-#define TRACE_FILTER_CLASSES(T) \
-  T(EVM_CLIENT)                 \
-  T(EVM_CLIENT_LOW_LEVEL)       \
-  T(SCILLA_PROCESSING)          \
-  T(SCILLA_IPC)                 \
-  T(EVM_RPC)                    \
-  T(LOOKUP_SERVER)              \
-  T(QUEUE)                      \
-  T(ACC_EVM)                    \
-  T(NODE)                       \
-  T(ACC_HISTOGRAM)
+// To extend filter classes, you may add items, paths must stay unique
+#define TRACE_FILTER_CLASSES(T)                       \
+  T(EVM_CLIENT, "EVM.CLIENT")                         \
+  T(EVM_CLIENT_LOW_LEVEL, "EVM.CLIENT.LOW_LEVEL")     \
+  T(SCILLA_PROCESSING, "SCILLA.PROCESSING")           \
+  T(SCILLA_IPC, "SCILLA.IPC")                         \
+  T(EVM_RPC, "EVM.RPC")                               \
+  T(LOOKUP_SERVER, "LOOKUP.SERVER")                   \
+  T(QUEUE, "QUEUE")                                   \
+  T(ACC_EVM, "ACCOUNTSTORE.EVM")                      \
+  T(NODE, "NODE")                                     \
+  T(ACC_HISTOGRAM, "ACCOUNTSTORE.HISTOGRAM")
+
 namespace zil {
 namespace trace {
 enum class FilterClass {
-#define ENUM_FILTER_CLASS(C) C,
+#define ENUM_FILTER_CLASS(C, PATH) C,
   TRACE_FILTER_CLASSES(ENUM_FILTER_CLASS)
 #undef ENUM_FILTER_CLASS
       FILTER_CLASS_END
 };
+
+using TraceFilterMask = zil::metrics::FilterMask<static_cast<size_t>(
+    FilterClass::FILTER_CLASS_END)>;
+
+inline constexpr TraceFilterMask::Classes TRACE_FILTER_CLASS_NAMES{{
+#define NAME_FILTER_CLASS(C, PATH) {#C, PATH},
+    TRACE_FILTER_CLASSES(NAME_FILTER_CLASS)
+#undef NAME_FILTER_CLASS
+}};
 }  // namespace trace
 }  // namespace zil
 
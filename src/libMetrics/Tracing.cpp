@@ -17,6 +17,8 @@
 
 #include "Tracing.h"
 
+#include <mutex>
+
 #include <opentelemetry/exporters/otlp/otlp_grpc_exporter_options.h>
 #include <opentelemetry/sdk/trace/tracer_context_factory.h>
 #include <boost/algorithm/string.hpp>
@@ -32,6 +34,10 @@
 
 #include "TraceFilters.h"
 #include "common/Constants.h"
+#include "internal/perfetto.h"
+#include "internal/selftelemetry.h"
+#include "internal/spanlog.h"
+#include "internal/start.h"
 #include "libUtils/Logger.h"
 
 namespace trace_api = opentelemetry::trace;
@@ -48,8 +54,28 @@ const char* appname = program_invocation_name;
 const char* appname = "?";
 #endif
 
+namespace {
+
+// joined by Shutdown, or at exit if that is never called
+zil::metrics::StartThread g_startThread;
+
+}  // namespace
+
 Tracing::Tracing() { Init(); }
 
+void Tracing::StartAsync() {
+  bool created = false;
+  GetInstance([&created] {
+    created = true;
+    return std::make_shared<Tracing>(Deferred{});
+  });
+  if (!created) {
+    return;
+  }
+
+  g_startThread.Start([] { GetInstance().Init(); });
+}
+
 void Tracing::Init() {
   if (not TRACE_ZILLIQA_MASK.empty() and TRACE_ZILLIQA_MASK != "NONE") {
     zil::trace::Filter::GetInstance().init();
@@ -60,6 +86,10 @@ void Tracing::Init() {
     OtlpHTTPInit();
   } else if (cmp == "STDOUT") {
     StdOutInit();
+  } else if (cmp == "FILE_PERFETTO") {
+    PerfettoInit();
+  } else if (cmp == "FILE_SPANLOG") {
+    SpanLogInit();
   } else {
     LOG_GENERAL(WARNING, "Telemetry provider has defaulted to NOOP provider due to no configuration");
     NoopInit();
@@ -93,8 +123,7 @@ void Tracing::OtlpHTTPInit() {
 
   auto resource = resource::Resource::Create(attributes);
   // Create OTLP exporter instance
-  auto exporter = otlp::OtlpHttpExporterFactory::Create(opts);
-  auto processor = opentelemetry::sdk::trace::SimpleSpanProcessorFactory::Create(std::move(exporter));
+  auto processor = zil::metrics::SelfTelemetry::CreateSpanProcessor(otlp::OtlpHttpExporterFactory::Create(opts));
   std::vector<std::unique_ptr<opentelemetry::sdk::trace::SpanProcessor>> processors;
   processors.push_back(std::move(processor));
   // Default is an always-on sampler.
@@ -113,16 +142,50 @@ void Tracing::OtlpHTTPInit() {
 
 void Tracing::InitOtlpGrpc() {
   opentelemetry::exporter::otlp::OtlpGrpcExporterOptions opts;
-  auto exporter = otlp::OtlpGrpcExporterFactory::Create(opts);
-  auto processor = trace_sdk::SimpleSpanProcessorFactory::Create(std::move(exporter));
+  auto processor = zil::metrics::SelfTelemetry::CreateSpanProcessor(otlp::OtlpGrpcExporterFactory::Create(opts));
   std::shared_ptr<opentelemetry::trace::TracerProvider> provider = trace_sdk::TracerProviderFactory::Create(std::move(processor));
   // Set the global trace provider
   opentelemetry::trace::Provider::SetTracerProvider(provider);
 }
 
+void Tracing::PerfettoInit() {
+  auto processor = zil::trace::CreatePerfettoProcessor(TRACE_ZILLIQA_PERFETTO_FILE);
+  resource::ResourceAttributes attributes = {{"service.name", "zilliqa-cpp"}, {"version", (uint32_t)1}};
+  auto resource = resource::Resource::Create(attributes);
+  std::shared_ptr<opentelemetry::trace::TracerProvider> provider =
+      trace_sdk::TracerProviderFactory::Create(std::move(processor), resource);
+
+  trace_api::Provider::SetTracerProvider(provider);
+}
+
+void Tracing::SpanLogInit() {
+  zil::trace::SpanLogOptions options;
+  options.directory = TRACE_ZILLIQA_SPANLOG_DIR;
+  options.segment_size = TRACE_ZILLIQA_SPANLOG_SEGMENT_MB << 20;
+  options.max_segments = TRACE_ZILLIQA_SPANLOG_SEGMENTS;
+  options.compress = TRACE_ZILLIQA_SPANLOG_ZSTD;
+
+  std::unique_ptr<opentelemetry::sdk::trace::SpanProcessor> processor;
+  try {
+    processor = zil::metrics::SelfTelemetry::CreateSpanProcessor(zil::trace::CreateSpanLogExporter(options));
+  } catch (const std::exception &e) {
+    LOG_GENERAL(WARNING, "Span log unavailable: " << e.what());
+    NoopInit();
+    return;
+  }
+
+  std::string nice_name{appname};
+  nice_name += ":" + Naming::GetInstance().name();
+  resource::ResourceAttributes attributes = {{"service.name", nice_name}, {"version", (uint32_t)1}};
+  auto resource = resource::Resource::Create(attributes);
+  std::shared_ptr<opentelemetry::trace::TracerProvider> provider =
+      trace_sdk::TracerProviderFactory::Create(std::move(processor), resource);
+
+  trace_api::Provider::SetTracerProvider(provider);
+}
+
 void Tracing::StdOutInit() {
-  auto exporter = trace_exporter::OStreamSpanExporterFactory::Create();
-  auto processor = trace_sdk::SimpleSpanProcessorFactory::Create(std::move(exporter));
+  auto processor = zil::metrics::SelfTelemetry::CreateSpanProcessor(trace_exporter::OStreamSpanExporterFactory::Create());
   resource::ResourceAttributes attributes = {{"service.name", "zilliqa-cpp"}, {"version", (uint32_t)1}};
   auto resource = resource::Resource::Create(attributes);
   std::shared_ptr<opentelemetry::trace::TracerProvider> provider =
@@ -143,6 +206,8 @@ std::shared_ptr<trace_api::Tracer> Tracing::get_tracer() {
 }
 
 void Tracing::Shutdown() {
+  g_startThread.Join();
+
   std::shared_ptr<opentelemetry::trace::TracerProvider> provider(new opentelemetry::trace::NoopTracerProvider());
 
   // Set the global tracer provider
@@ -151,38 +216,32 @@ void Tracing::Shutdown() {
 
 namespace zil::trace {
 namespace {
-constexpr uint64_t ALL = std::numeric_limits<uint64_t>::max();
-
-void UpdateMetricsMask(uint64_t& mask, const std::string& filter) {
-  if (filter.empty()) {
-    return;
-  }
 
-  if (filter == "ALL") {
-    mask = ALL;
-    return;
+TraceFilterMask::Words ParseTraceMask(std::string_view mask) {
+  std::vector<std::string> unmatched;
+  auto words =
+      TraceFilterMask::Parse(mask, TRACE_FILTER_CLASS_NAMES, &unmatched);
+  for (const auto& entry : unmatched) {
+    LOG_GENERAL(WARNING, "Unknown trace filter class " << entry);
   }
-
-#define CHECK_FILTER(FILTER)                              \
-  if (filter == #FILTER) {                                \
-    mask |= (1 << static_cast<int>(FilterClass::FILTER)); \
-    return;                                               \
-  }
-
-  TRACE_FILTER_CLASSES(CHECK_FILTER)
-#undef CHECK_FILTER2
+  return words;
 }
+
 }  // namespace
 
 void Filter::init() {
-  std::vector<std::string> flags;
-  boost::split(flags, TRACE_ZILLIQA_MASK, boost::is_any_of(","));
-  for (const auto& f : flags) {
-    UpdateMetricsMask(m_mask, f);
-    if (m_mask == ALL) {
-      break;
-    }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_set) {
+    m_set = true;
+    m_mask.Store(ParseTraceMask(TRACE_ZILLIQA_MASK));
   }
 }
 
+bool Filter::Reload(std::string_view mask) {
+  auto words = ParseTraceMask(mask);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_set = true;
+  return m_mask.Store(words);
+}
+
 }  // namespace zil::trace
@@ -23,6 +23,8 @@
 #include <opentelemetry/trace/tracer.h>
 #include <opentelemetry/trace/tracer_provider.h>
 #include <cassert>
+#include <mutex>
+#include <string_view>
 #include "opentelemetry/exporters/ostream/span_exporter_factory.h"
 #include "opentelemetry/sdk/trace/simple_processor_factory.h"
 #include "opentelemetry/sdk/trace/tracer_provider_factory.h"
@@ -40,14 +42,23 @@ class Filter : public Singleton<Filter> {
  public:
   Filter() { init(); }
 
+  /// Seeds the mask from TRACE_ZILLIQA_MASK, unless it was set before by
+  /// init or Reload: a mask applied at runtime is kept
   void init();
 
+  /// Replaces the mask with a TRACE_ZILLIQA_MASK style list, may be called
+  /// at any time. Returns false if the mask is unchanged.
+  bool Reload(std::string_view mask);
+
   bool Enabled(FilterClass to_test) {
-    return m_mask & (1 << static_cast<int>(to_test));
+    return m_mask.Test(static_cast<size_t>(to_test));
   }
 
  private:
-  uint64_t m_mask{};
+  TraceFilterMask m_mask;
+  // orders the seeding of init against runtime changes
+  std::mutex m_mutex;
+  bool m_set = false;
 };
 
 /// Extract info to continue spans with distributed tracing
@@ -72,8 +83,18 @@ class Naming : public Singleton<Naming> {
 
 class Tracing : public Singleton<Tracing> {
  public:
+  struct Deferred {};
+
   Tracing();
 
+  /// Constructs without a provider, see StartAsync
+  explicit Tracing(Deferred) {}
+
+  /// Builds the provider on a background thread. Spans started before it
+  /// is ready come from the default Noop provider and are not recorded.
+  /// Does nothing if Tracing is already constructed.
+  static void StartAsync();
+
   std::string Version() { return "Initial"; }
 
   std::shared_ptr<trace_api::Tracer> get_tracer();
@@ -84,6 +105,8 @@ class Tracing : public Singleton<Tracing> {
  private:
   void Init();
   void StdOutInit();
+  void PerfettoInit();
+  void SpanLogInit();
   void OtlpHTTPInit();
   void NoopInit();
   void InitOtlpGrpc();
@@ -17,8 +17,13 @@
 
 #include "Tracing2.h"
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <cstring>
 #include <optional>
+#include <random>
 #include <thread>
 
 #include <boost/algorithm/string.hpp>
@@ -27,6 +32,7 @@
 #include <opentelemetry/context/propagation/text_map_propagator.h>
 #include <opentelemetry/context/runtime_context.h>
 #include <opentelemetry/exporters/ostream/span_exporter_factory.h>
+#include <opentelemetry/exporters/otlp/otlp_grpc_exporter_factory.h>
 #include <opentelemetry/exporters/otlp/otlp_grpc_exporter_options.h>
 #include <opentelemetry/exporters/otlp/otlp_http_exporter_factory.h>
 #include <opentelemetry/sdk/trace/simple_processor_factory.h>
@@ -37,10 +43,19 @@
 #include <opentelemetry/trace/provider.h>
 #include <opentelemetry/trace/span.h>
 
+#include "Profiler.h"
+#include "internal/flightrecorder.h"
+#include "internal/perfetto.h"
+#include "internal/probes.h"
+#include "internal/selftelemetry.h"
+#include "internal/spanlog.h"
+#include "internal/start.h"
 #include "libUtils/Logger.h"
 
 namespace zil::trace2 {
 
+using zil::metrics::SelfTelemetry;
+
 namespace trace_api = opentelemetry::trace;
 namespace otel_std = opentelemetry::v1::nostd;
 namespace trace_sdk = opentelemetry::sdk::trace;
@@ -85,12 +100,66 @@ class KVI : public opentelemetry::common::KeyValueIterable {
   size_t size() const noexcept override { return m_cont.size(); }
 };
 
+using zil::trace::FlightRecorder;
+namespace flight = zil::trace::flight;
+
+// Span and trace ids of FLIGHT_RECORDER spans, which bypass the SDK
+uint64_t NextRandomId() noexcept {
+  static thread_local uint64_t state = [] {
+    std::random_device device;
+    return (static_cast<uint64_t>(device()) << 32) ^ device();
+  }();
+  // splitmix64
+  uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+void RecordAttribute(flight::RecordType type, const uint8_t (&span_id)[8],
+                     std::string_view key, const Value& value) noexcept {
+  std::visit(
+      [&](const auto& v) {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<T, bool>) {
+          FlightRecorder::Attribute(type, span_id, key, flight::ValueType::BOOL,
+                                    v ? 1 : 0);
+        } else if constexpr (std::is_same_v<T, int64_t>) {
+          FlightRecorder::Attribute(type, span_id, key, flight::ValueType::I64,
+                                    static_cast<uint64_t>(v));
+        } else if constexpr (std::is_same_v<T, uint64_t>) {
+          FlightRecorder::Attribute(type, span_id, key, flight::ValueType::U64,
+                                    v);
+        } else if constexpr (std::is_same_v<T, double>) {
+          FlightRecorder::Attribute(type, span_id, key, flight::ValueType::F64,
+                                    std::bit_cast<uint64_t>(v));
+        } else if constexpr (std::is_same_v<T, const char*>) {
+          FlightRecorder::Attribute(type, span_id, key, flight::ValueType::STR,
+                                    0, v != nullptr ? v : "");
+        } else if constexpr (std::is_same_v<T, std::string_view>) {
+          FlightRecorder::Attribute(type, span_id, key, flight::ValueType::STR,
+                                    0, v);
+        } else {
+          // only the size of arrays is kept
+          FlightRecorder::Attribute(type, span_id, key,
+                                    flight::ValueType::ARRAY, v.size());
+        }
+      },
+      value);
+}
+
 }  // namespace
 
 class TracingImpl {
-  // thread local stack of spans
+  // thread local stack of spans. Spans started while the Profiler runs are
+  // mirrored into its stack, the thread registers with it on the first one.
   class Stack {
-    std::vector<std::shared_ptr<Span::Impl>> m_stack;
+    struct Entry {
+      std::shared_ptr<Span::Impl> span;
+      bool profiled;
+    };
+
+    std::vector<Entry> m_stack;
 
    public:
     static Stack& GetInstance() {
@@ -102,17 +171,32 @@ class TracingImpl {
 
     const std::shared_ptr<Span::Impl>& GetActiveSpan() const {
       static const std::shared_ptr<Span::Impl> emptySpan;
-      return m_stack.empty() ? emptySpan : m_stack.back();
+      return m_stack.empty() ? emptySpan : m_stack.back().span;
+    }
+
+    /// CPU ms the profiler sampled in the innermost span, 0 if not profiled
+    double InnermostSpanCpuMs() const noexcept {
+      return !m_stack.empty() && m_stack.back().profiled
+                 ? zil::trace::Profiler::InnermostSpanCpuMs()
+                 : 0;
     }
 
-    void Push(std::shared_ptr<Span::Impl> span) {
+    void Push(std::shared_ptr<Span::Impl> span, std::string_view name) {
       assert(span);
       assert(span->IsRecording());
-      m_stack.emplace_back(std::move(span));
+      const bool profiled = zil::trace::Profiler::Running();
+      if (profiled) {
+        zil::trace::Profiler::RegisterThread();
+        zil::trace::Profiler::PushSpan(name);
+      }
+      m_stack.push_back({std::move(span), profiled});
     }
 
     void Pop() {
       assert(!m_stack.empty());
+      if (m_stack.back().profiled) {
+        zil::trace::Profiler::PopSpan();
+      }
       m_stack.pop_back();
     }
   };
@@ -136,6 +220,8 @@ class TracingImpl {
     // serialized span identity
     std::string m_ids;
 
+    FilterClass m_filter;
+
     bool IsRecording() const noexcept override { return m_span->IsRecording(); }
 
     SpanId GetSpanId() const noexcept override { return m_context.span_id(); }
@@ -164,47 +250,192 @@ class TracingImpl {
           abort();
         }
 
+        if (ZIL_PROBE_ENABLED(span_end)) {
+          ZIL_PROBE3(span_end, static_cast<int>(m_filter), m_ids.c_str(),
+                     static_cast<int>(status));
+        }
+        if (double cpuMs = Stack::GetInstance().InnermostSpanCpuMs();
+            cpuMs > 0) {
+          m_span->SetAttribute("profile.cpu_ms", cpuMs);
+        }
         m_span->SetStatus(static_cast<trace_api::StatusCode>(status));
         m_span->End();
         m_token.reset();
         Stack::GetInstance().Pop();
+        SelfTelemetry::GetInstance().SpanEnded(m_filter);
       }
     }
 
    public:
     SpanImpl(otel_std::shared_ptr<trace_api::Span> span,
-             otel_std::unique_ptr<opentelemetry::context::Token> token)
+             otel_std::unique_ptr<opentelemetry::context::Token> token,
+             FilterClass filter)
         : m_span(std::move(span)),
           m_token(std::move(token)),
           m_threadId(std::this_thread::get_id()),
-          m_context(m_span->GetContext()) {
+          m_context(m_span->GetContext()),
+          m_filter(filter) {
       assert(m_token);
       assert(m_context.IsValid());
       GetIdsImpl(m_ids, m_context);
     }
   };
 
-  // Filters mask. Can be zero if tracing is not enabled or initialized
-  uint64_t m_filtersMask{};
+  // FLIGHT_RECORDER span, recorded into the thread's ring only
+  class RecorderSpanImpl : public Span::Impl {
+    uint8_t m_traceId[16];
+    uint8_t m_spanId[8];
+
+    // serialized span identity, formatted on first use only
+    mutable std::string m_ids;
+
+    std::thread::id m_threadId;
+
+    // copy of the name for the END record, the recorder keeps no more of it
+    char m_name[40];
+    uint8_t m_nameSize;
+
+    FilterClass m_filter;
+
+    bool m_ended = false;
+
+    bool IsRecording() const noexcept override { return !m_ended; }
+
+    SpanId GetSpanId() const noexcept override { return SpanId(m_spanId); }
+
+    TraceId GetTraceId() const noexcept override { return TraceId(m_traceId); }
+
+    const std::string& GetIds() const noexcept override {
+      if (m_ids.empty()) {
+        trace_api::SpanContext context(
+            GetTraceId(), GetSpanId(),
+            trace_api::TraceFlags(trace_api::TraceFlags::kIsSampled), false);
+        GetIdsImpl(m_ids, context);
+      }
+      return m_ids;
+    }
+
+    void SetAttribute(std::string_view name, Value value) noexcept override {
+      RecordAttribute(flight::RecordType::SPAN_ATTRIBUTE, m_spanId, name,
+                      value);
+    }
+
+    void AddEvent(std::string_view name,
+                  std::initializer_list<std::pair<std::string_view, Value>>
+                      attributes) noexcept override {
+      FlightRecorder::Event(m_spanId, name);
+      for (const auto& [key, value] : attributes) {
+        RecordAttribute(flight::RecordType::EVENT_ATTRIBUTE, m_spanId, key,
+                        value);
+      }
+    }
+
+    void End(StatusCode status = StatusCode::UNSET) noexcept override {
+      if (!m_ended) {
+        if (m_threadId != std::this_thread::get_id()) {
+          LOG_GENERAL(FATAL, "Tracing scope usage violation (threading)");
+          abort();
+        }
+
+        m_ended = true;
+        if (ZIL_PROBE_ENABLED(span_end)) {
+          ZIL_PROBE3(span_end, static_cast<int>(m_filter), GetIds().c_str(),
+                     static_cast<int>(status));
+        }
+        if (double cpuMs = Stack::GetInstance().InnermostSpanCpuMs();
+            cpuMs > 0) {
+          SetAttribute("profile.cpu_ms", cpuMs);
+        }
+        FlightRecorder::End(m_spanId, std::string_view(m_name, m_nameSize),
+                            static_cast<uint8_t>(status));
+        Stack::GetInstance().Pop();
+        SelfTelemetry::GetInstance().SpanEnded(m_filter);
+      }
+    }
+
+   public:
+    RecorderSpanImpl(FilterClass filter, std::string_view name,
+                     const TraceId& traceId, const SpanId& parentId)
+        : m_threadId(std::this_thread::get_id()),
+          m_nameSize(
+              static_cast<uint8_t>(std::min(name.size(), sizeof(m_name)))),
+          m_filter(filter) {
+      std::memcpy(m_name, name.data(), m_nameSize);
+      if (traceId.IsValid()) {
+        traceId.CopyBytesTo(m_traceId);
+      } else {
+        const uint64_t high = NextRandomId();
+        const uint64_t low = NextRandomId();
+        std::memcpy(m_traceId, &high, sizeof(high));
+        std::memcpy(m_traceId + sizeof(high), &low, sizeof(low));
+      }
+      const uint64_t spanId = NextRandomId() | 1;  // never all zeros
+      std::memcpy(m_spanId, &spanId, sizeof(spanId));
+
+      uint8_t parent[8];
+      parentId.CopyBytesTo(parent);
+      FlightRecorder::Start(static_cast<uint8_t>(filter), m_traceId, m_spanId,
+                            parent, name);
+    }
+  };
+
+  // Filters mask. Can be empty if tracing is not enabled or initialized,
+  // replaced at runtime by SetFilters
+  zil::trace::TraceFilterMask m_filtersMask;
 
   // Tracer which creates spans. Can be nullptr if tracing is not enabled or
   // initialized
   otel_std::shared_ptr<trace_api::Tracer> m_tracer;
 
-  Span CreateSpanImpl(std::string_view name,
+  // Set once m_tracer is, Initialize may run on the StartAsync thread
+  std::atomic<bool> m_ready{false};
+
+  // FLIGHT_RECORDER mode, spans go to FlightRecorder instead of m_tracer
+  bool m_recorder = false;
+
+  static void ProbeSpanStart(FilterClass filter, std::string_view name,
+                             const Span::Impl& span) {
+    if (ZIL_PROBE_ENABLED(span_start)) {
+      ZIL_PROBE4(span_start, static_cast<int>(filter), name.data(),
+                 name.size(), span.GetIds().c_str());
+    }
+  }
+
+  Span CreateRecorderSpan(FilterClass filter, std::string_view name,
+                          const TraceId& traceId, const SpanId& parentId) {
+    auto impl =
+        std::make_shared<RecorderSpanImpl>(filter, name, traceId, parentId);
+    ProbeSpanStart(filter, name, *impl);
+    Stack::GetInstance().Push(impl, name);
+    SelfTelemetry::GetInstance().SpanStarted(filter);
+    return Span(std::move(impl), true);
+  }
+
+  Span CreateSpanImpl(FilterClass filter, std::string_view name,
                       const trace_api::StartSpanOptions& options) {
     assert(m_tracer);
 
+    // track of the span in FILE_PERFETTO traces
+    zil::trace::SetSpanCategory(
+        zil::trace::TRACE_FILTER_CLASS_NAMES[static_cast<size_t>(filter)]
+            .name);
     auto internalSpan = m_tracer->StartSpan(name, options);
+    zil::trace::SetSpanCategory({});
     assert(internalSpan);
+    if (!internalSpan->IsRecording()) {
+      // sampled out, it still carries the context to its children
+      SelfTelemetry::GetInstance().SpanDropped(filter);
+    }
 
     auto token = opentelemetry::context::RuntimeContext::Attach(
         opentelemetry::context::RuntimeContext::GetCurrent().SetValue(
             trace_api::kSpanKey,
             opentelemetry::context::ContextValue(internalSpan)));
-    auto impl =
-        std::make_shared<SpanImpl>(std::move(internalSpan), std::move(token));
-    Stack::GetInstance().Push(impl);
+    auto impl = std::make_shared<SpanImpl>(std::move(internalSpan),
+                                           std::move(token), filter);
+    ProbeSpanStart(filter, name, *impl);
+    Stack::GetInstance().Push(impl, name);
+    SelfTelemetry::GetInstance().SpanStarted(filter);
     return Span(std::move(impl), true);
   }
 
@@ -218,40 +449,84 @@ class TracingImpl {
     return Span(stack.GetActiveSpan(), false);
   }
 
+  static TraceContext GetActiveContext() {
+    const auto& active = Stack::GetInstance().GetActiveSpan();
+    return active ? TraceContext{active->GetTraceId(), active->GetSpanId()}
+                  : TraceContext{};
+  }
+
   static TracingImpl& GetInstance() {
     static TracingImpl tracing;
     return tracing;
   }
 
-  bool Initialize(std::string_view global_name, std::string_view filters_mask);
+  bool Initialize(std::string_view global_name, std::string_view filters_mask,
+                  std::string_view provider);
 
   bool IsEnabled(FilterClass to_test) const {
-    return m_filtersMask & (1 << static_cast<int>(to_test));
+    return m_filtersMask.Test(static_cast<size_t>(to_test));
   }
 
+  bool SetFilters(std::string_view filters_mask);
+
   Span CreateSpan(FilterClass filter, std::string_view name) {
-    if (m_tracer && IsEnabled(filter)) {
+    if (m_ready.load(std::memory_order_acquire) && IsEnabled(filter)) {
+      if (m_recorder) {
+        const auto& parent = Stack::GetInstance().GetActiveSpan();
+        return parent ? CreateRecorderSpan(filter, name, parent->GetTraceId(),
+                                           parent->GetSpanId())
+                      : CreateRecorderSpan(filter, name, {}, {});
+      }
       trace_api::StartSpanOptions options;
-      return CreateSpanImpl(name, options);
+      return CreateSpanImpl(filter, name, options);
     }
     return Span{};
   }
 
   Span CreateChildSpanOfRemoteTrace(FilterClass filter, std::string_view name,
                                     std::string_view remote_trace_info) {
-    if (m_tracer && IsEnabled(filter)) {
+    if (m_ready.load(std::memory_order_acquire) && IsEnabled(filter)) {
       auto ctx_opt = ExtractSpanContextFromIds(remote_trace_info);
       if (!ctx_opt.has_value()) {
+        SelfTelemetry::GetInstance().SpanDropped(filter);
         return Span{};
       }
 
+      if (m_recorder) {
+        return CreateRecorderSpan(filter, name, ctx_opt->trace_id(),
+                                  ctx_opt->span_id());
+      }
+
       trace_api::StartSpanOptions options;
 
       // child spans from deserialized parent  are of server kind
       options.kind = trace_api::SpanKind::kServer;
       options.parent = std::move(ctx_opt.value());
 
-      return CreateSpanImpl(name, options);
+      return CreateSpanImpl(filter, name, options);
+    }
+    return Span{};
+  }
+
+  Span CreateChildSpan(FilterClass filter, std::string_view name,
+                       const TraceContext& parent) {
+    if (!parent.IsValid()) {
+      return CreateSpan(filter, name);
+    }
+    if (m_ready.load(std::memory_order_acquire) && IsEnabled(filter)) {
+      if (m_recorder) {
+        return CreateRecorderSpan(filter, name, parent.traceId,
+                                  parent.spanId);
+      }
+
+      // contexts are taken from recording spans, hence sampled
+      trace_api::StartSpanOptions options;
+      options.kind = trace_api::SpanKind::kConsumer;
+      options.parent = trace_api::SpanContext(
+          parent.traceId, parent.spanId,
+          trace_api::TraceFlags(trace_api::TraceFlags::kIsSampled), false);
+
+      return CreateSpanImpl(filter, name, options);
     }
     return Span{};
   }
@@ -260,15 +535,33 @@ class TracingImpl {
 };
 
 bool Tracing::Initialize(std::string_view global_name,
-                         std::string_view filters_mask) {
+                         std::string_view filters_mask,
+                         std::string_view provider) {
   static std::once_flag initialized;
   bool result = false;
-  std::call_once(initialized, [&result, &global_name, &filters_mask] {
-    result = TracingImpl::GetInstance().Initialize(global_name, filters_mask);
-  });
+  std::call_once(initialized,
+                 [&result, &global_name, &filters_mask, &provider] {
+                   result = TracingImpl::GetInstance().Initialize(
+                       global_name, filters_mask, provider);
+                 });
   return result;
 }
 
+void Tracing::StartAsync(std::string_view global_name,
+                         std::string_view filters_mask,
+                         std::string_view provider) {
+  static metrics::StartThread startThread;
+  startThread.Start([global_name = std::string(global_name),
+                     filters_mask = std::string(filters_mask),
+                     provider = std::string(provider)] {
+    Initialize(global_name, filters_mask, provider);
+  });
+}
+
+bool Tracing::SetFilters(std::string_view filters_mask) {
+  return TracingImpl::GetInstance().SetFilters(filters_mask);
+}
+
 bool Tracing::IsEnabled(FilterClass filter) {
   return TracingImpl::GetInstance().IsEnabled(filter);
 }
@@ -284,6 +577,15 @@ Span Tracing::CreateChildSpanOfRemoteTrace(FilterClass filter,
       filter, name, remote_trace_info);
 }
 
+Span Tracing::CreateChildSpan(FilterClass filter, std::string_view name,
+                              const TraceContext& parent) {
+  return TracingImpl::GetInstance().CreateChildSpan(filter, name, parent);
+}
+
+TraceContext Tracing::GetActiveContext() {
+  return TracingImpl::GetActiveContext();
+}
+
 Span Tracing::GetActiveSpan() { return TracingImpl::GetActiveSpan(); }
 
 namespace {
@@ -349,26 +651,25 @@ std::optional<trace_api::SpanContext> ExtractSpanContextFromIds(
   return trace_api::SpanContext(trace_id, span_id, trace_flags, true);
 }
 
-constexpr uint64_t ALL = std::numeric_limits<uint64_t>::max();
+using zil::trace::TraceFilterMask;
 
-void UpdateMask(uint64_t& mask, std::string_view filter) {
-  if (filter.empty()) {
-    return;
-  }
-
-  if (filter == "ALL") {
-    mask = ALL;
-    return;
+TraceFilterMask::Words ParseMask(std::string_view mask) {
+  std::vector<std::string> unmatched;
+  auto words = TraceFilterMask::Parse(mask, zil::trace::TRACE_FILTER_CLASS_NAMES,
+                                      &unmatched);
+  for (const auto& entry : unmatched) {
+    LOG_GENERAL(WARNING, "Unknown trace filter class " << entry);
   }
+  return words;
+}
 
-#define CHECK_FILTER(FILTER)                              \
-  if (filter == #FILTER) {                                \
-    mask |= (1 << static_cast<int>(FilterClass::FILTER)); \
-    return;                                               \
+bool IsEmpty(const TraceFilterMask::Words& words) {
+  for (auto word : words) {
+    if (word != 0) {
+      return false;
+    }
   }
-
-  TRACE_FILTER_CLASSES(CHECK_FILTER)
-#undef CHECK_FILTER2
+  return true;
 }
 
 void TracingOtlpHTTPInit(std::string_view global_name) {
@@ -399,10 +700,8 @@ void TracingOtlpHTTPInit(std::string_view global_name) {
 
   auto resource = resource::Resource::Create(attributes);
   // Create OTLP exporter instance
-  auto exporter = otlp::OtlpHttpExporterFactory::Create(opts);
-  auto processor =
-      opentelemetry::sdk::trace::SimpleSpanProcessorFactory::Create(
-          std::move(exporter));
+  auto processor = SelfTelemetry::CreateSpanProcessor(
+      otlp::OtlpHttpExporterFactory::Create(opts));
   std::vector<std::unique_ptr<opentelemetry::sdk::trace::SpanProcessor>>
       processors;
   processors.push_back(std::move(processor));
@@ -423,10 +722,73 @@ void TracingOtlpHTTPInit(std::string_view global_name) {
               new opentelemetry::trace::propagation::HttpTraceContext()));
 }
 
-void TracingStdOutInit() {
-  auto exporter = trace_exporter::OStreamSpanExporterFactory::Create();
+void TracingOtlpGrpcInit(std::string_view global_name) {
+  std::string nice_name = "zilliqa-cpp";
+  if (!global_name.empty()) {
+    nice_name += ":";
+    nice_name += global_name;
+  }
+
+  otlp::OtlpGrpcExporterOptions opts;
+  opts.endpoint =
+      std::string(TRACE_ZILLIQA_HOSTNAME) + ":" + TRACE_ZILLIQA_GRPC_PORT;
+
+  resource::ResourceAttributes attributes = {{"service.name", nice_name},
+                                             {"version", (uint32_t)1}};
+  auto resource = resource::Resource::Create(attributes);
+  auto processor = SelfTelemetry::CreateSpanProcessor(
+      otlp::OtlpGrpcExporterFactory::Create(opts));
+  std::shared_ptr<opentelemetry::trace::TracerProvider> provider =
+      trace_sdk::TracerProviderFactory::Create(std::move(processor), resource);
+
+  trace_api::Provider::SetTracerProvider(provider);
+
+  opentelemetry::context::propagation::GlobalTextMapPropagator::
+      SetGlobalPropagator(
+          otel_std::shared_ptr<
+              opentelemetry::context::propagation::TextMapPropagator>(
+              new opentelemetry::trace::propagation::HttpTraceContext()));
+}
+
+void TracingPerfettoInit() {
   auto processor =
-      trace_sdk::SimpleSpanProcessorFactory::Create(std::move(exporter));
+      zil::trace::CreatePerfettoProcessor(TRACE_ZILLIQA_PERFETTO_FILE);
+  resource::ResourceAttributes attributes = {{"service.name", "zilliqa-cpp"},
+                                             {"version", (uint32_t)1}};
+  auto resource = resource::Resource::Create(attributes);
+  std::shared_ptr<opentelemetry::trace::TracerProvider> provider =
+      trace_sdk::TracerProviderFactory::Create(std::move(processor), resource);
+
+  trace_api::Provider::SetTracerProvider(provider);
+}
+
+void TracingSpanLogInit(std::string_view global_name) {
+  std::string nice_name = "zilliqa-cpp";
+  if (!global_name.empty()) {
+    nice_name += ":";
+    nice_name += global_name;
+  }
+
+  zil::trace::SpanLogOptions options;
+  options.directory = TRACE_ZILLIQA_SPANLOG_DIR;
+  options.segment_size = TRACE_ZILLIQA_SPANLOG_SEGMENT_MB << 20;
+  options.max_segments = TRACE_ZILLIQA_SPANLOG_SEGMENTS;
+  options.compress = TRACE_ZILLIQA_SPANLOG_ZSTD;
+
+  resource::ResourceAttributes attributes = {{"service.name", nice_name},
+                                             {"version", (uint32_t)1}};
+  auto resource = resource::Resource::Create(attributes);
+  auto processor = SelfTelemetry::CreateSpanProcessor(
+      zil::trace::CreateSpanLogExporter(options));
+  std::shared_ptr<opentelemetry::trace::TracerProvider> provider =
+      trace_sdk::TracerProviderFactory::Create(std::move(processor), resource);
+
+  trace_api::Provider::SetTracerProvider(provider);
+}
+
+void TracingStdOutInit() {
+  auto processor = SelfTelemetry::CreateSpanProcessor(
+      trace_exporter::OStreamSpanExporterFactory::Create());
   resource::ResourceAttributes attributes = {{"service.name", "zilliqa-cpp"},
                                              {"version", (uint32_t)1}};
   auto resource = resource::Resource::Create(attributes);
@@ -447,7 +809,8 @@ void TracingStdOutInit() {
 }  // namespace
 
 bool TracingImpl::Initialize(std::string_view global_name,
-                             std::string_view filters_mask) {
+                             std::string_view filters_mask,
+                             std::string_view provider) {
   std::string_view mask =
       filters_mask.empty() ? TRACE_ZILLIQA_MASK : filters_mask;
 
@@ -456,18 +819,9 @@ bool TracingImpl::Initialize(std::string_view global_name,
     return false;
   }
 
-  uint64_t filtersMask = 0;
+  auto filtersMask = ParseMask(mask);
 
-  std::vector<std::string_view> flags;
-  boost::split(flags, mask, boost::is_any_of(","));
-  for (const auto& f : flags) {
-    UpdateMask(filtersMask, f);
-    if (filtersMask == ALL) {
-      break;
-    }
-  }
-
-  if (filtersMask == 0) {
+  if (IsEmpty(filtersMask)) {
     // Tracing disabled, corrupted string passed
     LOG_GENERAL(WARNING,
                 "Tracing disabled, incorrect filter parameter: " << mask);
@@ -475,12 +829,22 @@ bool TracingImpl::Initialize(std::string_view global_name,
   }
 
   try {
-    std::string cmp{TRACE_ZILLIQA_PROVIDER};
+    std::string cmp{provider.empty() ? TRACE_ZILLIQA_PROVIDER : provider};
 
     if (cmp == "OTLPHTTP") {
       TracingOtlpHTTPInit(global_name);
+    } else if (cmp == "OTLPGRPC") {
+      TracingOtlpGrpcInit(global_name);
     } else if (cmp == "STDOUT") {
       TracingStdOutInit();
+    } else if (cmp == "FILE_PERFETTO") {
+      TracingPerfettoInit();
+    } else if (cmp == "FILE_SPANLOG") {
+      TracingSpanLogInit(global_name);
+    } else if (cmp == "FLIGHT_RECORDER") {
+      FlightRecorder::Init(TRACE_ZILLIQA_FLIGHT_DIR,
+                           TRACE_ZILLIQA_FLIGHT_RECORDS);
+      m_recorder = true;
     } else {
       LOG_GENERAL(WARNING,
                   "Telemetry provider has defaulted to NOOP provider due to no "
@@ -498,13 +862,29 @@ bool TracingImpl::Initialize(std::string_view global_name,
     return false;
   }
 
-  auto provider = trace_api::Provider::GetTracerProvider();
-  assert(provider);
-  m_tracer = provider->GetTracer("zilliqa-cpp", OPENTELEMETRY_SDK_VERSION);
-  assert(m_tracer);
+  if (!m_recorder) {
+    auto provider = trace_api::Provider::GetTracerProvider();
+    assert(provider);
+    m_tracer = provider->GetTracer("zilliqa-cpp", OPENTELEMETRY_SDK_VERSION);
+    assert(m_tracer);
+  }
 
-  m_filtersMask = filtersMask;
+  m_filtersMask.Store(filtersMask);
+  m_ready.store(true, std::memory_order_release);
   return true;
 }
 
+bool TracingImpl::SetFilters(std::string_view filters_mask) {
+  auto filtersMask = ParseMask(filters_mask);
+  if (IsEmpty(filtersMask) && !filters_mask.empty() &&
+      filters_mask != "NONE") {
+    LOG_GENERAL(WARNING,
+                "Ignoring incorrect filter parameter: " << filters_mask);
+    return false;
+  }
+  return m_filtersMask.Store(filtersMask);
+}
+
+std::string Tracing::DumpFlightRecorder() { return FlightRecorder::Dump(); }
+
 }  // namespace zil::trace2
@@ -26,32 +26,13 @@
 #include <opentelemetry/trace/span_id.h>
 #include <opentelemetry/trace/trace_id.h>
 
-// Currently maxes out at 64 filters, in order to increase developer should
-// change the type of the mask from uint64_t to uint128_t or uint256_t if
-// the number of filters ever increases beyond 64.
-//
-// Do not override the default numbering of these items, the algorithms rely
-// upon these definitions being consecutive, so no assigning new numbers.
-
-// To extend filter classes, you may add items, the total number is limited to
-// 64 (bit mask)
-#define TRACE_FILTER_CLASSES(T) \
-  T(EVM_CLIENT)                 \
-  T(EVM_CLIENT_LOW_LEVEL)       \
-  T(SCILLA_PROCESSING)          \
-  T(SCILLA_IPC)                 \
-  T(EVM_RPC)                    \
-  T(LOOKUP_SERVER)              \
-  T(QUEUE)                      \
-  T(ACC_EVM)                    \
-  T(NODE)                       \
-  T(ACC_HISTOGRAM)
+#include "TraceFilters.h"
 
 // TODO XXX '2' to be removed after api stabilizes
 namespace zil::trace2 {
 
 enum class FilterClass {
-#define ENUM_FILTER_CLASS(C) C,
+#define ENUM_FILTER_CLASS(C, PATH) C,
   TRACE_FILTER_CLASSES(ENUM_FILTER_CLASS)
 #undef ENUM_FILTER_CLASS
       FILTER_CLASS_END
@@ -66,6 +47,15 @@ using Value =
 using opentelemetry::trace::SpanId;
 using opentelemetry::trace::TraceId;
 
+// Identity of a span as plain ids, for parenting spans in other threads of
+// the process without serializing it, see Tracing::CreateChildSpan
+struct TraceContext {
+  TraceId traceId;
+  SpanId spanId;
+
+  bool IsValid() const noexcept { return spanId.IsValid(); }
+};
+
 // StatusCode - Represents the canonical set of status codes of a finished Span.
 enum class StatusCode {
   UNSET,  // default status
@@ -136,6 +126,12 @@ class Span {
     return m_impl ? m_impl->GetTraceId() : TraceId();
   }
 
+  /// Returns an invalid context for no-op spans
+  TraceContext GetContext() const {
+    return m_impl ? TraceContext{m_impl->GetTraceId(), m_impl->GetSpanId()}
+                  : TraceContext{};
+  }
+
   void SetAttribute(std::string_view name, Value value) {
     if (m_impl) {
       m_impl->SetAttribute(name, value);
@@ -164,10 +160,28 @@ class Tracing {
   /// Can be (optionally) called before the first usage to see logs and
   /// initialization result
   /// \param filters_mask If empty then config value is used
+  /// \param provider One of OTLPHTTP, OTLPGRPC, STDOUT, FILE_PERFETTO
+  /// (TRACE_ZILLIQA_PERFETTO_FILE), FILE_SPANLOG (TRACE_ZILLIQA_SPANLOG_DIR)
+  /// or FLIGHT_RECORDER (in memory only, see DumpFlightRecorder).
+  /// If empty then config value is used
   /// \return Success of initialization. If 'false' is returned, then
   /// the tracing will be disabled
   static bool Initialize(std::string_view global_name = {},
-                         std::string_view filters_mask = {});
+                         std::string_view filters_mask = {},
+                         std::string_view provider = {});
+
+  /// Runs Initialize on a background thread, so startup does not wait for
+  /// the exporter. Spans created before it completes are no-op spans.
+  static void StartAsync(std::string_view global_name = {},
+                         std::string_view filters_mask = {},
+                         std::string_view provider = {});
+
+  /// Replaces the filters mask at runtime, e.g. to turn on a low level class
+  /// during an incident. Spans are only recorded if Initialize succeeded.
+  /// \param filters_mask Same format as TRACE_ZILLIQA_MASK, NONE or empty
+  /// disables all classes
+  /// \return false if the mask is unchanged or cannot be parsed
+  static bool SetFilters(std::string_view filters_mask);
 
   /// Returns if tracing with a given filter is enabled. Usable for more complex
   /// scenarios than just CreateSpan(...)
@@ -186,10 +200,26 @@ class Tracing {
                                            std::string_view name,
                                            std::string_view remote_trace_info);
 
+  /// Creates a scoped span as a child of a span of this process, e.g. one
+  /// that produced a queued item in another thread. Falls back to CreateSpan
+  /// if the context is not valid.
+  static Span CreateChildSpan(FilterClass filter, std::string_view name,
+                              const TraceContext& parent);
+
+  /// Returns the context of the active span, invalid if there is none.
+  /// Cheaper than GetActiveSpan().GetContext()
+  static TraceContext GetActiveContext();
+
   /// Returns the active span (if any) or to a no-op span (if no
   /// active span or tracing disabled)
   static Span GetActiveSpan();
 
+  /// Writes the rings of the FLIGHT_RECORDER provider to a new dump file in
+  /// TRACE_ZILLIQA_FLIGHT_DIR, e.g. from an admin call. SIGUSR2 does the same.
+  /// \return Path of the dump, empty if the provider is not in use or the
+  /// write failed
+  static std::string DumpFlightRecorder();
+
   // TODO some research needed to shutdown it gracefully
   // static void Shutdown();
 };
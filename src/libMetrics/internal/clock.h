@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_CLOCK_H_
+#define ZILLIQA_SRC_LIBMETRICS_INTERNAL_CLOCK_H_
+
+#include <time.h>
+
+#include <cstdint>
+
+namespace zil {
+namespace metrics {
+
+// CLOCK_MONOTONIC is served by the vDSO, so no syscall, and unlike
+// system_clock it never jumps. Raw TSC reads would be a few ns cheaper but
+// need per-machine calibration and are not available on arm64 builds.
+
+inline uint64_t MonotonicNs() noexcept {
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/// CPU time consumed by the calling thread
+inline uint64_t ThreadCpuNs() noexcept {
+  timespec ts{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/// Wall clock in ns since epoch, for timestamps that leave the process
+inline uint64_t RealtimeNs() noexcept {
+  timespec ts{};
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+}  // namespace metrics
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_INTERNAL_CLOCK_H_
@@ -0,0 +1,424 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "flightrecorder.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include "libUtils/Logger.h"
+
+namespace zil::trace {
+
+namespace {
+
+using flight::Record;
+using flight::RecordType;
+
+constexpr size_t MAX_RINGS = 1024;
+
+// Large enough for a dump from a handler of a stack overflow
+constexpr size_t ALT_STACK_SIZE = 64 << 10;
+
+constexpr int FATAL_SIGNALS[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+
+struct Ring {
+  std::atomic<uint64_t> head{0};
+  std::atomic<bool> exited{false};
+  uint32_t tid = 0;
+  char thread_name[16] = {};
+  Record *records = nullptr;
+};
+
+// Everything the signal path reads is set up before the handlers are
+// installed and is never freed
+std::atomic<bool> g_enabled{false};
+uint64_t g_capacity = 0;  // power of two
+char g_directory[PATH_MAX] = {};
+std::atomic<Ring *> g_rings[MAX_RINGS];
+std::atomic<uint32_t> g_ringCount{0};
+std::atomic<uint32_t> g_dumpCount{0};
+std::atomic<bool> g_fatalDumped{false};
+struct sigaction g_previous[NSIG];
+
+std::mutex g_registerMutex;
+
+// Serializes Init and Shutdown
+std::mutex g_initMutex;
+
+uint64_t NowNs() noexcept {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Ring of the thread. Rings are not freed: the ring of an exited thread is
+// kept for the dumps until all slots are in use, then the one of the thread
+// which exited first is taken over.
+class ThreadRing {
+ public:
+  ThreadRing() {
+    std::lock_guard<std::mutex> lock(g_registerMutex);
+    const uint32_t count = g_ringCount.load(std::memory_order_relaxed);
+    if (count < MAX_RINGS) {
+      m_ring = new Ring;
+      m_ring->records = new Record[g_capacity]();
+      g_rings[count].store(m_ring, std::memory_order_release);
+      g_ringCount.store(count + 1, std::memory_order_release);
+    } else {
+      uint64_t oldest = UINT64_MAX;
+      for (auto &slot : g_rings) {
+        Ring *ring = slot.load(std::memory_order_relaxed);
+        if (!ring->exited.load(std::memory_order_relaxed)) {
+          continue;
+        }
+        const uint64_t head = ring->head.load(std::memory_order_relaxed);
+        const uint64_t last =
+            head == 0
+                ? 0
+                : ring->records[(head - 1) & (g_capacity - 1)].timestamp_ns;
+        if (last < oldest) {
+          oldest = last;
+          m_ring = ring;
+        }
+      }
+      if (m_ring == nullptr) {
+        return;
+      }
+      m_ring->head.store(0, std::memory_order_relaxed);
+      m_ring->exited.store(false, std::memory_order_relaxed);
+    }
+
+    m_ring->tid = static_cast<uint32_t>(::syscall(SYS_gettid));
+    pthread_getname_np(pthread_self(), m_ring->thread_name,
+                       sizeof(m_ring->thread_name));
+
+    stack_t current{};
+    if (sigaltstack(nullptr, &current) == 0 &&
+        (current.ss_flags & SS_DISABLE)) {
+      m_altStack = std::malloc(ALT_STACK_SIZE);
+      stack_t stack{};
+      stack.ss_sp = m_altStack;
+      stack.ss_size = ALT_STACK_SIZE;
+      if (m_altStack != nullptr && sigaltstack(&stack, nullptr) != 0) {
+        std::free(m_altStack);
+        m_altStack = nullptr;
+      }
+    }
+  }
+
+  ~ThreadRing() {
+    if (m_ring != nullptr) {
+      m_ring->exited.store(true, std::memory_order_release);
+    }
+    if (m_altStack != nullptr) {
+      stack_t disable{};
+      disable.ss_flags = SS_DISABLE;
+      sigaltstack(&disable, nullptr);
+      std::free(m_altStack);
+    }
+  }
+
+  /// Null if no ring is available
+  static Ring *Get() noexcept {
+    static thread_local ThreadRing ring;
+    return ring.m_ring;
+  }
+
+ private:
+  Ring *m_ring = nullptr;
+  void *m_altStack = nullptr;
+};
+
+// Fills the next record of the thread's ring and publishes it
+template <typename F>
+void Write(RecordType type, const uint8_t (&span_id)[8], F &&fill) noexcept {
+  if (!g_enabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  Ring *ring = ThreadRing::Get();
+  if (ring == nullptr) {
+    return;
+  }
+  const uint64_t head = ring->head.load(std::memory_order_relaxed);
+  Record &record = ring->records[head & (g_capacity - 1)];
+  record.timestamp_ns = NowNs();
+  std::memcpy(record.span_id, span_id, sizeof(record.span_id));
+  record.type = type;
+  record.name_size = 0;
+  record.text_size = 0;
+  fill(record);
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void SetName(Record &record, std::string_view name) noexcept {
+  const size_t size = std::min(name.size(), sizeof(record.text) / 2);
+  if (size > 0) {
+    std::memcpy(record.text, name.data(), size);
+  }
+  record.name_size = static_cast<uint8_t>(size);
+}
+
+void SetText(Record &record, std::string_view text) noexcept {
+  const size_t size =
+      std::min(text.size(), sizeof(record.text) - record.name_size);
+  if (size > 0) {
+    std::memcpy(record.text + record.name_size, text.data(), size);
+  }
+  record.text_size = static_cast<uint8_t>(size);
+}
+
+bool WriteAll(int fd, const void *data, size_t size, off_t offset) noexcept {
+  const char *at = static_cast<const char *>(data);
+  while (size > 0) {
+    const ssize_t written = ::pwrite(fd, at, size, offset);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    at += written;
+    offset += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+// Decimal digits of value appended at out, returns the end
+char *AppendNumber(char *out, uint64_t value) noexcept {
+  char digits[20];
+  size_t count = 0;
+  do {
+    digits[count++] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  while (count > 0) {
+    *out++ = digits[--count];
+  }
+  return out;
+}
+
+char *AppendText(char *out, const char *text) noexcept {
+  while (*text != '\0') {
+    *out++ = *text++;
+  }
+  return out;
+}
+
+/// Async-signal-safe, path receives the file name
+bool DumpTo(char (&path)[PATH_MAX + 64], int signal) noexcept {
+  const uint32_t number = g_dumpCount.fetch_add(1, std::memory_order_relaxed);
+  char *end = AppendText(path, g_directory);
+  end = AppendText(end, "/flight-");
+  end = AppendNumber(end, static_cast<uint64_t>(::getpid()));
+  *end++ = '-';
+  end = AppendNumber(end, number);
+  end = AppendText(end, ".zfr");
+  *end = '\0';
+
+  const int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  flight::DumpHeader header{};
+  std::memcpy(header.magic, flight::MAGIC, sizeof(header.magic));
+  header.version = flight::VERSION;
+  header.record_size = sizeof(Record);
+  header.capacity = g_capacity;
+  header.dump_ns = NowNs();
+  header.rings = g_ringCount.load(std::memory_order_acquire);
+  header.pid = static_cast<uint32_t>(::getpid());
+  header.signal = signal;
+  bool written = WriteAll(fd, &header, sizeof(header), 0);
+
+  off_t offset = sizeof(header);
+  for (uint32_t i = 0; written && i < header.rings; ++i) {
+    const Ring *ring = g_rings[i].load(std::memory_order_acquire);
+    flight::RingHeader ringHeader{};
+    ringHeader.head = ring->head.load(std::memory_order_acquire);
+    ringHeader.tid = ring->tid;
+    ringHeader.exited = ring->exited.load(std::memory_order_relaxed);
+    std::memcpy(ringHeader.thread_name, ring->thread_name,
+                sizeof(ringHeader.thread_name));
+
+    // The thread keeps writing while its ring is copied: the slot of the
+    // record at the head seen afterwards may be torn, and so may all slots
+    // it has lapped since the first read. The header, written last, only
+    // covers the records intact in the copy.
+    const size_t size = g_capacity * sizeof(Record);
+    written = WriteAll(fd, ring->records, size, offset + sizeof(ringHeader));
+    const uint64_t after = ring->head.load(std::memory_order_acquire);
+    const uint64_t first = after >= g_capacity ? after - g_capacity + 1 : 0;
+    ringHeader.first = std::min(first, ringHeader.head);
+    written = written && WriteAll(fd, &ringHeader, sizeof(ringHeader), offset);
+    offset += sizeof(ringHeader) + size;
+  }
+  ::close(fd);
+  return written;
+}
+
+void OnDumpSignal(int) {
+  const int saved = errno;
+  // on the stack, handlers of several threads may run at once
+  char path[PATH_MAX + 64];
+  DumpTo(path, SIGUSR2);
+  errno = saved;
+}
+
+void OnFatalSignal(int signal, siginfo_t *, void *) {
+  if (!g_fatalDumped.exchange(true)) {
+    char path[PATH_MAX + 64];
+    DumpTo(path, signal);
+  }
+  // the signal is blocked in here, it is delivered to the previous
+  // disposition once the handler returns
+  sigaction(signal, &g_previous[signal], nullptr);
+  raise(signal);
+}
+
+}  // namespace
+
+void FlightRecorder::Init(std::string_view directory,
+                          uint64_t records_per_thread) {
+  std::lock_guard<std::mutex> lock(g_initMutex);
+  if (g_enabled.load(std::memory_order_relaxed)) {
+    LOG_GENERAL(WARNING, "Flight recorder is on already, Init ignored");
+    return;
+  }
+
+  // rings of the threads are sized once, a later Init keeps them
+  const uint64_t capacity =
+      std::bit_ceil(std::max<uint64_t>(records_per_thread, 64));
+  if (g_capacity == 0) {
+    g_capacity = capacity;
+  } else if (capacity != g_capacity) {
+    LOG_GENERAL(WARNING, "Flight recorder keeps " << g_capacity
+                                                  << " records per thread");
+  }
+  const size_t size = std::min(directory.size(), sizeof(g_directory) - 1);
+  std::memcpy(g_directory, directory.data(), size);
+  g_directory[size] = '\0';
+  if (size == 0) {
+    g_directory[0] = '.';
+    g_directory[1] = '\0';
+  }
+
+  struct sigaction action {};
+  action.sa_handler = OnDumpSignal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGUSR2, &action, &g_previous[SIGUSR2]);
+
+  for (int signal : FATAL_SIGNALS) {
+    struct sigaction fatal {};
+    fatal.sa_sigaction = OnFatalSignal;
+    fatal.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&fatal.sa_mask);
+    sigaction(signal, &fatal, &g_previous[signal]);
+  }
+
+  g_enabled.store(true, std::memory_order_release);
+  LOG_GENERAL(INFO, "Flight recorder on, " << g_capacity
+                                           << " records per thread, dumps to "
+                                           << g_directory);
+}
+
+void FlightRecorder::Shutdown() {
+  std::lock_guard<std::mutex> lock(g_initMutex);
+  if (!g_enabled.exchange(false)) {
+    return;
+  }
+  sigaction(SIGUSR2, &g_previous[SIGUSR2], nullptr);
+  for (int signal : FATAL_SIGNALS) {
+    sigaction(signal, &g_previous[signal], nullptr);
+  }
+}
+
+bool FlightRecorder::Enabled() noexcept {
+  return g_enabled.load(std::memory_order_relaxed);
+}
+
+void FlightRecorder::Start(uint8_t filter, const uint8_t (&trace_id)[16],
+                           const uint8_t (&span_id)[8],
+                           const uint8_t (&parent_id)[8],
+                           std::string_view name) noexcept {
+  Write(RecordType::START, span_id, [&](Record &record) {
+    record.filter = filter;
+    record.value_type = flight::ValueType::NONE;
+    std::memcpy(record.start.trace_id, trace_id, sizeof(trace_id));
+    std::memcpy(record.start.parent_id, parent_id, sizeof(parent_id));
+    SetName(record, name);
+  });
+}
+
+void FlightRecorder::End(const uint8_t (&span_id)[8], std::string_view name,
+                         uint8_t status) noexcept {
+  Write(RecordType::END, span_id, [&](Record &record) {
+    record.status = status;
+    record.value_type = flight::ValueType::NONE;
+    SetName(record, name);
+  });
+}
+
+void FlightRecorder::Event(const uint8_t (&span_id)[8],
+                           std::string_view name) noexcept {
+  Write(RecordType::EVENT, span_id, [&](Record &record) {
+    record.value_type = flight::ValueType::NONE;
+    SetName(record, name);
+  });
+}
+
+void FlightRecorder::Attribute(RecordType type, const uint8_t (&span_id)[8],
+                               std::string_view key,
+                               flight::ValueType value_type, uint64_t bits,
+                               std::string_view text) noexcept {
+  Write(type, span_id, [&](Record &record) {
+    record.value_type = value_type;
+    record.u64 = bits;
+    SetName(record, key);
+    SetText(record, text);
+  });
+}
+
+std::string FlightRecorder::Dump() {
+  if (!Enabled()) {
+    return {};
+  }
+  char path[PATH_MAX + 64];
+  if (!DumpTo(path, 0)) {
+    LOG_GENERAL(WARNING, "Cannot write flight recorder dump " << path);
+    return {};
+  }
+  return path;
+}
+
+}  // namespace zil::trace
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_FLIGHTRECORDER_H_
+#define ZILLIQA_SRC_LIBMETRICS_INTERNAL_FLIGHTRECORDER_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace zil {
+namespace trace {
+
+// Dump format of the flight recorder, read by tools/flightdump. A dump is a
+// DumpHeader followed, for every thread ring, by a RingHeader and the ring's
+// capacity records. The records of a ring are those from first to head - 1,
+// at index sequence % capacity, the other slots may be torn. Host byte order.
+namespace flight {
+
+constexpr char MAGIC[8] = {'Z', 'I', 'L', 'F', 'L', 'I', 'G', 'H'};
+constexpr uint32_t VERSION = 2;
+
+enum class RecordType : uint8_t {
+  START = 1,
+  END,
+  EVENT,
+  SPAN_ATTRIBUTE,
+  EVENT_ATTRIBUTE  // of the last EVENT of the span
+};
+
+enum class ValueType : uint8_t { NONE, BOOL, I64, U64, F64, STR, ARRAY };
+
+struct Record {
+  uint64_t timestamp_ns;  // unix epoch
+  uint8_t span_id[8];
+  RecordType type;
+  uint8_t filter;  // START
+  uint8_t status;  // END, trace2::StatusCode
+  ValueType value_type;
+  uint8_t name_size;  // text[0, name_size)
+  uint8_t text_size;  // string value, text[name_size, name_size + text_size)
+  uint8_t reserved[2];
+  union {
+    struct {
+      uint8_t trace_id[16];
+      uint8_t parent_id[8];
+    } start;
+    int64_t i64;
+    uint64_t u64;  // also BOOL and the element count of ARRAY
+    double f64;
+  };
+  char text[80];  // truncated to fit
+};
+static_assert(sizeof(Record) == 128);
+
+struct DumpHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t capacity;  // records per ring
+  uint64_t dump_ns;   // unix epoch
+  uint32_t rings;
+  uint32_t pid;
+  int32_t signal;  // that caused the dump, 0 on request
+  uint32_t reserved;
+};
+
+struct RingHeader {
+  uint64_t head;   // records written to the ring so far
+  uint64_t first;  // oldest record intact in the dump
+  uint32_t tid;
+  uint8_t exited;
+  uint8_t reserved[3];
+  char thread_name[16];
+};
+
+}  // namespace flight
+
+// Backend of the FLIGHT_RECORDER mode of Tracing2. Every thread writes its
+// spans, events and attributes into a ring of fixed size records of its own,
+// nothing is exported. A write is a clock read and a copy into the ring, no
+// lock and no allocation.
+//
+// Dump() writes all rings to a new file flight-<pid>-<n>.zfr in the
+// directory. So does SIGUSR2, and a fatal signal (SIGSEGV, SIGBUS, SIGFPE,
+// SIGILL, SIGABRT) before the previous disposition of the signal runs. The
+// signal path only uses async-signal-safe calls; each recording thread gets
+// an alternate signal stack so that a stack overflow is dumped as well.
+class FlightRecorder {
+ public:
+  /// Sizes the rings (rounded up to a power of two) and installs the signal
+  /// handlers. Ignored while the recorder is on. After Shutdown it turns the
+  /// recorder on again, with the ring size of the first call.
+  static void Init(std::string_view directory, uint64_t records_per_thread);
+
+  /// Stops recording and restores the previous signal dispositions
+  static void Shutdown();
+
+  static bool Enabled() noexcept;
+
+  static void Start(uint8_t filter, const uint8_t (&trace_id)[16],
+                    const uint8_t (&span_id)[8], const uint8_t (&parent_id)[8],
+                    std::string_view name) noexcept;
+
+  static void End(const uint8_t (&span_id)[8], std::string_view name,
+                  uint8_t status) noexcept;
+
+  static void Event(const uint8_t (&span_id)[8],
+                    std::string_view name) noexcept;
+
+  /// \param type SPAN_ATTRIBUTE or EVENT_ATTRIBUTE
+  /// \param bits The value for BOOL, I64, U64, F64 and ARRAY (its size)
+  /// \param text The value for STR
+  static void Attribute(flight::RecordType type, const uint8_t (&span_id)[8],
+                        std::string_view key, flight::ValueType value_type,
+                        uint64_t bits, std::string_view text = {}) noexcept;
+
+  /// Writes a dump, returns its path or empty on failure
+  static std::string Dump();
+};
+
+}  // namespace trace
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_INTERNAL_FLIGHTRECORDER_H_
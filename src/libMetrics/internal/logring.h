@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_LOGRING_H_
+#define ZILLIQA_SRC_LIBMETRICS_INTERNAL_LOGRING_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace zil {
+namespace logging {
+
+// Single producer, single consumer ring of variable sized records. The
+// owning thread pushes, the log consumer drains. Each record is preceded by
+// a frame of 8 bytes and padded to 8 bytes; a record which does not fit
+// before the end of the buffer leaves a padding frame and starts over at
+// offset 0, so records are always contiguous.
+class LogRing {
+ public:
+  static constexpr uint64_t CAPACITY = uint64_t{1} << 18;
+
+  LogRing() : m_data(new char[CAPACITY]) {}
+
+  /// Producer side, false if the ring is full
+  bool Push(const void *record, uint32_t size) noexcept {
+    const uint64_t frame = Align(sizeof(Frame) + size);
+    const uint64_t head = m_head.load(std::memory_order_relaxed);
+    const uint64_t pos = head & (CAPACITY - 1);
+    const uint64_t to_end = CAPACITY - pos;
+    const uint64_t total = frame <= to_end ? frame : to_end + frame;
+
+    if (head + total - m_cachedTail > CAPACITY) {
+      m_cachedTail = m_tail.load(std::memory_order_acquire);
+      if (head + total - m_cachedTail > CAPACITY) {
+        return false;
+      }
+    }
+
+    uint64_t at = pos;
+    if (frame > to_end) {
+      Frame padding{static_cast<uint32_t>(to_end), 0};
+      std::memcpy(m_data.get() + pos, &padding, sizeof(padding));
+      at = 0;
+    }
+    Frame header{static_cast<uint32_t>(frame), size};
+    std::memcpy(m_data.get() + at, &header, sizeof(header));
+    std::memcpy(m_data.get() + at + sizeof(header), record, size);
+
+    m_head.store(head + total, std::memory_order_release);
+    return true;
+  }
+
+  /// Consumer side, calls consume(const char *record, uint32_t size) for
+  /// every record pushed so far. Returns the number of records.
+  template <typename F>
+  size_t Drain(F &&consume) {
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    const uint64_t head = m_head.load(std::memory_order_acquire);
+    size_t count = 0;
+    while (tail != head) {
+      const char *at = m_data.get() + (tail & (CAPACITY - 1));
+      Frame frame;
+      std::memcpy(&frame, at, sizeof(frame));
+      if (frame.size != 0) {
+        consume(at + sizeof(frame), frame.size);
+        ++count;
+      }
+      tail += frame.length;
+    }
+    m_tail.store(tail, std::memory_order_release);
+    return count;
+  }
+
+  /// Bytes not drained yet, exact on the producer side
+  uint64_t Used() const noexcept {
+    return m_head.load(std::memory_order_relaxed) -
+           m_tail.load(std::memory_order_relaxed);
+  }
+
+  bool Empty() const noexcept {
+    return m_tail.load(std::memory_order_acquire) ==
+           m_head.load(std::memory_order_acquire);
+  }
+
+  /// Set when the owning thread exits, the consumer drops the ring once it
+  /// is drained
+  std::atomic<bool> m_closed{false};
+
+ private:
+  struct Frame {
+    uint32_t length;  // of the whole frame including padding
+    uint32_t size;    // of the record, 0 for a padding frame
+  };
+
+  static constexpr uint64_t Align(uint64_t size) { return (size + 7) & ~7ull; }
+
+  std::unique_ptr<char[]> m_data;
+  alignas(64) std::atomic<uint64_t> m_head{0};
+  uint64_t m_cachedTail = 0;  // producer's view of m_tail
+  alignas(64) std::atomic<uint64_t> m_tail{0};
+};
+
+}  // namespace logging
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_INTERNAL_LOGRING_H_
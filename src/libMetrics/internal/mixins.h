@@ -17,31 +17,113 @@
 #ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_MIXINS_H_
 #define ZILLIQA_SRC_LIBMETRICS_INTERNAL_MIXINS_H_
 
+#include <atomic>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include "libMetrics/Metrics.h"
+#include "prebuffer.h"
+#include "probes.h"
+#include "registry.h"
 
 namespace zil {
 namespace metrics {
 
 using METRIC_ATTRIBUTE = std::map<std::string, opentelemetry::common::AttributeValue>;
 
-// Wrap an integer Counter
-
-class I64Counter {
+// The instrument of a wrapper: the registry one while the filter class is
+// enabled, a Noop otherwise. Filter::Generation is compared on every use so
+// a class switched on by Filter::Reload brings its instruments alive. While
+// Metrics::StartAsync runs an enabled wrapper records into a pre-buffer,
+// replayed into the registry instrument once the provider is ready. All of
+// them are kept until the wrapper goes away, so a pointer handed out stays
+// valid.
+template <typename T>
+class LazyInstrument {
  public:
-  I64Counter(zil::metrics::FilterClass fc, const std::string &name, const std::string &description, const std::string &units) {
-    //   Metrics::GetInstance().AddCounterSumView(GetFullName(METRIC_FAMILY,
-    //   name),
-    //                                            "View of the Metric");
-    if (Filter::GetInstance().Enabled(fc)) {
-      m_theCounter = Metrics::GetMeter()->CreateUInt64Counter(GetFullName(METRIC_FAMILY, name), description, units);
+  using Factory = std::function<std::shared_ptr<T>()>;
+
+  LazyInstrument(zil::metrics::FilterClass fc, Factory factory, std::shared_ptr<T> noop)
+      : m_fc(fc), m_factory(std::move(factory)), m_noop(std::move(noop)) {
+    Refresh(Filter::Generation());
+  }
+
+  T *operator->() { return Resolve(); }
+
+  std::shared_ptr<T> handle() {
+    auto active = Resolve();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (active == m_noop.get()) {
+      return m_noop;
+    }
+    if (m_buffer && active == m_buffer.get()) {
+      return m_buffer;
+    }
+    return m_real;
+  }
+
+ private:
+  T *Resolve() {
+    auto generation = Filter::Generation();
+    if (generation != m_generation.load(std::memory_order_acquire)) {
+      Refresh(generation);
+    }
+    return m_active.load(std::memory_order_acquire);
+  }
+
+  void Refresh(uint64_t generation) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (Filter::GetInstance().Enabled(m_fc)) {
+      if (!m_real && Metrics::Ready()) {
+        m_real = m_factory();
+        if (m_buffer) {
+          // values a racing thread adds to the buffer after this are lost
+          m_active.store(m_real.get(), std::memory_order_release);
+          m_buffer->Replay(*m_real);
+        }
+      }
+      if (m_real) {
+        m_active.store(m_real.get(), std::memory_order_release);
+      } else {
+        // Metrics::StartAsync is still building the provider
+        if (!m_buffer) {
+          m_buffer = std::make_shared<Buffer>();
+        }
+        m_active.store(m_buffer.get(), std::memory_order_release);
+      }
     } else {
-      m_theCounter = static_cast<uint64Counter_t>(new opentelemetry::metrics::NoopCounter<uint64_t>("test", "none", "unitless"));
+      m_active.store(m_noop.get(), std::memory_order_release);
     }
+    m_generation.store(generation, std::memory_order_release);
   }
 
+  using Buffer = typename BufferedInstrument<T>::type;
+
+  zil::metrics::FilterClass m_fc;
+  Factory m_factory;
+  std::shared_ptr<T> m_noop;
+  std::shared_ptr<T> m_real;
+  std::shared_ptr<Buffer> m_buffer;
+  std::atomic<T *> m_active{};
+  std::atomic<uint64_t> m_generation{};
+  std::mutex m_mutex;
+};
+
+// Wrap an integer Counter
+
+class I64Counter {
+ public:
+  I64Counter(zil::metrics::FilterClass fc, const std::string &name, const std::string &description, const std::string &units)
+      : m_theCounter(
+            fc,
+            [full_name = GetFullName(METRIC_FAMILY, name), description, units]() {
+              return InstrumentRegistry::GetInstance().GetUInt64Counter(full_name, description, units);
+            },
+            std::make_shared<opentelemetry::metrics::NoopCounter<uint64_t>>("test", "none", "unitless")) {}
+
   void Increment() { m_theCounter->Add(1); }
 
   void IncrementWithAttributes(long val, const METRIC_ATTRIBUTE &attr) {
@@ -52,24 +134,24 @@ class I64Counter {
 
   friend std::ostream &operator<<(std::ostream &os, const I64Counter &counter);
 
-  uint64Counter_t &get() { return m_theCounter; }
+  uint64CounterHandle_t get() { return m_theCounter.handle(); }
 
  private:
-  uint64Counter_t m_theCounter;
+  LazyInstrument<metrics_api::Counter<uint64_t>> m_theCounter;
 };
 
 // wrap a double counter
 
 class DoubleCounter {
  public:
-  DoubleCounter(zil::metrics::FilterClass fc, const std::string &name, const std::string &description, const std::string &units) {
-    if (Filter::GetInstance().Enabled(fc)) {
-      m_theCounter = Metrics::GetMeter()->CreateDoubleCounter(GetFullName(METRIC_FAMILY, name), description, units);
-    } else {
-      m_theCounter = static_cast<doubleCounter_t>(
-          new opentelemetry::metrics::NoopCounter<double>(GetFullName(METRIC_FAMILY, name), "none", "unitless"));
-    }
-  }
+  DoubleCounter(zil::metrics::FilterClass fc, const std::string &name, const std::string &description, const std::string &units)
+      : m_theCounter(
+            fc,
+            [full_name = GetFullName(METRIC_FAMILY, name), description, units]() {
+              return InstrumentRegistry::GetInstance().GetDoubleCounter(full_name, description, units);
+            },
+            std::make_shared<opentelemetry::metrics::NoopCounter<double>>(GetFullName(METRIC_FAMILY, name), "none",
+                                                                          "unitless")) {}
 
   void Increment() { m_theCounter->Add(1); }
 
@@ -79,7 +161,7 @@ class DoubleCounter {
   }
 
  private:
-  doubleCounter_t m_theCounter;
+  LazyInstrument<metrics_api::Counter<double>> m_theCounter;
 };
 
 // wrap a histogram
@@ -88,35 +170,71 @@ class DoubleHistogram {
  public:
   DoubleHistogram(zil::metrics::FilterClass fc, const std::string &name, const std::vector<double> &boundaries,
                   const std::string &description, const std::string &units)
-      : m_boundaries(boundaries) {
-    if (Filter::GetInstance().Enabled(fc)) {
-      Metrics::GetInstance().AddCounterHistogramView(GetFullName(METRIC_FAMILY, name), boundaries, description);
-      m_theCounter = Metrics::GetMeter()->CreateDoubleHistogram(GetFullName(METRIC_FAMILY, name), description, units);
-    } else {
-      m_theCounter = static_cast<doubleHistogram_t>(
-          new opentelemetry::metrics::NoopHistogram<double>(GetFullName(METRIC_FAMILY, name), "none", "unitless"));
-    }
-  }
+      :
+#ifdef ZIL_ENABLE_USDT
+        m_name(GetFullName(METRIC_FAMILY, name)),
+        m_fc(fc),
+#endif
+        m_theCounter(
+            fc,
+            [full_name = GetFullName(METRIC_FAMILY, name), boundaries, description, units]() {
+              return InstrumentRegistry::GetInstance().GetDoubleHistogram(full_name, boundaries, description, units);
+            },
+            std::make_shared<opentelemetry::metrics::NoopHistogram<double>>(GetFullName(METRIC_FAMILY, name), "none",
+                                                                            "unitless")) {}
 
   void Record(double val) {
+    Probe(val);
     auto context = opentelemetry::context::Context{};
     m_theCounter->Record(val, context);
   }
 
   void Record(double val, const METRIC_ATTRIBUTE &attr) {
+    Probe(val);
     auto context = opentelemetry::context::Context{};
     m_theCounter->Record(val, attr, context);
   }
 
+  // Pre-built attributes, nothing is allocated on our side
+
+  void RecordWithAttributes(double val, const opentelemetry::common::KeyValueIterable &attr) {
+    Probe(val);
+    m_theCounter->Record(val, attr, opentelemetry::context::Context{});
+  }
+
   void Record(double val, opentelemetry::context::Context  ctx ) {
+    Probe(val);
     m_theCounter->Record(val, ctx);
   }
 
  private:
-  std::vector<double> m_boundaries;
-  doubleHistogram_t m_theCounter;
+  void Probe([[maybe_unused]] double val) {
+#ifdef ZIL_ENABLE_USDT
+    if (ZIL_PROBE_ENABLED(histogram_record)) {
+      ZIL_PROBE3(histogram_record, static_cast<int>(m_fc), m_name.c_str(), static_cast<int64_t>(val * 1000));
+    }
+#endif
+  }
+
+#ifdef ZIL_ENABLE_USDT
+  // probe arguments only
+  std::string m_name;
+  zil::metrics::FilterClass m_fc;
+#endif
+  LazyInstrument<metrics_api::Histogram<double>> m_theCounter;
 };
 
+// Observable callbacks stay registered and report nothing while their filter
+// class is disabled, so Filter::Reload can switch them on and off.
+template <typename Callback>
+auto FilteredCallback(zil::metrics::FilterClass fc, Callback cb) {
+  return [fc, cb = std::move(cb)](Observable::Result &&result) {
+    if (Filter::GetInstance().Enabled(fc)) {
+      cb(std::move(result));
+    }
+  };
+}
+
 class DoubleGauge {
  public:
   DoubleGauge(zil::metrics::FilterClass fc, const std::string &name, const std::string &description, const std::string &units,
@@ -127,9 +245,12 @@ class DoubleGauge {
   using Callback = std::function<void(Observable::Result &&result)>;
 
   void SetCallback(const Callback &cb) {
-    if (zil::metrics::Filter::GetInstance().Enabled(m_fc)) m_theGauge.SetCallback(cb);
+    m_theGauge.SetCallback(FilteredCallback(m_fc, cb));
   }
 
+  // For BatchObservable membership
+  zil::metrics::Observable &get() { return m_theGauge; }
+
  private:
   zil::metrics::Observable m_theGauge;
   zil::metrics::FilterClass m_fc;
@@ -144,9 +265,12 @@ class I64Gauge {
   using Callback = std::function<void(Observable::Result &&result)>;
 
   void SetCallback(const Callback &cb) {
-    if (zil::metrics::Filter::GetInstance().Enabled(m_fc)) m_theGauge.SetCallback(cb);
+    m_theGauge.SetCallback(FilteredCallback(m_fc, cb));
   }
 
+  // For BatchObservable membership
+  zil::metrics::Observable &get() { return m_theGauge; }
+
  private:
   zil::metrics::Observable m_theGauge;
   zil::metrics::FilterClass m_fc;
@@ -162,9 +286,12 @@ class I64UpDown {
   using Callback = std::function<void(Observable::Result &&result)>;
 
   void SetCallback(const Callback &cb) {
-    if (zil::metrics::Filter::GetInstance().Enabled(m_fc)) m_theGauge.SetCallback(cb);
+    m_theGauge.SetCallback(FilteredCallback(m_fc, cb));
   }
 
+  // For BatchObservable membership
+  zil::metrics::Observable &get() { return m_theGauge; }
+
  private:
   zil::metrics::Observable m_theGauge;
   zil::metrics::FilterClass m_fc;
@@ -180,18 +307,102 @@ class DoubleUpDown {
   using Callback = std::function<void(Observable::Result &&result)>;
 
   void SetCallback(const Callback &cb) {
-    if (zil::metrics::Filter::GetInstance().Enabled(m_fc)) m_theGauge.SetCallback(cb);
+    m_theGauge.SetCallback(FilteredCallback(m_fc, cb));
   }
 
+  // For BatchObservable membership
+  zil::metrics::Observable &get() { return m_theGauge; }
+
  private:
   zil::metrics::Observable m_theGauge;
   zil::metrics::FilterClass m_fc;
 };
 
+// Synchronous gauges and up/down counters. The value lives in its own cache
+// line and is read by one internal callback at collection, so Set, Add and
+// Sub are a single relaxed atomic operation with no SDK call.
+
+enum class SyncKind { GAUGE, UPDOWN };
+
+template <typename V, SyncKind K>
+class SyncObservable {
+ public:
+  static_assert(std::is_same_v<V, int64_t> || std::is_same_v<V, double>);
+
+  SyncObservable(zil::metrics::FilterClass fc, const std::string &name, const std::string &description,
+                 const std::string &units, bool)
+      : m_fc(fc), m_theGauge(Create(GetFullName(METRIC_FAMILY, name), description, units)) {
+    m_theGauge.SetCallback(
+        FilteredCallback(m_fc, [this](Observable::Result &&result) { result.Set(Get(), m_attributes); }));
+  }
+
+  void Set(V value) noexcept { m_value.store(value, std::memory_order_relaxed); }
+
+  void Add(V value = 1) noexcept { m_value.fetch_add(value, std::memory_order_relaxed); }
+
+  void Sub(V value = 1) noexcept { m_value.fetch_sub(value, std::memory_order_relaxed); }
+
+  V Get() const noexcept { return m_value.load(std::memory_order_relaxed); }
+
+  SyncObservable &operator++() noexcept {
+    Add();
+    return *this;
+  }
+
+  SyncObservable &operator++(int) noexcept {
+    Add();
+    return *this;
+  }
+
+  SyncObservable &operator--() noexcept {
+    Sub();
+    return *this;
+  }
+
+  SyncObservable &operator--(int) noexcept {
+    Sub();
+    return *this;
+  }
+
+  bool Enabled() { return zil::metrics::Filter::GetInstance().Enabled(m_fc); }
+
+ private:
+  static Observable Create(const std::string &name, const std::string &description, const std::string &units) {
+    auto &metrics = Metrics::GetInstance();
+    if constexpr (std::is_same_v<V, int64_t>) {
+      if constexpr (K == SyncKind::GAUGE) {
+        return metrics.CreateInt64Gauge(name, description, units);
+      } else {
+        return metrics.CreateInt64UpDownMetric(name, description, units);
+      }
+    } else {
+      if constexpr (K == SyncKind::GAUGE) {
+        return metrics.CreateDoubleGauge(name, description, units);
+      } else {
+        return metrics.CreateDoubleUpDownMetric(name, description, units);
+      }
+    }
+  }
+
+  alignas(64) std::atomic<V> m_value{};
+  AttributeSetHandle m_attributes;
+  zil::metrics::FilterClass m_fc;
+  // Last, so the callback is removed before anything it reads goes away
+  zil::metrics::Observable m_theGauge;
+};
+
+using I64SyncGauge = SyncObservable<int64_t, SyncKind::GAUGE>;
+using DoubleSyncGauge = SyncObservable<double, SyncKind::GAUGE>;
+using I64SyncUpDown = SyncObservable<int64_t, SyncKind::UPDOWN>;
+using DoubleSyncUpDown = SyncObservable<double, SyncKind::UPDOWN>;
+
 template <typename T>
 struct InstrumentWrapper : T {
   InstrumentWrapper(zil::metrics::FilterClass fc, const std::string &name, const std::string &description, const std::string &units)
       : T(fc, name, description, units) {
+#ifdef ZIL_ENABLE_USDT
+    m_name = GetFullName(METRIC_FAMILY, name);
+#endif
     m_fc = fc;
   }
 
@@ -200,17 +411,24 @@ struct InstrumentWrapper : T {
   InstrumentWrapper(zil::metrics::FilterClass fc, const std::string &name, const std::vector<double> &list,
                     const std::string &description, const std::string &units)
       : T(fc, name, list, description, units) {
+#ifdef ZIL_ENABLE_USDT
+    m_name = GetFullName(METRIC_FAMILY, name);
+#endif
     m_fc = fc;
   }
 
   InstrumentWrapper(zil::metrics::FilterClass fc, const std::string &name, const std::string &description, const std::string &units,
                     bool obs)
       : T(fc, name, description, units, obs) {
+#ifdef ZIL_ENABLE_USDT
+    m_name = GetFullName(METRIC_FAMILY, name);
+#endif
     m_fc = fc;
   }
 
   InstrumentWrapper &operator++() {
     if (Filter::GetInstance().Enabled(m_fc)) {
+      Probe(1);
       T::Increment();
     }
     return *this;
@@ -219,43 +437,49 @@ struct InstrumentWrapper : T {
   // Prefix increment operator.
   InstrumentWrapper &operator++(int) {
     if (Filter::GetInstance().Enabled(m_fc)) {
+      Probe(1);
       T::Increment();
     }
     return *this;
   }
 
-  // Declare prefix and postfix decrement operators.
+  // Declare prefix and postfix decrement operators, only for types with a
+  // Decrement().
   InstrumentWrapper &operator--() {
     if (Filter::GetInstance().Enabled(m_fc)) {
+      Probe(-1);
       T::Decrement();
     }
     return *this;
   }  // Prefix d
 
-  // decrement operator.
-  InstrumentWrapper operator--(int) {
-    InstrumentWrapper temp = *this;
+  // decrement operator, like operator++(int) returns *this as wrapped
+  // instruments are not copyable.
+  InstrumentWrapper &operator--(int) {
     if (Filter::GetInstance().Enabled(m_fc)) {
+      Probe(-1);
       T::Decrement();
     }
-    --*this;
-    return temp;
+    return *this;
   }
 
   void IncrementAttr(const METRIC_ATTRIBUTE &attr) {
     if (Filter::GetInstance().Enabled(m_fc)) {
+      Probe(1);
       T::IncrementWithAttributes(1L, attr);
     }
   }
 
   void Increment(size_t steps) {
     if (Filter::GetInstance().Enabled(m_fc)) {
+      Probe(static_cast<int64_t>(steps));
       while (steps--) T::Increment();
     }
   }
 
   void Decrement(size_t steps) {
     if (Filter::GetInstance().Enabled(m_fc)) {
+      Probe(-static_cast<int64_t>(steps));
       while (steps--) T::Decrement();
     }
   }
@@ -263,7 +487,19 @@ struct InstrumentWrapper : T {
   bool Enabled() { return zil::metrics::Filter::GetInstance().Enabled(m_fc); }
 
  private:
+  void Probe([[maybe_unused]] int64_t delta) {
+#ifdef ZIL_ENABLE_USDT
+    if (ZIL_PROBE_ENABLED(counter_add)) {
+      ZIL_PROBE3(counter_add, static_cast<int>(m_fc), m_name.c_str(), delta);
+    }
+#endif
+  }
+
   zil::metrics::FilterClass m_fc;
+#ifdef ZIL_ENABLE_USDT
+  // full name for the probes only
+  std::string m_name;
+#endif
 };
 
 };  // namespace metrics
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "mutex.h"
+
+#include "libMetrics/Tracing2.h"
+#include "libUtils/Logger.h"
+
+namespace zil {
+namespace metrics {
+
+namespace {
+
+void SlowHolderEvent(const char *name, uint64_t hold_ns) noexcept {
+  try {
+    auto span = trace2::Tracing::GetActiveSpan();
+    span.AddEvent("slow lock holder",
+                  {{"lock", name},
+                   {"hold_us", static_cast<int64_t>(hold_ns / 1000)}});
+  } catch (...) {
+    LOG_GENERAL(WARNING, "Slow holder event of lock " << name << " not added");
+  }
+}
+
+}  // namespace
+
+LockHistograms::LockHistograms(FilterClass fc, const std::string &name,
+                               const std::string &description,
+                               const std::vector<double> &boundaries)
+    : m_wait(fc, name + "_wait", boundaries, description + " (wait time)",
+             "us"),
+      m_hold(fc, name + "_hold", boundaries, description + " (hold time)",
+             "us") {}
+
+void LockHistograms::RecordWait(
+    const opentelemetry::common::KeyValueIterable &attributes,
+    uint64_t ns) noexcept {
+  try {
+    m_wait.RecordWithAttributes(ns / 1e3, attributes);
+  } catch (...) {
+    LOG_GENERAL(WARNING, "Lock wait time not recorded");
+  }
+}
+
+void LockHistograms::RecordHold(
+    const opentelemetry::common::KeyValueIterable &attributes,
+    uint64_t ns) noexcept {
+  try {
+    m_hold.RecordWithAttributes(ns / 1e3, attributes);
+  } catch (...) {
+    LOG_GENERAL(WARNING, "Lock hold time not recorded");
+  }
+}
+
+LockSite::LockSite(const char *name, const char *mode) noexcept
+    : m_name(name),
+      m_pairs{Attribute{"lock", name}, Attribute{"mode", mode}},
+      m_attributes(m_pairs) {}
+
+void InstrumentedMutex::Record(uint64_t holdStart, uint64_t waitNs) noexcept {
+  if (waitNs != 0) {
+    m_histograms.RecordWait(m_site.Attributes(), waitNs);
+  }
+  if (holdStart != 0) {
+    const uint64_t holdNs = MonotonicNs() - holdStart;
+    m_histograms.RecordHold(m_site.Attributes(), holdNs);
+    if (m_slowHoldNs != 0 && holdNs > m_slowHoldNs) {
+      SlowHolderEvent(m_site.Name(), holdNs);
+    }
+  }
+}
+
+void InstrumentedSharedMutex::Record(uint64_t holdStart,
+                                     uint64_t waitNs) noexcept {
+  if (waitNs != 0) {
+    m_histograms.RecordWait(m_exclusive.Attributes(), waitNs);
+  }
+  if (holdStart != 0) {
+    const uint64_t holdNs = MonotonicNs() - holdStart;
+    m_histograms.RecordHold(m_exclusive.Attributes(), holdNs);
+    if (m_slowHoldNs != 0 && holdNs > m_slowHoldNs) {
+      SlowHolderEvent(m_exclusive.Name(), holdNs);
+    }
+  }
+}
+
+}  // namespace metrics
+}  // namespace zil
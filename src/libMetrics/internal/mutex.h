@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_MUTEX_H_
+#define ZILLIQA_SRC_LIBMETRICS_INTERNAL_MUTEX_H_
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+
+#include <opentelemetry/common/key_value_iterable_view.h>
+
+#include "clock.h"
+#include "mixins.h"
+
+namespace zil {
+namespace metrics {
+
+// Wait and hold time histograms (us) shared by the locks of one filter
+// class, created once as <name>_wait and <name>_hold. Every lock records
+// with its name as the "lock" attribute and "exclusive" or "shared" as
+// "mode".
+class LockHistograms final {
+ public:
+  LockHistograms(FilterClass fc, const std::string &name,
+                 const std::string &description,
+                 const std::vector<double> &boundaries = {
+                     1.0, 10.0, 100.0, 1000.0, 10000.0, 100000.0});
+
+  bool Enabled() { return m_wait.Enabled(); }
+
+  void RecordWait(const opentelemetry::common::KeyValueIterable &attributes,
+                  uint64_t ns) noexcept;
+
+  void RecordHold(const opentelemetry::common::KeyValueIterable &attributes,
+                  uint64_t ns) noexcept;
+
+ private:
+  InstrumentWrapper<DoubleHistogram> m_wait;
+  InstrumentWrapper<DoubleHistogram> m_hold;
+
+  LockHistograms(const LockHistograms &) = delete;
+
+  LockHistograms &operator=(const LockHistograms &) = delete;
+};
+
+// Name and mode of a lock as pre-built attributes, nothing is allocated
+// when recording
+class LockSite final {
+ public:
+  LockSite(const char *name, const char *mode) noexcept;
+
+  const char *Name() const noexcept { return m_name; }
+
+  const opentelemetry::common::KeyValueIterable &Attributes() const noexcept {
+    return m_attributes;
+  }
+
+ private:
+  using Attribute = std::pair<opentelemetry::nostd::string_view,
+                              opentelemetry::common::AttributeValue>;
+
+  const char *m_name;
+  std::array<Attribute, 2> m_pairs;
+  // Refers to m_pairs, hence no copy or move
+  opentelemetry::common::KeyValueIterableView<std::array<Attribute, 2>>
+      m_attributes;
+
+  LockSite(const LockSite &) = delete;
+
+  LockSite &operator=(const LockSite &) = delete;
+};
+
+// Drop-in std::mutex that reports contention. Acquiring a free lock is one
+// try_lock and a filter check: the wait is only timed when try_lock fails.
+// The hold time is timed for contended acquisitions and one in
+// HOLD_SAMPLE_RATE of the others, or every acquisition if slow_hold is set.
+// A hold longer than slow_hold adds a "slow lock holder" event to the
+// active Tracing2 span of the holder. Everything is recorded after the
+// lock is released.
+class InstrumentedMutex final {
+ public:
+  static constexpr uint32_t HOLD_SAMPLE_RATE = 64;
+
+  /// \param name Must outlive the mutex, e.g. a literal
+  InstrumentedMutex(LockHistograms &histograms, const char *name,
+                    std::chrono::microseconds slow_hold = {}) noexcept
+      : m_histograms(histograms),
+        m_site(name, "exclusive"),
+        m_slowHoldNs(static_cast<uint64_t>(
+            std::chrono::nanoseconds(slow_hold).count())) {}
+
+  void lock() {
+    if (!m_histograms.Enabled()) {
+      m_mutex.lock();
+      return;
+    }
+    if (m_mutex.try_lock()) {
+      if (m_slowHoldNs != 0 || ++m_acquisitions % HOLD_SAMPLE_RATE == 0) {
+        m_holdStart = MonotonicNs();
+      }
+      return;
+    }
+    const uint64_t start = MonotonicNs();
+    m_mutex.lock();
+    m_holdStart = MonotonicNs();
+    m_waitNs = m_holdStart - start;
+  }
+
+  bool try_lock() {
+    if (!m_mutex.try_lock()) {
+      return false;
+    }
+    if (m_slowHoldNs != 0 && m_histograms.Enabled()) {
+      m_holdStart = MonotonicNs();
+    }
+    return true;
+  }
+
+  void unlock() {
+    // the members belong to the next holder once the lock is released
+    const uint64_t holdStart = std::exchange(m_holdStart, 0);
+    const uint64_t waitNs = std::exchange(m_waitNs, 0);
+    m_mutex.unlock();
+    if (holdStart != 0 || waitNs != 0) {
+      Record(holdStart, waitNs);
+    }
+  }
+
+ private:
+  void Record(uint64_t holdStart, uint64_t waitNs) noexcept;
+
+  std::mutex m_mutex;
+  LockHistograms &m_histograms;
+  LockSite m_site;
+  uint64_t m_slowHoldNs;
+  // Guarded by m_mutex
+  uint32_t m_acquisitions{};
+  uint64_t m_holdStart{};
+  uint64_t m_waitNs{};
+
+  InstrumentedMutex(const InstrumentedMutex &) = delete;
+
+  InstrumentedMutex &operator=(const InstrumentedMutex &) = delete;
+};
+
+// Drop-in std::shared_mutex, exclusive locking as InstrumentedMutex. Shared
+// acquisitions only record their wait, when try_lock_shared fails, as there
+// is no single holder to time.
+class InstrumentedSharedMutex final {
+ public:
+  /// \param name Must outlive the mutex, e.g. a literal
+  InstrumentedSharedMutex(LockHistograms &histograms, const char *name,
+                          std::chrono::microseconds slow_hold = {}) noexcept
+      : m_histograms(histograms),
+        m_exclusive(name, "exclusive"),
+        m_shared(name, "shared"),
+        m_slowHoldNs(static_cast<uint64_t>(
+            std::chrono::nanoseconds(slow_hold).count())) {}
+
+  void lock() {
+    if (!m_histograms.Enabled()) {
+      m_mutex.lock();
+      return;
+    }
+    if (m_mutex.try_lock()) {
+      if (m_slowHoldNs != 0 ||
+          ++m_acquisitions % InstrumentedMutex::HOLD_SAMPLE_RATE == 0) {
+        m_holdStart = MonotonicNs();
+      }
+      return;
+    }
+    const uint64_t start = MonotonicNs();
+    m_mutex.lock();
+    m_holdStart = MonotonicNs();
+    m_waitNs = m_holdStart - start;
+  }
+
+  bool try_lock() {
+    if (!m_mutex.try_lock()) {
+      return false;
+    }
+    if (m_slowHoldNs != 0 && m_histograms.Enabled()) {
+      m_holdStart = MonotonicNs();
+    }
+    return true;
+  }
+
+  void unlock() {
+    const uint64_t holdStart = std::exchange(m_holdStart, 0);
+    const uint64_t waitNs = std::exchange(m_waitNs, 0);
+    m_mutex.unlock();
+    if (holdStart != 0 || waitNs != 0) {
+      Record(holdStart, waitNs);
+    }
+  }
+
+  void lock_shared() {
+    if (m_mutex.try_lock_shared()) {
+      return;
+    }
+    if (!m_histograms.Enabled()) {
+      m_mutex.lock_shared();
+      return;
+    }
+    const uint64_t start = MonotonicNs();
+    m_mutex.lock_shared();
+    m_histograms.RecordWait(m_shared.Attributes(), MonotonicNs() - start);
+  }
+
+  bool try_lock_shared() { return m_mutex.try_lock_shared(); }
+
+  void unlock_shared() { m_mutex.unlock_shared(); }
+
+ private:
+  void Record(uint64_t holdStart, uint64_t waitNs) noexcept;
+
+  std::shared_mutex m_mutex;
+  LockHistograms &m_histograms;
+  LockSite m_exclusive;
+  LockSite m_shared;
+  uint64_t m_slowHoldNs;
+  // Guarded by exclusive ownership of m_mutex
+  uint32_t m_acquisitions{};
+  uint64_t m_holdStart{};
+  uint64_t m_waitNs{};
+
+  InstrumentedSharedMutex(const InstrumentedSharedMutex &) = delete;
+
+  InstrumentedSharedMutex &operator=(const InstrumentedSharedMutex &) = delete;
+};
+
+}  // namespace metrics
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_INTERNAL_MUTEX_H_
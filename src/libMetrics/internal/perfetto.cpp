@@ -0,0 +1,441 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "perfetto.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <opentelemetry/sdk/trace/recordable.h>
+
+#include "libUtils/Logger.h"
+
+namespace zil::trace {
+
+namespace {
+
+namespace common = opentelemetry::common;
+namespace nostd = opentelemetry::nostd;
+namespace trace_api = opentelemetry::trace;
+namespace trace_sdk = opentelemetry::sdk::trace;
+
+// a stalled disk must not eat the memory of the node
+constexpr size_t MAX_BUFFER = size_t{64} << 20;
+
+constexpr std::string_view DEFAULT_CATEGORY = "zilliqa";
+
+thread_local std::string_view t_category = DEFAULT_CATEGORY;
+
+uint64_t ToNs(common::SystemTimestamp timestamp) {
+  return static_cast<uint64_t>(timestamp.time_since_epoch().count());
+}
+
+void AppendEscaped(std::string &out, std::string_view text) {
+  for (char c : text) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char escaped[8];
+          std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          out += escaped;
+        } else {
+          out += c;
+        }
+    }
+  }
+}
+
+/// Microseconds with ns precision, the unit of trace event timestamps
+void AppendUs(std::string &out, uint64_t ns) {
+  char number[32];
+  std::snprintf(number, sizeof(number), "%llu.%03llu",
+                static_cast<unsigned long long>(ns / 1000),
+                static_cast<unsigned long long>(ns % 1000));
+  out += number;
+}
+
+void AppendValue(std::string &out, const common::AttributeValue &value) {
+  char number[32];
+  nostd::visit(
+      [&](const auto &v) {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<T, bool>) {
+          out += v ? "true" : "false";
+        } else if constexpr (std::is_integral_v<T>) {
+          out += std::to_string(v);
+        } else if constexpr (std::is_floating_point_v<T>) {
+          std::snprintf(number, sizeof(number), "%.17g", v);
+          out += number;
+        } else if constexpr (std::is_same_v<T, const char *>) {
+          out += '"';
+          AppendEscaped(out, v);
+          out += '"';
+        } else if constexpr (std::is_same_v<T, nostd::string_view>) {
+          out += '"';
+          AppendEscaped(out, std::string_view(v.data(), v.size()));
+          out += '"';
+        } else {
+          out += "\"[array]\"";
+        }
+      },
+      value);
+}
+
+// Only what the trace event needs, filled in by the SDK on the thread that
+// ends the span
+class PerfettoRecordable final : public trace_sdk::Recordable {
+ public:
+  void SetIdentity(const trace_api::SpanContext &,
+                   trace_api::SpanId) noexcept override {}
+
+  void SetAttribute(nostd::string_view key,
+                    const common::AttributeValue &value) noexcept override {
+    m_args += m_args.empty() ? "\"" : ",\"";
+    AppendEscaped(m_args, std::string_view(key.data(), key.size()));
+    m_args += "\":";
+    AppendValue(m_args, value);
+  }
+
+  void AddEvent(nostd::string_view name, common::SystemTimestamp timestamp,
+                const common::KeyValueIterable &) noexcept override {
+    m_events.push_back({std::string(name.data(), name.size()), ToNs(timestamp)});
+  }
+
+  void AddLink(const trace_api::SpanContext &,
+               const common::KeyValueIterable &) noexcept override {}
+
+  void SetStatus(trace_api::StatusCode code,
+                 nostd::string_view) noexcept override {
+    m_error = code == trace_api::StatusCode::kError;
+  }
+
+  void SetName(nostd::string_view name) noexcept override {
+    m_name.assign(name.data(), name.size());
+  }
+
+  void SetSpanKind(trace_api::SpanKind) noexcept override {}
+
+  void SetResource(
+      const opentelemetry::sdk::resource::Resource &) noexcept override {}
+
+  void SetStartTime(common::SystemTimestamp start_time) noexcept override {
+    m_startNs = ToNs(start_time);
+  }
+
+  void SetDuration(std::chrono::nanoseconds duration) noexcept override {
+    m_durationNs = static_cast<uint64_t>(duration.count());
+  }
+
+  void SetInstrumentationScope(
+      const opentelemetry::sdk::instrumentationscope::InstrumentationScope &)
+      noexcept override {}
+
+  struct Event {
+    std::string name;
+    uint64_t ns;
+  };
+
+  std::string_view m_category = DEFAULT_CATEGORY;
+  std::string m_name;
+  std::string m_args;
+  std::vector<Event> m_events;
+  uint64_t m_startNs = 0;
+  uint64_t m_durationNs = 0;
+  bool m_error = false;
+};
+
+// Events formatted by one thread, swapped out by the flusher
+struct ThreadBuffer {
+  std::mutex mutex;
+  std::string data;
+  uint64_t dropped = 0;
+  // set once the processor has shut down, the thread may drop the buffer
+  std::atomic<bool> closed{false};
+
+  // owning thread only
+  uint32_t osTid = static_cast<uint32_t>(syscall(SYS_gettid));
+  std::unordered_map<std::string_view, uint32_t> tracks;
+};
+
+std::atomic<uint64_t> g_processorIds{0};
+
+class PerfettoProcessor final : public trace_sdk::SpanProcessor {
+ public:
+  PerfettoProcessor(const std::string &path,
+                    std::chrono::milliseconds flush_interval)
+      : m_id(++g_processorIds), m_interval(flush_interval) {
+    m_file = std::fopen(path.c_str(), "w");
+    if (!m_file) {
+      LOG_GENERAL(WARNING, "Cannot open trace file " << path);
+      return;
+    }
+    std::fputs("[", m_file);
+    m_open = true;
+    m_thread = std::thread([this] { Run(); });
+  }
+
+  ~PerfettoProcessor() override { Shutdown(std::chrono::microseconds::max()); }
+
+  std::unique_ptr<trace_sdk::Recordable> MakeRecordable() noexcept override {
+    return std::make_unique<PerfettoRecordable>();
+  }
+
+  void OnStart(trace_sdk::Recordable &span,
+               const trace_api::SpanContext &) noexcept override {
+    static_cast<PerfettoRecordable &>(span).m_category = t_category;
+  }
+
+  void OnEnd(std::unique_ptr<trace_sdk::Recordable> &&span) noexcept override {
+    if (!m_open.load(std::memory_order_relaxed)) {
+      return;
+    }
+    auto &record = static_cast<PerfettoRecordable &>(*span);
+    auto &buffer = GetThreadBuffer();
+    auto track = GetTrack(buffer, record.m_category);
+
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    if (buffer.data.size() > MAX_BUFFER) {
+      ++buffer.dropped;
+      return;
+    }
+    auto &out = buffer.data;
+    out += ",\n{\"name\":\"";
+    AppendEscaped(out, record.m_name);
+    out += "\",\"cat\":\"";
+    out += record.m_category;
+    out += "\",\"ph\":\"X\",\"ts\":";
+    AppendUs(out, record.m_startNs);
+    out += ",\"dur\":";
+    AppendUs(out, record.m_durationNs);
+    AppendIds(out, track);
+    if (!record.m_args.empty() || record.m_error) {
+      out += ",\"args\":{";
+      out += record.m_args;
+      if (record.m_error) {
+        out += record.m_args.empty() ? "\"error\":true" : ",\"error\":true";
+      }
+      out += '}';
+    }
+    out += '}';
+
+    for (const auto &event : record.m_events) {
+      out += ",\n{\"name\":\"";
+      AppendEscaped(out, event.name);
+      out += "\",\"cat\":\"";
+      out += record.m_category;
+      out += "\",\"ph\":\"i\",\"s\":\"t\",\"ts\":";
+      AppendUs(out, event.ns);
+      AppendIds(out, track);
+      out += '}';
+    }
+  }
+
+  bool ForceFlush(std::chrono::microseconds) noexcept override {
+    Flush();
+    return true;
+  }
+
+  bool Shutdown(std::chrono::microseconds) noexcept override {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_stop) {
+        return true;
+      }
+      m_stop = true;
+    }
+    m_open = false;
+    m_cv.notify_all();
+    if (m_thread.joinable()) {
+      m_thread.join();
+    }
+    Flush();
+
+    {
+      std::lock_guard<std::mutex> lock(m_buffersMutex);
+      for (auto &buffer : m_buffers) {
+        buffer->closed.store(true, std::memory_order_relaxed);
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    if (m_file) {
+      std::fputs("\n]\n", m_file);
+      std::fclose(m_file);
+      m_file = nullptr;
+    }
+    return true;
+  }
+
+ private:
+  ThreadBuffer &GetThreadBuffer() {
+    // One buffer per processor the thread ends spans on, the last one used
+    // is looked up first. A thread alternating between two processors keeps
+    // both buffers and their tracks.
+    struct Local {
+      uint64_t owner = 0;
+      ThreadBuffer *last = nullptr;
+      std::vector<std::pair<uint64_t, std::shared_ptr<ThreadBuffer>>> buffers;
+    };
+    thread_local Local local;
+    if (local.owner == m_id) [[likely]] {
+      return *local.last;
+    }
+
+    auto it = std::find_if(local.buffers.begin(), local.buffers.end(),
+                           [this](const auto &entry) {
+                             return entry.first == m_id;
+                           });
+    if (it == local.buffers.end()) {
+      std::erase_if(local.buffers, [](const auto &entry) {
+        return entry.second->closed.load(std::memory_order_relaxed);
+      });
+      auto buffer = std::make_shared<ThreadBuffer>();
+      {
+        std::lock_guard<std::mutex> lock(m_buffersMutex);
+        m_buffers.push_back(buffer);
+      }
+      it = local.buffers.emplace(local.buffers.end(), m_id, std::move(buffer));
+    }
+    local.owner = m_id;
+    local.last = it->second.get();
+    return *local.last;
+  }
+
+  /// Track id of (thread, category), the first span on it names the track
+  uint32_t GetTrack(ThreadBuffer &buffer, std::string_view category) {
+    auto it = buffer.tracks.find(category);
+    if (it != buffer.tracks.end()) {
+      return it->second;
+    }
+    auto track = ++m_tracks;
+    buffer.tracks.emplace(category, track);
+
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    auto &out = buffer.data;
+    out += ",\n{\"name\":\"thread_name\",\"ph\":\"M\"";
+    AppendIds(out, track);
+    out += ",\"args\":{\"name\":\"";
+    out += std::to_string(buffer.osTid);
+    out += ' ';
+    out += category;
+    out += "\"}}";
+    return track;
+  }
+
+  void AppendIds(std::string &out, uint32_t track) const {
+    out += ",\"pid\":";
+    out += m_pid;
+    out += ",\"tid\":";
+    out += std::to_string(track);
+  }
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_cv.wait_for(lock, m_interval, [this] { return m_stop; })) {
+      lock.unlock();
+      Flush();
+      lock.lock();
+    }
+  }
+
+  void Flush() {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+      std::lock_guard<std::mutex> lock(m_buffersMutex);
+      buffers = m_buffers;
+    }
+
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    if (!m_file) {
+      return;
+    }
+    uint64_t dropped = 0;
+    for (auto &buffer : buffers) {
+      {
+        std::lock_guard<std::mutex> swap(buffer->mutex);
+        m_chunk.swap(buffer->data);
+        dropped += std::exchange(buffer->dropped, 0);
+      }
+      std::string_view chunk(m_chunk);
+      if (m_first && !chunk.empty()) {
+        chunk.remove_prefix(1);  // no comma before the first event
+        m_first = false;
+      }
+      std::fwrite(chunk.data(), 1, chunk.size(), m_file);
+      m_chunk.clear();
+    }
+    std::fflush(m_file);
+    if (dropped > 0) {
+      LOG_GENERAL(WARNING, dropped << " spans not written to the trace file");
+    }
+
+    // buffers of exited threads are only referenced from m_buffers
+    buffers.clear();
+    std::lock_guard<std::mutex> lock2(m_buffersMutex);
+    std::erase_if(m_buffers, [](const std::shared_ptr<ThreadBuffer> &buffer) {
+      std::lock_guard<std::mutex> lock(buffer->mutex);
+      return buffer.use_count() == 1 && buffer->data.empty();
+    });
+  }
+
+  const uint64_t m_id;
+  const std::chrono::milliseconds m_interval;
+  const std::string m_pid = std::to_string(getpid());
+  std::atomic<uint32_t> m_tracks{0};
+
+  std::mutex m_buffersMutex;
+  std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+
+  std::mutex m_fileMutex;
+  FILE *m_file = nullptr;
+  std::atomic<bool> m_open{false};
+  std::string m_chunk;
+  bool m_first = true;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_stop = false;
+  std::thread m_thread;
+};
+
+}  // namespace
+
+void SetSpanCategory(std::string_view category) noexcept {
+  t_category = category.empty() ? DEFAULT_CATEGORY : category;
+}
+
+std::unique_ptr<trace_sdk::SpanProcessor> CreatePerfettoProcessor(
+    const std::string &path, std::chrono::milliseconds flush_interval) {
+  return std::make_unique<PerfettoProcessor>(path, flush_interval);
+}
+
+}  // namespace zil::trace
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_PERFETTO_H_
+#define ZILLIQA_SRC_LIBMETRICS_INTERNAL_PERFETTO_H_
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <opentelemetry/sdk/trace/processor.h>
+
+namespace zil {
+namespace trace {
+
+/// Category of the spans the calling thread starts until the next call,
+/// Tracing2 sets the filter class name around StartSpan. Spans without one
+/// are filed under "zilliqa".
+void SetSpanCategory(std::string_view category) noexcept;
+
+// Span processor of the FILE_PERFETTO provider. Ended spans and their events
+// are formatted as Chrome trace events by the thread ending them, into a
+// buffer owned by that thread, so there is no exporter queue and no lock
+// shared between threads. A flusher thread appends the buffers to the file
+// every flush_interval. Every (thread, category) pair is a track of its own.
+//
+// The file is a JSON array of trace events which ui.perfetto.dev and
+// chrome://tracing open directly, also while it is still being written.
+std::unique_ptr<opentelemetry::sdk::trace::SpanProcessor>
+CreatePerfettoProcessor(const std::string &path,
+                        std::chrono::milliseconds flush_interval =
+                            std::chrono::milliseconds(1000));
+
+}  // namespace trace
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_INTERNAL_PERFETTO_H_
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_PREBUFFER_H_
+#define ZILLIQA_SRC_LIBMETRICS_INTERNAL_PREBUFFER_H_
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "libMetrics/Metrics.h"
+
+namespace zil {
+namespace metrics {
+
+// Stand-ins for the SDK instruments while Metrics::StartAsync is still
+// building the provider. Plain adds are summed in one atomic, adds with
+// attributes and histogram records are kept up to MAX_ENTRIES and dropped
+// beyond. Replay hands everything to the real instrument once it exists.
+
+template <typename V>
+class PreBuffer {
+ public:
+  static constexpr size_t MAX_ENTRIES = 4096;
+
+  struct Entry {
+    V value;
+    AttributeSetHandle attributes;
+  };
+
+  void Keep(V value, const common::KeyValueIterable &attributes) noexcept {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_entries.size() < MAX_ENTRIES) {
+      m_entries.push_back({value, AttributeSetHandle(attributes)});
+    }
+  }
+
+  std::vector<Entry> Take() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::move(m_entries);
+  }
+
+ private:
+  std::mutex m_mutex;
+  std::vector<Entry> m_entries;
+};
+
+template <typename V>
+class BufferedCounter final : public metrics_api::Counter<V> {
+ public:
+  void Add(V value) noexcept override {
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  void Add(V value, const opentelemetry::context::Context &) noexcept override {
+    Add(value);
+  }
+
+  void Add(V value,
+           const common::KeyValueIterable &attributes) noexcept override {
+    m_buffer.Keep(value, attributes);
+  }
+
+  void Add(V value, const common::KeyValueIterable &attributes,
+           const opentelemetry::context::Context &) noexcept override {
+    m_buffer.Keep(value, attributes);
+  }
+
+  void Replay(metrics_api::Counter<V> &target) {
+    if (auto sum = m_sum.exchange(0, std::memory_order_relaxed); sum != 0) {
+      target.Add(sum);
+    }
+    for (const auto &entry : m_buffer.Take()) {
+      target.Add(entry.value, static_cast<const common::KeyValueIterable &>(
+                                  entry.attributes));
+    }
+  }
+
+ private:
+  std::atomic<V> m_sum{};
+  PreBuffer<V> m_buffer;
+};
+
+template <typename V>
+class BufferedHistogram final : public metrics_api::Histogram<V> {
+ public:
+  void Record(V value,
+              const opentelemetry::context::Context &) noexcept override {
+    m_buffer.Keep(value, opentelemetry::common::NoopKeyValueIterable{});
+  }
+
+  void Record(V value, const common::KeyValueIterable &attributes,
+              const opentelemetry::context::Context &) noexcept override {
+    m_buffer.Keep(value, attributes);
+  }
+
+  void Replay(metrics_api::Histogram<V> &target) {
+    for (const auto &entry : m_buffer.Take()) {
+      target.Record(
+          entry.value,
+          static_cast<const common::KeyValueIterable &>(entry.attributes),
+          opentelemetry::context::Context{});
+    }
+  }
+
+ private:
+  PreBuffer<V> m_buffer;
+};
+
+template <typename T>
+struct BufferedInstrument;
+
+template <typename V>
+struct BufferedInstrument<metrics_api::Counter<V>> {
+  using type = BufferedCounter<V>;
+};
+
+template <typename V>
+struct BufferedInstrument<metrics_api::Histogram<V>> {
+  using type = BufferedHistogram<V>;
+};
+
+}  // namespace metrics
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_INTERNAL_PREBUFFER_H_
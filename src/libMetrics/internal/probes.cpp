@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "probes.h"
+
+#ifdef ZIL_ENABLE_USDT
+
+// The tracer increments a semaphore while it is attached to the probe, the
+// .probes section is where it looks for them
+#define ZIL_PROBE_DEFINE_SEMAPHORE(NAME)             \
+  volatile unsigned short zilliqa_##NAME##_semaphore \
+      __attribute__((section(".probes"))) = 0;
+ZIL_PROBES(ZIL_PROBE_DEFINE_SEMAPHORE)
+#undef ZIL_PROBE_DEFINE_SEMAPHORE
+
+#endif  // ZIL_ENABLE_USDT
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_PROBES_H_
+#define ZILLIQA_SRC_LIBMETRICS_INTERNAL_PROBES_H_
+
+// USDT probes of provider "zilliqa", compiled in with -DZIL_ENABLE_USDT=ON.
+// A probe site is a nop until bpftrace or perf attaches to it, and each
+// probe has a semaphore so that its arguments (e.g. the hex ids of a span)
+// are only computed while someone listens:
+//
+//   bpftrace -e 'usdt:./server:zilliqa:span_start
+//                { printf("%s %s\n", str(arg1, arg2), str(arg3)); }'
+//
+// Probes and their arguments. filter is the filter class enum value, ids
+// is the serialized span identity (Span::GetIds). Floating point values are
+// passed as integers in thousandths of the unit of the histogram, i.e. ns
+// for the latency histograms in us.
+//
+//   span_start(int filter, const char *name, size_t name_size,
+//              const char *ids)
+//   span_end(int filter, const char *ids, int status)
+//   counter_add(int filter, const char *name, int64_t delta)
+//   histogram_record(int filter, const char *name, int64_t value)
+//   latency_scope(int filter, const char *function, int64_t ns)
+#define ZIL_PROBES(P) \
+  P(span_start)       \
+  P(span_end)         \
+  P(counter_add)      \
+  P(histogram_record) \
+  P(latency_scope)
+
+#ifdef ZIL_ENABLE_USDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+// Semaphores are named as sys/sdt.h expects them, defined in probes.cpp
+#define ZIL_PROBE_DECLARE_SEMAPHORE(NAME) \
+  extern "C" volatile unsigned short zilliqa_##NAME##_semaphore;
+ZIL_PROBES(ZIL_PROBE_DECLARE_SEMAPHORE)
+#undef ZIL_PROBE_DECLARE_SEMAPHORE
+
+#define ZIL_PROBE_ENABLED(NAME) \
+  (__builtin_expect(zilliqa_##NAME##_semaphore != 0, 0))
+#define ZIL_PROBE2(NAME, A1, A2) DTRACE_PROBE2(zilliqa, NAME, A1, A2)
+#define ZIL_PROBE3(NAME, A1, A2, A3) DTRACE_PROBE3(zilliqa, NAME, A1, A2, A3)
+#define ZIL_PROBE4(NAME, A1, A2, A3, A4) \
+  DTRACE_PROBE4(zilliqa, NAME, A1, A2, A3, A4)
+
+#else
+
+// The arguments are not evaluated, only referenced
+#define ZIL_PROBE_ENABLED(NAME) (false)
+#define ZIL_PROBE2(NAME, A1, A2) \
+  do {                           \
+    (void)sizeof(A1);            \
+    (void)sizeof(A2);            \
+  } while (0)
+#define ZIL_PROBE3(NAME, A1, A2, A3) \
+  do {                               \
+    ZIL_PROBE2(NAME, A1, A2);        \
+    (void)sizeof(A3);                \
+  } while (0)
+#define ZIL_PROBE4(NAME, A1, A2, A3, A4) \
+  do {                                   \
+    ZIL_PROBE3(NAME, A1, A2, A3);        \
+    (void)sizeof(A4);                    \
+  } while (0)
+
+#endif  // ZIL_ENABLE_USDT
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_INTERNAL_PROBES_H_
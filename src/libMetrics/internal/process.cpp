@@ -0,0 +1,459 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "process.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <opentelemetry/metrics/provider.h>
+
+namespace zil {
+namespace metrics {
+
+namespace {
+
+// Same order as the instruments created in Publish
+enum Instrument : size_t {
+  RSS,
+  RSS_PEAK,
+  CPU_SECONDS,
+  CONTEXT_SWITCHES,
+  PAGE_FAULTS,
+  THREADS,
+  OPEN_FDS,
+  IO_BYTES,
+  CGROUP_THROTTLED_PERIODS,
+  CGROUP_THROTTLED_SECONDS,
+  CGROUP_MEMORY_PRESSURE,
+};
+
+constexpr size_t BUFFER_SIZE = 16384;
+
+const opentelemetry::common::NoopKeyValueIterable NO_ATTRIBUTES;
+const AttributeSetHandle MODE_USER{{"mode", "user"}};
+const AttributeSetHandle MODE_SYSTEM{{"mode", "system"}};
+const AttributeSetHandle KIND_VOLUNTARY{{"kind", "voluntary"}};
+const AttributeSetHandle KIND_INVOLUNTARY{{"kind", "involuntary"}};
+const AttributeSetHandle KIND_MINOR{{"kind", "minor"}};
+const AttributeSetHandle KIND_MAJOR{{"kind", "major"}};
+const AttributeSetHandle KIND_SOME{{"kind", "some"}};
+const AttributeSetHandle KIND_FULL{{"kind", "full"}};
+const AttributeSetHandle DIRECTION_READ{{"direction", "read"}};
+const AttributeSetHandle DIRECTION_WRITE{{"direction", "write"}};
+
+int OpenRead(const std::string &path, int flags = 0) {
+  return ::open(path.c_str(), O_RDONLY | O_CLOEXEC | flags);
+}
+
+void CloseFd(int &fd) {
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+// Skips blanks then parses an unsigned number, advances pos past it
+uint64_t ParseU64(std::string_view text, size_t &pos) {
+  while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t')) ++pos;
+  uint64_t value = 0;
+  while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+    value = value * 10 + (text[pos++] - '0');
+  }
+  return value;
+}
+
+// Calls fn(key, rest) for every "key<sep>rest" line
+template <typename F>
+void ForEachLine(std::string_view text, char sep, F &&fn) {
+  while (!text.empty()) {
+    auto eol = text.find('\n');
+    auto line = text.substr(0, eol);
+    auto split = line.find(sep);
+    if (split != std::string_view::npos) {
+      fn(line.substr(0, split), line.substr(split + 1));
+    }
+    if (eol == std::string_view::npos) break;
+    text.remove_prefix(eol + 1);
+  }
+}
+
+// Value of "avg10=" in one PSI line
+double ParseAvg10(std::string_view line) {
+  auto pos = line.find("avg10=");
+  if (pos == std::string_view::npos) {
+    return 0;
+  }
+  // the line always goes on with " avg60=" so strtod stops in the buffer
+  return std::strtod(line.data() + pos + 6, nullptr);
+}
+
+std::string CgroupPath() {
+  int fd = OpenRead("/proc/self/cgroup");
+  if (fd < 0) {
+    return {};
+  }
+  char buf[4096];
+  ssize_t n = ::read(fd, buf, sizeof(buf) - 1);
+  ::close(fd);
+  if (n <= 0) {
+    return {};
+  }
+
+  // cgroup v2 only: "0::/path"
+  std::string_view text(buf, n);
+  std::string path;
+  ForEachLine(text, ':', [&path](std::string_view key, std::string_view rest) {
+    if (key == "0" && !rest.empty() && rest[0] == ':') {
+      path = rest.substr(1);
+    }
+  });
+  return path;
+}
+
+}  // namespace
+
+ProcessMetrics &ProcessMetrics::GetInstance() {
+  static ProcessMetrics metrics;
+  return metrics;
+}
+
+ProcessMetrics::ProcessMetrics() : m_buffer(BUFFER_SIZE) {
+  if (auto ticks = sysconf(_SC_CLK_TCK); ticks > 0) {
+    m_ticksPerSecond = static_cast<double>(ticks);
+  }
+  if (auto page = sysconf(_SC_PAGESIZE); page > 0) {
+    m_pageSize = static_cast<uint64_t>(page);
+  }
+}
+
+ProcessMetrics::~ProcessMetrics() { Close(); }
+
+void ProcessMetrics::Open() {
+  Close();
+  m_stat = OpenRead("/proc/self/stat");
+  m_status = OpenRead("/proc/self/status");
+  m_io = OpenRead("/proc/self/io");
+  m_fdDir = OpenRead("/proc/self/fd", O_DIRECTORY);
+
+  auto cgroup = CgroupPath();
+  if (!cgroup.empty()) {
+    std::string dir = "/sys/fs/cgroup" + cgroup;
+    m_cpuStat = OpenRead(dir + "/cpu.stat");
+    m_memoryPressure = OpenRead(dir + "/memory.pressure");
+  }
+}
+
+void ProcessMetrics::Close() {
+  CloseFd(m_stat);
+  CloseFd(m_status);
+  CloseFd(m_io);
+  CloseFd(m_fdDir);
+  CloseFd(m_cpuStat);
+  CloseFd(m_memoryPressure);
+}
+
+void ProcessMetrics::Publish() {
+  std::vector<std::unique_ptr<Observable>> instruments;
+
+  // Created even if PROCESS is disabled, the callback checks the filter
+  // class on every collection so Filter::Reload can switch it on
+  auto meter =
+      opentelemetry::metrics::Provider::GetMeterProvider()->GetMeter(
+          PROCESS_METRIC_FAMILY, METRIC_SCHEMA_VERSION, METRIC_SCHEMA);
+
+  auto name = [](const char *n) {
+    return GetFullName(PROCESS_METRIC_FAMILY, n);
+  };
+
+  // Same order as enum Instrument
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableGauge(name("resident_memory_bytes"),
+                                        "Resident set size", "By"),
+      name("resident_memory_bytes")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableGauge(name("resident_memory_peak_bytes"),
+                                        "Peak resident set size", "By"),
+      name("resident_memory_peak_bytes")));
+  instruments.emplace_back(new Observable(
+      meter->CreateDoubleObservableCounter(
+          name("cpu_seconds"), "CPU time per mode (user, system)", "s"),
+      name("cpu_seconds")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableCounter(
+          name("context_switches"),
+          "Context switches (voluntary, involuntary)"),
+      name("context_switches")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableCounter(name("page_faults"),
+                                          "Page faults (minor, major)"),
+      name("page_faults")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableGauge(name("threads"), "Thread count"),
+      name("threads")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableGauge(name("open_fds"),
+                                        "Open file descriptors"),
+      name("open_fds")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableCounter(
+          name("io_bytes"), "Storage I/O (read, write)", "By"),
+      name("io_bytes")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableCounter(
+          name("cgroup_cpu_throttled_periods"),
+          "cgroup v2 periods with the CPU quota exhausted"),
+      name("cgroup_cpu_throttled_periods")));
+  instruments.emplace_back(new Observable(
+      meter->CreateDoubleObservableCounter(
+          name("cgroup_cpu_throttled_seconds"),
+          "cgroup v2 time spent throttled", "s"),
+      name("cgroup_cpu_throttled_seconds")));
+  instruments.emplace_back(new Observable(
+      meter->CreateDoubleObservableGauge(
+          name("cgroup_memory_pressure"),
+          "cgroup v2 memory PSI avg10 (some, full)", "%"),
+      name("cgroup_memory_pressure")));
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Open();
+  }
+
+  std::unique_ptr<BatchObservable> batch;
+  if (!instruments.empty()) {
+    std::vector<Observable *> members;
+    for (auto &i : instruments) {
+      members.push_back(i.get());
+    }
+    batch = std::make_unique<BatchObservable>(members);
+    batch->SetCallback(
+        [this, members](BatchObservable::BatchResult &&result) {
+          Observe(std::move(result), members);
+        });
+  }
+
+  // old instruments remove their callbacks in dtor, which waits for a
+  // running collection, so swap outside the lock. The old batch goes first.
+  std::vector<std::unique_ptr<Observable>> old;
+  std::unique_ptr<BatchObservable> old_batch;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    old.swap(m_instruments);
+    old_batch.swap(m_batch);
+    m_instruments = std::move(instruments);
+    m_batch = std::move(batch);
+  }
+}
+
+std::string_view ProcessMetrics::Read(int fd) {
+  if (fd < 0) {
+    return {};
+  }
+  size_t size = 0;
+  while (size < m_buffer.size() - 1) {
+    ssize_t n = ::pread(fd, m_buffer.data() + size, m_buffer.size() - 1 - size,
+                        static_cast<off_t>(size));
+    if (n <= 0) {
+      break;
+    }
+    size += n;
+  }
+  m_buffer[size] = '\0';
+  return {m_buffer.data(), size};
+}
+
+void ProcessMetrics::ReadStat(Snapshot &snapshot) {
+  auto text = Read(m_stat);
+  // comm may contain blanks and parens, fields start after the last ')'
+  auto paren = text.rfind(')');
+  if (paren == std::string_view::npos) {
+    return;
+  }
+  text.remove_prefix(paren + 2);
+
+  // text starts at field 3 (state), see proc(5)
+  uint64_t fields[22]{};
+  size_t pos = 0;
+  for (int field = 3; field <= 24 && pos < text.size(); ++field) {
+    auto next = text.find(' ', pos);
+    if (field > 3) {
+      size_t p = pos;
+      fields[field - 3] = ParseU64(text, p);
+    }
+    if (next == std::string_view::npos) break;
+    pos = next + 1;
+  }
+
+  snapshot.minor_faults = fields[10 - 3];
+  snapshot.major_faults = fields[12 - 3];
+  snapshot.cpu_user_seconds = fields[14 - 3] / m_ticksPerSecond;
+  snapshot.cpu_system_seconds = fields[15 - 3] / m_ticksPerSecond;
+  snapshot.threads = fields[20 - 3];
+  snapshot.rss_bytes = fields[24 - 3] * m_pageSize;
+  snapshot.valid = true;
+}
+
+void ProcessMetrics::ReadStatus(Snapshot &snapshot) {
+  ForEachLine(Read(m_status), ':',
+              [&snapshot](std::string_view key, std::string_view rest) {
+                size_t pos = 0;
+                if (key == "VmHWM") {
+                  snapshot.rss_peak_bytes = ParseU64(rest, pos) * 1024;
+                } else if (key == "voluntary_ctxt_switches") {
+                  snapshot.voluntary_switches = ParseU64(rest, pos);
+                } else if (key == "nonvoluntary_ctxt_switches") {
+                  snapshot.involuntary_switches = ParseU64(rest, pos);
+                }
+              });
+}
+
+void ProcessMetrics::ReadIo(Snapshot &snapshot) {
+  // needs ptrace access to ourselves, not granted in every container
+  auto text = Read(m_io);
+  snapshot.has_io = !text.empty();
+  ForEachLine(text, ':',
+              [&snapshot](std::string_view key, std::string_view rest) {
+                size_t pos = 0;
+                if (key == "read_bytes") {
+                  snapshot.read_bytes = ParseU64(rest, pos);
+                } else if (key == "write_bytes") {
+                  snapshot.write_bytes = ParseU64(rest, pos);
+                }
+              });
+}
+
+void ProcessMetrics::ReadFds(Snapshot &snapshot) {
+  if (m_fdDir < 0 || ::lseek(m_fdDir, 0, SEEK_SET) != 0) {
+    return;
+  }
+
+  uint64_t count = 0;
+  for (;;) {
+    long n = ::syscall(SYS_getdents64, m_fdDir, m_buffer.data(),
+                       m_buffer.size());
+    if (n <= 0) {
+      break;
+    }
+    for (long offset = 0; offset < n;) {
+      // struct linux_dirent64: ino, off, reclen, type, name
+      unsigned short reclen;
+      std::memcpy(&reclen, m_buffer.data() + offset + 16, sizeof(reclen));
+      const char *name = m_buffer.data() + offset + 19;
+      if (name[0] != '.') {
+        ++count;
+      }
+      offset += reclen;
+    }
+  }
+  // minus our own directory fd
+  snapshot.open_fds = count ? count - 1 : 0;
+}
+
+void ProcessMetrics::ReadCpuStat(Snapshot &snapshot) {
+  auto text = Read(m_cpuStat);
+  snapshot.has_cpu_stat = !text.empty();
+  ForEachLine(text, ' ',
+              [&snapshot](std::string_view key, std::string_view rest) {
+                size_t pos = 0;
+                if (key == "nr_throttled") {
+                  snapshot.throttled_periods = ParseU64(rest, pos);
+                } else if (key == "throttled_usec") {
+                  snapshot.throttled_seconds = ParseU64(rest, pos) / 1e6;
+                }
+              });
+}
+
+void ProcessMetrics::ReadMemoryPressure(Snapshot &snapshot) {
+  auto text = Read(m_memoryPressure);
+  snapshot.has_memory_pressure = !text.empty();
+  ForEachLine(text, ' ',
+              [&snapshot](std::string_view key, std::string_view rest) {
+                if (key == "some") {
+                  snapshot.memory_some_avg10 = ParseAvg10(rest);
+                } else if (key == "full") {
+                  snapshot.memory_full_avg10 = ParseAvg10(rest);
+                }
+              });
+}
+
+ProcessMetrics::Snapshot ProcessMetrics::Sample() {
+  Snapshot snapshot;
+  ReadStat(snapshot);
+  ReadStatus(snapshot);
+  ReadIo(snapshot);
+  ReadFds(snapshot);
+  ReadCpuStat(snapshot);
+  ReadMemoryPressure(snapshot);
+  return snapshot;
+}
+
+void ProcessMetrics::Observe(BatchObservable::BatchResult &&result,
+                             const std::vector<Observable *> &members) {
+  if (!Filter::GetInstance().Enabled(FilterClass::PROCESS)) {
+    return;
+  }
+
+  Snapshot s;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    s = Sample();
+  }
+  if (!s.valid) {
+    return;
+  }
+
+  result.Set(*members[RSS], s.rss_bytes, NO_ATTRIBUTES);
+  result.Set(*members[RSS_PEAK], s.rss_peak_bytes, NO_ATTRIBUTES);
+  result.Set(*members[CPU_SECONDS], s.cpu_user_seconds, MODE_USER);
+  result.Set(*members[CPU_SECONDS], s.cpu_system_seconds, MODE_SYSTEM);
+  result.Set(*members[CONTEXT_SWITCHES], s.voluntary_switches, KIND_VOLUNTARY);
+  result.Set(*members[CONTEXT_SWITCHES], s.involuntary_switches,
+             KIND_INVOLUNTARY);
+  result.Set(*members[PAGE_FAULTS], s.minor_faults, KIND_MINOR);
+  result.Set(*members[PAGE_FAULTS], s.major_faults, KIND_MAJOR);
+  result.Set(*members[THREADS], s.threads, NO_ATTRIBUTES);
+  result.Set(*members[OPEN_FDS], s.open_fds, NO_ATTRIBUTES);
+
+  if (s.has_io) {
+    result.Set(*members[IO_BYTES], s.read_bytes, DIRECTION_READ);
+    result.Set(*members[IO_BYTES], s.write_bytes, DIRECTION_WRITE);
+  }
+
+  if (s.has_cpu_stat) {
+    result.Set(*members[CGROUP_THROTTLED_PERIODS], s.throttled_periods,
+               NO_ATTRIBUTES);
+    result.Set(*members[CGROUP_THROTTLED_SECONDS], s.throttled_seconds,
+               NO_ATTRIBUTES);
+  }
+
+  if (s.has_memory_pressure) {
+    result.Set(*members[CGROUP_MEMORY_PRESSURE], s.memory_some_avg10,
+               KIND_SOME);
+    result.Set(*members[CGROUP_MEMORY_PRESSURE], s.memory_full_avg10,
+               KIND_FULL);
+  }
+}
+
+}  // namespace metrics
+}  // namespace zil
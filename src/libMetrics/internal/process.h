@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_PROCESS_H_
+#define ZILLIQA_SRC_LIBMETRICS_INTERNAL_PROCESS_H_
+
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "libMetrics/Metrics.h"
+
+namespace zil {
+namespace metrics {
+
+// Process gauges under PROCESS_METRIC_FAMILY, enabled by the PROCESS filter
+// class: RSS, CPU, context switches, page faults, I/O, open fds, threads and
+// cgroup v2 CPU throttling and memory pressure.
+//
+// The /proc and cgroup files stay open and are re-read with pread into one
+// reusable buffer. All instruments are members of one BatchObservable so
+// the files are read once per collection cycle.
+class ProcessMetrics {
+ public:
+  static ProcessMetrics &GetInstance();
+
+  /// (Re)creates the instruments on the current meter provider, they report
+  /// nothing while PROCESS is disabled. Called by Metrics::Init
+  void Publish();
+
+  ~ProcessMetrics();
+
+  ProcessMetrics(const ProcessMetrics &) = delete;
+
+  ProcessMetrics &operator=(const ProcessMetrics &) = delete;
+
+ private:
+  struct Snapshot {
+    bool valid = false;
+    uint64_t rss_bytes = 0;
+    uint64_t rss_peak_bytes = 0;
+    double cpu_user_seconds = 0;
+    double cpu_system_seconds = 0;
+    uint64_t voluntary_switches = 0;
+    uint64_t involuntary_switches = 0;
+    uint64_t minor_faults = 0;
+    uint64_t major_faults = 0;
+    uint64_t threads = 0;
+    uint64_t open_fds = 0;
+
+    bool has_io = false;
+    uint64_t read_bytes = 0;
+    uint64_t write_bytes = 0;
+
+    bool has_cpu_stat = false;
+    uint64_t throttled_periods = 0;
+    double throttled_seconds = 0;
+
+    bool has_memory_pressure = false;
+    double memory_some_avg10 = 0;
+    double memory_full_avg10 = 0;
+  };
+
+  ProcessMetrics();
+
+  void Open();
+
+  void Close();
+
+  /// Re-reads everything, called with m_mutex held
+  Snapshot Sample();
+
+  std::string_view Read(int fd);
+
+  void ReadStat(Snapshot &snapshot);
+
+  void ReadStatus(Snapshot &snapshot);
+
+  void ReadIo(Snapshot &snapshot);
+
+  void ReadFds(Snapshot &snapshot);
+
+  void ReadCpuStat(Snapshot &snapshot);
+
+  void ReadMemoryPressure(Snapshot &snapshot);
+
+  void Observe(BatchObservable::BatchResult &&result,
+               const std::vector<Observable *> &members);
+
+  std::mutex m_mutex;
+  std::vector<std::unique_ptr<Observable>> m_instruments;
+  std::unique_ptr<BatchObservable> m_batch;
+
+  int m_stat = -1;
+  int m_status = -1;
+  int m_io = -1;
+  int m_fdDir = -1;
+  int m_cpuStat = -1;
+  int m_memoryPressure = -1;
+
+  double m_ticksPerSecond = 100;
+  uint64_t m_pageSize = 4096;
+
+  std::vector<char> m_buffer;
+};
+
+}  // namespace metrics
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_INTERNAL_PROCESS_H_
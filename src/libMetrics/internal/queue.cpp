@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "queue.h"
+
+#include <algorithm>
+
+#include "libUtils/Logger.h"
+
+namespace zil {
+namespace metrics {
+
+QueueStats::QueueStats(FilterClass fc, const std::string &name,
+                       const std::string &description,
+                       const std::vector<double> &boundaries)
+    : m_fc(fc),
+      m_sojourn(fc, name + "_sojourn", boundaries,
+                description + " (time in queue)", "us"),
+      m_blocked(fc, name + "_blocked", boundaries,
+                description + " (producer blocked on a full queue)", "us"),
+      m_enqueueAttributes{{"op", "enqueue"}},
+      m_dequeueAttributes{{"op", "dequeue"}},
+      m_depth(Metrics::GetInstance().CreateInt64Gauge(
+          name + "_depth", description + " (depth)", "items")),
+      m_ops(Metrics::GetInstance().CreateInt64ObservableCounter(
+          name + "_ops", description + " (operations)", "items")) {
+  m_depth.SetCallback(FilteredCallback(
+      m_fc, [this](Observable::Result &&result) {
+        result.Set(Depth(), AttributeSetHandle{});
+      }));
+  m_ops.SetCallback(FilteredCallback(
+      m_fc, [this](Observable::Result &&result) {
+        result.Set(m_enqueued.load(std::memory_order_relaxed),
+                   m_enqueueAttributes);
+        result.Set(m_dequeued.load(std::memory_order_relaxed),
+                   m_dequeueAttributes);
+      }));
+}
+
+int64_t QueueStats::Depth() const noexcept {
+  // a pop can be counted before its push, hence the clamp
+  const uint64_t dequeued = m_dequeued.load(std::memory_order_relaxed);
+  const uint64_t enqueued = m_enqueued.load(std::memory_order_relaxed);
+  return std::max<int64_t>(static_cast<int64_t>(enqueued - dequeued), 0);
+}
+
+void QueueStats::RecordBlocked(uint64_t ns) noexcept {
+  try {
+    m_blocked.Record(ns / 1e3);
+  } catch (...) {
+    LOG_GENERAL(WARNING, "Queue blocked time not recorded");
+  }
+}
+
+void QueueStats::RecordSojourn(uint64_t ns) noexcept {
+  try {
+    m_sojourn.Record(ns / 1e3);
+  } catch (...) {
+    LOG_GENERAL(WARNING, "Queue sojourn time not recorded");
+  }
+}
+
+}  // namespace metrics
+}  // namespace zil
@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_QUEUE_H_
+#define ZILLIQA_SRC_LIBMETRICS_INTERNAL_QUEUE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "clock.h"
+#include "libMetrics/Tracing2.h"
+#include "mixins.h"
+
+namespace zil {
+namespace metrics {
+
+// Bounded lock-free multi producer multi consumer ring (D. Vyukov). Each
+// cell has a sequence number telling producers and consumers whose turn it
+// is, so an operation is one CAS on its position and no cell is shared
+// with the other side until it is handed over. The capacity is rounded up
+// to a power of two, T must be default constructible and move assignable.
+template <typename T>
+class MpmcRing final {
+ public:
+  explicit MpmcRing(size_t capacity)
+      : m_mask(RoundUp(capacity) - 1), m_cells(new Cell[m_mask + 1]) {
+    for (size_t i = 0; i <= m_mask; ++i) {
+      m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  size_t Capacity() const noexcept { return m_mask + 1; }
+
+  /// \return false if full, value is left untouched then
+  bool TryPush(T &&value) {
+    Cell *cell;
+    size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &m_cells[pos & m_mask];
+      const size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const auto diff =
+          static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+      if (diff == 0) {
+        if (m_enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = m_enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// \return false if empty
+  bool TryPop(T &value) {
+    Cell *cell;
+    size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &m_cells[pos & m_mask];
+      const size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq) -
+                        static_cast<std::ptrdiff_t>(pos + 1);
+      if (diff == 0) {
+        if (m_dequeuePos.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = m_dequeuePos.load(std::memory_order_relaxed);
+      }
+    }
+    value = std::move(cell->value);
+    cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  static size_t RoundUp(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  const size_t m_mask;
+  const std::unique_ptr<Cell[]> m_cells;
+  alignas(64) std::atomic<size_t> m_enqueuePos{0};
+  alignas(64) std::atomic<size_t> m_dequeuePos{0};
+
+  MpmcRing(const MpmcRing &) = delete;
+
+  MpmcRing &operator=(const MpmcRing &) = delete;
+};
+
+// Instruments of one queue: <name>_depth gauge, <name>_ops counter with
+// "op" enqueue or dequeue, <name>_sojourn histogram (us from enqueue to
+// dequeue) and <name>_blocked histogram (us a producer waited for space).
+// Depth and rates are read from two counters at collection, so they cost
+// one relaxed atomic add per operation.
+class QueueStats final {
+ public:
+  QueueStats(FilterClass fc, const std::string &name,
+             const std::string &description,
+             const std::vector<double> &boundaries = {
+                 10.0, 100.0, 1000.0, 10000.0, 100000.0, 1000000.0});
+
+  bool Enabled() { return Filter::GetInstance().Enabled(m_fc); }
+
+  void Enqueued() noexcept {
+    m_enqueued.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// \param enqueuedNs MonotonicNs() at enqueue, 0 if not taken
+  void Dequeued(uint64_t enqueuedNs) noexcept {
+    m_dequeued.fetch_add(1, std::memory_order_relaxed);
+    if (enqueuedNs != 0) {
+      RecordSojourn(MonotonicNs() - enqueuedNs);
+    }
+  }
+
+  void RecordBlocked(uint64_t ns) noexcept;
+
+  /// Items in the queue, may be off by the operations in flight
+  int64_t Depth() const noexcept;
+
+ private:
+  void RecordSojourn(uint64_t ns) noexcept;
+
+  FilterClass m_fc;
+  alignas(64) std::atomic<uint64_t> m_enqueued{};
+  alignas(64) std::atomic<uint64_t> m_dequeued{};
+  InstrumentWrapper<DoubleHistogram> m_sojourn;
+  InstrumentWrapper<DoubleHistogram> m_blocked;
+  AttributeSetHandle m_enqueueAttributes;
+  AttributeSetHandle m_dequeueAttributes;
+  // Last, so the callbacks are removed before anything they read goes away
+  Observable m_depth;
+  Observable m_ops;
+
+  QueueStats(const QueueStats &) = delete;
+
+  QueueStats &operator=(const QueueStats &) = delete;
+};
+
+// What an InstrumentedQueue stores per item
+template <typename T>
+struct QueueEntry {
+  T value{};
+  // MonotonicNs() at enqueue, 0 while the filter class is disabled
+  uint64_t enqueuedNs{};
+  // Active Tracing2 span of the producer, if the queue carries contexts
+  trace2::TraceContext context{};
+};
+
+// Queue adaptor publishing QueueStats. Impl<QueueEntry<T>> is the queue
+// itself, MpmcRing by default, or any type with a capacity constructor and
+// the TryPush(U&&) and TryPop(U&) of MpmcRing, e.g. a locked deque. TryPush
+// must leave the item untouched when it fails.
+//
+// With carry_context every item takes the producer's active span context
+// along, so the consumer can continue the trace with
+// trace2::Tracing::CreateChildSpan(filter, name, context), no ids are
+// serialized.
+template <typename T, template <typename> class Impl = MpmcRing>
+class InstrumentedQueue final {
+ public:
+  InstrumentedQueue(QueueStats &stats, size_t capacity,
+                    bool carry_context = false)
+      : m_stats(stats), m_queue(capacity), m_carryContext(carry_context) {}
+
+  /// \return false if full, value is left untouched then
+  bool TryPush(T &&value) {
+    QueueEntry<T> entry{std::move(value), Stamp(), Context()};
+    if (!m_queue.TryPush(std::move(entry))) {
+      value = std::move(entry.value);
+      return false;
+    }
+    m_stats.Enqueued();
+    return true;
+  }
+
+  /// Waits for space, the time blocked is recorded
+  void Push(T value) {
+    QueueEntry<T> entry{std::move(value), Stamp(), Context()};
+    if (m_queue.TryPush(std::move(entry))) {
+      m_stats.Enqueued();
+      return;
+    }
+    const uint64_t start = MonotonicNs();
+    for (unsigned spins = 0;; ++spins) {
+      Backoff(spins);
+      // the sojourn starts when the item is in
+      if (entry.enqueuedNs != 0) {
+        entry.enqueuedNs = MonotonicNs();
+      }
+      if (m_queue.TryPush(std::move(entry))) {
+        break;
+      }
+    }
+    m_stats.Enqueued();
+    if (m_stats.Enabled()) {
+      m_stats.RecordBlocked(MonotonicNs() - start);
+    }
+  }
+
+  /// \return false if empty
+  bool TryPop(T &value) {
+    trace2::TraceContext ignored;
+    return TryPop(value, ignored);
+  }
+
+  /// \param context Producer's span context, invalid if none or not carried
+  bool TryPop(T &value, trace2::TraceContext &context) {
+    QueueEntry<T> entry;
+    if (!m_queue.TryPop(entry)) {
+      return false;
+    }
+    m_stats.Dequeued(entry.enqueuedNs);
+    value = std::move(entry.value);
+    context = entry.context;
+    return true;
+  }
+
+  /// Waits for an item
+  void Pop(T &value, trace2::TraceContext &context) {
+    for (unsigned spins = 0; !TryPop(value, context); ++spins) {
+      Backoff(spins);
+    }
+  }
+
+  void Pop(T &value) {
+    trace2::TraceContext ignored;
+    Pop(value, ignored);
+  }
+
+  int64_t Depth() const noexcept { return m_stats.Depth(); }
+
+ private:
+  uint64_t Stamp() { return m_stats.Enabled() ? MonotonicNs() : 0; }
+
+  trace2::TraceContext Context() const {
+    return m_carryContext ? trace2::Tracing::GetActiveContext()
+                          : trace2::TraceContext{};
+  }
+
+  // Spin, then yield, then sleep, so a stalled peer does not burn a core
+  static void Backoff(unsigned spins) {
+    if (spins < 64) {
+      return;
+    }
+    if (spins < 128) {
+      std::this_thread::yield();
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+
+  QueueStats &m_stats;
+  Impl<QueueEntry<T>> m_queue;
+  const bool m_carryContext;
+
+  InstrumentedQueue(const InstrumentedQueue &) = delete;
+
+  InstrumentedQueue &operator=(const InstrumentedQueue &) = delete;
+};
+
+}  // namespace metrics
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_INTERNAL_QUEUE_H_
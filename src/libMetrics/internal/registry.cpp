@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "registry.h"
+
+namespace zil {
+namespace metrics {
+
+namespace {
+
+const std::vector<double> NO_BOUNDARIES;
+
+}  // namespace
+
+InstrumentRegistry &InstrumentRegistry::GetInstance() {
+  static InstrumentRegistry registry;
+  return registry;
+}
+
+std::unique_lock<std::mutex> InstrumentRegistry::LockWithMeter() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_meter) {
+    auto generation = m_generation;
+    lock.unlock();
+    auto meter = Metrics::GetMeter();
+    lock.lock();
+    // Metrics::Init ran meanwhile, the meter may be of the old provider
+    if (generation == m_generation && !m_meter) {
+      m_meter = std::move(meter);
+    }
+  }
+  return lock;
+}
+
+bool InstrumentRegistry::Create(Entry &entry, InstrumentKind kind,
+                                const std::string &full_name,
+                                const std::vector<double> &boundaries,
+                                const std::string &description,
+                                const std::string &unit) {
+  switch (kind) {
+    case InstrumentKind::U64_COUNTER:
+      if (entry.u64_counter) return false;
+      entry.u64_counter =
+          m_meter->CreateUInt64Counter(full_name, description, unit);
+      return true;
+    case InstrumentKind::DOUBLE_COUNTER:
+      if (entry.double_counter) return false;
+      entry.double_counter =
+          m_meter->CreateDoubleCounter(full_name, description, unit);
+      return true;
+    case InstrumentKind::DOUBLE_HISTOGRAM:
+      if (entry.double_histogram) return false;
+      Metrics::GetInstance().AddCounterHistogramView(full_name, boundaries,
+                                                     description);
+      entry.double_histogram =
+          m_meter->CreateDoubleHistogram(full_name, description, unit);
+      return true;
+  }
+  return false;
+}
+
+uint64CounterHandle_t InstrumentRegistry::GetUInt64Counter(
+    const std::string &full_name, const std::string &description,
+    const std::string &unit) {
+  auto lock = LockWithMeter();
+  auto &entry = m_entries[full_name];
+  Create(entry, InstrumentKind::U64_COUNTER, full_name, NO_BOUNDARIES,
+         description, unit);
+  return entry.u64_counter;
+}
+
+doubleCounterHandle_t InstrumentRegistry::GetDoubleCounter(
+    const std::string &full_name, const std::string &description,
+    const std::string &unit) {
+  auto lock = LockWithMeter();
+  auto &entry = m_entries[full_name];
+  Create(entry, InstrumentKind::DOUBLE_COUNTER, full_name, NO_BOUNDARIES,
+         description, unit);
+  return entry.double_counter;
+}
+
+doubleHistogramHandle_t InstrumentRegistry::GetDoubleHistogram(
+    const std::string &full_name, const std::vector<double> &boundaries,
+    const std::string &description, const std::string &unit) {
+  auto lock = LockWithMeter();
+  auto &entry = m_entries[full_name];
+  Create(entry, InstrumentKind::DOUBLE_HISTOGRAM, full_name, boundaries,
+         description, unit);
+  return entry.double_histogram;
+}
+
+size_t InstrumentRegistry::Register(const std::vector<InstrumentSpec> &specs) {
+  auto &filter = Filter::GetInstance();
+  size_t created = 0;
+
+  auto lock = LockWithMeter();
+  m_entries.reserve(m_entries.size() + specs.size());
+  for (const auto &spec : specs) {
+    if (!filter.Enabled(spec.filter)) {
+      continue;
+    }
+    auto full_name = GetFullName(METRIC_FAMILY, spec.name);
+    if (Create(m_entries[full_name], spec.kind, full_name, spec.boundaries,
+               spec.description, spec.unit)) {
+      ++created;
+    }
+  }
+  return created;
+}
+
+size_t InstrumentRegistry::Size() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  size_t size = 0;
+  for (const auto &[name, entry] : m_entries) {
+    size += (entry.u64_counter ? 1 : 0) + (entry.double_counter ? 1 : 0) +
+            (entry.double_histogram ? 1 : 0);
+  }
+  return size;
+}
+
+void InstrumentRegistry::Reset() {
+  std::unordered_map<std::string, Entry> entries;
+  std::shared_ptr<metrics_api::Meter> meter;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_generation;
+    entries.swap(m_entries);
+    meter.swap(m_meter);
+  }
+}
+
+}  // namespace metrics
+}  // namespace zil
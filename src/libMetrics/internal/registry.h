@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_REGISTRY_H_
+#define ZILLIQA_SRC_LIBMETRICS_INTERNAL_REGISTRY_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "libMetrics/Metrics.h"
+
+namespace zil {
+namespace metrics {
+
+enum class InstrumentKind { U64_COUNTER, DOUBLE_COUNTER, DOUBLE_HISTOGRAM };
+
+/// One instrument for InstrumentRegistry::Register, name is without the
+/// METRIC_FAMILY prefix as in the wrapper constructors
+struct InstrumentSpec {
+  InstrumentKind kind;
+  FilterClass filter;
+  std::string name;
+  std::string description;
+  std::string unit;
+  std::vector<double> boundaries;  // histograms only
+};
+
+// The synchronous instruments created by the wrappers in mixins.h, keyed by
+// full name and kind. Wrappers declared with the same name share one SDK
+// instrument instead of each creating their own, and the Meter is looked up
+// once per provider instead of once per instrument.
+//
+// Metrics::Init calls Reset, instruments handed out before keep pointing at
+// the provider they were created on.
+class InstrumentRegistry {
+ public:
+  static InstrumentRegistry &GetInstance();
+
+  uint64CounterHandle_t GetUInt64Counter(const std::string &full_name,
+                                         const std::string &description,
+                                         const std::string &unit);
+
+  doubleCounterHandle_t GetDoubleCounter(const std::string &full_name,
+                                         const std::string &description,
+                                         const std::string &unit);
+
+  /// Registers the bucket view the first time full_name is seen
+  doubleHistogramHandle_t GetDoubleHistogram(
+      const std::string &full_name, const std::vector<double> &boundaries,
+      const std::string &description, const std::string &unit);
+
+  /// Creates all the instruments of enabled filter classes in one pass, the
+  /// wrappers constructed afterwards only do a lookup. Returns the number of
+  /// instruments created.
+  size_t Register(const std::vector<InstrumentSpec> &specs);
+
+  /// Number of distinct instruments held
+  size_t Size();
+
+  /// Drops the cached meter and instruments, called by Metrics::Init
+  void Reset();
+
+  InstrumentRegistry(const InstrumentRegistry &) = delete;
+
+  InstrumentRegistry &operator=(const InstrumentRegistry &) = delete;
+
+ private:
+  struct Entry {
+    uint64CounterHandle_t u64_counter;
+    doubleCounterHandle_t double_counter;
+    doubleHistogramHandle_t double_histogram;
+  };
+
+  InstrumentRegistry() = default;
+
+  /// Locks m_mutex once m_meter is set. The meter is looked up unlocked
+  /// since that may initialise Metrics, which calls Reset.
+  std::unique_lock<std::mutex> LockWithMeter();
+
+  /// Creates the instrument of that kind unless the entry has it, called
+  /// with the lock of LockWithMeter held
+  bool Create(Entry &entry, InstrumentKind kind, const std::string &full_name,
+              const std::vector<double> &boundaries,
+              const std::string &description, const std::string &unit);
+
+  std::mutex m_mutex;
+  uint64_t m_generation = 0;
+  std::shared_ptr<metrics_api::Meter> m_meter;
+  std::unordered_map<std::string, Entry> m_entries;
+};
+
+}  // namespace metrics
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_INTERNAL_REGISTRY_H_
@@ -16,18 +16,20 @@
  */
 
 #include "scope.h"
-#include <iostream>
+
+#include "libUtils/Logger.h"
+#include "probes.h"
 
 namespace zil {
 namespace metrics {
 
-std::chrono::system_clock::time_point r_timer_start() {
-  return std::chrono::system_clock::now();
+std::chrono::steady_clock::time_point r_timer_start() {
+  return std::chrono::steady_clock::now();
 }
 
-double r_timer_end(std::chrono::system_clock::time_point start_time) {
+double r_timer_end(std::chrono::steady_clock::time_point start_time) {
   std::chrono::duration<double, std::micro> difference =
-      std::chrono::system_clock::now() - start_time;
+      std::chrono::steady_clock::now() - start_time;
   return difference.count();
 }
 
@@ -46,15 +48,78 @@ LatencyScopeMarker::~LatencyScopeMarker() {
   if (zil::metrics::Filter::GetInstance().Enabled(m_filterClass)) {
     try {
       double taken = zil::metrics::r_timer_end(m_startTime);
+      if (ZIL_PROBE_ENABLED(latency_scope)) {
+        ZIL_PROBE3(latency_scope, static_cast<int>(m_filterClass), m_func,
+                   static_cast<int64_t>(taken * 1000));
+      }
       METRIC_ATTRIBUTE counter_attr = {{"method", m_func}};
       m_metric->Add(1L, counter_attr);
       m_metric = nullptr;
       m_latency.Record(taken, counter_attr);
     } catch (...) {
-      // TODO - Write some very specific Exception Handling.
-      std::cout << "Brute force catch" << std::endl;
+      LOG_GENERAL(WARNING, "Latency scope of " << m_func << " not recorded");
     }
   }
 }
+
+ScopeSite::ScopeSite(const char *file, const char *func) noexcept
+    : m_file(file),
+      m_func(func),
+      m_pairs{Attribute{"method", func}},
+      m_attributes(m_pairs) {}
+
+LatencyHistograms::LatencyHistograms(FilterClass fc, const std::string &name,
+                                     const std::vector<double> &boundaries,
+                                     const std::string &description)
+    : m_wall(fc, name + "_wall", boundaries, description + " (wall time)",
+             "us"),
+      m_cpu(fc, name + "_cpu", boundaries, description + " (thread CPU time)",
+            "us") {}
+
+void LatencyHistograms::Record(const ScopeSite &site, uint64_t wall_ns,
+                               uint64_t cpu_ns) {
+  try {
+    m_wall.RecordWithAttributes(wall_ns / 1e3, site.Attributes());
+    m_cpu.RecordWithAttributes(cpu_ns / 1e3, site.Attributes());
+  } catch (...) {
+    LOG_GENERAL(WARNING, "Scope timer of " << site.Func() << " not recorded");
+  }
+}
+
+namespace {
+
+const char *const LATENCY_STATUS_NAMES[] = {"ok", "error", "cancelled"};
+
+}  // namespace
+
+LatencyBinding::LatencyBinding(FilterClass fc, const std::string &name,
+                               const std::vector<double> &boundaries,
+                               const std::string &description,
+                               const char *operation)
+    : m_histogram(fc, name, boundaries, description, "us") {
+  for (size_t i = 0; i < m_attributes.size(); ++i) {
+    m_attributes[i].pairs = {Attribute{"operation", operation},
+                             Attribute{"status", LATENCY_STATUS_NAMES[i]}};
+  }
+}
+
+LatencyToken LatencyBinding::Start() {
+  if (!m_histogram.Enabled()) {
+    return {};
+  }
+  return {this, MonotonicNs()};
+}
+
+void LatencyBinding::Record(LatencyStatus status,
+                            uint64_t elapsed_ns) noexcept {
+  try {
+    m_histogram.RecordWithAttributes(
+        elapsed_ns / 1e3,
+        m_attributes[static_cast<size_t>(status)].view);
+  } catch (...) {
+    LOG_GENERAL(WARNING, "Latency of an asynchronous operation not recorded");
+  }
+}
+
 }  // namespace metrics
 }  // namespace zil
@@ -17,14 +17,20 @@
 #ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_SCOPE_H_
 #define ZILLIQA_SRC_LIBMETRICS_INTERNAL_SCOPE_H_
 
+#include <array>
+#include <utility>
+
+#include <opentelemetry/common/key_value_iterable_view.h>
+
+#include "clock.h"
 #include "mixins.h"
 
 namespace zil {
 namespace metrics {
 
-std::chrono::system_clock::time_point r_timer_start();
+std::chrono::steady_clock::time_point r_timer_start();
 
-double r_timer_end(std::chrono::system_clock::time_point start_time);
+double r_timer_end(std::chrono::steady_clock::time_point start_time);
 
 class DoubleCounter;
 
@@ -39,17 +45,187 @@ struct LatencyScopeMarker final {
   ~LatencyScopeMarker();
 
  private:
-  std::string m_file;
-  std::string m_func;
+  const char *m_file;
+  const char *m_func;
   std::unique_ptr<metrics_api::Counter<uint64_t>> m_metric;
   InstrumentWrapper<DoubleHistogram> &m_latency;
   zil::metrics::FilterClass m_filterClass;
-  std::chrono::system_clock::time_point m_startTime;
+  std::chrono::steady_clock::time_point m_startTime;
 
   LatencyScopeMarker(const LatencyScopeMarker &) = delete;
 
   LatencyScopeMarker &operator=(const LatencyScopeMarker &) = delete;
 };
+
+// Call site of a ScopeTimer, meant to be a function local static (see
+// LATENCY_SCOPE in Api.h). The "method" attribute is built once here so
+// timing a scope never allocates on our side.
+class ScopeSite final {
+ public:
+  ScopeSite(const char *file, const char *func) noexcept;
+
+  const char *File() const noexcept { return m_file; }
+
+  const char *Func() const noexcept { return m_func; }
+
+  const opentelemetry::common::KeyValueIterable &Attributes() const noexcept {
+    return m_attributes;
+  }
+
+ private:
+  using Attribute = std::pair<opentelemetry::nostd::string_view,
+                              opentelemetry::common::AttributeValue>;
+
+  const char *m_file;
+  const char *m_func;
+  std::array<Attribute, 1> m_pairs;
+  // Refers to m_pairs, hence no copy or move
+  opentelemetry::common::KeyValueIterableView<std::array<Attribute, 1>>
+      m_attributes;
+
+  ScopeSite(const ScopeSite &) = delete;
+
+  ScopeSite &operator=(const ScopeSite &) = delete;
+};
+
+// Wall and thread CPU time histograms (microseconds) shared by every scope
+// timed against them, created once as <name>_wall and <name>_cpu. Wall much
+// larger than CPU for a method means it spends its time blocked.
+struct LatencyHistograms final {
+  LatencyHistograms(zil::metrics::FilterClass fc, const std::string &name,
+                    const std::vector<double> &boundaries,
+                    const std::string &description);
+
+  bool Enabled() { return m_wall.Enabled(); }
+
+  void Record(const ScopeSite &site, uint64_t wall_ns, uint64_t cpu_ns);
+
+ private:
+  InstrumentWrapper<DoubleHistogram> m_wall;
+  InstrumentWrapper<DoubleHistogram> m_cpu;
+};
+
+// RAII replacement for LatencyScopeMarker: two clock reads on entry, two on
+// exit and two histogram records, the filter is checked once on entry.
+class ScopeTimer final {
+ public:
+  ScopeTimer(LatencyHistograms &histograms, const ScopeSite &site) noexcept
+      : m_histograms(histograms.Enabled() ? &histograms : nullptr),
+        m_site(site) {
+    if (m_histograms) {
+      m_wallStart = MonotonicNs();
+      m_cpuStart = ThreadCpuNs();
+    }
+  }
+
+  ~ScopeTimer() {
+    if (m_histograms) {
+      uint64_t cpu = ThreadCpuNs() - m_cpuStart;
+      uint64_t wall = MonotonicNs() - m_wallStart;
+      m_histograms->Record(m_site, wall, cpu);
+    }
+  }
+
+ private:
+  LatencyHistograms *m_histograms;
+  const ScopeSite &m_site;
+  uint64_t m_wallStart{};
+  uint64_t m_cpuStart{};
+
+  ScopeTimer(const ScopeTimer &) = delete;
+
+  ScopeTimer &operator=(const ScopeTimer &) = delete;
+};
+
+enum class LatencyStatus { OK, ERROR, CANCELLED, STATUS_END };
+
+class LatencyToken;
+
+// Histogram for operations that start and end in different handlers or
+// threads (asio chains), see LatencyToken. One "status" attribute set per
+// LatencyStatus is built up front next to the "operation" attribute.
+class LatencyBinding final {
+ public:
+  LatencyBinding(zil::metrics::FilterClass fc, const std::string &name,
+                 const std::vector<double> &boundaries,
+                 const std::string &description, const char *operation);
+
+  /// Timestamps now, returns an empty token if the filter is disabled
+  LatencyToken Start();
+
+  void Record(LatencyStatus status, uint64_t elapsed_ns) noexcept;
+
+ private:
+  using Attribute = std::pair<opentelemetry::nostd::string_view,
+                              opentelemetry::common::AttributeValue>;
+
+  struct StatusAttributes {
+    std::array<Attribute, 2> pairs;
+    opentelemetry::common::KeyValueIterableView<std::array<Attribute, 2>> view{
+        pairs};
+
+    StatusAttributes() = default;
+    StatusAttributes(const StatusAttributes &) = delete;
+    StatusAttributes &operator=(const StatusAttributes &) = delete;
+  };
+
+  InstrumentWrapper<DoubleHistogram> m_histogram;
+  std::array<StatusAttributes, static_cast<size_t>(LatencyStatus::STATUS_END)>
+      m_attributes;
+
+  LatencyBinding(const LatencyBinding &) = delete;
+
+  LatencyBinding &operator=(const LatencyBinding &) = delete;
+};
+
+// Start timestamp of one operation, move it along the handler chain (or keep
+// it in the session object) and call Complete() in the last handler. It
+// records exactly once: a token destroyed or overwritten before Complete()
+// records as LatencyStatus::CANCELLED. Not thread safe, like any other
+// value only one handler may own it at a time.
+class LatencyToken final {
+ public:
+  LatencyToken() noexcept = default;
+
+  LatencyToken(LatencyToken &&other) noexcept
+      : m_binding(std::exchange(other.m_binding, nullptr)),
+        m_start(other.m_start) {}
+
+  LatencyToken &operator=(LatencyToken &&other) noexcept {
+    if (this != &other) {
+      Complete(LatencyStatus::CANCELLED);
+      m_binding = std::exchange(other.m_binding, nullptr);
+      m_start = other.m_start;
+    }
+    return *this;
+  }
+
+  ~LatencyToken() { Complete(LatencyStatus::CANCELLED); }
+
+  void Complete(LatencyStatus status = LatencyStatus::OK) noexcept {
+    if (auto *binding = std::exchange(m_binding, nullptr)) {
+      binding->Record(status, MonotonicNs() - m_start);
+    }
+  }
+
+  bool Pending() const noexcept { return m_binding != nullptr; }
+
+ private:
+  friend class LatencyBinding;
+
+  LatencyToken(LatencyBinding *binding, uint64_t start) noexcept
+      : m_binding(binding), m_start(start) {}
+
+  LatencyBinding *m_binding{};
+  uint64_t m_start{};
+
+  LatencyToken(const LatencyToken &) = delete;
+
+  LatencyToken &operator=(const LatencyToken &) = delete;
+};
+
+static_assert(sizeof(LatencyToken) == 16);
+
 }  // namespace metrics
 }  // namespace zil
 
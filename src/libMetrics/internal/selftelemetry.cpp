@@ -0,0 +1,438 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "selftelemetry.h"
+
+#include <opentelemetry/metrics/provider.h>
+#include <opentelemetry/sdk/trace/batch_span_processor_factory.h>
+#include <opentelemetry/sdk/trace/batch_span_processor_options.h>
+
+namespace zil {
+namespace metrics {
+
+namespace metrics_sdk = opentelemetry::sdk::metrics;
+namespace trace_sdk = opentelemetry::sdk::trace;
+
+namespace {
+
+const char* const TRACE_FILTER_NAMES[] = {
+#define FILTER_NAME(C, PATH) #C,
+    TRACE_FILTER_CLASSES(FILTER_NAME)
+#undef FILTER_NAME
+};
+
+const char* const SIGNAL_NAMES[] = {"traces", "metrics"};
+
+enum Instrument : size_t {
+  SPANS_STARTED,
+  SPANS_ENDED,
+  SPANS_DROPPED,
+  EXPORT_QUEUE_DEPTH,
+  EXPORT_DISCARDED,
+  EXPORT_BATCHES,
+  EXPORT_ITEMS,
+  EXPORT_FAILURES,
+  EXPORT_SECONDS,
+  EXPORT_LAST_BATCH_SIZE,
+  EXPORT_LAST_SECONDS,
+  COLLECTIONS,
+  COLLECTION_SECONDS,
+  COLLECTION_LAST_SECONDS,
+  OBSERVABLE_CALLBACKS,
+  OBSERVABLE_CALLBACK_SECONDS,
+};
+
+double Seconds(uint64_t ns) { return static_cast<double>(ns) / 1e9; }
+
+uint64_t Load(const std::atomic<uint64_t>& value) {
+  return value.load(std::memory_order_relaxed);
+}
+
+class InstrumentedSpanExporter : public trace_sdk::SpanExporter {
+ public:
+  explicit InstrumentedSpanExporter(std::unique_ptr<SpanExporter> exporter)
+      : m_exporter(std::move(exporter)) {}
+
+  std::unique_ptr<trace_sdk::Recordable> MakeRecordable() noexcept override {
+    return m_exporter->MakeRecordable();
+  }
+
+  opentelemetry::sdk::common::ExportResult Export(
+      const opentelemetry::nostd::span<std::unique_ptr<trace_sdk::Recordable>>&
+          spans) noexcept override {
+    auto& telemetry = SelfTelemetry::GetInstance();
+    auto start = MonotonicNs();
+    auto result = m_exporter->Export(spans);
+    telemetry.Exported(
+        SelfTelemetry::Signal::TRACES, spans.size(),
+        MonotonicNs() - start,
+        result == opentelemetry::sdk::common::ExportResult::kSuccess);
+    // failed or not, the spans are out of the pipeline
+    telemetry.SpansDequeued(spans.size());
+    return result;
+  }
+
+  bool Shutdown(std::chrono::microseconds timeout) noexcept override {
+    return m_exporter->Shutdown(timeout);
+  }
+
+ private:
+  std::unique_ptr<SpanExporter> m_exporter;
+};
+
+// Counts the spans going in, InstrumentedSpanExporter below it those going
+// out, so both ends of export_queue_depth are seen by the same pipeline.
+// Spans beyond SPAN_QUEUE_SIZE are discarded here rather than silently by
+// the batch processor, whose queue therefore never fills up.
+class InstrumentedSpanProcessor : public trace_sdk::SpanProcessor {
+ public:
+  explicit InstrumentedSpanProcessor(std::unique_ptr<SpanProcessor> processor)
+      : m_processor(std::move(processor)) {}
+
+  std::unique_ptr<trace_sdk::Recordable> MakeRecordable() noexcept override {
+    return m_processor->MakeRecordable();
+  }
+
+  void OnStart(trace_sdk::Recordable& span,
+               const opentelemetry::trace::SpanContext& parent) noexcept
+      override {
+    m_processor->OnStart(span, parent);
+  }
+
+  void OnEnd(std::unique_ptr<trace_sdk::Recordable>&& span) noexcept override {
+    // a processor shut down drops the span without exporting it
+    if (!m_shutdown.load(std::memory_order_acquire) &&
+        SelfTelemetry::GetInstance().SpanEnqueued(
+            SelfTelemetry::SPAN_QUEUE_SIZE)) {
+      m_processor->OnEnd(std::move(span));
+    }
+  }
+
+  bool ForceFlush(std::chrono::microseconds timeout) noexcept override {
+    return m_processor->ForceFlush(timeout);
+  }
+
+  bool Shutdown(std::chrono::microseconds timeout) noexcept override {
+    m_shutdown.store(true, std::memory_order_release);
+    return m_processor->Shutdown(timeout);
+  }
+
+ private:
+  std::unique_ptr<SpanProcessor> m_processor;
+  std::atomic<bool> m_shutdown{false};
+};
+
+class InstrumentedMetricExporter : public metrics_sdk::PushMetricExporter {
+ public:
+  explicit InstrumentedMetricExporter(
+      std::unique_ptr<PushMetricExporter> exporter)
+      : m_exporter(std::move(exporter)) {}
+
+  opentelemetry::sdk::common::ExportResult Export(
+      const metrics_sdk::ResourceMetrics& data) noexcept override {
+    auto& telemetry = SelfTelemetry::GetInstance();
+    telemetry.CollectionFinished();
+
+    size_t points = 0;
+    for (const auto& scope : data.scope_metric_data_) {
+      for (const auto& metric : scope.metric_data_) {
+        points += metric.point_data_attr_.size();
+      }
+    }
+
+    auto start = MonotonicNs();
+    auto result = m_exporter->Export(data);
+    telemetry.Exported(
+        SelfTelemetry::Signal::METRICS, points, MonotonicNs() - start,
+        result == opentelemetry::sdk::common::ExportResult::kSuccess);
+    return result;
+  }
+
+  metrics_sdk::AggregationTemporality GetAggregationTemporality(
+      metrics_sdk::InstrumentType instrument_type) const noexcept override {
+    return m_exporter->GetAggregationTemporality(instrument_type);
+  }
+
+  bool ForceFlush(std::chrono::microseconds timeout) noexcept override {
+    return m_exporter->ForceFlush(timeout);
+  }
+
+  bool Shutdown(std::chrono::microseconds timeout) noexcept override {
+    return m_exporter->Shutdown(timeout);
+  }
+
+ private:
+  std::unique_ptr<PushMetricExporter> m_exporter;
+};
+
+}  // namespace
+
+SelfTelemetry& SelfTelemetry::GetInstance() {
+  static SelfTelemetry telemetry;
+  return telemetry;
+}
+
+SelfTelemetry::SelfTelemetry() {
+  for (size_t i = 0; i < N_FILTERS; ++i) {
+    m_filterAttributes[i] = {{"filter", TRACE_FILTER_NAMES[i]}};
+  }
+  for (size_t i = 0; i < N_SIGNALS; ++i) {
+    m_signalAttributes[i] = {{"signal", SIGNAL_NAMES[i]}};
+  }
+}
+
+void SelfTelemetry::Exported(Signal signal, size_t batch_size,
+                             uint64_t latency_ns, bool ok) noexcept {
+  auto& counters = m_exports[static_cast<size_t>(signal)];
+  Add(counters.batches);
+  Add(counters.items, batch_size);
+  Add(counters.latency_ns, latency_ns);
+  counters.last_batch_size.store(batch_size, std::memory_order_relaxed);
+  counters.last_latency_ns.store(latency_ns, std::memory_order_relaxed);
+  if (!ok) {
+    Add(counters.failures);
+  }
+}
+
+void SelfTelemetry::CollectionStarted() noexcept {
+  uint64_t expected = 0;
+  m_collection.started_ns.compare_exchange_strong(expected, MonotonicNs(),
+                                                  std::memory_order_relaxed);
+}
+
+void SelfTelemetry::CollectionFinished() noexcept {
+  uint64_t started = m_collection.started_ns.exchange(0);
+  uint64_t duration = started ? MonotonicNs() - started : 0;
+  Add(m_collection.count);
+  Add(m_collection.duration_ns, duration);
+  m_collection.last_duration_ns.store(duration, std::memory_order_relaxed);
+}
+
+void SelfTelemetry::ObservableCalled(const Observable& observable,
+                                     uint64_t elapsed_ns) noexcept {
+  Add(observable.m_callbackCount);
+  Add(observable.m_callbackNs, elapsed_ns);
+}
+
+void SelfTelemetry::Register(const Observable* observable) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_observables.insert(observable);
+}
+
+void SelfTelemetry::Unregister(const Observable* observable) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_observables.erase(observable);
+}
+
+void SelfTelemetry::Publish(std::string_view reader) {
+  auto meter = opentelemetry::metrics::Provider::GetMeterProvider()->GetMeter(
+      SELF_METRIC_FAMILY, METRIC_SCHEMA_VERSION, METRIC_SCHEMA);
+
+  auto name = [](const char* n) { return GetFullName(SELF_METRIC_FAMILY, n); };
+
+  // Same order as enum Instrument
+  std::vector<std::unique_ptr<Observable>> instruments;
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableCounter(
+          name("spans_started"), "Spans started per filter class"),
+      name("spans_started")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableCounter(
+          name("spans_ended"), "Spans ended per filter class"),
+      name("spans_ended")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableCounter(
+          name("spans_dropped"),
+          "Spans requested on an enabled filter class but not recorded, "
+          "for an invalid remote parent or by the sampler"),
+      name("spans_dropped")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableGauge(
+          name("export_queue_depth"),
+          "Spans handed to the pipeline and not exported yet"),
+      name("export_queue_depth")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableCounter(
+          name("export_discarded"),
+          "Spans discarded because the export queue was full"),
+      name("export_discarded")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableCounter(name("export_batches"),
+                                          "Export calls per signal"),
+      name("export_batches")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableCounter(
+          name("export_items"), "Spans or data points exported per signal"),
+      name("export_items")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableCounter(name("export_failures"),
+                                          "Failed export calls per signal"),
+      name("export_failures")));
+  instruments.emplace_back(new Observable(
+      meter->CreateDoubleObservableCounter(
+          name("export_seconds"), "Time spent in exporters per signal", "s"),
+      name("export_seconds")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableGauge(name("export_last_batch_size"),
+                                        "Size of the last export batch"),
+      name("export_last_batch_size")));
+  instruments.emplace_back(new Observable(
+      meter->CreateDoubleObservableGauge(
+          name("export_last_seconds"), "Latency of the last export", "s"),
+      name("export_last_seconds")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableCounter(name("collections"),
+                                          "Collection cycles per reader"),
+      name("collections")));
+  instruments.emplace_back(new Observable(
+      meter->CreateDoubleObservableCounter(
+          name("collection_seconds"),
+          "Time from first callback to export per reader", "s"),
+      name("collection_seconds")));
+  instruments.emplace_back(new Observable(
+      meter->CreateDoubleObservableGauge(name("collection_last_seconds"),
+                                         "Duration of the last collection",
+                                         "s"),
+      name("collection_last_seconds")));
+  instruments.emplace_back(new Observable(
+      meter->CreateInt64ObservableCounter(name("observable_callbacks"),
+                                          "Callback calls per observable"),
+      name("observable_callbacks")));
+  instruments.emplace_back(new Observable(
+      meter->CreateDoubleObservableCounter(name("observable_callback_seconds"),
+                                           "Callback time per observable",
+                                           "s"),
+      name("observable_callback_seconds")));
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_readerAttributes = {
+        {"reader", opentelemetry::nostd::string_view(reader.data(),
+                                                     reader.size())}};
+  }
+
+  for (size_t i = 0; i < instruments.size(); ++i) {
+    instruments[i]->SetCallback(
+        [this, i](Observable::Result&& result) { Observe(std::move(result), i); });
+  }
+
+  // old instruments unregister themselves in dtor, so swap outside the lock
+  std::vector<std::unique_ptr<Observable>> old;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    old.swap(m_instruments);
+    m_instruments = std::move(instruments);
+  }
+}
+
+void SelfTelemetry::Observe(Observable::Result&& result, size_t instrument) {
+  switch (instrument) {
+    case SPANS_STARTED:
+    case SPANS_ENDED:
+    case SPANS_DROPPED:
+      for (size_t i = 0; i < N_FILTERS; ++i) {
+        const auto& c = m_spans[i];
+        uint64_t value = instrument == SPANS_STARTED ? Load(c.started)
+                         : instrument == SPANS_ENDED ? Load(c.ended)
+                                                     : Load(c.dropped);
+        result.Set(value, m_filterAttributes[i]);
+      }
+      break;
+
+    case EXPORT_QUEUE_DEPTH:
+      result.Set(Load(m_spanQueue.depth), m_signalAttributes[0]);
+      break;
+
+    case EXPORT_DISCARDED:
+      result.Set(Load(m_spanQueue.discarded), m_signalAttributes[0]);
+      break;
+
+    case EXPORT_BATCHES:
+    case EXPORT_ITEMS:
+    case EXPORT_FAILURES:
+    case EXPORT_LAST_BATCH_SIZE:
+      for (size_t i = 0; i < N_SIGNALS; ++i) {
+        const auto& c = m_exports[i];
+        uint64_t value = instrument == EXPORT_BATCHES    ? Load(c.batches)
+                         : instrument == EXPORT_ITEMS    ? Load(c.items)
+                         : instrument == EXPORT_FAILURES ? Load(c.failures)
+                                                         : Load(c.last_batch_size);
+        result.Set(value, m_signalAttributes[i]);
+      }
+      break;
+
+    case EXPORT_SECONDS:
+    case EXPORT_LAST_SECONDS:
+      for (size_t i = 0; i < N_SIGNALS; ++i) {
+        const auto& c = m_exports[i];
+        result.Set(Seconds(instrument == EXPORT_SECONDS
+                               ? Load(c.latency_ns)
+                               : Load(c.last_latency_ns)),
+                   m_signalAttributes[i]);
+      }
+      break;
+
+    case COLLECTIONS:
+    case COLLECTION_SECONDS:
+    case COLLECTION_LAST_SECONDS: {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (instrument == COLLECTIONS) {
+        result.Set(Load(m_collection.count), m_readerAttributes);
+      } else {
+        result.Set(Seconds(instrument == COLLECTION_SECONDS
+                               ? Load(m_collection.duration_ns)
+                               : Load(m_collection.last_duration_ns)),
+                   m_readerAttributes);
+      }
+    } break;
+
+    case OBSERVABLE_CALLBACKS:
+    case OBSERVABLE_CALLBACK_SECONDS: {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (const auto* o : m_observables) {
+        if (instrument == OBSERVABLE_CALLBACKS) {
+          result.Set(Load(o->m_callbackCount), o->m_nameAttribute);
+        } else {
+          result.Set(Seconds(Load(o->m_callbackNs)), o->m_nameAttribute);
+        }
+      }
+    } break;
+
+    default:
+      break;
+  }
+}
+
+std::unique_ptr<trace_sdk::SpanProcessor> SelfTelemetry::CreateSpanProcessor(
+    std::unique_ptr<trace_sdk::SpanExporter> exporter) {
+  trace_sdk::BatchSpanProcessorOptions options;
+  options.max_queue_size = SPAN_QUEUE_SIZE;
+  options.max_export_batch_size = 512;
+  options.schedule_delay_millis = std::chrono::milliseconds(1000);
+  return std::make_unique<InstrumentedSpanProcessor>(
+      trace_sdk::BatchSpanProcessorFactory::Create(
+          std::make_unique<InstrumentedSpanExporter>(std::move(exporter)),
+          options));
+}
+
+std::unique_ptr<metrics_sdk::PushMetricExporter> SelfTelemetry::Wrap(
+    std::unique_ptr<metrics_sdk::PushMetricExporter> exporter) {
+  return std::make_unique<InstrumentedMetricExporter>(std::move(exporter));
+}
+
+}  // namespace metrics
+}  // namespace zil
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_SELFTELEMETRY_H_
+#define ZILLIQA_SRC_LIBMETRICS_INTERNAL_SELFTELEMETRY_H_
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <opentelemetry/sdk/metrics/push_metric_exporter.h>
+#include <opentelemetry/sdk/trace/exporter.h>
+#include <opentelemetry/sdk/trace/processor.h>
+
+#include "clock.h"
+#include "libMetrics/Metrics.h"
+#include "libMetrics/Tracing2.h"
+
+namespace zil {
+namespace metrics {
+
+// Counters about libMetrics itself: span life cycle per trace2 filter class,
+// exporter batches and failures, collection and observable callback time.
+//
+// Updates are relaxed atomic increments so it stays on all the time, the
+// values are only read by the observable instruments published under
+// SELF_METRIC_FAMILY on every collection.
+class SelfTelemetry {
+ public:
+  enum class Signal { TRACES, METRICS, SIGNAL_END };
+
+  static SelfTelemetry& GetInstance();
+
+  SelfTelemetry();
+
+  void SpanStarted(trace2::FilterClass fc) noexcept {
+    Add(m_spans[Index(fc)].started);
+  }
+
+  void SpanEnded(trace2::FilterClass fc) noexcept {
+    Add(m_spans[Index(fc)].ended);
+  }
+
+  /// A span was requested on an enabled filter class but is not recorded,
+  /// its remote parent was not valid or the sampler dropped it
+  void SpanDropped(trace2::FilterClass fc) noexcept {
+    Add(m_spans[Index(fc)].dropped);
+  }
+
+  /// A span ended into a processor of CreateSpanProcessor. Returns false,
+  /// counting it as discarded, if capacity spans are queued already.
+  bool SpanEnqueued(size_t capacity) noexcept {
+    if (m_spanQueue.depth.fetch_add(1, std::memory_order_relaxed) >=
+        capacity) {
+      m_spanQueue.depth.fetch_sub(1, std::memory_order_relaxed);
+      Add(m_spanQueue.discarded);
+      return false;
+    }
+    return true;
+  }
+
+  /// Spans of such a processor left its exporter
+  void SpansDequeued(size_t count) noexcept {
+    m_spanQueue.depth.fetch_sub(count, std::memory_order_relaxed);
+  }
+
+  void Exported(Signal signal, size_t batch_size, uint64_t latency_ns,
+                bool ok) noexcept;
+
+  /// Called by the first observable callback of a collection cycle, the
+  /// cycle ends when the reader hands the data to its exporter
+  void CollectionStarted() noexcept;
+
+  void CollectionFinished() noexcept;
+
+  void ObservableCalled(const Observable& observable,
+                        uint64_t elapsed_ns) noexcept;
+
+  void Register(const Observable* observable);
+
+  void Unregister(const Observable* observable);
+
+  /// (Re)creates the self telemetry instruments on the current meter
+  /// provider, called by Metrics::Init
+  void Publish(std::string_view reader);
+
+  /// Batch span processor over the exporter, counting the export batches
+  /// and the spans between OnEnd and the end of their export, which is
+  /// export_queue_depth. Spans ending while SPAN_QUEUE_SIZE are queued are
+  /// discarded and counted by export_discarded.
+  static constexpr size_t SPAN_QUEUE_SIZE = 8192;
+
+  static std::unique_ptr<opentelemetry::sdk::trace::SpanProcessor>
+  CreateSpanProcessor(
+      std::unique_ptr<opentelemetry::sdk::trace::SpanExporter> exporter);
+
+  static std::unique_ptr<opentelemetry::sdk::metrics::PushMetricExporter> Wrap(
+      std::unique_ptr<opentelemetry::sdk::metrics::PushMetricExporter>
+          exporter);
+
+ private:
+  static constexpr size_t N_FILTERS =
+      static_cast<size_t>(trace2::FilterClass::FILTER_CLASS_END);
+  static constexpr size_t N_SIGNALS = static_cast<size_t>(Signal::SIGNAL_END);
+
+  struct alignas(64) SpanCounters {
+    std::atomic<uint64_t> started{};
+    std::atomic<uint64_t> ended{};
+    std::atomic<uint64_t> dropped{};
+  };
+
+  struct alignas(64) ExportCounters {
+    std::atomic<uint64_t> batches{};
+    std::atomic<uint64_t> items{};
+    std::atomic<uint64_t> failures{};
+    std::atomic<uint64_t> latency_ns{};
+    std::atomic<uint64_t> last_batch_size{};
+    std::atomic<uint64_t> last_latency_ns{};
+  };
+
+  struct alignas(64) QueueCounters {
+    std::atomic<uint64_t> depth{};
+    std::atomic<uint64_t> discarded{};
+  };
+
+  struct alignas(64) CollectionCounters {
+    std::atomic<uint64_t> started_ns{};
+    std::atomic<uint64_t> count{};
+    std::atomic<uint64_t> duration_ns{};
+    std::atomic<uint64_t> last_duration_ns{};
+  };
+
+  static size_t Index(trace2::FilterClass fc) noexcept {
+    return static_cast<size_t>(fc);
+  }
+
+  static void Add(std::atomic<uint64_t>& counter, uint64_t value = 1) noexcept {
+    counter.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  void Observe(Observable::Result&& result, size_t instrument);
+
+  std::array<SpanCounters, N_FILTERS> m_spans;
+  std::array<ExportCounters, N_SIGNALS> m_exports;
+  QueueCounters m_spanQueue;
+  CollectionCounters m_collection;
+
+  // built once, see AttributeSetHandle
+  std::array<AttributeSetHandle, N_FILTERS> m_filterAttributes;
+  std::array<AttributeSetHandle, N_SIGNALS> m_signalAttributes;
+
+  std::mutex m_mutex;
+  std::set<const Observable*> m_observables;
+  AttributeSetHandle m_readerAttributes;
+  std::vector<std::unique_ptr<Observable>> m_instruments;
+};
+
+}  // namespace metrics
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_INTERNAL_SELFTELEMETRY_H_
@@ -0,0 +1,762 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "spanlog.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+
+#ifdef ZIL_SPANLOG_ZSTD
+#include <zstd.h>
+#endif
+
+#include <opentelemetry/sdk/trace/span_data.h>
+
+#include "libUtils/Logger.h"
+
+namespace zil::trace {
+
+namespace {
+
+namespace nostd = opentelemetry::nostd;
+namespace sdk_common = opentelemetry::sdk::common;
+namespace trace_sdk = opentelemetry::sdk::trace;
+
+using spanlog::FrameHeader;
+using spanlog::FrameType;
+using spanlog::SegmentHeader;
+
+// Records are gathered into blocks of this size before being compressed
+constexpr size_t ZSTD_BLOCK_SIZE = size_t{256} << 10;
+constexpr int ZSTD_LEVEL = 3;
+
+constexpr std::string_view SEGMENT_PREFIX = "spans-";
+constexpr std::string_view SEGMENT_EXTENSION = ".zsl";
+
+enum Tag : uint8_t { BOOL, I64, U64, F64, STR, ARRAY = 0x80 };
+
+constexpr uint64_t Align(uint64_t size) { return (size + 7) & ~uint64_t{7}; }
+
+std::filesystem::path SegmentPath(const std::filesystem::path &directory,
+                                  uint64_t sequence) {
+  std::string number = std::to_string(sequence);
+  number.insert(0, 20 - std::min<size_t>(20, number.size()), '0');
+  return directory /
+         (std::string(SEGMENT_PREFIX) + number + std::string(SEGMENT_EXTENSION));
+}
+
+bool ParseSequence(const std::filesystem::path &path, uint64_t &sequence) {
+  const std::string name = path.filename().string();
+  if (name.size() <= SEGMENT_PREFIX.size() + SEGMENT_EXTENSION.size() ||
+      name.compare(0, SEGMENT_PREFIX.size(), SEGMENT_PREFIX) != 0 ||
+      path.extension().string() != SEGMENT_EXTENSION) {
+    return false;
+  }
+  const std::string number = name.substr(
+      SEGMENT_PREFIX.size(),
+      name.size() - SEGMENT_PREFIX.size() - SEGMENT_EXTENSION.size());
+  if (number.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  sequence = std::stoull(number);
+  return true;
+}
+
+template <typename T>
+constexpr uint8_t TagOf() {
+  if constexpr (std::is_same_v<T, bool>) {
+    return BOOL;
+  } else if constexpr (std::is_floating_point_v<T>) {
+    return F64;
+  } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+    return I64;
+  } else if constexpr (std::is_integral_v<T>) {
+    return U64;
+  } else {
+    return STR;
+  }
+}
+
+template <typename T, typename = void>
+struct IsVector : std::false_type {};
+
+template <typename T>
+struct IsVector<T, std::void_t<typename T::value_type>>
+    : std::is_same<T, std::vector<typename T::value_type>> {};
+
+class Encoder {
+ public:
+  explicit Encoder(std::string &out) : m_out(out) {}
+
+  template <typename T>
+  void Put(T value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    m_out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  void PutBytes(const uint8_t *data, size_t size) {
+    m_out.append(reinterpret_cast<const char *>(data), size);
+  }
+
+  void PutString(std::string_view text) {
+    Put(static_cast<uint32_t>(text.size()));
+    m_out.append(text);
+  }
+
+  template <typename Map>
+  void PutAttributes(const Map &attributes) {
+    Put(static_cast<uint32_t>(attributes.size()));
+    for (const auto &[key, value] : attributes) {
+      PutString(key);
+      std::visit([this](const auto &v) { PutValue(v); }, value);
+    }
+  }
+
+ private:
+  template <typename T>
+  void PutScalar(const T &value) {
+    constexpr uint8_t tag = TagOf<T>();
+    if constexpr (tag == BOOL) {
+      Put(static_cast<uint8_t>(value));
+    } else if constexpr (tag == F64) {
+      Put(static_cast<double>(value));
+    } else if constexpr (tag == I64) {
+      Put(static_cast<int64_t>(value));
+    } else if constexpr (tag == U64) {
+      Put(static_cast<uint64_t>(value));
+    } else {
+      PutString(value);
+    }
+  }
+
+  template <typename T>
+  void PutValue(const T &value) {
+    if constexpr (IsVector<T>::value) {
+      using E = typename T::value_type;
+      Put(static_cast<uint8_t>(ARRAY | TagOf<E>()));
+      Put(static_cast<uint32_t>(value.size()));
+      for (const auto &element : value) {
+        PutScalar<E>(element);
+      }
+    } else {
+      Put(TagOf<T>());
+      PutScalar(value);
+    }
+  }
+
+  std::string &m_out;
+};
+
+void EncodeSpan(const trace_sdk::SpanData &span, std::string &out) {
+  const size_t start = out.size();
+  Encoder encoder(out);
+  encoder.Put(uint32_t{0});  // size of the record, set at the end
+
+  encoder.PutBytes(span.GetTraceId().Id().data(), 16);
+  encoder.PutBytes(span.GetSpanId().Id().data(), 8);
+  encoder.PutBytes(span.GetParentSpanId().Id().data(), 8);
+  encoder.Put(span.GetTraceFlags().flags());
+  encoder.Put(static_cast<uint8_t>(span.GetSpanKind()));
+  encoder.Put(static_cast<uint8_t>(span.GetStatus()));
+  encoder.Put(static_cast<int64_t>(span.GetStartTime().time_since_epoch().count()));
+  encoder.Put(static_cast<int64_t>(span.GetDuration().count()));
+  encoder.PutString(span.GetName());
+  encoder.PutString(span.GetDescription());
+  const auto &scope = span.GetInstrumentationScope();
+  encoder.PutString(scope.GetName());
+  encoder.PutString(scope.GetVersion());
+  encoder.PutAttributes(span.GetAttributes());
+
+  encoder.Put(static_cast<uint32_t>(span.GetEvents().size()));
+  for (const auto &event : span.GetEvents()) {
+    encoder.PutString(event.GetName());
+    encoder.Put(static_cast<int64_t>(event.GetTimestamp().time_since_epoch().count()));
+    encoder.PutAttributes(event.GetAttributes());
+  }
+
+  encoder.Put(static_cast<uint32_t>(span.GetLinks().size()));
+  for (const auto &link : span.GetLinks()) {
+    const auto &context = link.GetSpanContext();
+    encoder.PutBytes(context.trace_id().Id().data(), 16);
+    encoder.PutBytes(context.span_id().Id().data(), 8);
+    encoder.Put(context.trace_flags().flags());
+    encoder.PutAttributes(link.GetAttributes());
+  }
+
+  const auto size = static_cast<uint32_t>(out.size() - start - sizeof(uint32_t));
+  std::memcpy(out.data() + start, &size, sizeof(size));
+}
+
+class SpanLogExporter : public trace_sdk::SpanExporter {
+ public:
+  explicit SpanLogExporter(const SpanLogOptions &options) : m_options(options) {
+    std::filesystem::create_directories(m_options.directory);
+    for (const auto &path : spanlog::Segments(m_options.directory)) {
+      uint64_t sequence = 0;
+      ParseSequence(path, sequence);
+      m_sequence = std::max(m_sequence, sequence + 1);
+    }
+#ifdef ZIL_SPANLOG_ZSTD
+    if (m_options.compress) {
+      m_cctx = ZSTD_createCCtx();
+    }
+#endif
+    m_options.compress = m_cctx != nullptr;
+    // fails here rather than on the first span if the directory is unusable
+    if (!Open()) {
+      throw std::runtime_error("cannot create span log segment in " +
+                               m_options.directory.string());
+    }
+  }
+
+  ~SpanLogExporter() override {
+    Shutdown(std::chrono::microseconds::max());
+#ifdef ZIL_SPANLOG_ZSTD
+    ZSTD_freeCCtx(m_cctx);
+#endif
+  }
+
+  std::unique_ptr<trace_sdk::Recordable> MakeRecordable() noexcept override {
+    return std::make_unique<trace_sdk::SpanData>();
+  }
+
+  sdk_common::ExportResult Export(
+      const nostd::span<std::unique_ptr<trace_sdk::Recordable>> &spans) noexcept
+      override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_shutdown) {
+      return sdk_common::ExportResult::kFailure;
+    }
+
+    std::string &out = m_options.compress ? m_block : m_scratch;
+    const size_t mark = out.size();
+    uint32_t count = 0;
+    try {
+      for (const auto &recordable : spans) {
+        const auto *span = static_cast<trace_sdk::SpanData *>(recordable.get());
+        if (span == nullptr) {
+          continue;
+        }
+        if (!m_haveResource) {
+          Encoder(m_resource).PutAttributes(span->GetResource().GetAttributes());
+          m_haveResource = true;
+        }
+        EncodeSpan(*span, out);
+        ++count;
+      }
+    } catch (const std::exception &e) {
+      LOG_GENERAL(WARNING, "Span log encoding failed: " << e.what());
+      out.resize(mark);
+      return sdk_common::ExportResult::kFailure;
+    }
+
+    bool written = true;
+    if (m_options.compress) {
+      const auto now = std::chrono::steady_clock::now();
+      if (m_blockCount == 0) {
+        m_blockStarted = now;
+      }
+      m_blockCount += count;
+      if (m_block.size() >= ZSTD_BLOCK_SIZE ||
+          now - m_blockStarted >= m_options.flush_interval) {
+        written = FlushBlock();
+      }
+    } else if (count > 0) {
+      written = WriteFrame(FrameType::SPANS, m_scratch, count);
+      m_scratch.clear();
+    }
+    return written ? sdk_common::ExportResult::kSuccess
+                   : sdk_common::ExportResult::kFailure;
+  }
+
+  bool ForceFlush(std::chrono::microseconds) noexcept override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_shutdown || FlushBlock();
+  }
+
+  bool Shutdown(std::chrono::microseconds) noexcept override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_shutdown) {
+      return true;
+    }
+    m_shutdown = true;
+    const bool flushed = FlushBlock();
+    Close();
+    return flushed;
+  }
+
+ private:
+  bool Open() {
+    const auto path = SegmentPath(m_options.directory, m_sequence);
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                          0644);
+    if (fd < 0) {
+      return false;
+    }
+    // allocated up front, a full disk is an error here and not a SIGBUS on
+    // a later memcpy
+    void *map = MAP_FAILED;
+    if (::posix_fallocate(fd, 0, static_cast<off_t>(m_options.segment_size)) ==
+        0) {
+      map = ::mmap(nullptr, m_options.segment_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+      ::close(fd);
+      std::error_code ec;
+      std::filesystem::remove(path, ec);
+      return false;
+    }
+
+    m_fd = fd;
+    m_map = static_cast<char *>(map);
+    SegmentHeader header{};
+    std::memcpy(header.magic, spanlog::MAGIC, sizeof(header.magic));
+    header.version = spanlog::VERSION;
+    header.flags = m_cctx != nullptr ? spanlog::FLAG_ZSTD : 0;
+    header.sequence = m_sequence++;
+    header.created_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::system_clock::now().time_since_epoch())
+                            .count();
+    std::memcpy(m_map, &header, sizeof(header));
+    m_used = sizeof(header);
+    m_resourceWritten = false;
+
+    RemoveOldSegments();
+    return true;
+  }
+
+  void Close() {
+    if (m_map == nullptr) {
+      return;
+    }
+    ::munmap(m_map, m_options.segment_size);
+    // readers stop at the end of the file as well as at an empty frame
+    if (::ftruncate(m_fd, static_cast<off_t>(m_used)) != 0) {
+      LOG_GENERAL(WARNING, "Cannot truncate span log segment: " << errno);
+    }
+    ::close(m_fd);
+    m_map = nullptr;
+    m_fd = -1;
+  }
+
+  void RemoveOldSegments() {
+    auto segments = spanlog::Segments(m_options.directory);
+    if (segments.size() <= m_options.max_segments) {
+      return;
+    }
+    segments.resize(segments.size() - m_options.max_segments);
+    for (const auto &path : segments) {
+      std::error_code ec;
+      std::filesystem::remove(path, ec);
+    }
+  }
+
+  /// Space for a frame with a payload of up to max_payload, in the current
+  /// segment or the next one. Null if there is none.
+  FrameHeader *Reserve(uint64_t max_payload) {
+    const uint64_t frame = Align(sizeof(FrameHeader) + max_payload);
+    const uint64_t resource =
+        Align(sizeof(FrameHeader) + m_resource.size());
+    if (sizeof(SegmentHeader) + resource + frame > m_options.segment_size) {
+      if (!m_tooLargeLogged) {
+        m_tooLargeLogged = true;
+        LOG_GENERAL(WARNING, "Spans of " << max_payload
+                                         << " bytes do not fit a span log "
+                                            "segment, dropped");
+      }
+      return nullptr;
+    }
+
+    const uint64_t needed = frame + (m_resourceWritten ? 0 : resource);
+    if (m_map == nullptr || m_used + needed > m_options.segment_size) {
+      Close();
+      if (!Open()) {
+        if (!m_openFailedLogged) {
+          m_openFailedLogged = true;
+          LOG_GENERAL(WARNING, "Cannot open the next span log segment in "
+                                   << m_options.directory.string());
+        }
+        return nullptr;
+      }
+    }
+
+    if (!m_resourceWritten) {
+      auto *header = At();
+      std::memcpy(header + 1, m_resource.data(), m_resource.size());
+      Commit(header, FrameType::RESOURCE, m_resource.size(), m_resource.size(),
+             0);
+      m_resourceWritten = true;
+    }
+    return At();
+  }
+
+  FrameHeader *At() { return reinterpret_cast<FrameHeader *>(m_map + m_used); }
+
+  void Commit(FrameHeader *header, FrameType type, uint32_t size,
+              uint32_t raw_size, uint32_t count) {
+    header->raw_size = raw_size;
+    header->count = count;
+    header->type = type;
+    std::atomic_ref<uint32_t>(header->size).store(size,
+                                                  std::memory_order_release);
+    m_used += Align(sizeof(FrameHeader) + size);
+  }
+
+  bool WriteFrame(FrameType type, const std::string &payload, uint32_t count) {
+    auto *header = Reserve(payload.size());
+    if (header == nullptr) {
+      return false;
+    }
+    std::memcpy(header + 1, payload.data(), payload.size());
+    Commit(header, type, payload.size(), payload.size(), count);
+    return true;
+  }
+
+  bool FlushBlock() {
+    if (m_blockCount == 0) {
+      return true;
+    }
+    bool written = false;
+#ifdef ZIL_SPANLOG_ZSTD
+    const size_t bound = ZSTD_compressBound(m_block.size());
+    if (auto *header = Reserve(bound)) {
+      const size_t size = ZSTD_compressCCtx(m_cctx, header + 1, bound,
+                                            m_block.data(), m_block.size(),
+                                            ZSTD_LEVEL);
+      if (ZSTD_isError(size)) {
+        LOG_GENERAL(WARNING,
+                    "Span log compression failed: " << ZSTD_getErrorName(size));
+      } else {
+        Commit(header, FrameType::SPANS_ZSTD, size, m_block.size(),
+               m_blockCount);
+        written = true;
+      }
+    }
+#endif
+    m_block.clear();
+    m_blockCount = 0;
+    return written;
+  }
+
+  SpanLogOptions m_options;
+  std::mutex m_mutex;
+  bool m_shutdown = false;
+  uint64_t m_sequence = 0;  // of the next segment
+  int m_fd = -1;
+  char *m_map = nullptr;
+  uint64_t m_used = 0;  // bytes of the current segment
+  std::string m_scratch;
+  std::string m_block;  // records of the block to compress
+  uint32_t m_blockCount = 0;
+  std::chrono::steady_clock::time_point m_blockStarted;
+  std::string m_resource;  // payload of the RESOURCE frame
+  bool m_haveResource = false;
+  bool m_resourceWritten = false;
+  bool m_tooLargeLogged = false;
+  bool m_openFailedLogged = false;
+#ifdef ZIL_SPANLOG_ZSTD
+  ZSTD_CCtx *m_cctx = nullptr;
+#else
+  void *m_cctx = nullptr;
+#endif
+};
+
+class Decoder {
+ public:
+  explicit Decoder(std::string_view data) : m_data(data) {}
+
+  template <typename T>
+  T Get() {
+    T value;
+    std::memcpy(&value, Take(sizeof(value)), sizeof(value));
+    return value;
+  }
+
+  void GetBytes(uint8_t *out, size_t size) {
+    std::memcpy(out, Take(size), size);
+  }
+
+  std::string GetString() {
+    const auto size = Get<uint32_t>();
+    return std::string(Take(size), size);
+  }
+
+  /// Element count of a sequence, checked against the bytes left so that a
+  /// corrupted count cannot make the reader allocate gigabytes
+  size_t GetCount(size_t min_element_size) {
+    const size_t count = Get<uint32_t>();
+    if (count > Remaining() / min_element_size) {
+      throw std::runtime_error("corrupted span log record");
+    }
+    return count;
+  }
+
+  spanlog::Attributes GetAttributes() {
+    // key size, type and a one byte value at least
+    spanlog::Attributes attributes(GetCount(sizeof(uint32_t) + 2));
+    for (auto &[key, value] : attributes) {
+      key = GetString();
+      value = GetValue();
+    }
+    return attributes;
+  }
+
+  size_t Remaining() const noexcept { return m_data.size() - m_offset; }
+
+ private:
+  const char *Take(size_t size) {
+    if (size > Remaining()) {
+      throw std::runtime_error("corrupted span log record");
+    }
+    const char *at = m_data.data() + m_offset;
+    m_offset += size;
+    return at;
+  }
+
+  template <typename T>
+  T GetScalar() {
+    if constexpr (std::is_same_v<T, bool>) {
+      return Get<uint8_t>() != 0;
+    } else if constexpr (std::is_same_v<T, std::string>) {
+      return GetString();
+    } else {
+      return Get<T>();
+    }
+  }
+
+  template <typename T>
+  spanlog::Value GetArray() {
+    // strings are their size at least, bool is one byte
+    std::vector<T> values(GetCount(
+        std::is_same_v<T, std::string> ? sizeof(uint32_t) : sizeof(T)));
+    for (size_t i = 0; i < values.size(); ++i) {
+      values[i] = GetScalar<T>();
+    }
+    return values;
+  }
+
+  spanlog::Value GetValue() {
+    switch (Get<uint8_t>()) {
+      case BOOL:
+        return GetScalar<bool>();
+      case I64:
+        return GetScalar<int64_t>();
+      case U64:
+        return GetScalar<uint64_t>();
+      case F64:
+        return GetScalar<double>();
+      case STR:
+        return GetScalar<std::string>();
+      case ARRAY | BOOL:
+        return GetArray<bool>();
+      case ARRAY | I64:
+        return GetArray<int64_t>();
+      case ARRAY | U64:
+        return GetArray<uint64_t>();
+      case ARRAY | F64:
+        return GetArray<double>();
+      case ARRAY | STR:
+        return GetArray<std::string>();
+      default:
+        throw std::runtime_error("unknown span log attribute type");
+    }
+  }
+
+  std::string_view m_data;
+  size_t m_offset = 0;
+};
+
+}  // namespace
+
+std::unique_ptr<trace_sdk::SpanExporter> CreateSpanLogExporter(
+    const SpanLogOptions &options) {
+  SpanLogOptions checked = options;
+  if (checked.compress && !SpanLogCompressionSupported()) {
+    LOG_GENERAL(WARNING, "Span log compression requires zstd, writing "
+                         "uncompressed segments");
+    checked.compress = false;
+  }
+  return std::make_unique<SpanLogExporter>(checked);
+}
+
+bool SpanLogCompressionSupported() noexcept {
+#ifdef ZIL_SPANLOG_ZSTD
+  return true;
+#else
+  return false;
+#endif
+}
+
+namespace spanlog {
+
+Reader::Reader(const std::filesystem::path &path) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) {
+    throw std::runtime_error("cannot open " + path.string());
+  }
+  m_data.resize(static_cast<size_t>(in.tellg()));
+  in.seekg(0);
+  in.read(m_data.data(), static_cast<std::streamsize>(m_data.size()));
+  if (!in || m_data.size() < sizeof(m_header)) {
+    throw std::runtime_error("cannot read " + path.string());
+  }
+  std::memcpy(&m_header, m_data.data(), sizeof(m_header));
+  if (std::memcmp(m_header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+    throw std::runtime_error(path.string() + " is not a span log segment");
+  }
+  if (m_header.version != VERSION) {
+    throw std::runtime_error(path.string() + " has unsupported version " +
+                             std::to_string(m_header.version));
+  }
+}
+
+bool Reader::NextFrame() {
+  while (m_offset + sizeof(FrameHeader) <= m_data.size()) {
+    FrameHeader header;
+    std::memcpy(&header, m_data.data() + m_offset, sizeof(header));
+    if (header.size == 0) {
+      return false;
+    }
+    if (m_offset + sizeof(header) + header.size > m_data.size()) {
+      throw std::runtime_error("truncated span log frame");
+    }
+    const std::string_view payload(m_data.data() + m_offset + sizeof(header),
+                                   header.size);
+    m_offset += Align(sizeof(header) + header.size);
+
+    switch (header.type) {
+      case FrameType::RESOURCE:
+        m_resource = Decoder(payload).GetAttributes();
+        break;
+      case FrameType::SPANS:
+        m_records = payload;
+        m_remaining = header.count;
+        return true;
+      case FrameType::SPANS_ZSTD: {
+#ifdef ZIL_SPANLOG_ZSTD
+        // the size recorded by the compressor, before allocating
+        if (ZSTD_getFrameContentSize(payload.data(), payload.size()) !=
+            header.raw_size) {
+          throw std::runtime_error("corrupted compressed span log frame");
+        }
+        m_block.resize(header.raw_size);
+        const size_t size = ZSTD_decompress(m_block.data(), m_block.size(),
+                                            payload.data(), payload.size());
+        if (ZSTD_isError(size) || size != header.raw_size) {
+          throw std::runtime_error("corrupted compressed span log frame");
+        }
+        m_records = m_block;
+        m_remaining = header.count;
+        return true;
+#else
+        throw std::runtime_error(
+            "compressed span log segment, built without zstd");
+#endif
+      }
+      default:
+        // written by a later version, skipped
+        break;
+    }
+  }
+  return false;
+}
+
+bool Reader::Next(Span &span) {
+  while (m_remaining == 0) {
+    if (!NextFrame()) {
+      return false;
+    }
+  }
+
+  Decoder frame(m_records);
+  const auto size = frame.Get<uint32_t>();
+  if (size > frame.Remaining()) {
+    throw std::runtime_error("corrupted span log record");
+  }
+  Decoder decoder(m_records.substr(sizeof(size), size));
+  m_records.remove_prefix(sizeof(size) + size);
+  --m_remaining;
+
+  decoder.GetBytes(span.trace_id, sizeof(span.trace_id));
+  decoder.GetBytes(span.span_id, sizeof(span.span_id));
+  decoder.GetBytes(span.parent_span_id, sizeof(span.parent_span_id));
+  span.trace_flags = decoder.Get<uint8_t>();
+  span.kind = decoder.Get<uint8_t>();
+  span.status = decoder.Get<uint8_t>();
+  span.start_ns = decoder.Get<int64_t>();
+  span.duration_ns = decoder.Get<int64_t>();
+  span.name = decoder.GetString();
+  span.status_description = decoder.GetString();
+  span.scope_name = decoder.GetString();
+  span.scope_version = decoder.GetString();
+  span.attributes = decoder.GetAttributes();
+
+  // name size, timestamp and attribute count
+  span.events.resize(decoder.GetCount(2 * sizeof(uint32_t) + sizeof(int64_t)));
+  for (auto &event : span.events) {
+    event.name = decoder.GetString();
+    event.timestamp_ns = decoder.Get<int64_t>();
+    event.attributes = decoder.GetAttributes();
+  }
+
+  // ids, flags and attribute count
+  span.links.resize(decoder.GetCount(sizeof(Link::trace_id) +
+                                     sizeof(Link::span_id) + 1 +
+                                     sizeof(uint32_t)));
+  for (auto &link : span.links) {
+    decoder.GetBytes(link.trace_id, sizeof(link.trace_id));
+    decoder.GetBytes(link.span_id, sizeof(link.span_id));
+    link.trace_flags = decoder.Get<uint8_t>();
+    link.attributes = decoder.GetAttributes();
+  }
+  return true;
+}
+
+std::vector<std::filesystem::path> Segments(
+    const std::filesystem::path &directory) {
+  std::vector<std::pair<uint64_t, std::filesystem::path>> found;
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(directory, ec)) {
+    uint64_t sequence = 0;
+    if (entry.is_regular_file(ec) && ParseSequence(entry.path(), sequence)) {
+      found.emplace_back(sequence, entry.path());
+    }
+  }
+  std::sort(found.begin(), found.end());
+
+  std::vector<std::filesystem::path> segments;
+  segments.reserve(found.size());
+  for (auto &[sequence, path] : found) {
+    segments.push_back(std::move(path));
+  }
+  return segments;
+}
+
+}  // namespace spanlog
+
+}  // namespace zil::trace
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_SPANLOG_H_
+#define ZILLIQA_SRC_LIBMETRICS_INTERNAL_SPANLOG_H_
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <opentelemetry/sdk/trace/exporter.h>
+
+namespace zil {
+namespace trace {
+
+// Span log of the FILE_SPANLOG provider, written when there is no collector
+// to export to and replayed later by tools/spanlog.
+//
+// The log is a directory of segment files spans-<sequence>.zsl, each of them
+// memory mapped at its full size when opened. A segment starts with a
+// SegmentHeader, followed by 8 byte aligned frames: a RESOURCE frame with the
+// resource attributes, then SPANS frames of the encoded spans of one export,
+// or SPANS_ZSTD frames of a compressed block of them. Exporting a span is an
+// encoding and a memcpy into the mapping, the only syscalls are those of
+// opening the next segment. The size in a frame header is stored once the
+// payload is written, so a segment of a crashed process ends at its last
+// complete frame; a frame size of 0 ends the segment. Integers are in host
+// byte order.
+//
+// Once a segment is full the oldest segments beyond max_segments are removed.
+// A new process continues after the highest sequence in the directory.
+
+struct SpanLogOptions {
+  std::filesystem::path directory{"spanlog"};
+  uint64_t segment_size = uint64_t{64} << 20;
+  uint64_t max_segments = 16;
+  /// zstd compressed blocks, spans of the block being filled are lost on a
+  /// crash. Ignored with a warning if built without zstd.
+  bool compress = false;
+  /// A compressed block this old is written by the next export even if it
+  /// is not full, ForceFlush writes it right away
+  std::chrono::milliseconds flush_interval{1000};
+};
+
+std::unique_ptr<opentelemetry::sdk::trace::SpanExporter> CreateSpanLogExporter(
+    const SpanLogOptions &options);
+
+/// Whether the build supports SpanLogOptions::compress
+bool SpanLogCompressionSupported() noexcept;
+
+namespace spanlog {
+
+constexpr char MAGIC[8] = {'Z', 'I', 'L', 'S', 'P', 'A', 'N', 'S'};
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t FLAG_ZSTD = 1;
+
+struct SegmentHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t sequence;
+  uint64_t created_ns;  // unix epoch
+  uint64_t reserved[4];
+};
+static_assert(sizeof(SegmentHeader) == 64);
+
+enum class FrameType : uint8_t { RESOURCE = 1, SPANS = 2, SPANS_ZSTD = 3 };
+
+struct FrameHeader {
+  uint32_t size;      // of the payload, written last
+  uint32_t raw_size;  // of the payload uncompressed
+  uint32_t count;     // of the records in the payload
+  FrameType type;
+  uint8_t reserved[3];
+};
+static_assert(sizeof(FrameHeader) == 16);
+
+// Attribute values as decoded, narrower types are widened when written
+using Value = std::variant<bool, int64_t, uint64_t, double, std::string,
+                           std::vector<bool>, std::vector<int64_t>,
+                           std::vector<uint64_t>, std::vector<double>,
+                           std::vector<std::string>>;
+
+using Attributes = std::vector<std::pair<std::string, Value>>;
+
+struct Event {
+  std::string name;
+  int64_t timestamp_ns;
+  Attributes attributes;
+};
+
+struct Link {
+  uint8_t trace_id[16];
+  uint8_t span_id[8];
+  uint8_t trace_flags;
+  Attributes attributes;
+};
+
+struct Span {
+  uint8_t trace_id[16];
+  uint8_t span_id[8];
+  uint8_t parent_span_id[8];
+  uint8_t trace_flags;
+  uint8_t kind;    // opentelemetry::trace::SpanKind
+  uint8_t status;  // opentelemetry::trace::StatusCode
+  int64_t start_ns;
+  int64_t duration_ns;
+  std::string name;
+  std::string status_description;
+  std::string scope_name;
+  std::string scope_version;
+  Attributes attributes;
+  std::vector<Event> events;
+  std::vector<Link> links;
+};
+
+// Reads one segment, throws std::runtime_error if it is not a segment or is
+// corrupted before its end.
+class Reader {
+ public:
+  explicit Reader(const std::filesystem::path &path);
+
+  Reader(const Reader &) = delete;
+
+  Reader &operator=(const Reader &) = delete;
+
+  const SegmentHeader &Header() const noexcept { return m_header; }
+
+  /// Resource attributes of the segment, known once the first span is read
+  const Attributes &Resource() const noexcept { return m_resource; }
+
+  /// False at the end of the segment
+  bool Next(Span &span);
+
+ private:
+  bool NextFrame();
+
+  std::string m_data;
+  size_t m_offset = sizeof(SegmentHeader);
+  SegmentHeader m_header;
+  Attributes m_resource;
+  std::string m_block;         // decompressed records of a SPANS_ZSTD frame
+  std::string_view m_records;  // not yet read records of the current frame
+  uint32_t m_remaining = 0;    // records left in m_records
+};
+
+/// Segment files of a span log directory in sequence order
+std::vector<std::filesystem::path> Segments(
+    const std::filesystem::path &directory);
+
+}  // namespace spanlog
+
+}  // namespace trace
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_INTERNAL_SPANLOG_H_
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ZILLIQA_SRC_LIBMETRICS_INTERNAL_START_H_
+#define ZILLIQA_SRC_LIBMETRICS_INTERNAL_START_H_
+
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace zil {
+namespace metrics {
+
+// Background thread of a StartAsync. It is joined by Join, or at exit if
+// that is never called, so the exporters it builds are not torn down under
+// it.
+class StartThread {
+ public:
+  StartThread() = default;
+
+  ~StartThread() { Join(); }
+
+  StartThread(const StartThread &) = delete;
+
+  StartThread &operator=(const StartThread &) = delete;
+
+  /// Runs start on the thread, only on the first call. Returns false if the
+  /// thread was started before.
+  template <typename F>
+  bool Start(F &&start) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_started) {
+      return false;
+    }
+    m_started = true;
+    m_thread = std::thread(std::forward<F>(start));
+    return true;
+  }
+
+  /// Waits for the thread to finish, does nothing on the thread itself
+  void Join() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_thread.joinable() &&
+        m_thread.get_id() != std::this_thread::get_id()) {
+      m_thread.join();
+    }
+  }
+
+ private:
+  std::mutex m_mutex;
+  std::thread m_thread;
+  bool m_started = false;
+};
+
+}  // namespace metrics
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBMETRICS_INTERNAL_START_H_
@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZILLIQA_SRC_LIBUTILS_LOGRECORD_H_
+#define ZILLIQA_SRC_LIBUTILS_LOGRECORD_H_
+
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace zil {
+namespace logging {
+
+enum class Severity : uint8_t { INFO, WARNING, FATAL };
+
+// Receives the records of LOG_GENERAL. libUtils only encodes them, the
+// asynchronous pipeline of libMetrics/Logging.h installs itself as the
+// backend. Without a backend a record is formatted and written to stdout by
+// the thread logging it.
+class LogBackend {
+ public:
+  virtual ~LogBackend() = default;
+
+  /// Trace and span id of the active span of the calling thread, left zero
+  /// outside a span
+  virtual void ActiveIds(uint8_t (&trace_id)[16],
+                         uint8_t (&span_id)[8]) noexcept = 0;
+
+  /// Takes a record encoded by RecordWriter, see DecodeRecord
+  virtual void Write(const char *record, uint32_t size) noexcept = 0;
+};
+
+class LogControl {
+ public:
+  /// The backend must live until exit, null restores the stdout fallback
+  static void SetBackend(LogBackend *backend) noexcept {
+    m_backend.store(backend, std::memory_order_release);
+  }
+
+  static LogBackend *Backend() noexcept {
+    return m_backend.load(std::memory_order_acquire);
+  }
+
+  static void SetLevel(Severity level) noexcept {
+    m_level.store(level, std::memory_order_relaxed);
+  }
+
+  static bool Enabled(Severity level) noexcept {
+    return level >= m_level.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static inline std::atomic<LogBackend *> m_backend{nullptr};
+  static inline std::atomic<Severity> m_level{Severity::INFO};
+};
+
+// Encodes one record on the stack and writes it to the backend on
+// destruction. Integers, floating point numbers and strings are stored as
+// they are and formatted by the backend, any other type is formatted here
+// through its operator<<. A record longer than MAX_RECORD is truncated.
+class RecordWriter {
+ public:
+  static constexpr size_t MAX_RECORD = 2048;
+
+  enum class Tag : uint8_t { I64, U64, F64, STR };
+
+  struct Header {
+    uint64_t timestamp_ns;
+    const char *file;      // __FILE__, static storage
+    const char *function;  // __FUNCTION__, static storage
+    uint32_t line;
+    uint32_t thread;
+    uint8_t trace_id[16];
+    uint8_t span_id[8];
+    Severity severity;
+    bool truncated;
+  };
+
+  RecordWriter(Severity severity, const char *file, uint32_t line,
+               const char *function) noexcept;
+
+  ~RecordWriter();
+
+  RecordWriter(const RecordWriter &) = delete;
+
+  RecordWriter &operator=(const RecordWriter &) = delete;
+
+  template <typename T>
+  RecordWriter &operator<<(const T &value) {
+    if constexpr (std::is_same_v<T, char> || std::is_same_v<T, signed char> ||
+                  std::is_same_v<T, unsigned char>) {
+      PutString(std::string_view(reinterpret_cast<const char *>(&value), 1));
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+      Put(Tag::I64, static_cast<int64_t>(value));
+    } else if constexpr (std::is_integral_v<T>) {
+      // bool included, printed as 0 or 1 like std::ostream does
+      Put(Tag::U64, static_cast<uint64_t>(value));
+    } else if constexpr (std::is_floating_point_v<T>) {
+      Put(Tag::F64, static_cast<double>(value));
+    } else if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+      PutString(std::string_view(value));
+    } else {
+      std::ostringstream os;
+      os << value;
+      PutString(os.str());
+    }
+    return *this;
+  }
+
+ private:
+  template <typename V>
+  void Put(Tag tag, V value) noexcept {
+    if (m_size + 1 + sizeof(value) > MAX_RECORD) {
+      GetHeader().truncated = true;
+      return;
+    }
+    m_buffer[m_size++] = static_cast<char>(tag);
+    std::memcpy(m_buffer + m_size, &value, sizeof(value));
+    m_size += sizeof(value);
+  }
+
+  void PutString(std::string_view text) noexcept;
+
+  /// Constructed in m_buffer by the constructor
+  Header &GetHeader() noexcept {
+    return *std::launder(reinterpret_cast<Header *>(m_buffer));
+  }
+
+  alignas(Header) char m_buffer[MAX_RECORD];
+  size_t m_size = sizeof(Header);
+};
+
+// A record as decoded by the backend
+struct Record {
+  RecordWriter::Header header;
+  std::string message;
+};
+
+inline uint32_t LogThreadId() noexcept {
+  thread_local uint32_t id = static_cast<uint32_t>(syscall(SYS_gettid));
+  return id;
+}
+
+inline const char *SeverityName(Severity severity) noexcept {
+  switch (severity) {
+    case Severity::INFO:
+      return "INFO";
+    case Severity::WARNING:
+      return "WARNING";
+    case Severity::FATAL:
+      return "FATAL";
+  }
+  return "?";
+}
+
+/// Whether the record was logged inside a span
+inline bool HasTraceIds(const RecordWriter::Header &header) noexcept {
+  return std::any_of(std::begin(header.trace_id), std::end(header.trace_id),
+                     [](uint8_t b) { return b != 0; });
+}
+
+inline Record DecodeRecord(const char *data, uint32_t size) {
+  using Tag = RecordWriter::Tag;
+
+  Record record;
+  std::memcpy(&record.header, data, sizeof(record.header));
+
+  auto read = [data](size_t &pos, auto value) {
+    std::memcpy(&value, data + pos, sizeof(value));
+    pos += sizeof(value);
+    return value;
+  };
+
+  char number[32];
+  size_t pos = sizeof(RecordWriter::Header);
+  while (pos < size) {
+    auto tag = static_cast<Tag>(data[pos++]);
+    switch (tag) {
+      case Tag::I64: {
+        auto end = std::to_chars(number, number + sizeof(number),
+                                 read(pos, int64_t{}))
+                       .ptr;
+        record.message.append(number, end);
+        break;
+      }
+      case Tag::U64: {
+        auto end = std::to_chars(number, number + sizeof(number),
+                                 read(pos, uint64_t{}))
+                       .ptr;
+        record.message.append(number, end);
+        break;
+      }
+      case Tag::F64: {
+        // %g matches the default std::ostream formatting
+        int n = std::snprintf(number, sizeof(number), "%g", read(pos, 0.0));
+        record.message.append(number, std::clamp(n, 0, 31));
+        break;
+      }
+      case Tag::STR: {
+        auto length = read(pos, uint32_t{});
+        record.message.append(data + pos, length);
+        pos += length;
+        break;
+      }
+    }
+  }
+  if (record.header.truncated) {
+    record.message += "...";
+  }
+  return record;
+}
+
+// [2023-05-04T10:11:12.123456Z][  1234][WARNING][Tracing2.cpp:411][ParseMask]
+// [<trace id>-<span id>] message, the trace part only inside a span
+inline void FormatRecord(std::string &out, const Record &record) {
+  static constexpr char DIGITS[] = "0123456789abcdef";
+  auto appendHex = [&out](const uint8_t *bytes, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      out += DIGITS[bytes[i] >> 4];
+      out += DIGITS[bytes[i] & 0xf];
+    }
+  };
+
+  const auto &header = record.header;
+
+  time_t seconds = static_cast<time_t>(header.timestamp_ns / 1000000000);
+  tm utc{};
+  gmtime_r(&seconds, &utc);
+  char time[64];
+  size_t n = std::strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%S", &utc);
+  std::snprintf(time + n, sizeof(time) - n, ".%06uZ",
+                static_cast<unsigned>(header.timestamp_ns % 1000000000 / 1000));
+
+  std::string_view file(header.file);
+  if (auto slash = file.rfind('/'); slash != std::string_view::npos) {
+    file.remove_prefix(slash + 1);
+  }
+
+  char prefix[64];
+  std::snprintf(prefix, sizeof(prefix), "][%6u][%s][", header.thread,
+                SeverityName(header.severity));
+
+  out += '[';
+  out += time;
+  out += prefix;
+  out += file;
+  out += ':';
+  out += std::to_string(header.line);
+  out += "][";
+  out += header.function;
+  out += ']';
+  if (HasTraceIds(header)) {
+    out += '[';
+    appendHex(header.trace_id, sizeof(header.trace_id));
+    out += '-';
+    appendHex(header.span_id, sizeof(header.span_id));
+    out += ']';
+  }
+  out += ' ';
+  out += record.message;
+  out += '\n';
+}
+
+inline RecordWriter::RecordWriter(Severity severity, const char *file,
+                                  uint32_t line, const char *function) noexcept {
+  auto &header = *new (m_buffer) Header{};
+  timespec ts{};
+  clock_gettime(CLOCK_REALTIME, &ts);
+  header.timestamp_ns = static_cast<uint64_t>(ts.tv_sec) * 1000000000 +
+                        static_cast<uint64_t>(ts.tv_nsec);
+  header.file = file;
+  header.function = function;
+  header.line = line;
+  header.thread = LogThreadId();
+  header.severity = severity;
+  if (auto *backend = LogControl::Backend()) {
+    backend->ActiveIds(header.trace_id, header.span_id);
+  }
+}
+
+inline RecordWriter::~RecordWriter() {
+  if (auto *backend = LogControl::Backend()) {
+    backend->Write(m_buffer, static_cast<uint32_t>(m_size));
+    return;
+  }
+
+  std::string line;
+  FormatRecord(line, DecodeRecord(m_buffer, static_cast<uint32_t>(m_size)));
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::fwrite(line.data(), 1, line.size(), stdout);
+  std::fflush(stdout);
+}
+
+inline void RecordWriter::PutString(std::string_view text) noexcept {
+  constexpr size_t OVERHEAD = 1 + sizeof(uint32_t);
+  if (m_size + OVERHEAD >= MAX_RECORD) {
+    GetHeader().truncated = true;
+    return;
+  }
+  auto length = std::min(text.size(), MAX_RECORD - m_size - OVERHEAD);
+  if (length < text.size()) {
+    GetHeader().truncated = true;
+  }
+  auto length32 = static_cast<uint32_t>(length);
+  m_buffer[m_size++] = static_cast<char>(Tag::STR);
+  std::memcpy(m_buffer + m_size, &length32, sizeof(length32));
+  m_size += sizeof(length32);
+  std::memcpy(m_buffer + m_size, text.data(), length);
+  m_size += length;
+}
+
+}  // namespace logging
+}  // namespace zil
+
+#endif  // ZILLIQA_SRC_LIBUTILS_LOGRECORD_H_
@@ -2,8 +2,17 @@
 #define BOLLOX
 
 #include "common/Constants.h"
+#include "libUtils/LogRecord.h"
 
-#define LOG_GENERAL(level, msg) \
-  { std::cout << "level:" << level << ": " << msg << std::endl; }
+// level is one of INFO, WARNING or FATAL. The record is encoded on the
+// calling thread and written by the LogBackend of libUtils/LogRecord.h.
+#define LOG_GENERAL(level, msg)                                              \
+  {                                                                          \
+    if (zil::logging::LogControl::Enabled(zil::logging::Severity::level)) {  \
+      zil::logging::RecordWriter zil_log_record(                             \
+          zil::logging::Severity::level, __FILE__, __LINE__, __FUNCTION__);  \
+      zil_log_record << msg;                                                 \
+    }                                                                        \
+  }
 
 #endif
@@ -3,6 +3,10 @@
 #include <opentelemetry/trace/span_id.h>
 #include <opentelemetry/trace/trace_flags.h>
 #include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <map>
 #include <memory>
 #include <span>
@@ -11,13 +15,27 @@
 
 #include "gtest/gtest.h"
 #include "libMetrics/Api.h"
+#include "libMetrics/Asio.h"
+#include "libMetrics/internal/flightrecorder.h"
+#include "libMetrics/internal/logring.h"
+#include "libMetrics/internal/perfetto.h"
+#include "libMetrics/internal/process.h"
+#include "libMetrics/internal/spanlog.h"
 
 // These will be ssummed into the cpp files of the API and not exposed once testing completed
 
 #include "common/Constants.h"
 #include "libUtils/Logger.h"
+#include <nlohmann/json.hpp>
+
 #include "opentelemetry/context/propagation/global_propagator.h"
 #include "opentelemetry/context/propagation/text_map_propagator.h"
+#include "opentelemetry/metrics/noop.h"
+#include "opentelemetry/metrics/provider.h"
+#include "opentelemetry/sdk/metrics/meter_provider.h"
+#include "opentelemetry/sdk/metrics/metric_reader.h"
+#include "opentelemetry/sdk/trace/simple_processor_factory.h"
+#include "opentelemetry/sdk/trace/tracer_provider_factory.h"
 #include "opentelemetry/trace/context.h"
 #include "opentelemetry/trace/propagation/b3_propagator.h"
 #include "opentelemetry/trace/propagation/http_trace_context.h"
@@ -64,11 +82,83 @@ class ApiTest : public ::testing::Test {
 
   ~ApiTest() override {}
 
-  void SetUp() override {}
+  void SetUp() override { m_filterMask = zil::metrics::Filter::GetInstance().Mask(); }
+
+  // tests may reload the filter, the next one starts from the same mask
+  void TearDown() override { zil::metrics::Filter::GetInstance().Store(m_filterMask); }
+
+ private:
+  zil::metrics::MetricsFilterMask::Words m_filterMask{};
+};
+
+namespace {
+
+namespace metrics_sdk = opentelemetry::sdk::metrics;
+
+// Swaps in an SDK provider whose reader collects on demand, so a test can
+// check what its instruments report. Instruments must be created after it,
+// the previous provider is put back at the end of the scope.
+class CollectingProvider final {
+ public:
+  CollectingProvider()
+      : m_previous(opentelemetry::metrics::Provider::GetMeterProvider()),
+        m_provider(std::make_shared<metrics_sdk::MeterProvider>()) {
+    auto reader = std::make_unique<Reader>();
+    m_reader = reader.get();
+    m_provider->AddMetricReader(std::move(reader));
+    opentelemetry::metrics::Provider::SetMeterProvider(m_provider);
+    zil::metrics::InstrumentRegistry::GetInstance().Reset();
+  }
+
+  ~CollectingProvider() {
+    opentelemetry::metrics::Provider::SetMeterProvider(m_previous);
+    zil::metrics::InstrumentRegistry::GetInstance().Reset();
+  }
+
+  /// Points of the metrics whose name ends in name, from one collection
+  std::vector<metrics_sdk::PointDataAttributes> Collect(const std::string &name) {
+    std::vector<metrics_sdk::PointDataAttributes> points;
+    m_reader->Collect([&](metrics_sdk::ResourceMetrics &data) {
+      for (const auto &scope : data.scope_metric_data_) {
+        for (const auto &metric : scope.metric_data_) {
+          const auto &full_name = metric.instrument_descriptor.name_;
+          if (full_name.size() >= name.size() &&
+              full_name.compare(full_name.size() - name.size(), name.size(), name) == 0) {
+            points.insert(points.end(), metric.point_data_attr_.begin(), metric.point_data_attr_.end());
+          }
+        }
+      }
+      return true;
+    });
+    return points;
+  }
+
+ private:
+  class Reader final : public metrics_sdk::MetricReader {
+   public:
+    metrics_sdk::AggregationTemporality GetAggregationTemporality(
+        metrics_sdk::InstrumentType) const noexcept override {
+      return metrics_sdk::AggregationTemporality::kCumulative;
+    }
+
+   private:
+    bool OnForceFlush(std::chrono::microseconds) noexcept override { return true; }
 
-  void TearDown() override {}
+    bool OnShutDown(std::chrono::microseconds) noexcept override { return true; }
+  };
+
+  std::shared_ptr<opentelemetry::metrics::MeterProvider> m_previous;
+  std::shared_ptr<metrics_sdk::MeterProvider> m_provider;
+  Reader *m_reader;
 };
 
+std::string StringAttribute(const metrics_sdk::PointDataAttributes &point, const std::string &key) {
+  auto it = point.attributes.find(key);
+  return it == point.attributes.end() ? std::string{} : opentelemetry::nostd::get<std::string>(it->second);
+}
+
+}  // namespace
+
 TEST_F(ApiTest, TestBadProviderConfiguration) {
   Z_I64METRIC iCounter(zil::metrics::FilterClass::ACCOUNTSTORE_EVM, "i64Counter", "the first i64 counter", "seconds");
 
@@ -117,6 +207,217 @@ TEST_F(ApiTest, TestdoubleHistogram) {
   }
 }
 
+TEST_F(ApiTest, TestLatencyScope) {
+  zil::metrics::Filter::GetInstance().Reload("ACCOUNTSTORE_EVM");
+  CollectingProvider provider;
+  std::vector<double> boundary{10.0, 100.0, 1000.0, 10000.0, 100000.0};
+  Z_LATENCY latency(zil::metrics::FilterClass::ACCOUNTSTORE_EVM, "scopeLatency", boundary, "the first scope timer");
+
+  for (int i = 0; i < 10; i++) {
+    LATENCY_SCOPE(latency);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  auto wallPoints = provider.Collect("scopeLatency_wall");
+  ASSERT_EQ(wallPoints.size(), 1u);
+  EXPECT_EQ(StringAttribute(wallPoints[0], "method"), "TestBody");
+  auto &wall = opentelemetry::nostd::get<metrics_sdk::HistogramPointData>(wallPoints[0].point_data);
+  EXPECT_EQ(wall.count_, 10u);
+  EXPECT_GE(opentelemetry::nostd::get<double>(wall.min_), 10000.0);
+
+  // a sleeping thread uses next to no CPU
+  auto cpuPoints = provider.Collect("scopeLatency_cpu");
+  ASSERT_EQ(cpuPoints.size(), 1u);
+  auto &cpu = opentelemetry::nostd::get<metrics_sdk::HistogramPointData>(cpuPoints[0].point_data);
+  EXPECT_EQ(cpu.count_, 10u);
+  EXPECT_LT(opentelemetry::nostd::get<double>(cpu.sum_), opentelemetry::nostd::get<double>(wall.sum_) / 10);
+}
+
+TEST_F(ApiTest, TestLatencyToken) {
+  CollectingProvider provider;
+  Z_ASYNCLATENCY binding(zil::metrics::FilterClass::ACCOUNTSTORE_EVM, "tokenLatency", {100.0, 10000.0},
+                         "handed across threads", "fetch");
+
+  Z_LATENCYTOKEN token = binding.Start();
+  ASSERT_TRUE(token.Pending());
+  std::thread([token = std::move(token)]() mutable {
+    Z_LATENCYTOKEN moved = std::move(token);
+    EXPECT_FALSE(token.Pending());
+    moved.Complete(zil::metrics::LatencyStatus::ERROR);
+    // completing again or destroying it records nothing more
+    moved.Complete();
+  }).join();
+
+  auto points = provider.Collect("tokenLatency");
+  ASSERT_EQ(points.size(), 1u);
+  EXPECT_EQ(StringAttribute(points[0], "status"), "error");
+  EXPECT_EQ(StringAttribute(points[0], "operation"), "fetch");
+  auto &histogram = opentelemetry::nostd::get<metrics_sdk::HistogramPointData>(points[0].point_data);
+  EXPECT_EQ(histogram.count_, 1u);
+}
+
+TEST_F(ApiTest, TestInstrumentedMutex) {
+  zil::metrics::Filter::GetInstance().Reload("ACCOUNTSTORE_EVM");
+  CollectingProvider provider;
+  Z_LOCKSTATS locks(zil::metrics::FilterClass::ACCOUNTSTORE_EVM, "testLock", "test locks");
+  Z_MUTEX mutex(locks, "counter", std::chrono::milliseconds(1));
+  Z_SHAREDMUTEX shared(locks, "table");
+
+  int64_t counter = 0;
+  int64_t table = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 10000; i++) {
+        {
+          std::lock_guard<Z_MUTEX> lock(mutex);
+          counter++;
+        }
+        {
+          std::unique_lock<Z_SHAREDMUTEX> lock(shared);
+          table++;
+        }
+        std::shared_lock<Z_SHAREDMUTEX> lock(shared);
+        EXPECT_GT(table, 0);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(counter, 40000);
+  EXPECT_EQ(table, 40000);
+
+  // one acquisition certainly waits
+  std::atomic<bool> waiting{false};
+  mutex.lock();
+  std::thread contender([&] {
+    waiting = true;
+    std::lock_guard<Z_MUTEX> lock(mutex);
+  });
+  while (!waiting) {
+    std::this_thread::yield();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  mutex.unlock();
+  contender.join();
+
+  auto Find = [](const std::vector<metrics_sdk::PointDataAttributes> &points, const std::string &lock,
+                 const std::string &mode) -> const metrics_sdk::HistogramPointData * {
+    for (const auto &point : points) {
+      EXPECT_TRUE(StringAttribute(point, "lock") == "counter" || StringAttribute(point, "lock") == "table");
+      EXPECT_TRUE(StringAttribute(point, "mode") == "exclusive" || StringAttribute(point, "mode") == "shared");
+      if (StringAttribute(point, "lock") == lock && StringAttribute(point, "mode") == mode) {
+        return &opentelemetry::nostd::get<metrics_sdk::HistogramPointData>(point.point_data);
+      }
+    }
+    return nullptr;
+  };
+
+  auto waits = provider.Collect("testLock_wait");
+  auto *wait = Find(waits, "counter", "exclusive");
+  ASSERT_NE(wait, nullptr);
+  EXPECT_GE(wait->count_, 1u);
+  EXPECT_GE(opentelemetry::nostd::get<double>(wait->max_), 4000.0);
+
+  // with slow_hold every hold of counter is timed, those of table are sampled
+  auto holds = provider.Collect("testLock_hold");
+  auto *hold = Find(holds, "counter", "exclusive");
+  ASSERT_NE(hold, nullptr);
+  EXPECT_EQ(hold->count_, 40002u);
+  auto *tableHold = Find(holds, "table", "exclusive");
+  ASSERT_NE(tableHold, nullptr);
+  EXPECT_GE(tableHold->count_, 40000u / Z_MUTEX::HOLD_SAMPLE_RATE);
+  EXPECT_EQ(Find(holds, "table", "shared"), nullptr);
+}
+
+TEST_F(ApiTest, TestInstrumentedQueue) {
+  Z_QUEUESTATS stats(zil::metrics::FilterClass::QUEUE, "testQueue", "test queue");
+  Z_QUEUE<int> queue(stats, 16, true);
+
+  std::thread producer([&queue] {
+    for (int i = 0; i < 10000; i++) {
+      queue.Push(i);
+    }
+  });
+  int64_t sum = 0;
+  for (int i = 0; i < 10000; i++) {
+    int value;
+    zil::trace2::TraceContext context;
+    queue.Pop(value, context);
+    sum += value;
+  }
+  producer.join();
+  EXPECT_EQ(sum, 10000LL * 9999 / 2);
+  EXPECT_EQ(queue.Depth(), 0);
+
+  for (int i = 0; i < 16; i++) {
+    EXPECT_TRUE(queue.TryPush(int(i)));
+  }
+  int last = 16;
+  EXPECT_FALSE(queue.TryPush(std::move(last)));
+  EXPECT_EQ(queue.Depth(), 16);
+}
+
+TEST_F(ApiTest, TestInstrumentedExecutor) {
+  Z_EXECUTORSTATS stats(zil::metrics::FilterClass::API_SERVER, "testPool", "test pool");
+  boost::asio::io_context context;
+  Z_EXECUTOR executor(context, stats);
+  static const Z_HANDLERTAG postTag("post");
+  static const Z_HANDLERTAG timerTag("timer");
+
+  std::atomic<int> ran{0};
+  for (int i = 0; i < 100; i++) {
+    executor.Post(postTag, [&ran] { ran++; });
+  }
+  EXPECT_EQ(stats.Pending(), 100);
+
+  boost::asio::steady_timer timer(context, std::chrono::milliseconds(10));
+  timer.async_wait(executor.Wrap(timerTag, [&ran](const boost::system::error_code &) { ran++; }));
+
+  std::thread thread([&executor] { executor.Run(); });
+  thread.join();
+  EXPECT_EQ(ran, 101);
+  EXPECT_EQ(stats.Pending(), 0);
+}
+
+TEST_F(ApiTest, TestInstrumentedSocket) {
+  Z_SOCKETSTATS stats(zil::metrics::FilterClass::API_SERVER, "testNet", "test connections");
+  boost::asio::io_context context;
+  boost::asio::ip::tcp::acceptor acceptor(context, {boost::asio::ip::address_v4::loopback(), 0});
+  Z_SOCKET server(context, stats);
+  Z_SOCKET client(context, stats);
+  std::string request = "ping\n";
+  boost::asio::streambuf received;
+  std::size_t read = 0;
+
+  acceptor.async_accept(server.Raw(), [&](const boost::system::error_code &ec) {
+    ASSERT_FALSE(ec);
+    server.AsyncReadUntil(received, '\n', [&](const boost::system::error_code &ec, std::size_t bytes) {
+      EXPECT_FALSE(ec);
+      read = bytes;
+    });
+  });
+  client.AsyncConnect(acceptor.local_endpoint(), [&](const boost::system::error_code &ec) {
+    ASSERT_FALSE(ec);
+    client.AsyncWrite(boost::asio::buffer(request), [](const boost::system::error_code &ec, std::size_t) {
+      EXPECT_FALSE(ec);
+    });
+  });
+  context.run();
+  EXPECT_EQ(read, request.size());
+  EXPECT_EQ(client.PeerLabel(), "127.0.0.1");
+
+  // Totals reach the peer in batches, or when the socket flushes
+  server.Flush();
+  client.Flush();
+  auto &peer = stats.GetPeer("127.0.0.1");
+  EXPECT_EQ(peer.bytesOut, request.size());
+  EXPECT_EQ(peer.bytesIn, request.size());
+  EXPECT_EQ(peer.opsOut, 1);
+  EXPECT_EQ(peer.opsIn, 1);
+}
+
 TEST_F(ApiTest, TestDoubleGauge) {
   Z_DBLGAUGE dGauge(zil::metrics::FilterClass::ACCOUNTSTORE_EVM, "dblGauge", "My very first gauge", "seconds", true);
 
@@ -145,6 +446,703 @@ TEST_F(ApiTest, Testi64Gauge) {
   });
 }
 
+TEST_F(ApiTest, TestProcessMetrics) {
+  auto &process = zil::metrics::ProcessMetrics::GetInstance();
+  {
+    CollectingProvider provider;
+    process.Publish();
+
+    auto cpuSeconds = [&provider] {
+      double total = 0;
+      for (const auto &point : provider.Collect("process_cpu_seconds")) {
+        auto &sum = opentelemetry::nostd::get<metrics_sdk::SumPointData>(point.point_data);
+        total += opentelemetry::nostd::get<double>(sum.value_);
+      }
+      return total;
+    };
+
+    auto rss = provider.Collect("process_resident_memory_bytes");
+    ASSERT_EQ(rss.size(), 1u);
+    auto &value = opentelemetry::nostd::get<metrics_sdk::LastValuePointData>(rss[0].point_data);
+    EXPECT_GT(opentelemetry::nostd::get<int64_t>(value.value_), 1 << 20);
+
+    // every collection reads /proc again, no exporter has to end the cycle
+    double before = cpuSeconds();
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+    for (volatile uint64_t spin = 0; std::chrono::steady_clock::now() < end; spin = spin + 1) {
+    }
+    EXPECT_GT(cpuSeconds(), before);
+  }
+  // back on the provider of Metrics::Init
+  process.Publish();
+}
+
+TEST_F(ApiTest, TestBatchObservable) {
+  CollectingProvider provider;
+  auto blocks = Metrics::GetInstance().CreateInt64Gauge("batchBlocks", "Blocks from one snapshot");
+  auto size = Metrics::GetInstance().CreateDoubleGauge("batchSize", "Size from the same snapshot", "MB");
+
+  int snapshots = 0;
+  zil::metrics::BatchObservable batch({&blocks, &size});
+  batch.SetCallback([&](auto &&result) {
+    ++snapshots;
+    result.Set(blocks, 1234 + snapshots, {{"counter", "BlockNumber"}});
+    result.Set(size, 56.7 * snapshots, {{"store", "accounts"}});
+  });
+
+  // every collection calls both members, the snapshot must be taken once per
+  // collection and both values must come from it
+  for (int cycle = 1; cycle <= 3; ++cycle) {
+    auto blockPoints = provider.Collect("batchBlocks");
+    EXPECT_EQ(snapshots, 2 * cycle - 1);
+    ASSERT_EQ(blockPoints.size(), 1u);
+    EXPECT_EQ(StringAttribute(blockPoints[0], "counter"), "BlockNumber");
+    auto &blockValue = opentelemetry::nostd::get<metrics_sdk::LastValuePointData>(blockPoints[0].point_data);
+    EXPECT_EQ(opentelemetry::nostd::get<int64_t>(blockValue.value_), 1234 + snapshots);
+
+    auto sizePoints = provider.Collect("batchSize");
+    EXPECT_EQ(snapshots, 2 * cycle);
+    ASSERT_EQ(sizePoints.size(), 1u);
+    EXPECT_EQ(StringAttribute(sizePoints[0], "store"), "accounts");
+    auto &sizeValue = opentelemetry::nostd::get<metrics_sdk::LastValuePointData>(sizePoints[0].point_data);
+    EXPECT_DOUBLE_EQ(opentelemetry::nostd::get<double>(sizeValue.value_), 56.7 * snapshots);
+  }
+}
+
+TEST_F(ApiTest, TestAttributeSetHandle) {
+  zil::metrics::Filter::GetInstance().Reload("ACCOUNTSTORE_EVM");
+  CollectingProvider provider;
+  Z_I64GAUGE iGauge(zil::metrics::FilterClass::ACCOUNTSTORE_EVM, "handleGauge", "Gauge with pre-built attributes", "blocks",
+                    true);
+
+  std::vector<zil::metrics::AttributeSetHandle> shards;
+  for (int i = 0; i < 1000; i++) {
+    shards.push_back({{"shard", i}, {"store", "accounts"}});
+  }
+
+  iGauge.SetCallback([&shards](auto &&result) {
+    for (size_t i = 0; i < shards.size(); i++) {
+      result.Set(i * 10, shards[i]);
+    }
+  });
+
+  auto points = provider.Collect("handleGauge");
+  ASSERT_EQ(points.size(), 1000u);
+  std::vector<bool> seen(shards.size());
+  for (const auto &point : points) {
+    EXPECT_EQ(StringAttribute(point, "store"), "accounts");
+    auto shard = opentelemetry::nostd::get<int64_t>(point.attributes.find("shard")->second);
+    ASSERT_TRUE(shard >= 0 && shard < 1000);
+    EXPECT_FALSE(seen[shard]);
+    seen[shard] = true;
+    auto &value = opentelemetry::nostd::get<metrics_sdk::LastValuePointData>(point.point_data);
+    EXPECT_EQ(opentelemetry::nostd::get<int64_t>(value.value_), shard * 10);
+  }
+}
+
+TEST_F(ApiTest, TestSyncGauge) {
+  Z_I64SYNCUPDOWN depth(zil::metrics::FilterClass::ACCOUNTSTORE_EVM, "syncDepth", "Queue depth", "items", true);
+  Z_DBLSYNCGAUGE load(zil::metrics::FilterClass::ACCOUNTSTORE_EVM, "syncLoad", "Load", "ratio", true);
+
+  for (int i = 0; i < 100; i++) {
+    depth++;
+    load.Set(i / 100.0);
+  }
+  depth.Sub(40);
+  depth--;
+
+  EXPECT_EQ(depth.Get(), 59);
+  EXPECT_DOUBLE_EQ(load.Get(), 0.99);
+}
+
+TEST_F(ApiTest, TestMetricCatalog) {
+  auto path = std::filesystem::temp_directory_path() / "catalog_filters.conf";
+  std::ofstream(path) << "# no mask, nothing is changed\n";
+
+  ASSERT_TRUE(zil::metrics::FilterReload::Watch(path.string()));
+  EXPECT_EQ(Z_CATALOG::Get(Z_MID::FILTER_FILE_WATCHED), 1);
+  zil::metrics::FilterReload::Stop();
+  EXPECT_EQ(Z_CATALOG::Get(Z_MID::FILTER_FILE_WATCHED), 0);
+  std::filesystem::remove(path);
+
+  {
+    CollectingProvider provider;
+    Z_CATALOG::Publish();
+
+    auto metrics = Z_CATALOG::Get(Z_MID::FILTER_MASK_CHANGES, 0);
+    auto traces = Z_CATALOG::Get(Z_MID::FILTER_MASK_CHANGES, 1);
+    Z_CATALOG::Add<Z_MID::FILTER_MASK_CHANGES>(2, 1);
+
+    auto points = provider.Collect("filter_mask_changes");
+    ASSERT_EQ(points.size(), 2u);
+    for (const auto &point : points) {
+      auto signal = opentelemetry::nostd::get<int64_t>(point.attributes.find("signal")->second);
+      auto &sum = opentelemetry::nostd::get<metrics_sdk::SumPointData>(point.point_data);
+      EXPECT_EQ(opentelemetry::nostd::get<int64_t>(sum.value_), signal == 0 ? metrics : traces + 2);
+    }
+
+    // filter telemetry has a class of its own, apart from PROCESS
+    static_assert(Z_CATALOG::Describe(Z_MID::FILTER_MASK_CHANGES).filter == Z_FL::TELEMETRY_FILTER);
+    static_assert(Z_CATALOG::Describe(Z_MID::FILTER_FILE_WATCHED).filter == Z_FL::TELEMETRY_FILTER);
+    zil::metrics::Filter::GetInstance().Reload("ALL,-TELEMETRY.FILTER");
+    EXPECT_TRUE(zil::metrics::Filter::GetInstance().Enabled(Z_FL::PROCESS));
+    EXPECT_TRUE(provider.Collect("filter_mask_changes").empty());
+  }
+  // back on the provider of Metrics::Init
+  Z_CATALOG::Publish();
+}
+
+TEST_F(ApiTest, TestInstrumentRegistry) {
+  zil::metrics::Filter::GetInstance().Reload("API_SERVER");
+  CollectingProvider provider;
+  auto &registry = zil::metrics::InstrumentRegistry::GetInstance();
+  auto created = registry.Register(
+      {{zil::metrics::InstrumentKind::U64_COUNTER, Z_FL::API_SERVER,
+        "registry_counter", "Registered in bulk", "calls", {}},
+       {zil::metrics::InstrumentKind::DOUBLE_HISTOGRAM, Z_FL::API_SERVER,
+        "registry_histogram", "Registered in bulk", "us", {1.0, 10.0}}});
+  auto size = registry.Size();
+
+  Z_I64METRIC first(Z_FL::API_SERVER, "registry_counter", "Registered in bulk",
+                    "calls");
+  Z_I64METRIC second(Z_FL::API_SERVER, "registry_counter",
+                     "Registered in bulk", "calls");
+  Z_DBLHIST histogram(Z_FL::API_SERVER, "registry_histogram", {1.0, 10.0},
+                      "Registered in bulk", "us");
+
+  EXPECT_EQ(created, 2u);
+  EXPECT_EQ(first.get(), second.get());
+  EXPECT_EQ(registry.Size(), size);
+
+  first++;
+  second++;
+  histogram.Record(5.0);
+
+  // both handles feed the one counter registered in bulk
+  auto counters = provider.Collect("registry_counter");
+  ASSERT_EQ(counters.size(), 1u);
+  auto &sum = opentelemetry::nostd::get<metrics_sdk::SumPointData>(counters[0].point_data);
+  EXPECT_EQ(opentelemetry::nostd::get<int64_t>(sum.value_), 2);
+
+  auto histograms = provider.Collect("registry_histogram");
+  ASSERT_EQ(histograms.size(), 1u);
+  EXPECT_EQ(opentelemetry::nostd::get<metrics_sdk::HistogramPointData>(histograms[0].point_data).count_, 1u);
+}
+
+TEST_F(ApiTest, TestViewsOnNoopProvider) {
+  auto previous = opentelemetry::metrics::Provider::GetMeterProvider();
+  opentelemetry::metrics::Provider::SetMeterProvider(
+      opentelemetry::nostd::shared_ptr<opentelemetry::metrics::MeterProvider>(
+          new opentelemetry::metrics::NoopMeterProvider()));
+  auto &registry = zil::metrics::InstrumentRegistry::GetInstance();
+  registry.Reset();
+
+  // histograms add a view, which the NOOP provider does not have
+  Z_DBLHIST histogram(Z_FL::API_SERVER, "noop_histogram", {1.0, 10.0}, "No views", "us");
+  histogram.Record(5.0);
+  Metrics::GetInstance().AddCounterSumView("noop_counter", "No views");
+
+  opentelemetry::metrics::Provider::SetMeterProvider(previous);
+  registry.Reset();
+}
+
+TEST_F(ApiTest, TestFilterMask) {
+  using zil::metrics::MetricsFilterMask;
+  const auto &names = zil::metrics::METRICS_FILTER_CLASS_NAMES;
+
+  MetricsFilterMask mask;
+  mask.Store(MetricsFilterMask::Parse("EVM,-EVM.CLIENT.LOW_LEVEL", names));
+  EXPECT_TRUE(mask.Test(static_cast<size_t>(Z_FL::EVM_CLIENT)));
+  EXPECT_TRUE(mask.Test(static_cast<size_t>(Z_FL::EVM_RPC)));
+  EXPECT_FALSE(mask.Test(static_cast<size_t>(Z_FL::EVM_CLIENT_LOW_LEVEL)));
+  EXPECT_FALSE(mask.Test(static_cast<size_t>(Z_FL::SCILLA_IPC)));
+
+  std::vector<std::string> unmatched;
+  mask.Store(MetricsFilterMask::Parse("*.SERVER,NO_SUCH_CLASS", names,
+                                      &unmatched));
+  EXPECT_TRUE(mask.Test(static_cast<size_t>(Z_FL::API_SERVER)));
+  EXPECT_TRUE(mask.Test(static_cast<size_t>(Z_FL::LOOKUP_SERVER)));
+  EXPECT_EQ(unmatched, std::vector<std::string>{"NO_SUCH_CLASS"});
+}
+
+TEST_F(ApiTest, TestWideFilterMask) {
+  using WideMask = zil::metrics::FilterMask<130>;
+  static_assert(WideMask::WORDS == 3);
+  static_assert(WideMask::Word(63) == 0 && WideMask::Word(64) == 1 && WideMask::Word(129) == 2);
+  static_assert(WideMask::Bit(63) == uint64_t{1} << 63 && WideMask::Bit(64) == 1 && WideMask::Bit(129) == 2);
+
+  // classes on both sides of each word boundary, with paths A.x for
+  // indices below 64, B.x up to 127 and C.x above
+  std::vector<std::string> names(130);
+  std::vector<std::string> paths(130);
+  WideMask::Classes classes;
+  for (size_t i = 0; i < classes.size(); ++i) {
+    names[i] = "CLASS_" + std::to_string(i);
+    paths[i] = std::string(i < 64 ? "A." : i < 128 ? "B." : "C.") + std::to_string(i);
+    classes[i] = {names[i], paths[i]};
+  }
+  const std::vector<size_t> edges{0, 63, 64, 127, 128, 129};
+  auto Selected = [](const WideMask &mask) {
+    std::vector<size_t> selected;
+    for (size_t i = 0; i < 130; ++i) {
+      if (mask.Test(i)) {
+        selected.push_back(i);
+      }
+    }
+    return selected;
+  };
+
+  WideMask mask;
+  WideMask::Words words{};
+  for (size_t i : {0, 63, 64, 129}) {
+    words[WideMask::Word(i)] |= WideMask::Bit(i);
+  }
+  EXPECT_TRUE(mask.Store(words));
+  EXPECT_FALSE(mask.Store(words));
+  EXPECT_EQ(Selected(mask), (std::vector<size_t>{0, 63, 64, 129}));
+  EXPECT_EQ(mask.Load(), words);
+
+  mask.Store(WideMask::Parse("CLASS_0,CLASS_63,CLASS_64,CLASS_129", classes));
+  EXPECT_EQ(Selected(mask), (std::vector<size_t>{0, 63, 64, 129}));
+
+  mask.Store(WideMask::Parse("ALL,-CLASS_63,-CLASS_64,-C", classes));
+  for (size_t i : edges) {
+    EXPECT_EQ(mask.Test(i), i == 0 || i == 127) << i;
+  }
+  EXPECT_EQ(Selected(mask).size(), 126u);
+
+  // a wildcard segment spans all words, the exclusion only its own
+  mask.Store(WideMask::Parse("*.*,-B.*", classes));
+  for (size_t i : edges) {
+    EXPECT_EQ(mask.Test(i), i < 64 || i >= 128) << i;
+  }
+  mask.Store(WideMask::Parse("*.6*,*.12*", classes));
+  EXPECT_EQ(Selected(mask),
+            (std::vector<size_t>{6, 12, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 120, 121, 122, 123, 124, 125, 126,
+                                 127, 128, 129}));
+
+  mask.Store(WideMask::Parse("NONE", classes));
+  EXPECT_TRUE(Selected(mask).empty());
+}
+
+TEST_F(ApiTest, TestFilterReload) {
+  auto &filter = zil::metrics::Filter::GetInstance();
+  Z_I64METRIC counter(Z_FL::CPS, "reload_counter", "Switched at runtime",
+                      "calls");
+
+  auto changes = Z_CATALOG::Get(Z_MID::FILTER_MASK_CHANGES, 0);
+  zil::metrics::FilterReload::Apply("API_SERVER", std::nullopt);
+  EXPECT_FALSE(filter.Enabled(Z_FL::CPS));
+  EXPECT_EQ(Z_CATALOG::Get(Z_MID::FILTER_MASK_CHANGES, 0), changes + 1);
+  zil::metrics::FilterReload::Apply("API_SERVER", std::nullopt);
+  EXPECT_EQ(Z_CATALOG::Get(Z_MID::FILTER_MASK_CHANGES, 0), changes + 1);
+  auto noop = counter.get();
+  counter++;
+
+  zil::metrics::FilterReload::Apply("ALL", std::nullopt);
+  EXPECT_TRUE(filter.Enabled(Z_FL::CPS));
+  EXPECT_NE(counter.get(), noop);
+  counter++;
+}
+
+namespace {
+
+class SumCounter final
+    : public opentelemetry::metrics::Counter<uint64_t> {
+ public:
+  void Add(uint64_t value) noexcept override { sum += value; }
+
+  void Add(uint64_t value,
+           const opentelemetry::context::Context &) noexcept override {
+    sum += value;
+  }
+
+  void Add(uint64_t value,
+           const opentelemetry::common::KeyValueIterable &) noexcept override {
+    sum += value;
+    ++attributed;
+  }
+
+  void Add(uint64_t value, const opentelemetry::common::KeyValueIterable &,
+           const opentelemetry::context::Context &) noexcept override {
+    sum += value;
+    ++attributed;
+  }
+
+  uint64_t sum = 0;
+  size_t attributed = 0;
+};
+
+}  // namespace
+
+TEST_F(ApiTest, TestReloadedMaskSurvivesInit) {
+  auto &filter = zil::metrics::Filter::GetInstance();
+  filter.Reload("CPS");
+  {
+    // the provider before Init is put back at the end of the scope
+    CollectingProvider provider;
+    Metrics::GetInstance().Init("NOOP");
+  }
+  EXPECT_TRUE(filter.Enabled(Z_FL::CPS));
+  EXPECT_FALSE(filter.Enabled(Z_FL::API_SERVER));
+
+  auto &traceFilter = zil::trace::Filter::GetInstance();
+  traceFilter.Reload("NODE");
+  traceFilter.init();
+  EXPECT_TRUE(traceFilter.Enabled(zil::trace::FilterClass::NODE));
+  EXPECT_FALSE(traceFilter.Enabled(zil::trace::FilterClass::EVM_RPC));
+  traceFilter.Reload(TRACE_ZILLIQA_MASK);
+}
+
+TEST_F(ApiTest, TestPreBufferReplay) {
+  zil::metrics::BufferedCounter<uint64_t> buffer;
+  buffer.Add(3);
+  buffer.Add(4);
+  buffer.Add(5, zil::metrics::AttributeSetHandle{{"shard", int64_t{1}}});
+
+  SumCounter counter;
+  buffer.Replay(counter);
+  EXPECT_EQ(counter.sum, 12u);
+  EXPECT_EQ(counter.attributed, 1u);
+
+  // replayed once only
+  buffer.Replay(counter);
+  EXPECT_EQ(counter.sum, 12u);
+  EXPECT_TRUE(Metrics::Ready());
+}
+
+TEST_F(ApiTest, TestLogRing) {
+  constexpr uint32_t COUNT = 100000;
+  zil::logging::LogRing ring;
+
+  std::thread producer([&ring] {
+    std::string record;
+    for (uint32_t i = 0; i < COUNT;) {
+      record.assign(i % 300 + sizeof(i), 'x');
+      std::memcpy(record.data(), &i, sizeof(i));
+      if (ring.Push(record.data(), record.size())) {
+        ++i;
+      }
+    }
+  });
+
+  uint32_t expected = 0;
+  while (expected < COUNT) {
+    ring.Drain([&expected](const char *data, uint32_t size) {
+      uint32_t i;
+      std::memcpy(&i, data, sizeof(i));
+      EXPECT_EQ(i, expected);
+      EXPECT_EQ(size, i % 300 + sizeof(i));
+      ++expected;
+    });
+  }
+  producer.join();
+  EXPECT_TRUE(ring.Empty());
+}
+
+TEST_F(ApiTest, TestLogging) {
+  auto path = std::filesystem::temp_directory_path() / "test_logging.log";
+  std::filesystem::remove(path);
+  zil::logging::Logging::Init("FILE", path.string());
+
+  LOG_GENERAL(INFO, "logging " << 1 << " " << 2.5 << " " << std::string("ok"));
+  LOG_GENERAL(WARNING, "signed " << -3 << ' ' << true);
+  // replacing the sink writes out what the file sink has not yet
+  zil::logging::Logging::Init("STDOUT");
+  EXPECT_EQ(zil::logging::Logging::Dropped(), 0u);
+
+  // other threads of the process may log meanwhile
+  std::vector<std::string> lines;
+  std::ifstream file(path);
+  for (std::string line; std::getline(file, line);) {
+    if (line.find("[Test.cpp:") != std::string::npos) {
+      lines.push_back(line);
+    }
+  }
+  ASSERT_EQ(lines.size(), 2u);
+  EXPECT_NE(lines[0].find("][INFO][Test.cpp:"), std::string::npos) << lines[0];
+  // no trace part outside a span
+  EXPECT_NE(lines[0].find("][TestBody] logging 1 2.5 ok"), std::string::npos) << lines[0];
+  EXPECT_NE(lines[1].find("][WARNING][Test.cpp:"), std::string::npos) << lines[1];
+  EXPECT_NE(lines[1].find("][TestBody] signed -3 1"), std::string::npos) << lines[1];
+
+  std::filesystem::remove(path);
+}
+
+TEST_F(ApiTest, TestPerfettoProcessors) {
+  auto directory = std::filesystem::temp_directory_path();
+  std::vector<std::string> paths{(directory / "test_perfetto_a.json").string(),
+                                 (directory / "test_perfetto_b.json").string()};
+
+  {
+    std::vector<std::shared_ptr<opentelemetry::trace::TracerProvider>> providers;
+    for (const auto &path : paths) {
+      providers.emplace_back(opentelemetry::sdk::trace::TracerProviderFactory::Create(
+          zil::trace::CreatePerfettoProcessor(path, std::chrono::milliseconds(10))));
+    }
+    // one thread alternating between both, each file only gets its own spans
+    for (int i = 0; i < 100; ++i) {
+      for (size_t p = 0; p < providers.size(); ++p) {
+        auto span = providers[p]->GetTracer("test")->StartSpan("span" + std::to_string(p));
+        span->AddEvent("event");
+        span->End();
+      }
+      if (i == 50) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+      }
+    }
+  }
+
+  for (size_t p = 0; p < paths.size(); ++p) {
+    std::ifstream file(paths[p]);
+    auto events = nlohmann::json::parse(file);
+    ASSERT_TRUE(events.is_array());
+
+    int spans = 0, instants = 0, tracks = 0;
+    for (const auto &event : events) {
+      auto phase = event.at("ph").get<std::string>();
+      if (phase == "X") {
+        EXPECT_EQ(event.at("name"), "span" + std::to_string(p));
+        ++spans;
+      } else if (phase == "i") {
+        ++instants;
+      } else if (phase == "M") {
+        ++tracks;
+      }
+    }
+    EXPECT_EQ(spans, 100);
+    EXPECT_EQ(instants, 100);
+    EXPECT_EQ(tracks, 1);
+    std::filesystem::remove(paths[p]);
+  }
+}
+
+TEST_F(ApiTest, TestSpanLog) {
+  namespace spanlog = zil::trace::spanlog;
+
+  zil::trace::SpanLogOptions options;
+  options.directory = std::filesystem::temp_directory_path() / "test_spanlog";
+  options.segment_size = 64 << 10;
+  options.max_segments = 2;
+  std::filesystem::remove_all(options.directory);
+
+  {
+    auto resource = opentelemetry::sdk::resource::Resource::Create({{"service.name", "test_spanlog"}});
+    auto processor =
+        opentelemetry::sdk::trace::SimpleSpanProcessorFactory::Create(zil::trace::CreateSpanLogExporter(options));
+    auto provider = opentelemetry::sdk::trace::TracerProviderFactory::Create(std::move(processor), resource);
+    auto tracer = provider->GetTracer("test");
+    for (int i = 0; i < 2000; ++i) {
+      auto span = tracer->StartSpan("span" + std::to_string(i), {{"index", i}});
+      span->AddEvent("event", {{"label", "value"}});
+      span->End();
+    }
+  }
+
+  auto segments = spanlog::Segments(options.directory);
+  ASSERT_EQ(segments.size(), 2u);
+
+  int last = -1;
+  for (const auto &path : segments) {
+    spanlog::Reader reader(path);
+    spanlog::Span span;
+    while (reader.Next(span)) {
+      ASSERT_EQ(span.attributes.size(), 1u);
+      int index = static_cast<int>(std::get<int64_t>(span.attributes[0].second));
+      EXPECT_TRUE(last < 0 || index == last + 1);
+      EXPECT_EQ(span.name, "span" + std::to_string(index));
+      ASSERT_EQ(span.events.size(), 1u);
+      EXPECT_EQ(std::get<std::string>(span.events[0].attributes[0].second), "value");
+      last = index;
+    }
+    EXPECT_FALSE(reader.Resource().empty());
+  }
+  EXPECT_EQ(last, 1999);
+
+  // a corrupted attribute count must not be trusted for an allocation
+  {
+    std::fstream file(segments[0], std::ios::in | std::ios::out | std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    // the count is followed by the size of the first key, then the key
+    auto key = data.find("index");
+    ASSERT_NE(key, std::string::npos);
+    const uint32_t count = 0x7fffffff;
+    file.clear();
+    file.seekp(static_cast<std::streamoff>(key - 2 * sizeof(uint32_t)));
+    file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+  }
+  spanlog::Reader reader(segments[0]);
+  spanlog::Span span;
+  EXPECT_THROW(reader.Next(span), std::runtime_error);
+
+  std::filesystem::remove_all(options.directory);
+}
+
+TEST_F(ApiTest, TestSpanLogPartialBlock) {
+  namespace spanlog = zil::trace::spanlog;
+
+  if (!zil::trace::SpanLogCompressionSupported()) {
+    GTEST_SKIP() << "built without zstd";
+  }
+
+  zil::trace::SpanLogOptions options;
+  options.directory = std::filesystem::temp_directory_path() / "test_spanlog_partial";
+  options.segment_size = 64 << 10;
+  options.compress = true;
+  options.flush_interval = std::chrono::milliseconds(50);
+  std::filesystem::remove_all(options.directory);
+
+  auto CountSpans = [&options] {
+    int count = 0;
+    for (const auto &path : spanlog::Segments(options.directory)) {
+      spanlog::Reader reader(path);
+      spanlog::Span span;
+      while (reader.Next(span)) {
+        ++count;
+      }
+    }
+    return count;
+  };
+
+  {
+    auto resource = opentelemetry::sdk::resource::Resource::Create({{"service.name", "test_spanlog"}});
+    auto processor =
+        opentelemetry::sdk::trace::SimpleSpanProcessorFactory::Create(zil::trace::CreateSpanLogExporter(options));
+    auto *flusher = processor.get();
+    auto provider = opentelemetry::sdk::trace::TracerProviderFactory::Create(std::move(processor), resource);
+    auto tracer = provider->GetTracer("test");
+
+    // a block far from full stays in memory
+    for (int i = 0; i < 5; ++i) {
+      tracer->StartSpan("span" + std::to_string(i))->End();
+    }
+    EXPECT_EQ(CountSpans(), 0);
+
+    // until the next export after the flush interval
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    tracer->StartSpan("span5")->End();
+    EXPECT_EQ(CountSpans(), 6);
+
+    // or a flush, the exporter is still running
+    tracer->StartSpan("span6")->End();
+    EXPECT_EQ(CountSpans(), 6);
+    ASSERT_TRUE(flusher->ForceFlush());
+    EXPECT_EQ(CountSpans(), 7);
+  }
+
+  std::filesystem::remove_all(options.directory);
+}
+
+TEST_F(ApiTest, TestFlightRecorder) {
+  namespace flight = zil::trace::flight;
+  using zil::trace::FlightRecorder;
+
+  auto directory = std::filesystem::temp_directory_path() / "test_flight";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  FlightRecorder::Init(directory.string(), 64);
+  ASSERT_TRUE(FlightRecorder::Enabled());
+
+  const uint8_t traceId[16] = {1};
+  const uint8_t parentId[8] = {};
+  std::thread([&] {
+    for (uint8_t i = 0; i < 100; ++i) {
+      const uint8_t spanId[8] = {i};
+      FlightRecorder::Start(0, traceId, spanId, parentId, "span");
+      FlightRecorder::Attribute(flight::RecordType::SPAN_ATTRIBUTE, spanId, "index", flight::ValueType::U64, i);
+      FlightRecorder::End(spanId, "span", 1);
+    }
+  }).join();
+
+  auto path = FlightRecorder::Dump();
+  ASSERT_FALSE(path.empty());
+  std::ifstream in(path, std::ios::binary);
+  flight::DumpHeader header;
+  ASSERT_TRUE(in.read(reinterpret_cast<char *>(&header), sizeof(header)));
+  EXPECT_EQ(std::memcmp(header.magic, flight::MAGIC, sizeof(header.magic)), 0);
+  EXPECT_EQ(header.capacity, 64u);
+  EXPECT_EQ(header.signal, 0);
+  ASSERT_GE(header.rings, 1u);
+
+  // the rings of exited threads are kept, ours is the last one registered
+  std::vector<flight::Record> records(header.capacity);
+  flight::RingHeader ring;
+  for (uint32_t i = 0; i < header.rings; ++i) {
+    ASSERT_TRUE(in.read(reinterpret_cast<char *>(&ring), sizeof(ring)));
+    ASSERT_TRUE(in.read(reinterpret_cast<char *>(records.data()), records.size() * sizeof(flight::Record)));
+  }
+  EXPECT_EQ(ring.head, 300u);
+  EXPECT_EQ(ring.first, ring.head - header.capacity + 1);
+  EXPECT_TRUE(ring.exited);
+  const auto &last = records[(ring.head - 1) % header.capacity];
+  EXPECT_EQ(last.type, flight::RecordType::END);
+  EXPECT_EQ(last.span_id[0], 99);
+  EXPECT_EQ(std::string_view(last.text, last.name_size), "span");
+  std::filesystem::remove_all(directory);
+
+  // the fatal signals of the following tests go to gtest again
+  FlightRecorder::Shutdown();
+  EXPECT_FALSE(FlightRecorder::Enabled());
+  EXPECT_TRUE(FlightRecorder::Dump().empty());
+
+  // on again after Shutdown, with the rings sized by the first Init
+  std::filesystem::create_directories(directory);
+  FlightRecorder::Init(directory.string(), 1024);
+  ASSERT_TRUE(FlightRecorder::Enabled());
+  auto again = FlightRecorder::Dump();
+  ASSERT_FALSE(again.empty());
+  EXPECT_EQ(std::filesystem::path(again).parent_path(), directory);
+  {
+    std::ifstream in(again, std::ios::binary);
+    flight::DumpHeader header{};
+    ASSERT_TRUE(in.read(reinterpret_cast<char *>(&header), sizeof(header)));
+    EXPECT_EQ(header.capacity, 64u);
+  }
+  FlightRecorder::Shutdown();
+  EXPECT_FALSE(FlightRecorder::Enabled());
+  std::filesystem::remove_all(directory);
+}
+
+TEST_F(ApiTest, TestProfiler) {
+  using zil::trace::Profiler;
+
+  auto path = std::filesystem::temp_directory_path() / "test_profiler.folded";
+  // the disposition from before Start comes back with Stop
+  struct sigaction ignore {};
+  ignore.sa_handler = SIG_IGN;
+  struct sigaction original {};
+  ASSERT_EQ(sigaction(SIGPROF, &ignore, &original), 0);
+
+  Profiler::RegisterThread();
+  ASSERT_TRUE(Profiler::Start(999));
+  EXPECT_FALSE(Profiler::Start(999));
+
+  Profiler::PushSpan("busy");
+  volatile uint64_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(200)) {
+    sink = sink + 1;
+  }
+  EXPECT_GT(Profiler::InnermostSpanCpuMs(), 0);
+  Profiler::PopSpan();
+  Profiler::Stop();
+
+  struct sigaction restored {};
+  ASSERT_EQ(sigaction(SIGPROF, &original, &restored), 0);
+  EXPECT_EQ(restored.sa_handler, SIG_IGN);
+
+  ASSERT_TRUE(Profiler::WriteFolded(path.string()));
+  std::ifstream in(path);
+  std::string line;
+  bool found = false;
+  while (std::getline(in, line)) {
+    found = found || line.rfind("busy;", 0) == 0;
+  }
+  EXPECT_TRUE(found);
+  Profiler::Reset();
+  std::filesystem::remove(path);
+}
+
 TEST_F(ApiTest, TestUpDown) {
   Z_I64UPDOWN i64upAndDown(zil::metrics::FilterClass::ACCOUNTSTORE_EVM, "upAndDown", "My very first updown", "flips", true);
 
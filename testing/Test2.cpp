@@ -1,9 +1,22 @@
+#include <unistd.h>
+
+#include <atomic>
 #include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
 #include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
+#include "libMetrics/Api.h"
+#include "libMetrics/Asio.h"
 #include "libMetrics/Tracing2.h"
+#include "libMetrics/internal/spanlog.h"
+#include "opentelemetry/sdk/trace/simple_processor_factory.h"
+#include "opentelemetry/sdk/trace/tracer_provider.h"
+#include "opentelemetry/trace/provider.h"
 
 // These will be ssummed into the cpp files of the API and not exposed once
 // testing completed
@@ -131,6 +144,247 @@ TEST_F(ApiTest, TestRemoteChildSpans) {
   }
 }
 
+TEST_F(ApiTest, TestQueueCarriesContext) {
+  Z_QUEUESTATS stats(zil::metrics::FilterClass::QUEUE, "contextQueue", "queue carrying span contexts");
+  Z_QUEUE<int> queue(stats, 16, true);
+
+  zil::trace2::TraceContext producer;
+  {
+    auto span = Tracing::CreateSpan(NODE_FILTER, "Producer");
+    ASSERT_TRUE(span.IsRecording());
+    producer = span.GetContext();
+    queue.Push(1);
+  }
+  // no active span, nothing to carry
+  queue.Push(2);
+
+  std::thread([&] {
+    int value;
+    zil::trace2::TraceContext context;
+    queue.Pop(value, context);
+    EXPECT_EQ(value, 1);
+    ASSERT_TRUE(context.IsValid());
+    EXPECT_EQ(context.spanId, producer.spanId);
+    EXPECT_EQ(context.traceId, producer.traceId);
+
+    // the consumer has no active span, the trace continues from the producer
+    auto child = Tracing::CreateChildSpan(NODE_FILTER, "Consumer", context);
+    ASSERT_TRUE(child.IsRecording());
+    EXPECT_EQ(child.GetTraceId(), producer.traceId);
+    EXPECT_NE(child.GetSpanId(), producer.spanId);
+    EXPECT_EQ(Tracing::GetActiveContext().spanId, child.GetSpanId());
+    child.End();
+
+    queue.Pop(value, context);
+    EXPECT_EQ(value, 2);
+    EXPECT_FALSE(context.IsValid());
+  }).join();
+}
+
+namespace {
+
+namespace trace_sdk = opentelemetry::sdk::trace;
+
+// Also writes the spans of the Tracing2 provider to a span log in a
+// directory of its own, until Close. The SDK provider cannot drop a
+// processor once added, the tap stays there closed.
+class SpanLogTap final : public trace_sdk::SpanProcessor {
+ public:
+  static SpanLogTap *Attach(const std::filesystem::path &directory) {
+    auto provider = opentelemetry::trace::Provider::GetTracerProvider();
+    auto *sdk = dynamic_cast<trace_sdk::TracerProvider *>(provider.get());
+    if (sdk == nullptr) {
+      return nullptr;
+    }
+    zil::trace::SpanLogOptions options;
+    options.directory = directory;
+    options.segment_size = 1 << 20;
+    auto tap = std::make_unique<SpanLogTap>(
+        trace_sdk::SimpleSpanProcessorFactory::Create(zil::trace::CreateSpanLogExporter(options)));
+    auto *raw = tap.get();
+    sdk->AddProcessor(std::move(tap));
+    return raw;
+  }
+
+  explicit SpanLogTap(std::unique_ptr<trace_sdk::SpanProcessor> processor) : m_processor(std::move(processor)) {}
+
+  /// Writes out the segment, spans ending later are dropped
+  void Close() {
+    m_open.store(false);
+    m_processor->Shutdown();
+  }
+
+  std::unique_ptr<trace_sdk::Recordable> MakeRecordable() noexcept override { return m_processor->MakeRecordable(); }
+
+  void OnStart(trace_sdk::Recordable &span, const opentelemetry::trace::SpanContext &parent) noexcept override {
+    m_processor->OnStart(span, parent);
+  }
+
+  void OnEnd(std::unique_ptr<trace_sdk::Recordable> &&span) noexcept override {
+    if (m_open.load()) {
+      m_processor->OnEnd(std::move(span));
+    }
+  }
+
+  bool ForceFlush(std::chrono::microseconds timeout) noexcept override {
+    return !m_open.load() || m_processor->ForceFlush(timeout);
+  }
+
+  bool Shutdown(std::chrono::microseconds) noexcept override { return true; }
+
+ private:
+  std::unique_ptr<trace_sdk::SpanProcessor> m_processor;
+  std::atomic<bool> m_open{true};
+};
+
+}  // namespace
+
+TEST_F(ApiTest, TestSocketSpansParentToInitiator) {
+  const auto directory = std::filesystem::temp_directory_path() / ("test_socket_spans_" + std::to_string(getpid()));
+  std::filesystem::remove_all(directory);
+  auto *tap = SpanLogTap::Attach(directory);
+  ASSERT_NE(tap, nullptr);
+
+  Z_SOCKETSTATS stats(zil::metrics::FilterClass::API_SERVER, "tracedNet", "traced connections");
+  boost::asio::io_context context;
+  boost::asio::ip::tcp::acceptor acceptor(context, {boost::asio::ip::address_v4::loopback(), 0});
+  Z_SOCKET server(context, stats);
+  Z_SOCKET client(context, stats, NODE_FILTER);
+  std::string request = "ping\n";
+  boost::asio::streambuf echoed;
+  boost::asio::streambuf reply;
+
+  acceptor.async_accept(server.Raw(), [&](const boost::system::error_code &ec) {
+    ASSERT_FALSE(ec);
+    server.AsyncReadUntil(echoed, '\n', [&](const boost::system::error_code &ec, std::size_t) {
+      ASSERT_FALSE(ec);
+      server.AsyncWrite(echoed.data(), [](const boost::system::error_code &ec, std::size_t) { EXPECT_FALSE(ec); });
+    });
+  });
+
+  zil::trace2::TraceContext initiator;
+  {
+    auto span = Tracing::CreateSpan(NODE_FILTER, "Request");
+    ASSERT_TRUE(span.IsRecording());
+    initiator = span.GetContext();
+    client.AsyncConnect(acceptor.local_endpoint(), [&](const boost::system::error_code &ec) {
+      ASSERT_FALSE(ec);
+      // no span is active in the handler, neither the initiator nor the
+      // socket.connect span of the completion
+      EXPECT_FALSE(Tracing::GetActiveContext().IsValid());
+      client.AsyncWrite(boost::asio::buffer(request), [](const boost::system::error_code &ec, std::size_t) {
+        EXPECT_FALSE(ec);
+      });
+      client.AsyncReadUntil(reply, '\n', [](const boost::system::error_code &ec, std::size_t) { EXPECT_FALSE(ec); });
+    });
+  }
+  context.run();
+  tap->Close();
+
+  std::map<std::string, int> children;
+  for (const auto &path : zil::trace::spanlog::Segments(directory)) {
+    zil::trace::spanlog::Reader reader(path);
+    zil::trace::spanlog::Span span;
+    while (reader.Next(span)) {
+      if (span.name.rfind("socket.", 0) != 0 ||
+          std::memcmp(span.trace_id, initiator.traceId.Id().data(), sizeof(span.trace_id)) != 0) {
+        continue;
+      }
+      EXPECT_EQ(std::memcmp(span.parent_span_id, initiator.spanId.Id().data(), sizeof(span.parent_span_id)), 0)
+          << span.name << " is not a child of the initiating span";
+      ++children[span.name];
+    }
+  }
+  EXPECT_EQ(children["socket.connect"], 1);
+  EXPECT_EQ(children["socket.write"], 1);
+  EXPECT_EQ(children["socket.read"], 1);
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST_F(ApiTest, TestSlowLockHolderEvent) {
+  // holds are only timed for an enabled metrics filter class
+  auto &filter = zil::metrics::Filter::GetInstance();
+  const auto mask = filter.Mask();
+  filter.Reload("ACCOUNTSTORE_EVM");
+  Z_LOCKSTATS locks(zil::metrics::FilterClass::ACCOUNTSTORE_EVM, "slowLock", "slow locks");
+  Z_MUTEX mutex(locks, "slow", std::chrono::milliseconds(5));
+
+  const auto directory = std::filesystem::temp_directory_path() / ("test_slow_lock_" + std::to_string(getpid()));
+  std::filesystem::remove_all(directory);
+  auto *tap = SpanLogTap::Attach(directory);
+  ASSERT_NE(tap, nullptr);
+
+  zil::trace2::TraceContext holder;
+  {
+    auto span = Tracing::CreateSpan(NODE_FILTER, "Holder");
+    ASSERT_TRUE(span.IsRecording());
+    holder = span.GetContext();
+    {
+      std::lock_guard<Z_MUTEX> lock(mutex);
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    // short enough for no event
+    std::lock_guard<Z_MUTEX> lock(mutex);
+  }
+  tap->Close();
+  filter.Store(mask);
+
+  int found = 0;
+  for (const auto &path : zil::trace::spanlog::Segments(directory)) {
+    zil::trace::spanlog::Reader reader(path);
+    zil::trace::spanlog::Span span;
+    while (reader.Next(span)) {
+      if (std::memcmp(span.span_id, holder.spanId.Id().data(), sizeof(span.span_id)) != 0) {
+        continue;
+      }
+      ++found;
+      ASSERT_EQ(span.events.size(), 1u);
+      const auto &event = span.events[0];
+      EXPECT_EQ(event.name, "slow lock holder");
+      std::map<std::string, zil::trace::spanlog::Value> attributes(event.attributes.begin(), event.attributes.end());
+      EXPECT_EQ(std::get<std::string>(attributes["lock"]), "slow");
+      EXPECT_GE(std::get<int64_t>(attributes["hold_us"]), 10000);
+    }
+  }
+  EXPECT_EQ(found, 1);
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST_F(ApiTest, TestLogCarriesSpanIds) {
+  auto path = std::filesystem::temp_directory_path() / "test_trace2_logging.log";
+  std::filesystem::remove(path);
+  zil::logging::Logging::Init("FILE", path.string());
+
+  std::string ids;
+  {
+    auto span = Tracing::CreateSpan(NODE_FILTER, "Logging");
+    ASSERT_TRUE(span.IsRecording());
+    char traceId[32];
+    span.GetTraceId().ToLowerBase16(traceId);
+    char spanId[16];
+    span.GetSpanId().ToLowerBase16(spanId);
+    ids = "[" + std::string(traceId, sizeof(traceId)) + "-" + std::string(spanId, sizeof(spanId)) + "]";
+    LOG_GENERAL(INFO, "inside " << 1);
+  }
+  LOG_GENERAL(INFO, "outside " << 2);
+  zil::logging::Logging::Init("STDOUT");
+
+  std::vector<std::string> lines;
+  std::ifstream file(path);
+  for (std::string line; std::getline(file, line);) {
+    if (line.find("[Test2.cpp:") != std::string::npos) {
+      lines.push_back(line);
+    }
+  }
+  ASSERT_EQ(lines.size(), 2u);
+  EXPECT_NE(lines[0].find("][TestBody]" + ids + " inside 1"), std::string::npos) << lines[0];
+  EXPECT_NE(lines[1].find("][TestBody] outside 2"), std::string::npos) << lines[1];
+
+  std::filesystem::remove(path);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,565 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Rebuilds the traces of captured spans and reports per span name where
+// the time goes: self time, time covered by children, wait gaps between
+// children and the share of the critical path. Spans of one trace can come
+// from several processes, a child of a remote trace is joined to its
+// parent by span id like any other.
+//
+//   ./critpath --folded self.folded client.jsonl server-3333.jsonl spanlog/
+//
+// Inputs are span log segments or directories (FILE_SPANLOG) and OTLP JSON
+// files with one ExportTraceServiceRequest per line, as the file exporter of
+// the collector writes them. Inputs are read interleaved and a trace is
+// analysed once --idle spans have been read without one of it, or when
+// more than --max-spans are held, so memory does not grow with the input.
+// The folded files are input for flamegraph.pl or speedscope, in us.
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "libMetrics/internal/spanlog.h"
+
+namespace spanlog = zil::trace::spanlog;
+
+namespace {
+
+using TraceId = std::array<uint8_t, 16>;
+using SpanId = std::array<uint8_t, 8>;
+
+struct Options {
+  uint64_t max_spans = 1000000;
+  uint64_t idle = 100000;
+  size_t top = 30;
+  std::string folded;
+  std::string critical_folded;
+  std::vector<std::string> inputs;
+};
+
+struct SpanRecord {
+  TraceId trace_id;
+  SpanId span_id;
+  SpanId parent_id;
+  std::string name;
+  int64_t start_ns;
+  int64_t end_ns;
+};
+
+struct TraceIdHash {
+  size_t operator()(const TraceId& id) const noexcept {
+    size_t hash;
+    std::memcpy(&hash, id.data() + id.size() - sizeof(hash), sizeof(hash));
+    return hash;
+  }
+};
+
+struct SpanIdHash {
+  size_t operator()(const SpanId& id) const noexcept {
+    size_t hash;
+    std::memcpy(&hash, id.data(), sizeof(hash));
+    return hash;
+  }
+};
+
+class Source {
+ public:
+  virtual ~Source() = default;
+
+  /// False once the input is exhausted
+  virtual bool Next(SpanRecord& span) = 0;
+};
+
+class SpanLogSource : public Source {
+ public:
+  explicit SpanLogSource(std::vector<std::filesystem::path> segments)
+      : m_segments(std::move(segments)) {}
+
+  bool Next(SpanRecord& out) override {
+    spanlog::Span span;
+    while (!m_reader || !m_reader->Next(span)) {
+      if (m_next == m_segments.size()) {
+        return false;
+      }
+      m_reader = std::make_unique<spanlog::Reader>(m_segments[m_next++]);
+    }
+    std::copy(std::begin(span.trace_id), std::end(span.trace_id),
+              out.trace_id.begin());
+    std::copy(std::begin(span.span_id), std::end(span.span_id),
+              out.span_id.begin());
+    std::copy(std::begin(span.parent_span_id), std::end(span.parent_span_id),
+              out.parent_id.begin());
+    out.name = std::move(span.name);
+    out.start_ns = span.start_ns;
+    out.end_ns = span.start_ns + span.duration_ns;
+    return true;
+  }
+
+ private:
+  std::vector<std::filesystem::path> m_segments;
+  size_t m_next = 0;
+  std::unique_ptr<spanlog::Reader> m_reader;
+};
+
+// OTLP JSON, one request per line. Spans of a line are held until read.
+class OtlpJsonSource : public Source {
+ public:
+  explicit OtlpJsonSource(const std::string& path) : m_in(path), m_path(path) {
+    if (!m_in) {
+      throw std::runtime_error("cannot open " + path);
+    }
+  }
+
+  bool Next(SpanRecord& out) override {
+    while (m_pending == m_spans.size()) {
+      m_spans.clear();
+      m_pending = 0;
+      std::string line;
+      if (!std::getline(m_in, line)) {
+        return false;
+      }
+      ++m_line;
+      if (line.find_first_not_of(" \t\r") == std::string::npos) {
+        continue;
+      }
+      try {
+        Parse(nlohmann::json::parse(line));
+      } catch (const std::exception& e) {
+        std::cerr << m_path << ":" << m_line << ": skipped, " << e.what()
+                  << std::endl;
+      }
+    }
+    out = std::move(m_spans[m_pending++]);
+    return true;
+  }
+
+ private:
+  template <size_t N>
+  static std::array<uint8_t, N> ParseId(const nlohmann::json& value) {
+    std::array<uint8_t, N> id{};
+    if (!value.is_string()) {
+      return id;
+    }
+    const auto& hex = value.get_ref<const std::string&>();
+    if (hex.size() != 2 * N) {
+      return id;
+    }
+    for (size_t i = 0; i < N; ++i) {
+      id[i] = static_cast<uint8_t>(std::stoul(hex.substr(2 * i, 2), nullptr, 16));
+    }
+    return id;
+  }
+
+  // uint64 fields are strings in the JSON mapping of protobuf
+  static int64_t ParseTime(const nlohmann::json& value) {
+    if (value.is_string()) {
+      return std::stoll(value.get_ref<const std::string&>());
+    }
+    return value.is_number() ? value.get<int64_t>() : 0;
+  }
+
+  static const nlohmann::json& Field(const nlohmann::json& object,
+                                     const char* key) {
+    static const nlohmann::json missing;
+    auto it = object.find(key);
+    return it == object.end() ? missing : *it;
+  }
+
+  void Parse(const nlohmann::json& request) {
+    for (const auto& resourceSpans : Field(request, "resourceSpans")) {
+      for (const auto& scopeSpans : Field(resourceSpans, "scopeSpans")) {
+        for (const auto& span : Field(scopeSpans, "spans")) {
+          SpanRecord record;
+          record.trace_id = ParseId<16>(Field(span, "traceId"));
+          record.span_id = ParseId<8>(Field(span, "spanId"));
+          record.parent_id = ParseId<8>(Field(span, "parentSpanId"));
+          const auto& name = Field(span, "name");
+          record.name = name.is_string() ? name.get<std::string>() : "";
+          record.start_ns = ParseTime(Field(span, "startTimeUnixNano"));
+          record.end_ns = ParseTime(Field(span, "endTimeUnixNano"));
+          m_spans.push_back(std::move(record));
+        }
+      }
+    }
+  }
+
+  std::ifstream m_in;
+  std::string m_path;
+  uint64_t m_line = 0;
+  std::vector<SpanRecord> m_spans;
+  size_t m_pending = 0;
+};
+
+std::unique_ptr<Source> OpenSource(const std::string& input) {
+  const std::filesystem::path path = input;
+  if (std::filesystem::is_directory(path)) {
+    return std::make_unique<SpanLogSource>(spanlog::Segments(path));
+  }
+  if (path.extension() == ".zsl") {
+    return std::make_unique<SpanLogSource>(std::vector{path});
+  }
+  return std::make_unique<OtlpJsonSource>(input);
+}
+
+struct Stats {
+  uint64_t count = 0;
+  int64_t total_ns = 0;
+  int64_t self_ns = 0;
+  int64_t child_ns = 0;
+  int64_t wait_ns = 0;
+  int64_t critical_ns = 0;
+};
+
+class Analyzer {
+ public:
+  /// Takes the spans of one complete trace
+  void Analyze(std::vector<SpanRecord>& spans) {
+    ++m_traces;
+    m_spans += spans.size();
+
+    std::unordered_map<SpanId, size_t, SpanIdHash> index;
+    index.reserve(spans.size());
+    for (size_t i = 0; i < spans.size(); ++i) {
+      spans[i].end_ns = std::max(spans[i].end_ns, spans[i].start_ns);
+      index.emplace(spans[i].span_id, i);
+    }
+
+    m_children.assign(spans.size(), {});
+    std::vector<size_t> roots;
+    for (size_t i = 0; i < spans.size(); ++i) {
+      auto parent = index.find(spans[i].parent_id);
+      if (parent == index.end() || parent->second == i) {
+        // no parent, or a remote one which was not captured
+        if (spans[i].parent_id != SpanId{}) {
+          ++m_orphans;
+        }
+        roots.push_back(i);
+      } else {
+        m_children[parent->second].push_back(i);
+      }
+    }
+    // latest end first, as the critical path is walked backwards
+    for (auto& children : m_children) {
+      std::sort(children.begin(), children.end(), [&spans](size_t a, size_t b) {
+        return spans[a].end_ns > spans[b].end_ns;
+      });
+    }
+
+    for (size_t root : roots) {
+      std::string stack;
+      Times(spans, root, stack);
+      Critical(spans, root, spans[root].start_ns, spans[root].end_ns,
+               spans[root].name);
+    }
+  }
+
+  void Report(std::ostream& out, size_t top) const {
+    std::vector<std::pair<std::string, Stats>> rows(m_stats.begin(),
+                                                    m_stats.end());
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+      return a.second.critical_ns > b.second.critical_ns;
+    });
+    int64_t critical = 0;
+    for (const auto& [name, stats] : rows) {
+      critical += stats.critical_ns;
+    }
+
+    out << m_traces << " traces, " << m_spans << " spans, " << m_orphans
+        << " spans with a parent not captured\n\n";
+    out << std::left << std::setw(40) << "name" << std::right
+        << std::setw(10) << "count" << std::setw(14) << "total ms"
+        << std::setw(14) << "self ms" << std::setw(14) << "child ms"
+        << std::setw(14) << "wait ms" << std::setw(14) << "critical ms"
+        << std::setw(9) << "crit %" << '\n';
+    out << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < rows.size() && i < top; ++i) {
+      const auto& [name, stats] = rows[i];
+      out << std::left << std::setw(40) << name.substr(0, 39) << std::right
+          << std::setw(10) << stats.count << std::setw(14)
+          << stats.total_ns / 1e6 << std::setw(14) << stats.self_ns / 1e6
+          << std::setw(14) << stats.child_ns / 1e6 << std::setw(14)
+          << stats.wait_ns / 1e6 << std::setw(14) << stats.critical_ns / 1e6
+          << std::setw(8) << std::setprecision(1)
+          << (critical > 0 ? 100.0 * stats.critical_ns / critical : 0.0)
+          << "%" << std::setprecision(3) << '\n';
+    }
+  }
+
+  static void WriteFolded(const std::string& path,
+                          const std::map<std::string, int64_t>& stacks) {
+    std::ofstream out(path);
+    if (!out) {
+      throw std::runtime_error("cannot write " + path);
+    }
+    for (const auto& [stack, ns] : stacks) {
+      if (ns >= 1000) {
+        out << stack << ' ' << ns / 1000 << '\n';
+      }
+    }
+  }
+
+  const std::map<std::string, int64_t>& SelfStacks() const { return m_self; }
+
+  const std::map<std::string, int64_t>& CriticalStacks() const {
+    return m_critical;
+  }
+
+ private:
+  // Self, child and wait time of a span and its subtree. Children are
+  // clipped to their parent, clocks of different hosts are not in sync.
+  void Times(const std::vector<SpanRecord>& spans, size_t at,
+             std::string& stack) {
+    const auto& span = spans[at];
+    const size_t depth = stack.size();
+    if (!stack.empty()) {
+      stack += ';';
+    }
+    stack += span.name;
+
+    // union of the children intervals, by start
+    std::vector<std::pair<int64_t, int64_t>> covered;
+    for (size_t child : m_children[at]) {
+      const int64_t start = std::max(spans[child].start_ns, span.start_ns);
+      const int64_t end = std::min(spans[child].end_ns, span.end_ns);
+      if (start < end) {
+        covered.emplace_back(start, end);
+      }
+    }
+    std::sort(covered.begin(), covered.end());
+    int64_t childTime = 0, waitTime = 0, coveredEnd = 0;
+    bool first = true;
+    for (const auto& [start, end] : covered) {
+      if (first) {
+        childTime += end - start;
+        coveredEnd = end;
+        first = false;
+      } else if (start > coveredEnd) {
+        waitTime += start - coveredEnd;
+        childTime += end - start;
+        coveredEnd = end;
+      } else if (end > coveredEnd) {
+        childTime += end - coveredEnd;
+        coveredEnd = end;
+      }
+    }
+
+    const int64_t total = span.end_ns - span.start_ns;
+    auto& stats = m_stats[span.name];
+    ++stats.count;
+    stats.total_ns += total;
+    stats.child_ns += childTime;
+    stats.self_ns += total - childTime;
+    stats.wait_ns += waitTime;
+    m_self[stack] += total - childTime;
+
+    for (size_t child : m_children[at]) {
+      Times(spans, child, stack);
+    }
+    stack.resize(depth);
+  }
+
+  // Walks back from the end of the span: the child ending last is on the
+  // critical path, then the child ending last before that one starts, and
+  // so on. The time in between is the span's own part of the path.
+  void Critical(const std::vector<SpanRecord>& spans, size_t at, int64_t from,
+                int64_t to, const std::string& stack) {
+    int64_t own = 0;
+    int64_t t = to;
+    for (size_t child : m_children[at]) {
+      if (t <= from) {
+        break;
+      }
+      const auto& span = spans[child];
+      if (span.start_ns >= t) {
+        continue;
+      }
+      const int64_t end = std::min(span.end_ns, t);
+      const int64_t start = std::max(span.start_ns, from);
+      if (end <= start) {
+        continue;
+      }
+      own += t - end;
+      Critical(spans, child, start, end, stack + ';' + span.name);
+      t = start;
+    }
+    if (t > from) {
+      own += t - from;
+    }
+    m_stats[spans[at].name].critical_ns += own;
+    m_critical[stack] += own;
+  }
+
+  std::unordered_map<std::string, Stats> m_stats;
+  std::map<std::string, int64_t> m_self;
+  std::map<std::string, int64_t> m_critical;
+  std::vector<std::vector<size_t>> m_children;
+  uint64_t m_traces = 0;
+  uint64_t m_spans = 0;
+  uint64_t m_orphans = 0;
+};
+
+// Spans by trace, the least recently extended trace first out
+class TraceBuffer {
+ public:
+  TraceBuffer(const Options& options, Analyzer& analyzer)
+      : m_options(options), m_analyzer(analyzer) {}
+
+  void Add(SpanRecord&& span) {
+    ++m_sequence;
+    auto it = m_traces.find(span.trace_id);
+    if (it == m_traces.end()) {
+      m_lru.push_back(span.trace_id);
+      it = m_traces.emplace(span.trace_id, Trace{{}, 0, std::prev(m_lru.end())})
+               .first;
+    } else {
+      m_lru.splice(m_lru.end(), m_lru, it->second.lru);
+    }
+    it->second.last_seen = m_sequence;
+    it->second.spans.push_back(std::move(span));
+    ++m_held;
+
+    while (!m_lru.empty()) {
+      auto& oldest = m_traces.at(m_lru.front());
+      if (m_held <= m_options.max_spans &&
+          m_sequence - oldest.last_seen <= m_options.idle) {
+        break;
+      }
+      Finish(m_lru.front());
+    }
+  }
+
+  void FinishAll() {
+    while (!m_lru.empty()) {
+      Finish(m_lru.front());
+    }
+  }
+
+ private:
+  struct Trace {
+    std::vector<SpanRecord> spans;
+    uint64_t last_seen;
+    std::list<TraceId>::iterator lru;
+  };
+
+  void Finish(const TraceId& id) {
+    auto it = m_traces.find(id);
+    m_held -= it->second.spans.size();
+    m_analyzer.Analyze(it->second.spans);
+    m_lru.erase(it->second.lru);
+    m_traces.erase(it);
+  }
+
+  const Options& m_options;
+  Analyzer& m_analyzer;
+  std::unordered_map<TraceId, Trace, TraceIdHash> m_traces;
+  std::list<TraceId> m_lru;
+  uint64_t m_sequence = 0;
+  uint64_t m_held = 0;
+};
+
+void Usage(const char* prog) {
+  std::cout << "Usage: " << prog
+            << " [--folded FILE] [--critical-folded FILE] [--top N]"
+               " [--max-spans N] [--idle N] <input>..."
+            << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        Usage(argv[0]);
+        exit(1);
+      }
+      return argv[++i];
+    };
+
+    if (arg == "--folded") {
+      opts.folded = next();
+    } else if (arg == "--critical-folded") {
+      opts.critical_folded = next();
+    } else if (arg == "--top") {
+      opts.top = std::stoull(next());
+    } else if (arg == "--max-spans") {
+      opts.max_spans = std::stoull(next());
+    } else if (arg == "--idle") {
+      opts.idle = std::stoull(next());
+    } else if (arg.rfind("--", 0) == 0) {
+      Usage(argv[0]);
+      return 1;
+    } else {
+      opts.inputs.push_back(arg);
+    }
+  }
+  if (opts.inputs.empty()) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  try {
+    std::vector<std::unique_ptr<Source>> sources;
+    for (const auto& input : opts.inputs) {
+      sources.push_back(OpenSource(input));
+    }
+
+    Analyzer analyzer;
+    TraceBuffer buffer(opts, analyzer);
+    // one span of every input in turn, so spans of a trace recorded by
+    // several processes arrive close together
+    SpanRecord span;
+    while (!sources.empty()) {
+      for (auto it = sources.begin(); it != sources.end();) {
+        if ((*it)->Next(span)) {
+          buffer.Add(std::move(span));
+          ++it;
+        } else {
+          it = sources.erase(it);
+        }
+      }
+    }
+    buffer.FinishAll();
+
+    analyzer.Report(std::cout, opts.top);
+    if (!opts.folded.empty()) {
+      Analyzer::WriteFolded(opts.folded, analyzer.SelfStacks());
+    }
+    if (!opts.critical_folded.empty()) {
+      Analyzer::WriteFolded(opts.critical_folded, analyzer.CriticalStacks());
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
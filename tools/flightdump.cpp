@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Prints a dump of the FLIGHT_RECORDER trace provider as one timeline of
+// all threads, oldest record first. END lines carry the duration of the
+// span when its START is still in the dump.
+//
+//   ./flightdump --last 200 flight-12345-0.zfr
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "libMetrics/TraceFilters.h"
+#include "libMetrics/internal/flightrecorder.h"
+
+namespace flight = zil::trace::flight;
+
+namespace {
+
+struct Options {
+  uint32_t thread = 0;  // tid, 0 for all
+  size_t last = 0;      // 0 for all
+  std::string path;
+};
+
+struct Entry {
+  flight::Record record;
+  uint32_t tid;
+  std::string_view thread_name;
+};
+
+struct Dump {
+  flight::DumpHeader header;
+  std::vector<std::string> thread_names;
+  std::vector<Entry> entries;
+};
+
+template <typename T>
+void ReadExactly(std::ifstream& in, T* out, size_t count = 1) {
+  if (!in.read(reinterpret_cast<char*>(out), sizeof(T) * count)) {
+    throw std::runtime_error("truncated dump");
+  }
+}
+
+Dump Load(const Options& opts) {
+  std::ifstream in(opts.path, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("cannot open " + opts.path);
+  }
+
+  Dump dump;
+  ReadExactly(in, &dump.header);
+  if (std::memcmp(dump.header.magic, flight::MAGIC, sizeof(flight::MAGIC)) !=
+          0 ||
+      dump.header.version != flight::VERSION ||
+      dump.header.record_size != sizeof(flight::Record)) {
+    throw std::runtime_error(opts.path + " is not a flight recorder dump");
+  }
+
+  const uint64_t capacity = dump.header.capacity;
+  std::vector<flight::Record> records(capacity);
+  dump.thread_names.reserve(dump.header.rings);
+  for (uint32_t i = 0; i < dump.header.rings; ++i) {
+    flight::RingHeader ring;
+    ReadExactly(in, &ring);
+    ReadExactly(in, records.data(), records.size());
+    const auto& name = dump.thread_names.emplace_back(
+        ring.thread_name, strnlen(ring.thread_name, sizeof(ring.thread_name)));
+    if (opts.thread != 0 && ring.tid != opts.thread) {
+      continue;
+    }
+    // slots overwritten while the dump was taken are outside [first, head)
+    for (uint64_t seq = ring.first; seq < ring.head; ++seq) {
+      dump.entries.push_back({records[seq % capacity], ring.tid, name});
+    }
+  }
+
+  std::stable_sort(dump.entries.begin(), dump.entries.end(),
+                   [](const Entry& a, const Entry& b) {
+                     return a.record.timestamp_ns < b.record.timestamp_ns;
+                   });
+  if (opts.last != 0 && dump.entries.size() > opts.last) {
+    dump.entries.erase(dump.entries.begin(),
+                       dump.entries.end() - static_cast<ptrdiff_t>(opts.last));
+  }
+  return dump;
+}
+
+std::string Hex(const uint8_t* data, size_t size) {
+  static const char digits[] = "0123456789abcdef";
+  std::string out;
+  out.reserve(2 * size);
+  for (size_t i = 0; i < size; ++i) {
+    out += digits[data[i] >> 4];
+    out += digits[data[i] & 0xf];
+  }
+  return out;
+}
+
+// UTC wall clock with ns
+std::string Time(uint64_t ns) {
+  const time_t seconds = static_cast<time_t>(ns / 1000000000);
+  tm utc;
+  gmtime_r(&seconds, &utc);
+  char buffer[40];
+  const size_t size = strftime(buffer, sizeof(buffer), "%F %T", &utc);
+  snprintf(buffer + size, sizeof(buffer) - size, ".%09llu",
+           static_cast<unsigned long long>(ns % 1000000000));
+  return buffer;
+}
+
+std::string_view FilterName(uint8_t filter) {
+  const auto& names = zil::trace::TRACE_FILTER_CLASS_NAMES;
+  return filter < names.size() ? names[filter].name : "?";
+}
+
+std::string_view StatusName(uint8_t status) {
+  switch (status) {
+    case 0:
+      return "UNSET";
+    case 1:
+      return "OK";
+    case 2:
+      return "ERROR";
+    default:
+      return "?";
+  }
+}
+
+void PrintValue(std::ostream& out, const flight::Record& record) {
+  const std::string_view text(record.text + record.name_size,
+                              record.text_size);
+  switch (record.value_type) {
+    case flight::ValueType::BOOL:
+      out << (record.u64 != 0 ? "true" : "false");
+      break;
+    case flight::ValueType::I64:
+      out << record.i64;
+      break;
+    case flight::ValueType::U64:
+      out << record.u64;
+      break;
+    case flight::ValueType::F64:
+      out << record.f64;
+      break;
+    case flight::ValueType::STR:
+      out << '"' << text << '"';
+      break;
+    case flight::ValueType::ARRAY:
+      out << "[" << record.u64 << " elements]";
+      break;
+    case flight::ValueType::NONE:
+      break;
+  }
+}
+
+void Print(std::ostream& out, const Dump& dump) {
+  out << "pid " << dump.header.pid << ", dumped " << Time(dump.header.dump_ns);
+  if (dump.header.signal != 0) {
+    out << " on signal " << dump.header.signal;
+  }
+  out << ", " << dump.header.rings << " threads, " << dump.entries.size()
+      << " records" << std::endl;
+
+  std::unordered_map<std::string, uint64_t> starts;
+  for (const auto& entry : dump.entries) {
+    const auto& record = entry.record;
+    const std::string spanId = Hex(record.span_id, sizeof(record.span_id));
+    const std::string_view name(record.text, record.name_size);
+
+    out << Time(record.timestamp_ns) << ' ' << std::setw(7) << entry.tid << ' '
+        << std::left << std::setw(15) << entry.thread_name << std::right << ' '
+        << spanId << ' ';
+    switch (record.type) {
+      case flight::RecordType::START:
+        starts[spanId] = record.timestamp_ns;
+        out << "START " << name << " [" << FilterName(record.filter)
+            << "] trace " << Hex(record.start.trace_id, 16) << " parent "
+            << Hex(record.start.parent_id, 8);
+        break;
+      case flight::RecordType::END: {
+        out << "END   " << name << " " << StatusName(record.status);
+        auto it = starts.find(spanId);
+        if (it != starts.end()) {
+          out << " " << (record.timestamp_ns - it->second) / 1000.0 << " us";
+          starts.erase(it);
+        }
+        break;
+      }
+      case flight::RecordType::EVENT:
+        out << "EVENT " << name;
+        break;
+      case flight::RecordType::SPAN_ATTRIBUTE:
+      case flight::RecordType::EVENT_ATTRIBUTE:
+        out << (record.type == flight::RecordType::SPAN_ATTRIBUTE
+                    ? "  attr "
+                    : "  event attr ")
+            << name << " = ";
+        PrintValue(out, record);
+        break;
+      default:
+        out << "? type " << static_cast<int>(record.type);
+        break;
+    }
+    out << '\n';
+  }
+  out.flush();
+}
+
+void Usage(const char* prog) {
+  std::cout << "Usage: " << prog << " [--thread TID] [--last N] <dump>"
+            << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        Usage(argv[0]);
+        exit(1);
+      }
+      return argv[++i];
+    };
+
+    if (arg == "--thread") {
+      opts.thread = static_cast<uint32_t>(std::stoul(next()));
+    } else if (arg == "--last") {
+      opts.last = std::stoull(next());
+    } else if (arg.rfind("--", 0) == 0 || !opts.path.empty()) {
+      Usage(argv[0]);
+      return 1;
+    } else {
+      opts.path = arg;
+    }
+  }
+  if (opts.path.empty()) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  try {
+    Print(std::cout, Load(opts));
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
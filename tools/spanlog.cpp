@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2023 Zilliqa
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Reads the segments written by the FILE_SPANLOG trace provider and either
+// prints them as JSON, one object per line, or replays them to a collector.
+//
+//   ./spanlog json spanlog/
+//   ./spanlog replay http://collector:4318/v1/traces spanlog/
+//   ./spanlog replay grpc://collector:4317 spans-00000000000000000007.zsl
+//
+// Arguments are segment files or span log directories.
+
+#include <algorithm>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <opentelemetry/common/key_value_iterable_view.h>
+#include <opentelemetry/exporters/otlp/otlp_grpc_exporter_factory.h>
+#include <opentelemetry/exporters/otlp/otlp_grpc_exporter_options.h>
+#include <opentelemetry/exporters/otlp/otlp_http_exporter_factory.h>
+#include <opentelemetry/exporters/otlp/otlp_http_exporter_options.h>
+#include <opentelemetry/sdk/instrumentationscope/instrumentation_scope.h>
+#include <opentelemetry/sdk/resource/resource.h>
+#include <opentelemetry/sdk/trace/exporter.h>
+
+#include "libMetrics/internal/spanlog.h"
+
+namespace spanlog = zil::trace::spanlog;
+namespace common = opentelemetry::common;
+namespace nostd = opentelemetry::nostd;
+namespace otlp = opentelemetry::exporter::otlp;
+namespace resource = opentelemetry::sdk::resource;
+namespace scope = opentelemetry::sdk::instrumentationscope;
+namespace trace_api = opentelemetry::trace;
+namespace trace_sdk = opentelemetry::sdk::trace;
+
+namespace {
+
+constexpr size_t REPLAY_BATCH = 512;
+
+void Usage(const char* prog) {
+  std::cout << "Usage: " << prog << " json <segment|directory>...\n"
+            << "       " << prog
+            << " replay <http://host:port/v1/traces|grpc://host:port>"
+               " <segment|directory>..."
+            << std::endl;
+}
+
+std::vector<std::filesystem::path> Expand(char** args, int count) {
+  std::vector<std::filesystem::path> segments;
+  for (int i = 0; i < count; ++i) {
+    const std::filesystem::path path = args[i];
+    if (std::filesystem::is_directory(path)) {
+      auto found = spanlog::Segments(path);
+      segments.insert(segments.end(), found.begin(), found.end());
+    } else {
+      segments.push_back(path);
+    }
+  }
+  return segments;
+}
+
+std::string Hex(const uint8_t* data, size_t size) {
+  static constexpr char DIGITS[] = "0123456789abcdef";
+  std::string out;
+  out.reserve(size * 2);
+  for (size_t i = 0; i < size; ++i) {
+    out += DIGITS[data[i] >> 4];
+    out += DIGITS[data[i] & 0xf];
+  }
+  return out;
+}
+
+nlohmann::json ToJson(const spanlog::Attributes& attributes) {
+  nlohmann::json out = nlohmann::json::object();
+  for (const auto& [key, value] : attributes) {
+    out[key] = std::visit([](const auto& v) { return nlohmann::json(v); },
+                          value);
+  }
+  return out;
+}
+
+nlohmann::json ToJson(const spanlog::Span& span) {
+  nlohmann::json out;
+  out["trace_id"] = Hex(span.trace_id, sizeof(span.trace_id));
+  out["span_id"] = Hex(span.span_id, sizeof(span.span_id));
+  out["parent_span_id"] = Hex(span.parent_span_id, sizeof(span.parent_span_id));
+  out["trace_flags"] = span.trace_flags;
+  out["name"] = span.name;
+  out["kind"] = span.kind;
+  out["status"] = span.status;
+  if (!span.status_description.empty()) {
+    out["status_description"] = span.status_description;
+  }
+  out["start_unix_nano"] = span.start_ns;
+  out["duration_ns"] = span.duration_ns;
+  out["scope"] = {{"name", span.scope_name}, {"version", span.scope_version}};
+  out["attributes"] = ToJson(span.attributes);
+
+  out["events"] = nlohmann::json::array();
+  for (const auto& event : span.events) {
+    out["events"].push_back({{"name", event.name},
+                             {"time_unix_nano", event.timestamp_ns},
+                             {"attributes", ToJson(event.attributes)}});
+  }
+  out["links"] = nlohmann::json::array();
+  for (const auto& link : span.links) {
+    out["links"].push_back(
+        {{"trace_id", Hex(link.trace_id, sizeof(link.trace_id))},
+         {"span_id", Hex(link.span_id, sizeof(link.span_id))},
+         {"attributes", ToJson(link.attributes)}});
+  }
+  return out;
+}
+
+int PrintJson(const std::vector<std::filesystem::path>& segments) {
+  for (const auto& path : segments) {
+    spanlog::Reader reader(path);
+    spanlog::Span span;
+    bool headerPrinted = false;
+    auto printHeader = [&] {
+      nlohmann::json header{{"segment", path.string()},
+                            {"sequence", reader.Header().sequence},
+                            {"created_unix_nano", reader.Header().created_ns},
+                            {"resource", ToJson(reader.Resource())}};
+      std::cout << header.dump() << '\n';
+      headerPrinted = true;
+    };
+
+    while (reader.Next(span)) {
+      if (!headerPrinted) {
+        printHeader();
+      }
+      std::cout << ToJson(span).dump() << '\n';
+    }
+    if (!headerPrinted) {
+      printHeader();
+    }
+  }
+  std::cout.flush();
+  return 0;
+}
+
+// The decoded values own their data, the SDK takes views. Keeps what the
+// views point to for as long as the views are used.
+class AttributeViews {
+ public:
+  using View = std::vector<std::pair<std::string_view, common::AttributeValue>>;
+
+  explicit AttributeViews(const spanlog::Attributes& attributes) {
+    m_views.reserve(attributes.size());
+    for (const auto& [key, value] : attributes) {
+      m_views.emplace_back(key, std::visit(
+                                    [this](const auto& v) { return ToView(v); },
+                                    value));
+    }
+  }
+
+  const View& Get() const noexcept { return m_views; }
+
+  common::KeyValueIterableView<View> Iterable() const {
+    return common::KeyValueIterableView<View>(m_views);
+  }
+
+ private:
+  template <typename T>
+  common::AttributeValue ToView(const T& value) {
+    return common::AttributeValue(value);
+  }
+
+  common::AttributeValue ToView(const std::string& value) {
+    return nostd::string_view(value);
+  }
+
+  common::AttributeValue ToView(const std::vector<bool>& values) {
+    // not contiguous
+    auto& copy = m_bools.emplace_back(new bool[values.size()]);
+    std::copy(values.begin(), values.end(), copy.get());
+    return nostd::span<const bool>(copy.get(), values.size());
+  }
+
+  template <typename T>
+  common::AttributeValue ToView(const std::vector<T>& values) {
+    return nostd::span<const T>(values.data(), values.size());
+  }
+
+  common::AttributeValue ToView(const std::vector<std::string>& values) {
+    auto& views = m_strings.emplace_back(values.begin(), values.end());
+    return nostd::span<const nostd::string_view>(views.data(), views.size());
+  }
+
+  View m_views;
+  std::deque<std::unique_ptr<bool[]>> m_bools;
+  std::deque<std::vector<nostd::string_view>> m_strings;
+};
+
+common::SystemTimestamp ToTimestamp(int64_t ns) {
+  return common::SystemTimestamp(std::chrono::system_clock::time_point(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          std::chrono::nanoseconds(ns))));
+}
+
+trace_api::SpanContext ToContext(const uint8_t (&trace_id)[16],
+                                 const uint8_t (&span_id)[8], uint8_t flags) {
+  return trace_api::SpanContext(
+      trace_api::TraceId(nostd::span<const uint8_t, 16>(trace_id)),
+      trace_api::SpanId(nostd::span<const uint8_t, 8>(span_id)),
+      trace_api::TraceFlags(flags), false);
+}
+
+std::unique_ptr<trace_sdk::SpanExporter> CreateExporter(
+    const std::string& url) {
+  constexpr std::string_view GRPC = "grpc://";
+  if (url.compare(0, GRPC.size(), GRPC) == 0) {
+    otlp::OtlpGrpcExporterOptions opts;
+    opts.endpoint = url.substr(GRPC.size());
+    return otlp::OtlpGrpcExporterFactory::Create(opts);
+  }
+  otlp::OtlpHttpExporterOptions opts;
+  opts.url = url;
+  return otlp::OtlpHttpExporterFactory::Create(opts);
+}
+
+int Replay(const std::string& url,
+           const std::vector<std::filesystem::path>& segments) {
+  auto exporter = CreateExporter(url);
+
+  // recordables point to their resource and scope until exported
+  std::deque<resource::Resource> resources;
+  std::map<std::pair<std::string, std::string>,
+           std::unique_ptr<scope::InstrumentationScope>>
+      scopes;
+
+  std::vector<std::unique_ptr<trace_sdk::Recordable>> batch;
+  uint64_t exported = 0, failed = 0;
+  auto flush = [&] {
+    if (batch.empty()) {
+      return;
+    }
+    auto result = exporter->Export(
+        nostd::span<std::unique_ptr<trace_sdk::Recordable>>(batch.data(),
+                                                            batch.size()));
+    if (result == opentelemetry::sdk::common::ExportResult::kSuccess) {
+      exported += batch.size();
+    } else {
+      failed += batch.size();
+    }
+    batch.clear();
+  };
+
+  for (const auto& path : segments) {
+    spanlog::Reader reader(path);
+    spanlog::Span span;
+    const resource::Resource* segmentResource = nullptr;
+
+    while (reader.Next(span)) {
+      if (segmentResource == nullptr) {
+        resource::ResourceAttributes attributes;
+        AttributeViews views(reader.Resource());
+        for (const auto& [key, value] : views.Get()) {
+          attributes.SetAttribute(key, value);
+        }
+        segmentResource =
+            &resources.emplace_back(resource::Resource::Create(attributes));
+      }
+
+      auto& spanScope = scopes[{span.scope_name, span.scope_version}];
+      if (!spanScope) {
+        spanScope = scope::InstrumentationScope::Create(span.scope_name,
+                                                        span.scope_version);
+      }
+
+      auto recordable = exporter->MakeRecordable();
+      recordable->SetIdentity(
+          ToContext(span.trace_id, span.span_id, span.trace_flags),
+          trace_api::SpanId(
+              nostd::span<const uint8_t, 8>(span.parent_span_id)));
+      recordable->SetName(span.name);
+      recordable->SetSpanKind(static_cast<trace_api::SpanKind>(span.kind));
+      recordable->SetStatus(static_cast<trace_api::StatusCode>(span.status),
+                            span.status_description);
+      recordable->SetStartTime(ToTimestamp(span.start_ns));
+      recordable->SetDuration(std::chrono::nanoseconds(span.duration_ns));
+      recordable->SetResource(*segmentResource);
+      recordable->SetInstrumentationScope(*spanScope);
+
+      AttributeViews attributes(span.attributes);
+      for (const auto& [key, value] : attributes.Get()) {
+        recordable->SetAttribute(key, value);
+      }
+      for (const auto& event : span.events) {
+        AttributeViews views(event.attributes);
+        recordable->AddEvent(event.name, ToTimestamp(event.timestamp_ns),
+                             views.Iterable());
+      }
+      for (const auto& link : span.links) {
+        AttributeViews views(link.attributes);
+        recordable->AddLink(
+            ToContext(link.trace_id, link.span_id, link.trace_flags),
+            views.Iterable());
+      }
+
+      batch.push_back(std::move(recordable));
+      if (batch.size() == REPLAY_BATCH) {
+        flush();
+      }
+    }
+  }
+  flush();
+  exporter->Shutdown();
+
+  std::cout << exported << " spans replayed, " << failed << " failed"
+            << std::endl;
+  return failed == 0 ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  const std::string command = argv[1];
+  try {
+    if (command == "json") {
+      return PrintJson(Expand(argv + 2, argc - 2));
+    }
+    if (command == "replay" && argc >= 4) {
+      return Replay(argv[2], Expand(argv + 3, argc - 3));
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  Usage(argv[0]);
+  return 1;
+}
@@ -17,6 +17,9 @@
 
 #include <boost/asio.hpp>
 
+// after the Windows settings above, it includes asio
+#include "libMetrics/Asio.h"
+
 #include <opentelemetry/trace/context.h>
 #include <boost/core/noncopyable.hpp>
 #include <iostream>
@@ -35,18 +38,37 @@ using namespace boost;
 // function which is called when a request is complete.
 typedef void (*Callback)(unsigned int request_id, const std::string& response, const system::error_code& ec);
 
+// Wait and hold times of the client locks.
+Z_LOCKSTATS& ClientLocks() {
+  static Z_LOCKSTATS locks(Z_FL::MSG_DISPATCH, "client_lock", "Client session locks");
+  return locks;
+}
+
+// Handler lag, run time, pending handlers and thread busy time of the pool.
+Z_EXECUTORSTATS& ClientPool() {
+  static Z_EXECUTORSTATS stats(Z_FL::MSG_DISPATCH, "client_pool", "Client io_service pool");
+  return stats;
+}
+
+// Bytes, operations and latencies per server.
+Z_SOCKETSTATS& ClientSockets() {
+  static Z_SOCKETSTATS stats(Z_FL::MSG_DISPATCH, "client_net", "Client connections");
+  return stats;
+}
+
 // Structure represents a context of a single request.
 struct Session {
   Session(asio::io_service& ios, const std::string& raw_ip_address, unsigned short port_num, const std::string& request,
           unsigned int id, Callback callback)
-      : m_sock(ios),
+      : m_sock(ios, ClientSockets()),
         m_ep(asio::ip::address::from_string(raw_ip_address), port_num),
         m_request(request),
         m_id(id),
         m_callback(callback),
-        m_was_cancelled(false) {}
+        m_was_cancelled(false),
+        m_cancel_guard(ClientLocks(), "session_cancel") {}
 
-  asio::ip::tcp::socket m_sock;  // Socket used for communication
+  Z_SOCKET m_sock;               // Socket used for communication
   asio::ip::tcp::endpoint m_ep;  // Remote endpoint.
   std::string m_request;         // Request string.
 
@@ -65,16 +87,23 @@ struct Session {
   Callback m_callback;
 
   bool m_was_cancelled;
-  std::mutex m_cancel_guard;
+  Z_MUTEX m_cancel_guard;
+
+  // Started before async_connect, completed in onRequestComplete.
+  Z_LATENCYTOKEN m_latency;
 };
 
 class AsyncTCPClient : public boost::noncopyable {
  public:
-  AsyncTCPClient(unsigned char num_of_threads) {
+  AsyncTCPClient(unsigned char num_of_threads)
+      : m_request_latency(Z_FL::MSG_DISPATCH, "client_request_latency", {100.0, 1000.0, 10000.0, 100000.0, 1000000.0},
+                          "Connect, write and read of one request", "emulate_long_computation"),
+        m_executor(m_ios, ClientPool()),
+        m_active_sessions_guard(ClientLocks(), "active_sessions", std::chrono::milliseconds(10)) {
     m_work.reset(new boost::asio::io_service::work(m_ios));
 
     for (unsigned char i = 1; i <= num_of_threads; i++) {
-      std::unique_ptr<std::thread> th(new std::thread([this]() { m_ios.run(); }));
+      std::unique_ptr<std::thread> th(new std::thread([this]() { m_executor.Run(); }));
 
       m_threads.push_back(std::move(th));
     }
@@ -104,7 +133,8 @@ class AsyncTCPClient : public boost::noncopyable {
     std::shared_ptr<Session> session =
         std::shared_ptr<Session>(new Session(m_ios, raw_ip_address, port_num, request, request_id, callback));
 
-    session->m_sock.open(session->m_ep.protocol());
+    session->m_sock.Raw().open(session->m_ep.protocol());
+    session->m_latency = m_request_latency.Start();
 
     // Add new session to the list of active sessions so
     // that we can access it if the user decides to cancel
@@ -112,13 +142,16 @@ class AsyncTCPClient : public boost::noncopyable {
     // Because active sessions list can be accessed from
     // multiple threads, we guard it with a mutex to avoid
     // data corruption.
-    std::unique_lock<std::mutex> lock(m_active_sessions_guard);
+    std::unique_lock<Z_MUTEX> lock(m_active_sessions_guard);
     m_active_sessions[request_id] = session;
     lock.unlock();
 
     // We have to pass Context into a session as its tls based.
 
-    session->m_sock.async_connect(session->m_ep, [context, this, session](const system::error_code& ec) {
+    static const Z_HANDLERTAG connectTag("connect");
+    static const Z_HANDLERTAG writeTag("write");
+    static const Z_HANDLERTAG readTag("read");
+    session->m_sock.AsyncConnect(session->m_ep, m_executor.Wrap(connectTag, [context, this, session](const system::error_code& ec) {
 
 
 
@@ -129,7 +162,7 @@ class AsyncTCPClient : public boost::noncopyable {
         return;
       }
 
-      std::unique_lock<std::mutex> cancel_lock(session->m_cancel_guard);
+      std::unique_lock<Z_MUTEX> cancel_lock(session->m_cancel_guard);
 
       if (session->m_was_cancelled) {
         onRequestComplete(session);
@@ -153,8 +186,8 @@ class AsyncTCPClient : public boost::noncopyable {
       session->m_request = request;
 
 
-      asio::async_write(session->m_sock, asio::buffer(session->m_request),
-                        [span,this, session](const boost::system::error_code& ec, std::size_t bytes_transferred) {
+      session->m_sock.AsyncWrite(asio::buffer(session->m_request),
+                        m_executor.Wrap(writeTag, [span,this, session](const boost::system::error_code& ec, std::size_t bytes_transferred) {
                           if (ec != boost::system::errc::success) {
                             session->m_ec = ec;
                             span->AddEvent("Error on request");
@@ -162,7 +195,7 @@ class AsyncTCPClient : public boost::noncopyable {
                             return;
                           }
 
-                          std::unique_lock<std::mutex> cancel_lock(session->m_cancel_guard);
+                          std::unique_lock<Z_MUTEX> cancel_lock(session->m_cancel_guard);
 
                           if (session->m_was_cancelled) {
                             span->AddEvent("Cancelled");
@@ -170,9 +203,9 @@ class AsyncTCPClient : public boost::noncopyable {
                             return;
                           }
 
-                          asio::async_read_until(
-                              session->m_sock, session->m_response_buf, '\n',
-                              [span,this, session](const boost::system::error_code& ec, std::size_t bytes_transferred) {
+                          session->m_sock.AsyncReadUntil(
+                              session->m_response_buf, '\n',
+                              m_executor.Wrap(readTag, [span,this, session](const boost::system::error_code& ec, std::size_t bytes_transferred) {
                                 if (ec != boost::system::errc::success) {
                                   session->m_ec = ec;
                                 } else {
@@ -182,21 +215,21 @@ class AsyncTCPClient : public boost::noncopyable {
                                 }
 
                                 onRequestComplete(session);
-                              });
-                        });
-    });
+                              }));
+                        }));
+    }));
   };
 
   // Cancels the request.
   void cancelRequest(unsigned int request_id) {
-    std::unique_lock<std::mutex> lock(m_active_sessions_guard);
+    std::unique_lock<Z_MUTEX> lock(m_active_sessions_guard);
 
     auto it = m_active_sessions.find(request_id);
     if (it != m_active_sessions.end()) {
-      std::unique_lock<std::mutex> cancel_lock(it->second->m_cancel_guard);
+      std::unique_lock<Z_MUTEX> cancel_lock(it->second->m_cancel_guard);
 
       it->second->m_was_cancelled = true;
-      it->second->m_sock.cancel();
+      it->second->m_sock.Raw().cancel();
     }
   }
 
@@ -223,10 +256,10 @@ class AsyncTCPClient : public boost::noncopyable {
 
     // span_map[session->m_id]->End();
 
-    session->m_sock.shutdown(asio::ip::tcp::socket::shutdown_both, ignored_ec);
+    session->m_sock.Raw().shutdown(asio::ip::tcp::socket::shutdown_both, ignored_ec);
 
     // Remove session form the map of active sessions.
-    std::unique_lock<std::mutex> lock(m_active_sessions_guard);
+    std::unique_lock<Z_MUTEX> lock(m_active_sessions_guard);
 
     auto it = m_active_sessions.find(session->m_id);
     if (it != m_active_sessions.end()) m_active_sessions.erase(it);
@@ -240,14 +273,23 @@ class AsyncTCPClient : public boost::noncopyable {
     else
       ec = session->m_ec;
 
+    if (ec == boost::system::errc::success)
+      session->m_latency.Complete(Z_LATENCYSTATUS::OK);
+    else if (ec == asio::error::operation_aborted)
+      session->m_latency.Complete(Z_LATENCYSTATUS::CANCELLED);
+    else
+      session->m_latency.Complete(Z_LATENCYSTATUS::ERROR);
+
     // Call the callback provided by the user.
     session->m_callback(session->m_id, session->m_response, ec);
   };
 
  private:
+  Z_ASYNCLATENCY m_request_latency;
   asio::io_service m_ios;
+  Z_EXECUTOR m_executor;
   std::map<int, std::shared_ptr<Session>> m_active_sessions;
-  std::mutex m_active_sessions_guard;
+  Z_MUTEX m_active_sessions_guard;
   std::unique_ptr<boost::asio::io_service::work> m_work;
   std::list<std::unique_ptr<std::thread>> m_threads;
 };
@@ -8,17 +8,32 @@
 #include <thread>
 
 #include "libMetrics/Api.h"
+#include "libMetrics/Asio.h"
 
 using namespace boost;
 
+// Handler lag, run time, pending handlers and thread busy time of the pool.
+Z_EXECUTORSTATS& ServerPool() {
+  static Z_EXECUTORSTATS stats(Z_FL::API_SERVER, "server_pool", "Server io_service pool");
+  return stats;
+}
+
+// Bytes, operations and latencies per client.
+Z_SOCKETSTATS& ServerSockets() {
+  static Z_SOCKETSTATS stats(Z_FL::API_SERVER, "server_net", "Server connections");
+  return stats;
+}
+
 class Service {
  public:
-  Service(std::shared_ptr<asio::ip::tcp::socket> sock) : m_sock(sock) {}
+  Service(std::shared_ptr<Z_SOCKET> sock, Z_EXECUTOR& executor) : m_sock(sock), m_executor(executor) {}
 
   void StartHandling() {
-    asio::async_read_until(
-        *m_sock.get(), m_request, '\n',
-        [this](const boost::system::error_code& ec, std::size_t bytes_transferred) { onRequestReceived(ec, bytes_transferred); });
+    static const Z_HANDLERTAG tag("request");
+    m_sock->AsyncReadUntil(m_request, '\n',
+                           m_executor.Wrap(tag, [this](const boost::system::error_code& ec, std::size_t bytes_transferred) {
+                             onRequestReceived(ec, bytes_transferred);
+                           }));
   }
 
  private:
@@ -32,13 +47,19 @@ class Service {
 
     std::cout << "bytes transferred " << bytes_transferred << std::endl;
 
-    // Process the request.
-    m_response = ProcessRequest(m_request);
-
-    // Initiate asynchronous write operation.
-    asio::async_write(
-        *m_sock.get(), asio::buffer(m_response),
-        [this](const boost::system::error_code& ec, std::size_t bytes_transferred) { onResponseSent(ec, bytes_transferred); });
+    // Process the request as a handler of its own, so the time it waits for
+    // a pool thread shows up as lag and pending handlers.
+    static const Z_HANDLERTAG processTag("process");
+    m_executor.Post(processTag, [this] {
+      m_response = ProcessRequest(m_request);
+
+      // Initiate asynchronous write operation.
+      static const Z_HANDLERTAG tag("response");
+      m_sock->AsyncWrite(asio::buffer(m_response),
+                         m_executor.Wrap(tag, [this](const boost::system::error_code& ec, std::size_t bytes_transferred) {
+                           onResponseSent(ec, bytes_transferred);
+                         }));
+    });
   }
 
   void onResponseSent(const boost::system::error_code& ec, std::size_t bytes_transferred) {
@@ -111,15 +132,19 @@ class Service {
   }
 
  private:
-  std::shared_ptr<asio::ip::tcp::socket> m_sock;
+  std::shared_ptr<Z_SOCKET> m_sock;
+  Z_EXECUTOR& m_executor;
   std::string m_response;
   asio::streambuf m_request;
 };
 
 class Acceptor {
  public:
-  Acceptor(asio::io_service& ios, unsigned short port_num)
-      : m_ios(ios), m_acceptor(m_ios, asio::ip::tcp::endpoint(asio::ip::address_v4::any(), port_num)), m_isStopped(false) {}
+  Acceptor(Z_EXECUTOR& executor, unsigned short port_num)
+      : m_executor(executor),
+        m_ios(executor.Context()),
+        m_acceptor(m_ios, asio::ip::tcp::endpoint(asio::ip::address_v4::any(), port_num)),
+        m_isStopped(false) {}
 
   // Start accepting incoming connection requests.
   void Start() {
@@ -132,14 +157,17 @@ class Acceptor {
 
  private:
   void InitAccept() {
-    std::shared_ptr<asio::ip::tcp::socket> sock(new asio::ip::tcp::socket(m_ios));
+    auto sock = std::make_shared<Z_SOCKET>(m_ios, ServerSockets());
 
-    m_acceptor.async_accept(*sock.get(), [this, sock](const boost::system::error_code& error) { onAccept(error, sock); });
+    static const Z_HANDLERTAG tag("accept");
+    m_acceptor.async_accept(sock->Raw(), m_executor.Wrap(tag, [this, sock](const boost::system::error_code& error) {
+                              onAccept(error, sock);
+                            }));
   }
 
-  void onAccept(const boost::system::error_code& ec, std::shared_ptr<asio::ip::tcp::socket> sock) {
+  void onAccept(const boost::system::error_code& ec, std::shared_ptr<Z_SOCKET> sock) {
     if (ec.value() == 0) {
-      (new Service(sock))->StartHandling();
+      (new Service(sock, m_executor))->StartHandling();
     } else {
       std::cout << "Error occured! Error code = " << ec.value() << ". Message: " << ec.message();
     }
@@ -156,6 +184,7 @@ class Acceptor {
   }
 
  private:
+  Z_EXECUTOR& m_executor;
   asio::io_service& m_ios;
   asio::ip::tcp::acceptor m_acceptor;
   std::atomic<bool> m_isStopped;
@@ -163,20 +192,20 @@ class Acceptor {
 
 class Server {
  public:
-  Server() { m_work.reset(new asio::io_service::work(m_ios)); }
+  Server() : m_executor(m_ios, ServerPool()) { m_work.reset(new asio::io_service::work(m_ios)); }
 
   // Start the server.
   void Start(unsigned short port_num, unsigned int thread_pool_size) {
     assert(thread_pool_size > 0);
 
     // Create and start Acceptor.
-    acc.reset(new Acceptor(m_ios, port_num));
+    acc.reset(new Acceptor(m_executor, port_num));
     acc->Start();
 
     // Create specified number of threads and
     // add them to the pool.
     for (unsigned int i = 0; i < thread_pool_size; i++) {
-      std::unique_ptr<std::thread> th(new std::thread([this]() { m_ios.run(); }));
+      std::unique_ptr<std::thread> th(new std::thread([this]() { m_executor.Run(); }));
 
       m_thread_pool.push_back(std::move(th));
     }
@@ -194,6 +223,7 @@ class Server {
 
  private:
   asio::io_service m_ios;
+  Z_EXECUTOR m_executor;
   std::unique_ptr<asio::io_service::work> m_work;
   std::unique_ptr<Acceptor> acc;
   std::vector<std::unique_ptr<std::thread>> m_thread_pool;
@@ -231,7 +261,12 @@ int main(int argc, char** argv) {
 
     srv.Start(port, thread_pool_size);
 
-    std::this_thread::sleep_for(std::chrono::seconds(6000000));
+    // The histograms and busy times go to the metrics exporter, pending
+    // handlers growing under load means the pool cannot keep up.
+    for (int i = 0; i < 600000; i++) {
+      std::this_thread::sleep_for(std::chrono::seconds(10));
+      std::cout << "pending handlers " << ServerPool().Pending() << std::endl;
+    }
 
     srv.Stop();
   } catch (system::system_error& e) {